@@ -1,10 +1,91 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdbool.h>
 #include "assert.h"
 #include "compress40.h"
+#include "compress40ext.h"
+#include "batch.h"
 
 static void (*compress_or_decompress)(FILE *input) = compress40;
+static bool staged = false;
+static struct Compress40_options options = {
+        .threads = 1, .fixed = false, .entropy = false, .tiled = false
+};
+static bool cropped = false, preview = false, sequence = false;
+static bool timed = false;
+static bool coding = false, transforming = false;
+static int rotation = 0;
+static enum flip flip_type = none;
+static Stats stats = NULL;
+static struct Compress40_region region;
+static char *batch_list = NULL;
+static char *outdir = NULL;
+
+/* compress40_opts with the options from -j, -f and -e */
+static void compressOpts(FILE *input)
+{
+        compress40_opts(input, &options);
+}
+
+/* compress40_staged_stats with the Stats from --stats */
+static void compressStagedStats(FILE *input)
+{
+        compress40_staged_stats(input, stats);
+}
+
+/* decompress40_stats with the Stats from --stats */
+static void decompressStats(FILE *input)
+{
+        decompress40_stats(input, stats);
+}
+
+/* decompress40_staged_stats with the Stats from --stats */
+static void decompressStagedStats(FILE *input)
+{
+        decompress40_staged_stats(input, stats);
+}
+
+/* transform40 to stdout, with the transformation from -t */
+static void transformCompressed(FILE *input)
+{
+        transform40(input, stdout, rotation, flip_type);
+}
+
+/* compress40_sequence to stdout, with the kernel from -f */
+static void compressSequence(FILE *input)
+{
+        compress40_sequence(input, stdout, &options);
+}
+
+/* decompress40_region with the rectangle from --region */
+static void decompressCrop(FILE *input)
+{
+        decompress40_region(input, &region);
+}
+
+/* decompress40_preview of the whole image or the rectangle from --region */
+static void decompressPreview(FILE *input)
+{
+        decompress40_preview(input, cropped ? &region : NULL);
+}
+
+/* Print the command line synopsis and exit with failure */
+static void usage(const char *progname)
+{
+        fprintf(stderr, "Usage: %s -d [-s | [--preview] [--region x,y,w,h]] "
+                "[filename]\n"
+                "       %s -d [-s] --stats [filename]\n"
+                "       %s -c [-s | [-j N] [-f] [-e | --tiled]] [--stats] "
+                "[filename]\n"
+                "       %s -c [-f] --sequence [filename]\n"
+                "       %s -t rotate90|rotate180|rotate270|flip-h|flip-v|"
+                "transpose [filename]\n"
+                "       %s -c [-j N] [-f] [-e | --tiled] --batch list "
+                "--outdir dir\n",
+                progname, progname, progname, progname, progname, progname);
+        exit(1);
+}
 
 int main(int argc, char *argv[])
 {
@@ -13,22 +94,157 @@ int main(int argc, char *argv[])
         for (i = 1; i < argc; i++) {
                 if (strcmp(argv[i], "-c") == 0) {
                         compress_or_decompress = compress40;
+                        coding = true;
                 } else if (strcmp(argv[i], "-d") == 0) {
                         compress_or_decompress = decompress40;
+                        coding = true;
+                } else if (strcmp(argv[i], "-s") == 0) {
+                        /* the staged pipeline, to check the fused one */
+                        staged = true;
+                } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+                        /* compress on this many threads */
+                        char *endptr;
+                        long n = strtol(argv[++i], &endptr, 10);
+                        if (*endptr != '\0' || n < 1 || n > 256) {
+                                fprintf(stderr, "%s: bad thread count '%s'\n",
+                                        argv[0], argv[i]);
+                                exit(1);
+                        }
+                        options.threads = n;
+                } else if (strcmp(argv[i], "-f") == 0) {
+                        /* integer fixed-point compression kernel */
+                        options.fixed = true;
+                } else if (strcmp(argv[i], "-e") == 0) {
+                        /* entropy-coded compressed format */
+                        options.entropy = true;
+                } else if (strcmp(argv[i], "--tiled") == 0) {
+                        /* entropy coded in tiles, for --region */
+                        options.tiled = true;
+                } else if (strcmp(argv[i], "--sequence") == 0) {
+                        /* frames one after another, coded by changes */
+                        sequence = true;
+                } else if (strcmp(argv[i], "--region") == 0 && i + 1 < argc) {
+                        /* decompress only the rectangle x,y,w,h */
+                        char extra;
+                        if (strchr(argv[++i], '-') != NULL ||
+                            sscanf(argv[i], "%u,%u,%u,%u%c", &region.x,
+                                   &region.y, &region.width, &region.height,
+                                   &extra) != 4 ||
+                            region.width == 0 || region.height == 0) {
+                                fprintf(stderr, "%s: bad region '%s'\n",
+                                        argv[0], argv[i]);
+                                exit(1);
+                        }
+                        cropped = true;
+                } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+                        /* rotate or flip a compressed image as it is */
+                        i++;
+                        if (strcmp(argv[i], "rotate90") == 0) {
+                                rotation = 90;
+                        } else if (strcmp(argv[i], "rotate180") == 0) {
+                                rotation = 180;
+                        } else if (strcmp(argv[i], "rotate270") == 0) {
+                                rotation = 270;
+                        } else if (strcmp(argv[i], "flip-h") == 0) {
+                                flip_type = horizontal;
+                        } else if (strcmp(argv[i], "flip-v") == 0) {
+                                flip_type = vertical;
+                        } else if (strcmp(argv[i], "transpose") == 0) {
+                                flip_type = transpose;
+                        } else {
+                                fprintf(stderr, "%s: bad transformation "
+                                        "'%s'\n", argv[0], argv[i]);
+                                exit(1);
+                        }
+                        transforming = true;
+                } else if (strcmp(argv[i], "--stats") == 0) {
+                        /* time each stage, reported on stderr as JSON */
+                        timed = true;
+                } else if (strcmp(argv[i], "--preview") == 0) {
+                        /* one pixel per block, at half resolution */
+                        preview = true;
+                } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+                        /* compress every file named in a list */
+                        batch_list = argv[++i];
+                } else if (strcmp(argv[i], "--outdir") == 0 && i + 1 < argc) {
+                        outdir = argv[++i];
                 } else if (*argv[i] == '-') {
                         fprintf(stderr, "%s: unknown option '%s'\n",
                                 argv[0], argv[i]);
                         exit(1);
                 } else if (argc - i > 2) {
-                        fprintf(stderr, "Usage: %s -d [filename]\n"
-                                "       %s -c [filename]\n",
-                                argv[0], argv[0]);
-                        exit(1);
+                        usage(argv[0]);
                 } else {
                         break;
                 }
         }
         assert(argc - i <= 1);    /* at most one file on command line */
+        if (transforming) {
+                if (coding || staged || cropped || preview || sequence ||
+                    timed || batch_list != NULL || outdir != NULL ||
+                    options.threads != 1 || options.fixed ||
+                    options.entropy || options.tiled) {
+                        /* -t keeps the format and takes no other options */
+                        usage(argv[0]);
+                }
+                compress_or_decompress = transformCompressed;
+        }
+        if (staged && (options.threads != 1 || options.fixed ||
+                       options.entropy || options.tiled)) {
+                /* -s is the reference pipeline, with none of the others */
+                usage(argv[0]);
+        }
+        if (options.entropy && options.tiled) {
+                /* format 3 or format 4, not both */
+                usage(argv[0]);
+        }
+        if (compress_or_decompress == decompress40 &&
+            (options.threads != 1 || options.fixed || options.entropy ||
+             options.tiled)) {
+                /* the format comes from the file, and decoding is serial */
+                usage(argv[0]);
+        }
+        if (batch_list != NULL || outdir != NULL) {
+                /* -j N is the size of the thread pool */
+                if (batch_list == NULL || outdir == NULL || staged ||
+                    cropped || preview || sequence || timed ||
+                    compress_or_decompress != compress40 ||
+                    i < argc) {
+                        usage(argv[0]);
+                }
+                return compressBatch(batch_list, outdir, &options);
+        }
+        if (cropped || preview) {
+                if (staged || sequence || timed ||
+                    compress_or_decompress != decompress40) {
+                        usage(argv[0]);
+                }
+                compress_or_decompress = preview ? decompressPreview :
+                                         decompressCrop;
+        } else if (sequence) {
+                if (staged || timed || options.threads != 1 ||
+                    options.entropy || options.tiled ||
+                    compress_or_decompress != compress40) {
+                        usage(argv[0]);
+                }
+                compress_or_decompress = compressSequence;
+        } else if (staged && timed) {
+                compress_or_decompress =
+                        compress_or_decompress == compress40 ?
+                        compressStagedStats : decompressStagedStats;
+        } else if (staged) {
+                compress_or_decompress =
+                        compress_or_decompress == compress40 ?
+                        compress40_staged : decompress40_staged;
+        } else if (compress_or_decompress == compress40) {
+                compress_or_decompress = compressOpts;
+        } else if (timed) {
+                compress_or_decompress = decompressStats;
+        }
+        if (timed) {
+                stats = newStats();
+                options.stats = stats;
+        }
         if (i < argc) {
                 FILE *fp = fopen(argv[i], "r");
                 assert(fp != NULL);
@@ -37,6 +253,10 @@ int main(int argc, char *argv[])
         } else {
                 compress_or_decompress(stdin);
         }
+        if (timed) {
+                statsReport(stats, stderr);
+                freeStats(&stats);
+        }
 
         return EXIT_SUCCESS; 
 }
@@ -0,0 +1,348 @@
+/*
+ *     batch.c
+ *
+ *     Purpose: Implementation for batch. The list file is read into a
+ *              sequence of file names, and a pool of threads takes files
+ *              from it one at a time until none are left. Each thread keeps
+ *              one set of compress40_buffered working memory for all of its
+ *              files, which grows only for an image larger than any before
+ *              it. The row kernels and code word output work in that
+ *              memory, so a file in format 2 or 3 costs the same handful of
+ *              allocations (its reader, output name and any entropy writer)
+ *              whatever its size; format 4 also keeps its coded tiles in a
+ *              memory stream that grows with the file. Every file is
+ *              compressed on a single thread; the parallelism is between
+ *              files. Latencies are measured with the monotonic clock from
+ *              opening the input to closing the output.
+ */
+
+#include "batch.h"
+#include "assert.h"
+#include "mem.h"
+#include "seq.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/* A batch being compressed, shared by the threads of the pool */
+struct Batch {
+        Seq_T inputs;                   /* file names, read only */
+        const char *outdir;
+        struct Compress40_options options;      /* threads is 1 */
+        pthread_mutex_t lock;
+        int next;                       /* next file to take, under lock */
+        double *latency;                /* seconds, per file */
+        long long *bytes;       /* input size per file, -1 if failed */
+};
+
+Seq_T readList(FILE *list);
+char *outputName(const char *outdir, const char *input);
+void *batchWorker(void *cl);
+double monotonicSeconds(void);
+int compareDoubles(const void *a, const void *b);
+double percentile(double *sorted, int n, double p);
+
+/********** compressBatch ********
+ *
+ * Purpose: Compress every image named in a list file into a directory.
+ *
+ * Parameters:
+ *      const char *list: Path of a file naming one PPM image per line.
+ *      const char *outdir: Directory to write the compressed images to.
+ *      const struct Compress40_options *options: Number of threads in the
+ *                                                pool, and the kernel and
+ *                                                format of each image.
+ *
+ * Return: EXIT_SUCCESS if every image was compressed, EXIT_FAILURE if the
+ *         list could not be read or any image could not be opened or
+ *         written.
+ *
+ * Expects: outdir exists; options->threads is at least 1.
+ *
+ * Notes: Blank lines in the list are skipped. Each image is written to
+ *        outdir under its own base name with the extension replaced by
+ *        .c40, so two inputs with the same base name overwrite each other.
+ *        A file that cannot be opened is reported on stderr and skipped; an
+ *        image that is not a valid PPM raises a CRE, as in single-file
+ *        mode, which ends the whole batch. The totals and the 50th, 90th
+ *        and 99th percentile and maximum of the per-file latencies are
+ *        printed to standard output; MB/s counts input bytes, 10^6 to the
+ *        MB, over the wall-clock time of the batch.
+ *
+ ************************/
+int compressBatch(const char *list, const char *outdir,
+                  const struct Compress40_options *options)
+{
+        assert(list != NULL && outdir != NULL);
+        assert(options != NULL && options->threads >= 1);
+        FILE *fp = fopen(list, "r");
+        if (fp == NULL) {
+                fprintf(stderr, "batch: cannot open list '%s'\n", list);
+                return EXIT_FAILURE;
+        }
+        struct Batch batch = {
+                .inputs = readList(fp), .outdir = outdir,
+                .options = *options, .next = 0
+        };
+        fclose(fp);
+        batch.options.threads = 1;
+        int count = Seq_length(batch.inputs);
+        int pool = options->threads < count ? options->threads : count;
+        batch.latency = CALLOC(count > 0 ? count : 1, sizeof(double));
+        batch.bytes = CALLOC(count > 0 ? count : 1, sizeof(long long));
+        pthread_mutex_init(&batch.lock, NULL);
+
+        double start = monotonicSeconds();
+        pthread_t *workers = CALLOC(pool > 0 ? pool : 1, sizeof(pthread_t));
+        /* The calling thread is the first thread of the pool */
+        for (int t = 1; t < pool; t++) {
+                int err = pthread_create(&workers[t], NULL, batchWorker,
+                                         &batch);
+                assert(err == 0);
+        }
+        if (pool > 0) {
+                batchWorker(&batch);
+        }
+        for (int t = 1; t < pool; t++) {
+                int err = pthread_join(workers[t], NULL);
+                assert(err == 0);
+        }
+        double elapsed = monotonicSeconds() - start;
+
+        /* Gather the files that succeeded at the front of latency */
+        int done = 0;
+        long long total = 0;
+        for (int i = 0; i < count; i++) {
+                if (batch.bytes[i] >= 0) {
+                        total += batch.bytes[i];
+                        batch.latency[done++] = batch.latency[i];
+                }
+        }
+        qsort(batch.latency, done, sizeof(double), compareDoubles);
+        double mb = total / 1e6;
+        printf("%d files, %.1f MB in %.3f s, %.1f MB/s, %d threads\n",
+               done, mb, elapsed, elapsed > 0 ? mb / elapsed : 0.0, pool);
+        if (done > 0) {
+                printf("latency ms: p50 %.3f  p90 %.3f  p99 %.3f  "
+                       "max %.3f\n",
+                       1e3 * percentile(batch.latency, done, 50),
+                       1e3 * percentile(batch.latency, done, 90),
+                       1e3 * percentile(batch.latency, done, 99),
+                       1e3 * batch.latency[done - 1]);
+        }
+
+        pthread_mutex_destroy(&batch.lock);
+        FREE(workers);
+        FREE(batch.bytes);
+        FREE(batch.latency);
+        while (Seq_length(batch.inputs) > 0) {
+                char *name = Seq_remhi(batch.inputs);
+                FREE(name);
+        }
+        Seq_free(&batch.inputs);
+        return done == count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/********** batchWorker ********
+ *
+ * Purpose: Compress files of a batch until none are left.
+ *
+ * Parameters:
+ *      void *cl: Pointer to the struct Batch.
+ *
+ * Return: NULL.
+ *
+ * Expects: None.
+ *
+ * Notes: Has the signature of a pthread start routine. Takes the next file
+ *        under the batch's lock and records its latency and size in the
+ *        file's own slot, so nothing else is shared.
+ *
+ ************************/
+void *batchWorker(void *cl)
+{
+        struct Batch *batch = cl;
+        Compress40_buffers buffers = newCompress40Buffers();
+        for (;;) {
+                pthread_mutex_lock(&batch->lock);
+                int i = batch->next++;
+                pthread_mutex_unlock(&batch->lock);
+                if (i >= Seq_length(batch->inputs)) {
+                        break;
+                }
+                const char *name = Seq_get(batch->inputs, i);
+                char *out_name = outputName(batch->outdir, name);
+                batch->bytes[i] = -1;
+                double start = monotonicSeconds();
+                FILE *input = fopen(name, "rb");
+                FILE *output = input != NULL ? fopen(out_name, "wb") : NULL;
+                if (input == NULL || output == NULL) {
+                        fprintf(stderr, "batch: cannot open '%s'\n",
+                                input == NULL ? name : out_name);
+                        if (input != NULL) {
+                                fclose(input);
+                        }
+                        FREE(out_name);
+                        continue;
+                }
+                struct stat st;
+                long long size = fstat(fileno(input), &st) == 0 ?
+                                 st.st_size : 0;
+                compress40_buffered(input, output, &batch->options, buffers);
+                fclose(input);
+                if (fclose(output) != 0) {
+                        fprintf(stderr, "batch: cannot write '%s'\n",
+                                out_name);
+                } else {
+                        batch->latency[i] = monotonicSeconds() - start;
+                        batch->bytes[i] = size;
+                }
+                FREE(out_name);
+        }
+        freeCompress40Buffers(&buffers);
+        return NULL;
+}
+
+/********** readList ********
+ *
+ * Purpose: Read the file names of a batch.
+ *
+ * Parameters:
+ *      FILE *list: The list file, one name per line.
+ *
+ * Return: A sequence of the names, each a string allocated with ALLOC.
+ *
+ * Expects: list is not NULL.
+ *
+ * Notes: Line endings, including a carriage return, are removed and blank
+ *        lines are skipped. The strings must be freed with FREE and the
+ *        sequence with Seq_free.
+ *
+ ************************/
+Seq_T readList(FILE *list)
+{
+        assert(list != NULL);
+        Seq_T names = Seq_new(0);
+        char *line = NULL;
+        size_t capacity = 0;
+        ssize_t length;
+        while ((length = getline(&line, &capacity, list)) != -1) {
+                while (length > 0 && (line[length - 1] == '\n' ||
+                                      line[length - 1] == '\r')) {
+                        line[--length] = '\0';
+                }
+                if (length == 0) {
+                        continue;
+                }
+                char *name = ALLOC(length + 1);
+                memcpy(name, line, length + 1);
+                Seq_addhi(names, name);
+        }
+        free(line);
+        return names;
+}
+
+/********** outputName ********
+ *
+ * Purpose: Build the path a compressed image is written to.
+ *
+ * Parameters:
+ *      const char *outdir: The output directory.
+ *      const char *input: Path of the input image.
+ *
+ * Return: outdir, a slash, and the base name of input with its extension,
+ *         if any, replaced by .c40.
+ *
+ * Expects: outdir and input are not NULL.
+ *
+ * Notes: The string is allocated with ALLOC and must be freed with FREE.
+ *
+ ************************/
+char *outputName(const char *outdir, const char *input)
+{
+        assert(outdir != NULL && input != NULL);
+        const char *base = strrchr(input, '/');
+        base = base != NULL ? base + 1 : input;
+        const char *dot = strrchr(base, '.');
+        size_t stem = dot != NULL && dot != base ? (size_t) (dot - base) :
+                      strlen(base);
+        size_t dir = strlen(outdir);
+        char *name = ALLOC(dir + 1 + stem + sizeof(".c40"));
+        memcpy(name, outdir, dir);
+        name[dir] = '/';
+        memcpy(name + dir + 1, base, stem);
+        strcpy(name + dir + 1 + stem, ".c40");
+        return name;
+}
+
+/********** monotonicSeconds ********
+ *
+ * Purpose: Read the monotonic clock.
+ *
+ * Parameters: None.
+ *
+ * Return: Seconds since an arbitrary fixed point.
+ *
+ * Expects: None.
+ *
+ * Notes: Not affected by changes to the time of day.
+ *
+ ************************/
+double monotonicSeconds(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/********** compareDoubles ********
+ *
+ * Purpose: Order two doubles for qsort.
+ *
+ * Parameters:
+ *      const void *a, *b: Pointers to the doubles.
+ *
+ * Return: Negative, zero or positive as *a is below, equal to or above *b.
+ *
+ * Expects: Neither is NaN.
+ *
+ * Notes: None.
+ *
+ ************************/
+int compareDoubles(const void *a, const void *b)
+{
+        double x = *(const double *) a;
+        double y = *(const double *) b;
+        return (x > y) - (x < y);
+}
+
+/********** percentile ********
+ *
+ * Purpose: Find a percentile of sorted values.
+ *
+ * Parameters:
+ *      double *sorted: The values, in increasing order.
+ *      int n: Number of values.
+ *      double p: The percentile, from 0 to 100.
+ *
+ * Return: The smallest value that at least p percent of the values are no
+ *         greater than.
+ *
+ * Expects: n is at least 1.
+ *
+ * Notes: The nearest-rank definition, so the result is always one of the
+ *        values.
+ *
+ ************************/
+double percentile(double *sorted, int n, double p)
+{
+        assert(n >= 1);
+        int rank = (int) ceil(p / 100 * n);
+        if (rank < 1) {
+                rank = 1;
+        }
+        return sorted[(rank > n ? n : rank) - 1];
+}
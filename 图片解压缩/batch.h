@@ -0,0 +1,18 @@
+/*
+ *     batch.h
+ *
+ *     Purpose: Interface for batch. Compresses every PPM image named in a
+ *              list file into a directory in one process, spreading the
+ *              files over a pool of threads, and reports the throughput and
+ *              the spread of per-file latencies.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "compress40ext.h"
+
+int compressBatch(const char *list, const char *outdir,
+                  const struct Compress40_options *options);
+
+#endif
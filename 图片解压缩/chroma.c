@@ -3,7 +3,8 @@
  * 
  *     Purpose: Implementation for chroma. Goes through each pixel of a 2D array
  *              using a mapping function to get the average of the chroma
- *              elements and store them in a sequence or update the chroma
+ *              elements and store them in an array of CodeInfo_T structs or
+ *              update the chroma
  *              elements of the pixels. Relies on functions from arith40 to do
  *              the converison between floats and four-bit values. On the
  *              compression side, information is lost by storing only the
@@ -16,8 +17,8 @@
 typedef A2Methods_UArray2 A2;
 
 typedef struct mycl {
-        /* Sequence from compress40 to store CodeInfo_T structs */
-        Seq_T code_info;
+        /* Array from compress40 with a CodeInfo_T struct for each block */
+        CodeInfo_T code_info;
         float sumPb; /* Sum of Pb values of a 2-by-2 block */
         float sumPr; /* Sum of Pr values of a 2-by-2 block */
 } *mycl;
@@ -32,35 +33,35 @@ void populatePbPr(int col, int row, A2 array2, A2Methods_Object *ptr, void *cl);
  *
  * Parameters: 
  *      A2 array: The 2D array with component video values.
- *      Seq_T seq: A sequence to store a CodeInfo_T struct for each block.
+ *      CodeInfo_T code_info: An array with a CodeInfo_T struct for each block.
  * 
  * Return: None.
  *      
  * Expects: The given 2D array contains pixels in component video color space.
- *          The sequence passed in has already been initialized and should be 
- *          empty.
+ *          The array passed in holds (width / 2) * (height / 2) structs.
  * 
- * Notes: The sequence is updated with the average chroma values converted to
+ * Notes: The array is updated with the average chroma values converted to
  *        four-bit values. Utilizes an apply function to calculate the chroma 
- *        value averages of a block and populate the sequence. Information may
+ *        value averages of a block and populate the array. Information may
  *        be lost at this step because we only save the average of the chroma
  *        elements, thus making it impossible to determine the individual chroma
  *        values for each pixel when decompressing.
  *      
  ************************/
-void encodeChroma(A2 arrayCV, Seq_T seq)
+void encodeChroma(A2 arrayCV, CodeInfo_T code_info)
 {
-        assert(arrayCV != NULL && seq != NULL);
+        assert(arrayCV != NULL && code_info != NULL);
         A2Methods_T methods = uarray2_methods_blocked;
         assert(methods != NULL);
-        /* Compute the averages of Pb and Pr for a block and then add to seq */
-        struct mycl cl = {.code_info = seq, .sumPb = 0.0, .sumPr = 0.0};
+        /* Compute the averages of Pb and Pr for each block */
+        struct mycl cl = {.code_info = code_info, .sumPb = 0.0, .sumPr = 0.0};
         methods->map_block_major(arrayCV, calcPbPr, &cl);
         /* Converts chroma values from floats to 4 bit values and update the
            fields of the CodeInfo_T structs */
-        for (int i = 0; i < Seq_length(seq); i++) {
-                CodeInfo_T ct = Seq_get(seq, i);
-                assert(ct != NULL);
+        int blocks = (methods->width(arrayCV) / 2) *
+                     (methods->height(arrayCV) / 2);
+        for (int i = 0; i < blocks; i++) {
+                CodeInfo_T ct = &code_info[i];
                 ct->Pb_index = Arith40_index_of_chroma(ct->Pb_avg);
                 ct->Pr_index = Arith40_index_of_chroma(ct->Pr_avg);
         }
@@ -74,11 +75,12 @@ void encodeChroma(A2 arrayCV, Seq_T seq)
  *
  * Parameters: 
  *      A2 array: The 2D array meant to have component video values.
- *      Seq_T seq: A sequence containing CodeInfo_T structs for each code word.
+ *      CodeInfo_T code_info: An array with a CodeInfo_T struct for each code
+ *                            word.
  * 
  * Return: None.
  *      
- * Expects: The passed in sequence already contains CodeInfo_T structs whose
+ * Expects: The passed in array holds a CodeInfo_T struct for each block whose
  *          Pb_index and Pr_index values are already defined.
  * 
  * Notes: Utilizes an apply function to update the chroma values for each
@@ -86,21 +88,22 @@ void encodeChroma(A2 arrayCV, Seq_T seq)
  *        chroma codes to float chroma values.
  *      
  ************************/
-void decodeChroma(A2 arrayCV, Seq_T seq)
+void decodeChroma(A2 arrayCV, CodeInfo_T code_info)
 {
-        assert(arrayCV != NULL && seq != NULL);
+        assert(arrayCV != NULL && code_info != NULL);
+        A2Methods_T methods = uarray2_methods_blocked;
+        assert(methods != NULL);
         /* Converts 4-bit chroma codes to floats */
-        for (int i = 0; i < Seq_length(seq); i++) {
-                CodeInfo_T ct = Seq_get(seq, i);
-                assert(ct != NULL);
+        int blocks = (methods->width(arrayCV) / 2) *
+                     (methods->height(arrayCV) / 2);
+        for (int i = 0; i < blocks; i++) {
+                CodeInfo_T ct = &code_info[i];
                 ct->Pb_avg = Arith40_chroma_of_index(ct->Pb_index);
                 ct->Pr_avg = Arith40_chroma_of_index(ct->Pr_index);
         }     
 
         /* Populate the Pb and Pr values of each Component_T in the 2D array */
-        A2Methods_T methods = uarray2_methods_blocked;
-        assert(methods != NULL);
-        methods->map_block_major(arrayCV, populatePbPr, seq);
+        methods->map_block_major(arrayCV, populatePbPr, code_info);
 }
 
 /********** calcPbpr ********
@@ -118,22 +121,19 @@ void decodeChroma(A2 arrayCV, Seq_T seq)
  * Return: None.
  *      
  * Expects: The passed in ptr is a pointer to a Component_T element in arrayCV.
- *          cl points to struct mycl which contains the code_info sequence from
- *          compress40, meant to hold CodeInfo_T structs for each block.
+ *          cl points to struct mycl which contains the code_info array from
+ *          compress40, holding a CodeInfo_T struct for each block.
  * 
  * Notes: The sumPb and sumPr accumulate values of Pb and Pr of visited pixels
  *        respectively. When the last pixel in a block is visited, compute the
- *        average of Pb and Pr and store the information in a new CodeInfo_T
- *        struct, which is then passed into the sequence. Allocates memory for
- *        CodeInfo_T structs that must be freed in the compress40 function.
+ *        average of Pb and Pr and store it in the block's CodeInfo_T struct.
  *        
  ************************/
 void calcPbPr(int col, int row, A2 array2, A2Methods_Object *ptr, void *cl)
 {
-        (void) array2;
         Component_T pixel = ptr;
         mycl closure = cl;
-        Seq_T code_info = closure->code_info;
+        CodeInfo_T code_info = closure->code_info;
         float *spb = &(closure->sumPb);
         float *spr = &(closure->sumPr);
         /* Add the Pb and Pr values to sumPb and sumPr respectively */
@@ -142,11 +142,12 @@ void calcPbPr(int col, int row, A2 array2, A2Methods_Object *ptr, void *cl)
 
         /* Upon finding the last pixel of the block, calculate the averages */
         if (col % 2 == 1 && row % 2 == 1 && (col + row) % 2 == 0) {
-                CodeInfo_T ct;
-                NEW(ct);
+                A2Methods_T methods = uarray2_methods_blocked;
+                assert(methods != NULL);
+                int w = methods->width(array2);
+                CodeInfo_T ct = &code_info[CodeInfo_block(col, row, w)];
                 ct->Pb_avg = *spb / 4.0;
                 ct->Pr_avg = *spr / 4.0;
-                Seq_addhi(code_info, ct);
                 /* Reset sumPb and sumPr to 0 for the next block */
                 *spb = 0.0;
                 *spr = 0.0;
@@ -160,14 +161,14 @@ void calcPbPr(int col, int row, A2 array2, A2Methods_Object *ptr, void *cl)
  * Parameters: 
  *      int col: Column index of the element
  *      int row: Row index of the element.
- *      A2 array2: The 2D array with component video pixels. Set to void.
+ *      A2 array2: The 2D array with component video pixels.
  *      A2Methods_Object *ptr: Pointer to an element in the 2D array.
- *      void *cl: Pointer to the mycl struct.
+ *      void *cl: Pointer to the array of CodeInfo_T structs.
  * 
  * Return: None.
  *      
- * Expects: The passed in sequence already contains CodeInfo_T structs whose
- *          Pb_avg and Pr_avg values are already defined.
+ * Expects: The passed in array holds CodeInfo_T structs whose Pb_avg and
+ *          Pr_avg values are already defined.
  * 
  * Notes: The four pixels of any given block are updated with the same Pb and Pr
  *        values, equal to the average value. The block indices are equivalent
@@ -176,19 +177,15 @@ void calcPbPr(int col, int row, A2 array2, A2Methods_Object *ptr, void *cl)
  ************************/
 void populatePbPr(int col, int row, A2 array2, A2Methods_Object *ptr, void *cl)
 {
-        Seq_T seq = cl;
+        CodeInfo_T code_info = cl;
         A2Methods_T methods = uarray2_methods_blocked;
         assert(methods != NULL);
         Component_T pixel = ptr;
-        /* The number of blocks in arrayCV is equal to the length of seq
-         * The block is determined using the given indices of the element and
+        /* The block is determined using the given indices of the element and
          * the CodeInfo_T pertaining to that block is obtained
          */
-        unsigned w = methods->width(array2);
-        unsigned blocks_in_row = w / 2;
-        int block = (col / 2) + (row / 2) * blocks_in_row;
-        CodeInfo_T ct = Seq_get(seq, block);
-        assert(ct != NULL);
+        int w = methods->width(array2);
+        CodeInfo_T ct = &code_info[CodeInfo_block(col, row, w)];
         pixel->Pb = ct-> Pb_avg;
         pixel->Pr = ct-> Pr_avg;
 }
\ No newline at end of file
@@ -10,7 +10,6 @@
 #ifndef CHROMA_H
 #define CHROMA_H
 
-#include "seq.h"
 #include "a2methods.h"
 #include "a2blocked.h"
 #include "component.h"
@@ -22,8 +21,8 @@
 
 #define A2 A2Methods_UArray2
 
-void encodeChroma(A2 arrayCV, Seq_T seq);
-void decodeChroma(A2 arrayCV, Seq_T seq);
+void encodeChroma(A2 arrayCV, CodeInfo_T code_info);
+void decodeChroma(A2 arrayCV, CodeInfo_T code_info);
 
 #undef A2
 #endif
\ No newline at end of file
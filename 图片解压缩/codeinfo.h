@@ -3,7 +3,10 @@
  * 
  *     Purpose: Define a struct to store all of the necessary elements for
  *              packing and unpacking a code word. This struct is utilized by
- *              multiple implementations.
+ *              multiple implementations. The structs for an image live in one
+ *              contiguous array with an element for each 2-by-2 block, in
+ *              row-major order of the blocks, so every stage indexes it
+ *              directly instead of allocating a struct per block.
  */
 #ifndef CODEINFO_H
 #define CODEINFO_H
@@ -21,4 +24,11 @@ typedef struct CodeInfo_T {
         unsigned Pb_index, Pr_index;
 } *CodeInfo_T;
 
+/* Index of the block holding the pixel at (col, row) in an image of the given
+   width, which is also the index of its CodeInfo_T in the array */
+static inline int CodeInfo_block(int col, int row, int width)
+{
+        return (col / 2) + (row / 2) * (width / 2);
+}
+
 #endif
\ No newline at end of file
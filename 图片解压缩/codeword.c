@@ -3,8 +3,8 @@
  * 
  *     Purpose: Implementation for codeword. Utilizes the bitpack interface to
  *              handle the packing and unpacking of code words. Takes
- *              information from one sequence (eithr Codeinfo_T structs or the
- *              code words themselves) to populate the other sequence.
+ *              information from either the array of CodeInfo_T structs or the
+ *              array of code words to populate the other.
  */
 
 #include "codeword.h"
@@ -13,15 +13,16 @@
 /********** packWords ********
  *
  * Purpose: For each block, pack the gathered information into a 32-bit code
- *          word and push the word onto a new sequence.
+ *          word and store the word in an array.
  *
  * Parameters: 
- *      Seq_T code_info: Sequence containing CodeInfo_T structs.
- *      Seq_T code_words: Sequencec to hold all of the code words.
+ *      CodeInfo_T code_info: Array of CodeInfo_T structs.
+ *      int blocks: Number of structs in code_info.
+ *      uint32_t *code_words: Array with room for blocks code words.
  * 
  * Return: None.
  *      
- * Expects: The code_info sequence contains CodeInfo_T structs whose values have
+ * Expects: The code_info array contains CodeInfo_T structs whose values have
  *          all been defined in the previous compression steps. Bitpack
  *          functions are working properly.
  * 
@@ -29,12 +30,12 @@
  *        words.
  *      
  ************************/
-void packWords(Seq_T code_info, Seq_T code_words)
+void packWords(CodeInfo_T code_info, int blocks, uint32_t *code_words)
 {
         assert(code_info != NULL);
         assert(code_words != NULL);
-        for (int i = 0; i < Seq_length(code_info); i++) {
-                CodeInfo_T ct = Seq_get(code_info, i);
+        for (int i = 0; i < blocks; i++) {
+                CodeInfo_T ct = &code_info[i];
                 uint64_t codeword = 0;
                 codeword = Bitpack_newu(codeword, 4, 0, ct->Pr_index);
                 codeword = Bitpack_newu(codeword, 4, 4, ct->Pb_index);
@@ -42,43 +43,42 @@ void packWords(Seq_T code_info, Seq_T code_words)
                 codeword = Bitpack_news(codeword, 6, 14, ct->c);
                 codeword = Bitpack_news(codeword, 6, 20, ct->b);
                 codeword = Bitpack_newu(codeword, 6, 26, ct->a);
-                Seq_addhi(code_words, (void *)codeword);
+                code_words[i] = codeword;
         }
 }
 
 /********** unpackWords ********
  *
  * Purpose: For each code word, unpack the information represented in the code
- *          word. Initialize and update a CodeInfo_T struct for each word.
+ *          word into the CodeInfo_T struct for its block.
  *
  * Parameters: 
- *      Seq_T code_words: Sequencec containing all of the code words.
- *      Seq_T code_info: Sequence to hold CodeInfo_T structs.
+ *      uint32_t *code_words: Array containing all of the code words.
+ *      int blocks: Number of code words.
+ *      CodeInfo_T code_info: Array with room for a CodeInfo_T struct for each
+ *                            code word.
  * 
  * Return: None.
  *      
- * Expects: The code_words sequence contains the code words read in from the
- *          file in big-endian order. Bitpack functions are working properly.
+ * Expects: The code_words array contains the code words read in from the
+ *          file. Bitpack functions are working properly.
  * 
  * Notes: The bitpack interface is utilized to handle the unpacking of the code
- *        words. Allocates memory for CodeInfo_T structs that must be freed in
- *        the decompress40 function.
+ *        words.
  *      
  ************************/
-void unpackWords(Seq_T code_words, Seq_T code_info)
+void unpackWords(uint32_t *code_words, int blocks, CodeInfo_T code_info)
 {
         assert(code_info != NULL);
         assert(code_words != NULL);
-        for (int i = 0; i < Seq_length(code_words); i++) {
-                uint64_t codeword = (uint64_t) Seq_get(code_words, i);
-                CodeInfo_T ct;
-                NEW(ct);
+        for (int i = 0; i < blocks; i++) {
+                uint64_t codeword = code_words[i];
+                CodeInfo_T ct = &code_info[i];
                 ct->a = Bitpack_getu(codeword, 6, 26);
                 ct->b = Bitpack_gets(codeword, 6, 20);
                 ct->c = Bitpack_gets(codeword, 6, 14);
                 ct->d = Bitpack_gets(codeword, 6, 8);
                 ct->Pb_index = Bitpack_getu(codeword, 4, 4);
                 ct->Pr_index = Bitpack_getu(codeword, 4, 0);
-                Seq_addhi(code_info, ct);
         }  
 }
\ No newline at end of file
@@ -9,13 +9,13 @@
 #define CODEWORD_H
 
 #include "bitpack.h"
-#include "seq.h"
 #include "component.h"
 #include "codeinfo.h"
 #include "mem.h"
 #include <stdlib.h>
+#include <stdint.h>
 
-void packWords(Seq_T code_info, Seq_T code_words);
-void unpackWords(Seq_T code_words, Seq_T code_info);
+void packWords(CodeInfo_T code_info, int blocks, uint32_t *code_words);
+void unpackWords(uint32_t *code_words, int blocks, CodeInfo_T code_info);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,312 @@
+/*
+ *     comp40.c
+ *
+ *     Purpose: Implementation for comp40. Both directions work a row of
+ *              blocks at a time through the fused kernels, as compress40
+ *              and decompress40 do, so the bytes and pixels match the
+ *              streaming paths. Compression takes each row PIECE_BLOCKS
+ *              blocks at a time in buffers on the stack, since the blocks
+ *              of a row are coded independently, and so allocates nothing;
+ *              decompression keeps one row of working memory per call.
+ *              Arguments are checked and refused with a return of 0 rather
+ *              than asserted, since a bad image from a caller must not end
+ *              the caller's process; only running out of memory raises
+ *              Mem_Failed, as everywhere else.
+ */
+
+#include "comp40.h"
+#include "fused.h"
+#include "mem.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <limits.h>
+
+/* The header of a compressed image in format 2, as writeCompressedHeader
+   writes it, and the start that every format shares */
+#define HEADER_FORMAT "COMP40 Compressed image format 2\n%u %u\n"
+#define HEADER_START "COMP40 Compressed image format "
+
+/* Blocks comp40_compress_rows codes per call of the kernel */
+#define PIECE_BLOCKS 256
+
+static size_t readHeader(const uint8_t *in, size_t size, unsigned *width,
+                         unsigned *height);
+static bool readNumber(const uint8_t *in, size_t size, size_t *at,
+                       unsigned *value);
+
+/********** comp40_compress ********
+ *
+ * Purpose: Compress an image held in memory into a buffer.
+ *
+ * Parameters:
+ *      const uint8_t *rgb: The pixels, row by row, each row red, green and
+ *                          blue bytes for every pixel.
+ *      unsigned width: Width of the image, in pixels.
+ *      unsigned height: Height of the image, in pixels.
+ *      size_t stride: Bytes from the start of one row of rgb to the next.
+ *      uint8_t *out: Buffer for the compressed image, or NULL if cap is 0.
+ *      size_t cap: Bytes out can hold.
+ *
+ * Return: The size of the compressed image in bytes, whether or not it was
+ *         written, or 0 if the arguments are not valid.
+ *
+ * Expects: stride is at least 3 * width; rgb is not NULL unless the image
+ *          is empty.
+ *
+ * Notes: The image is written only if cap is at least its size, and is
+ *        then the same bytes 40image-6 -c writes for a P6 image of these
+ *        pixels with a maxval of 255: an odd last column or row is dropped
+ *        and the code words follow the header in big-endian order.
+ *
+ ************************/
+size_t comp40_compress(const uint8_t *rgb, unsigned width, unsigned height,
+                       size_t stride, uint8_t *out, size_t cap)
+{
+        if (stride < 3 * (uint64_t) width ||
+            (rgb == NULL && width > 0 && height > 0)) {
+                return 0;
+        }
+        unsigned w = width & ~1u, h = height & ~1u;
+        char header[64];
+        int header_length = snprintf(header, sizeof(header), HEADER_FORMAT,
+                                     w, h);
+        int blocks_in_row = w / 2;
+        int block_rows = h / 2;
+        size_t size = header_length +
+                      4 * (uint64_t) blocks_in_row * block_rows;
+        if (out == NULL || cap < size) {
+                return size;
+        }
+
+        for (int i = 0; i < header_length; i++) {
+                out[i] = header[i];
+        }
+        comp40_compress_rows(rgb, width, h, stride, out + header_length,
+                             size - header_length);
+        return size;
+}
+
+/********** comp40_compress_rows ********
+ *
+ * Purpose: Compress a horizontal slice of an image into its code words
+ *          alone, for a caller that streams an image in pieces.
+ *
+ * Parameters:
+ *      const uint8_t *rgb: The first scanline of the slice, laid out as
+ *                          comp40_compress takes it.
+ *      unsigned width: Width of the image, in pixels.
+ *      unsigned rows: Number of scanlines in the slice.
+ *      size_t stride: Bytes from the start of one row of rgb to the next.
+ *      uint8_t *out: Buffer for the code words, or NULL if cap is 0.
+ *      size_t cap: Bytes out can hold.
+ *
+ * Return: The size of the code words in bytes, 4 * (width / 2) * (rows /
+ *         2), whether or not they were written, or 0 if the arguments are
+ *         not valid.
+ *
+ * Expects: As comp40_compress.
+ *
+ * Notes: Writes no header. Slices of an even number of rows, taken from
+ *        the top of an image and written one after another after
+ *        "COMP40 Compressed image format 2\n<width> <height>\n" with the
+ *        trimmed size, make the bytes comp40_compress writes; an odd last
+ *        row of a slice is dropped. Allocates nothing.
+ *
+ ************************/
+size_t comp40_compress_rows(const uint8_t *rgb, unsigned width,
+                            unsigned rows, size_t stride, uint8_t *out,
+                            size_t cap)
+{
+        if (stride < 3 * (uint64_t) width ||
+            (rgb == NULL && width > 1 && rows > 1)) {
+                return 0;
+        }
+        int blocks_in_row = width / 2;
+        int block_rows = rows / 2;
+        size_t size = 4 * (uint64_t) blocks_in_row * block_rows;
+        if (out == NULL || cap < size) {
+                return size;
+        }
+
+        uint32_t words[PIECE_BLOCKS];
+        float scratch[FUSED_SCRATCH(PIECE_BLOCKS) / sizeof(float)];
+        uint8_t *next = out;
+        for (int r = 0; r < block_rows; r++) {
+                const uint8_t *top = rgb + 2 * (size_t) r * stride;
+                for (int first = 0; first < blocks_in_row;
+                     first += PIECE_BLOCKS) {
+                        int n = blocks_in_row - first < PIECE_BLOCKS ?
+                                blocks_in_row - first : PIECE_BLOCKS;
+                        compressRawRow(top + 6 * (size_t) first,
+                                       top + stride + 6 * (size_t) first,
+                                       255, n, words, scratch);
+                        for (int b = 0; b < n; b++) {
+                                *next++ = words[b] >> 24;
+                                *next++ = words[b] >> 16;
+                                *next++ = words[b] >> 8;
+                                *next++ = words[b];
+                        }
+                }
+        }
+        return size;
+}
+
+/********** comp40_decompress ********
+ *
+ * Purpose: Decompress an image held in memory into rows of RGB bytes.
+ *
+ * Parameters:
+ *      const uint8_t *in: The compressed image, in format 2.
+ *      size_t size: Bytes in the compressed image.
+ *      uint8_t *rgb: Buffer for the pixels, laid out as comp40_compress
+ *                    takes them, or NULL if cap is 0.
+ *      size_t stride: Bytes from the start of one row of rgb to the next.
+ *      size_t cap: Bytes rgb can hold.
+ *      unsigned *width: Set to the width of the image, or NULL.
+ *      unsigned *height: Set to the height of the image, or NULL.
+ *
+ * Return: The bytes of rgb the image covers, (height - 1) * stride + 3 *
+ *         width, whether or not it was written, or 0 if the image is not a
+ *         valid compressed image in format 2, stride is less than 3 *
+ *         width, or the image has no pixels.
+ *
+ * Expects: None.
+ *
+ * Notes: The pixels are written only if cap is at least the bytes the
+ *        image covers; bytes between the rows are left alone. They are the
+ *        pixels 40image-6 -d writes, with any odd last column or row black.
+ *        width and height are set whenever the header can be read, so a
+ *        first call with a capacity of 0 gives the size of the image. The
+ *        other formats, which only the command line writes, return 0.
+ *
+ ************************/
+size_t comp40_decompress(const uint8_t *in, size_t size, uint8_t *rgb,
+                         size_t stride, size_t cap, unsigned *width,
+                         unsigned *height)
+{
+        unsigned w, h;
+        size_t header_length = in != NULL ? readHeader(in, size, &w, &h) : 0;
+        if (header_length == 0) {
+                return 0;
+        }
+        if (width != NULL) {
+                *width = w;
+        }
+        if (height != NULL) {
+                *height = h;
+        }
+        int blocks_in_row = w / 2;
+        int block_rows = h / 2;
+        uint64_t words = (uint64_t) blocks_in_row * block_rows;
+        size_t line = 3 * (size_t) w;
+        if (size - header_length != 4 * words || w == 0 || h == 0 ||
+            stride < line || stride > (SIZE_MAX - line) / h) {
+                return 0;
+        }
+        size_t covered = (h - 1) * stride + line;
+        if (rgb == NULL || cap < covered) {
+                return covered;
+        }
+
+        const uint8_t *next = in + header_length;
+        uint32_t *row = ALLOC((blocks_in_row > 0 ? blocks_in_row : 1) *
+                              sizeof(uint32_t));
+        struct Pnm_rgb *top = CALLOC(w, sizeof(struct Pnm_rgb));
+        struct Pnm_rgb *bottom = CALLOC(w, sizeof(struct Pnm_rgb));
+        void *scratch = ALLOC(FUSED_SCRATCH(blocks_in_row > 0 ?
+                                            blocks_in_row : 1));
+        for (int r = 0; r < block_rows; r++) {
+                for (int b = 0; b < blocks_in_row; b++) {
+                        row[b] = (uint32_t) next[0] << 24 |
+                                 (uint32_t) next[1] << 16 |
+                                 (uint32_t) next[2] << 8 | next[3];
+                        next += 4;
+                }
+                /* An odd last column stays black from CALLOC */
+                decompressRow(row, blocks_in_row, 255, top, bottom,
+                              scratch);
+                for (int i = 0; i < 2; i++) {
+                        struct Pnm_rgb *pixels = i == 0 ? top : bottom;
+                        uint8_t *raw = rgb + (2 * (size_t) r + i) * stride;
+                        for (unsigned x = 0; x < w; x++) {
+                                raw[3 * x] = pixels[x].red;
+                                raw[3 * x + 1] = pixels[x].green;
+                                raw[3 * x + 2] = pixels[x].blue;
+                        }
+                }
+        }
+        if (h % 2 == 1) {
+                uint8_t *raw = rgb + (h - 1) * stride;
+                for (size_t x = 0; x < line; x++) {
+                        raw[x] = 0;
+                }
+        }
+        FREE(scratch);
+        FREE(bottom);
+        FREE(top);
+        FREE(row);
+        return covered;
+}
+
+/********** readHeader ********
+ *
+ * Purpose: Read the header of a compressed image in format 2 from memory.
+ *
+ * Parameters:
+ *      const uint8_t *in: The compressed image.
+ *      size_t size: Bytes in it.
+ *      unsigned *width: Set to the width of the image.
+ *      unsigned *height: Set to the height of the image.
+ *
+ * Return: Bytes in the header, or 0 if it is malformed or names another
+ *         format.
+ *
+ * Expects: in, width and height are not NULL.
+ *
+ * Notes: Accepts what readCompressedHeader accepts: any white space before
+ *        each number, and a newline right after the height.
+ *
+ ************************/
+static size_t readHeader(const uint8_t *in, size_t size, unsigned *width,
+                         unsigned *height)
+{
+        size_t at = 0;
+        for (const char *c = HEADER_START; *c != '\0'; c++, at++) {
+                if (at == size || in[at] != (uint8_t) *c) {
+                        return 0;
+                }
+        }
+        unsigned format;
+        if (!readNumber(in, size, &at, &format) || format != 2 ||
+            !readNumber(in, size, &at, width) ||
+            !readNumber(in, size, &at, height) ||
+            at == size || in[at] != '\n') {
+                return 0;
+        }
+        return at + 1;
+}
+
+/* Read an unsigned decimal number at *at after any white space, moving *at
+   past it; false if there is none or it is too large */
+static bool readNumber(const uint8_t *in, size_t size, size_t *at,
+                       unsigned *value)
+{
+        size_t i = *at;
+        while (i < size && (in[i] == ' ' || (in[i] >= '\t' && in[i] <= '\r'))) {
+                i++;
+        }
+        if (i == size || in[i] < '0' || in[i] > '9') {
+                return false;
+        }
+        uint64_t n = 0;
+        while (i < size && in[i] >= '0' && in[i] <= '9') {
+                n = 10 * n + (in[i] - '0');
+                if (n > UINT_MAX) {
+                        return false;
+                }
+                i++;
+        }
+        *value = n;
+        *at = i;
+        return true;
+}
@@ -0,0 +1,34 @@
+/*
+ *     comp40.h
+ *
+ *     Purpose: Interface for comp40, the in-memory library. Compresses an
+ *              image held as rows of 8-bit RGB bytes into a buffer in the
+ *              fixed code word format (format 2), and decompresses such a
+ *              buffer into rows of RGB bytes, the same bytes that 40image-6
+ *              -c writes and the same pixels that -d writes. The calls use
+ *              no FILE streams and no state outside their arguments, so any
+ *              number of threads can call them at once. Like snprintf, each
+ *              returns the size it needs and writes only when the buffer is
+ *              at least that large, so a caller can ask for the size with a
+ *              capacity of 0 first. comp40_compress_rows codes a slice of
+ *              an image without the header, so an image can be streamed
+ *              through a buffer of a few rows. Link with libcomp40.a and
+ *              the libraries 40image-6 links with.
+ */
+
+#ifndef COMP40_H
+#define COMP40_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+size_t comp40_compress(const uint8_t *rgb, unsigned width, unsigned height,
+                       size_t stride, uint8_t *out, size_t cap);
+size_t comp40_compress_rows(const uint8_t *rgb, unsigned width,
+                            unsigned rows, size_t stride, uint8_t *out,
+                            size_t cap);
+size_t comp40_decompress(const uint8_t *in, size_t size, uint8_t *rgb,
+                         size_t stride, size_t cap, unsigned *width,
+                         unsigned *height);
+
+#endif
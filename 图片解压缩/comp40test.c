@@ -0,0 +1,254 @@
+/*
+ *     comp40test.c
+ *
+ *     Purpose: Test program for the comp40 library. Builds images of odd
+ *              and even sizes in rows with padding after them, compresses
+ *              and decompresses each on the main thread, then does the same
+ *              for all of them at once on THREADS threads and checks that
+ *              every thread gets the same bytes and pixels. Also checks
+ *              that a buffer one byte short is left untouched, that the
+ *              padding between rows is never written, and that damaged or
+ *              truncated input is refused with 0, and that slices coded
+ *              by comp40_compress_rows make up the same code words.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "assert.h"
+#include "mem.h"
+#include "comp40.h"
+
+#define IMAGES 9
+#define THREADS 8
+#define ROUNDS 4
+
+/* Bytes after each row of an image, filled with PAD_BYTE */
+#define PADDING 5
+#define PAD_BYTE 0xA5
+
+/* An image with its compressed bytes and decoded pixels */
+struct Case {
+        unsigned width, height;
+        size_t stride;
+        uint8_t *rgb;
+        uint8_t *compressed;
+        size_t compressed_size;
+        uint8_t *decoded;
+        size_t decoded_size;
+};
+
+static void makeImage(struct Case *image, int seed);
+static bool roundTrip(struct Case *image, uint8_t **compressed,
+                      size_t *compressed_size, uint8_t **decoded,
+                      size_t *decoded_size);
+static void *worker(void *cl);
+static bool refusals(struct Case *image);
+static bool slicesMatch(struct Case *image, const uint8_t *compressed,
+                        size_t size);
+
+int main(void)
+{
+        unsigned sizes[IMAGES][2] = {
+                { 2, 2 }, { 3, 5 }, { 64, 48 }, { 97, 33 },
+                { 128, 1 }, { 1, 64 }, { 255, 130 }, { 40, 41 },
+                { 1030, 9 }
+        };
+        struct Case images[IMAGES];
+        int failures = 0;
+        srand(40);
+        for (int i = 0; i < IMAGES; i++) {
+                images[i].width = sizes[i][0];
+                images[i].height = sizes[i][1];
+                makeImage(&images[i], i);
+                bool ok = roundTrip(&images[i], &images[i].compressed,
+                                    &images[i].compressed_size,
+                                    &images[i].decoded,
+                                    &images[i].decoded_size) &&
+                          refusals(&images[i]);
+                printf("%3ux%-3u %s, %zu bytes compressed\n",
+                       images[i].width, images[i].height, ok ? "ok" : "FAIL",
+                       images[i].compressed_size);
+                failures += !ok;
+        }
+
+        pthread_t workers[THREADS];
+        for (int t = 0; t < THREADS; t++) {
+                int err = pthread_create(&workers[t], NULL, worker, images);
+                assert(err == 0);
+        }
+        for (int t = 0; t < THREADS; t++) {
+                void *ok;
+                int err = pthread_join(workers[t], &ok);
+                assert(err == 0);
+                failures += ok == NULL;
+        }
+        printf("%d threads %s\n", THREADS, failures == 0 ? "ok" : "FAIL");
+
+        for (int i = 0; i < IMAGES; i++) {
+                FREE(images[i].rgb);
+                FREE(images[i].compressed);
+                FREE(images[i].decoded);
+        }
+        return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Fill an image with random pixels in rows of stride bytes, the padding
+ * after each row set to PAD_BYTE.
+ */
+static void makeImage(struct Case *image, int seed)
+{
+        image->stride = 3 * image->width + PADDING;
+        size_t bytes = image->stride * image->height;
+        image->rgb = ALLOC(bytes);
+        memset(image->rgb, PAD_BYTE, bytes);
+        for (unsigned row = 0; row < image->height; row++) {
+                for (unsigned x = 0; x < 3 * image->width; x++) {
+                        image->rgb[row * image->stride + x] =
+                                (rand() + seed * (x / 3)) & 0xFF;
+                }
+        }
+}
+
+/*
+ * Compress and decompress an image, checking the sizes the library asks
+ * for and that it writes nothing to a buffer one byte short or to the
+ * padding of the pixels; the results are kept in new buffers.
+ */
+static bool roundTrip(struct Case *image, uint8_t **compressed,
+                      size_t *compressed_size, uint8_t **decoded,
+                      size_t *decoded_size)
+{
+        bool ok = true;
+        size_t size = comp40_compress(image->rgb, image->width, image->height,
+                                      image->stride, NULL, 0);
+        uint8_t *out = ALLOC(size);
+        memset(out, 0, size);
+        ok &= comp40_compress(image->rgb, image->width, image->height,
+                              image->stride, out, size - 1) == size;
+        for (size_t i = 0; i < size; i++) {
+                ok &= out[i] == 0;
+        }
+        ok &= comp40_compress(image->rgb, image->width, image->height,
+                              image->stride, out, size) == size;
+        ok &= slicesMatch(image, out, size);
+
+        unsigned width, height;
+        size_t covered = comp40_decompress(out, size, NULL, image->stride, 0,
+                                           &width, &height);
+        ok &= width == (image->width & ~1u) &&
+              height == (image->height & ~1u);
+        size_t bytes = covered > 0 ? covered + PADDING : 1;
+        uint8_t *pixels = ALLOC(bytes);
+        memset(pixels, PAD_BYTE, bytes);
+        if (covered > 0) {
+                ok &= comp40_decompress(out, size, pixels, image->stride,
+                                        covered, NULL, NULL) == covered;
+                for (size_t i = 0; i < bytes; i++) {
+                        if (i % image->stride >= 3 * width) {
+                                ok &= pixels[i] == PAD_BYTE;
+                        }
+                }
+        }
+        *compressed = out;
+        *compressed_size = size;
+        *decoded = pixels;
+        *decoded_size = covered;
+        return ok;
+}
+
+/*
+ * Repeat the round trip of every image ROUNDS times and compare the results
+ * with those of the main thread; returns non-NULL if all match.
+ */
+static void *worker(void *cl)
+{
+        struct Case *images = cl;
+        bool ok = true;
+        for (int round = 0; round < ROUNDS; round++) {
+                for (int i = 0; i < IMAGES; i++) {
+                        uint8_t *compressed, *decoded;
+                        size_t size, covered;
+                        ok &= roundTrip(&images[i], &compressed, &size,
+                                        &decoded, &covered);
+                        ok &= size == images[i].compressed_size &&
+                              memcmp(compressed, images[i].compressed,
+                                     size) == 0;
+                        ok &= covered == images[i].decoded_size &&
+                              memcmp(decoded, images[i].decoded,
+                                     covered) == 0;
+                        FREE(compressed);
+                        FREE(decoded);
+                }
+        }
+        return ok ? cl : NULL;
+}
+
+/*
+ * Check that damaged compressed images are refused: cut short, with a
+ * byte too many, with another format and with a bad header.
+ */
+static bool refusals(struct Case *image)
+{
+        size_t size = image->compressed_size;
+        uint8_t *copy = ALLOC(size + 1);
+        memcpy(copy, image->compressed, size);
+        copy[size] = 0;
+        size_t stride = image->stride;
+        bool ok = comp40_decompress(copy, size + 1, NULL, stride, 0, NULL,
+                                    NULL) == 0;
+        ok &= comp40_decompress(copy, size - 1, NULL, stride, 0, NULL,
+                                NULL) == 0;
+        ok &= comp40_decompress(copy, 10, NULL, stride, 0, NULL, NULL) == 0;
+        ok &= comp40_decompress(NULL, 0, NULL, stride, 0, NULL, NULL) == 0;
+        copy[31] = '3';         /* the format number */
+        ok &= comp40_decompress(copy, size, NULL, stride, 0, NULL,
+                                NULL) == 0;
+        copy[31] = '2';
+        copy[0] = 'X';
+        ok &= comp40_decompress(copy, size, NULL, stride, 0, NULL,
+                                NULL) == 0;
+        FREE(copy);
+        return ok;
+}
+
+/*
+ * Code the image again in slices of 2, 4 and 6 rows in turn with
+ * comp40_compress_rows and check that they make up the code words after
+ * the header of the whole image.
+ */
+static bool slicesMatch(struct Case *image, const uint8_t *compressed,
+                        size_t size)
+{
+        unsigned height = image->height & ~1u;
+        size_t words = comp40_compress_rows(image->rgb, image->width, height,
+                                            image->stride, NULL, 0);
+        if (words > size) {
+                return false;
+        }
+        const uint8_t *expected = compressed + size - words;
+        uint8_t *slice = ALLOC(words > 0 ? words : 1);
+        bool ok = true;
+        unsigned rows = 2;
+        for (unsigned row = 0; row < height; row += rows, rows = rows % 6 + 2) {
+                if (rows > height - row) {
+                        rows = height - row;
+                }
+                const uint8_t *rgb = image->rgb + row * image->stride;
+                size_t bytes = comp40_compress_rows(rgb, image->width, rows,
+                                                    image->stride, slice,
+                                                    words);
+                size_t left = compressed + size - expected;
+                if (bytes > left || memcmp(slice, expected, bytes) != 0) {
+                        ok = false;
+                        break;
+                }
+                expected += bytes;
+        }
+        ok &= expected == compressed + size;
+        FREE(slice);
+        return ok;
+}
@@ -6,18 +6,77 @@
  *              convert between portable pixmap images and compressed binary
  *              image files. The details of the compression and decompression
  *              process are hidden away in other modules, choosing to instead 
- *              rely on their interfaces.
+ *              rely on their interfaces. Compression and decompression
+ *              normally stream the image through the fused kernels, and
+ *              compression can split each chunk of the image into bands
+ *              computed on separate threads, with the float kernel or the
+ *              fixed-point one, entropy code the words, and keep its
+ *              buffers for the next image; decompression reads either
+ *              format; compress40_staged and decompress40_staged run the
+ *              separate stages over the whole image and produce the same
+ *              bytes.
  */
 
 #include "compress40.h"
+#include "compress40ext.h"
 #include "imageIO.h"
 #include "compvideo.h"
 #include "chroma.h"
 #include "dct.h"
 #include "codeword.h"
+#include "fused.h"
+#include "entropy.h"
+#include "tiles.h"
+#include "comp40.h"
 #include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
 
-void clearSeq(Seq_T seq);
+/* Block rows each thread computes per chunk of a threaded compression */
+#define CHUNK_ROWS 32
+
+/* A horizontal band of block rows, computed by one thread */
+struct Band {
+        struct Pnm_rgb *scanlines; /* 2 * rows scanlines of cols pixels */
+        const unsigned char *raw;  /* or of stride raw bytes, if not NULL */
+        size_t stride;
+        int cols, rows;
+        int blocks_in_row;
+        unsigned denom;
+        FixedScale fixed;          /* tables for compressRowFixed, or NULL */
+        uint32_t *words;           /* rows * blocks_in_row code words */
+        void *scratch;             /* working memory of the row kernels */
+};
+
+/* Working memory of compress40_buffered, kept between images */
+struct Compress40_buffers {
+        struct Pnm_rgb *scanlines;
+        size_t scanlines_size;     /* sizes are in bytes */
+        uint32_t *words;
+        size_t words_size;
+        struct Band *bands;
+        size_t bands_size;
+        pthread_t *workers;
+        size_t workers_size;
+        unsigned char *scratch;    /* FUSED_SCRATCH for each thread */
+        size_t scratch_size;
+        FixedScale fixed;          /* tables for the last denominator */
+};
+
+CodeInfo_T newCodeInfo(int width, int height, int *blocks);
+void *compressBand(void *cl);
+static void *reserve(void **buffer, size_t *size, size_t bytes);
+static FixedScale bufferedScale(Compress40_buffers buffers, unsigned denom);
+static void decompressRegion(FILE *input, int format, unsigned width,
+                             unsigned height,
+                             struct Compress40_region region, bool preview);
+static unsigned decompressSequence(FILE *input, unsigned width,
+                                   unsigned height);
+static void writeRegionRow(uint32_t *words, int blocks, int block_row,
+                           const struct Compress40_region *region,
+                           bool preview, struct Pnm_rgb *top,
+                           struct Pnm_rgb *bottom, unsigned char *raw,
+                           void *scratch);
 
 /********** compress40 ********
  *
@@ -30,26 +89,399 @@ void clearSeq(Seq_T seq);
  *      
  * Expects: The given file is a valid PPM image.
  * 
- * Notes: Utilizes functions hidden in other modules to handle the compression
- *        process.
+ * Notes: The same as compress40_opts with a single thread, the float
+ *        kernel and fixed 32-bit code words.
  *      
  ************************/
 void compress40(FILE *input)
+{
+        struct Compress40_options options = { .threads = 1, .fixed = false,
+                                              .entropy = false,
+                                              .tiled = false };
+        compress40_opts(input, &options);
+}
+
+/********** compress40_opts ********
+ *
+ * Purpose: Read in a PPM and write out a compressed image, computing the code
+ *          words on several threads and with the chosen kernel.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file to read from.
+ *      const struct Compress40_options *options: Number of threads,
+ *                                                whether to use the
+ *                                                fixed-point kernel, and
+ *                                                whether to entropy code
+ *                                                the code words.
+ * 
+ * Return: None.
+ *      
+ * Expects: The given file is a valid PPM image; options->threads is at
+ *          least 1.
+ * 
+ * Notes: compress40_buffered to standard output, with buffers used for this
+ *        image only.
+ *      
+ ************************/
+void compress40_opts(FILE *input, const struct Compress40_options *options)
+{
+        Compress40_buffers buffers = newCompress40Buffers();
+        compress40_buffered(input, stdout, options, buffers);
+        freeCompress40Buffers(&buffers);
+}
+
+/********** compress40_buffered ********
+ *
+ * Purpose: Read in a PPM and write out a compressed image, keeping the
+ *          working memory in buffers that can be used again for the next
+ *          image.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file to read from.
+ *      FILE *output: A pointer to a file to write to.
+ *      const struct Compress40_options *options: Number of threads,
+ *                                                whether to use the
+ *                                                fixed-point kernel, and
+ *                                                whether to entropy code
+ *                                                the code words.
+ *      Compress40_buffers buffers: Working memory from
+ *                                  newCompress40Buffers.
+ * 
+ * Return: None.
+ *      
+ * Expects: The given file is a valid PPM image; options->threads is at
+ *          least 1; buffers and options->stats are not in use by another
+ *          call.
+ * 
+ * Notes: Streams the image in chunks of at most threads * CHUNK_ROWS block
+ *        rows: the scanlines of a chunk are read (for a raw 8-bit image,
+ *        taken as they are from readRawScanlines, which maps a regular file
+ *        rather than copying it), the chunk is split into one horizontal
+ *        band of block rows per thread, each band is turned into code words
+ *        by the fused kernel in its own region of the word buffer, and the
+ *        chunk is written out before the next is read, as fixed words or
+ *        through an EntropyWriter, which codes whole segments however the
+ *        chunks fall; a TileWriter instead keeps the coded tiles until the
+ *        end, since their index is written first. The bytes are the same
+ *        for any number of threads. Memory is proportional to the width of
+ *        the image, not its size (apart from the coded tiles), and the
+ *        buffers only grow, so images no larger than one already compressed
+ *        allocate nothing new. An odd last row is never read. A raw 8-bit
+ *        image with a denominator of 255 compressed on one thread into
+ *        format 2 has each chunk coded instead by the library's
+ *        comp40_compress_rows, straight into the word buffer as the same
+ *        big-endian bytes, and written with one call. With options->stats,
+ *        reading, the kernel and writing are timed as the stages readPPM,
+ *        compressRow and writeCompressed on every path.
+ *      
+ ************************/
+void compress40_buffered(FILE *input, FILE *output,
+                         const struct Compress40_options *options,
+                         Compress40_buffers buffers)
+{
+        assert(options != NULL && options->threads >= 1);
+        assert(output != NULL && buffers != NULL);
+        int threads = options->threads;
+        Stats stats = options->stats;
+        statsStart(stats);
+        PPMReader reader = openPPM(input);
+        FixedScale fixed = NULL;
+        if (options->fixed) {
+                fixed = bufferedScale(buffers, reader->denominator);
+        }
+        unsigned w = reader->width & ~1u;
+        unsigned h = reader->height & ~1u;
+        int blocks_in_row = w / 2;
+        int cols = reader->width > 0 ? reader->width : 1;
+        int chunk_rows = threads * CHUNK_ROWS;
+        bool raw = rawPPM(reader);
+        /* The library codes 8-bit samples straight into big-endian bytes */
+        bool library = raw && reader->denominator == 255 && threads == 1 &&
+                       !options->fixed && !options->entropy &&
+                       !options->tiled;
+        struct Pnm_rgb *scanlines = reserve((void **) &buffers->scanlines,
+                                            &buffers->scanlines_size,
+                                            (raw ? 1 : 2 * chunk_rows * cols) *
+                                            sizeof(struct Pnm_rgb));
+        uint32_t *words = reserve((void **) &buffers->words,
+                                  &buffers->words_size,
+                                  chunk_rows * (blocks_in_row > 0 ?
+                                                blocks_in_row : 1) *
+                                  sizeof(uint32_t));
+        struct Band *bands = reserve((void **) &buffers->bands,
+                                     &buffers->bands_size,
+                                     threads * sizeof(struct Band));
+        pthread_t *workers = reserve((void **) &buffers->workers,
+                                     &buffers->workers_size,
+                                     threads * sizeof(pthread_t));
+        size_t scratch_bytes = FUSED_SCRATCH(blocks_in_row > 0 ?
+                                             blocks_in_row : 1);
+        unsigned char *scratch = reserve((void **) &buffers->scratch,
+                                         &buffers->scratch_size,
+                                         threads * scratch_bytes);
+
+        EntropyWriter entropy = NULL;
+        TileWriter tiles = NULL;
+        if (options->tiled) {
+                /* Writes the header itself, with the index of the tiles */
+                tiles = newTileWriter(output, w, h);
+        } else if (options->entropy) {
+                writeCompressedHeader(output, FORMAT_ENTROPY, w, h);
+                entropy = newEntropyWriter(output, blocks_in_row);
+        } else {
+                writeCompressedHeader(output, FORMAT_WORDS, w, h);
+        }
+        for (int done = 0; done < (int) h / 2; ) {
+                int rows = (int) h / 2 - done;
+                if (rows > chunk_rows) {
+                        rows = chunk_rows;
+                }
+                const unsigned char *lines = NULL;
+                if (raw) {
+                        lines = readRawScanlines(reader, 2 * rows);
+                } else {
+                        for (int i = 0; i < 2 * rows; i++) {
+                                readScanline(reader, &scanlines[i * cols]);
+                        }
+                }
+                uint64_t pixels = 2 * (uint64_t) rows * w;
+                statsMark(stats, "readPPM", pixels);
+                if (library) {
+                        size_t bytes = 4 * (size_t) rows * blocks_in_row;
+                        comp40_compress_rows(lines, reader->width, 2 * rows,
+                                             reader->stride,
+                                             (uint8_t *) words, bytes);
+                        statsMark(stats, "compressRow", pixels);
+                        size_t written = fwrite(words, 1, bytes, output);
+                        assert(written == bytes);
+                        statsMark(stats, "writeCompressed", pixels);
+                        done += rows;
+                        continue;
+                }
+                /* Bands differ by at most one block row */
+                int first = 0;
+                for (int t = 0; t < threads; t++) {
+                        int n = rows / threads + (t < rows % threads);
+                        bands[t] = (struct Band) {
+                                .scanlines = &scanlines[2 * first * cols],
+                                .raw = raw ? lines + 2 * first *
+                                             reader->stride : NULL,
+                                .stride = reader->stride,
+                                .cols = cols, .rows = n,
+                                .blocks_in_row = blocks_in_row,
+                                .denom = reader->denominator,
+                                .fixed = fixed,
+                                .words = &words[first * blocks_in_row],
+                                .scratch = &scratch[t * scratch_bytes]
+                        };
+                        first += n;
+                }
+                /* The calling thread takes the first band itself */
+                for (int t = 1; t < threads; t++) {
+                        int err = pthread_create(&workers[t], NULL,
+                                                 compressBand, &bands[t]);
+                        assert(err == 0);
+                }
+                compressBand(&bands[0]);
+                for (int t = 1; t < threads; t++) {
+                        int err = pthread_join(workers[t], NULL);
+                        assert(err == 0);
+                }
+                statsMark(stats, "compressRow", pixels);
+                if (tiles != NULL) {
+                        tileWriteWords(tiles, words, rows * blocks_in_row);
+                } else if (entropy != NULL) {
+                        entropyWriteWords(entropy, words,
+                                          rows * blocks_in_row);
+                } else {
+                        writeWords(output, words, rows * blocks_in_row);
+                }
+                statsMark(stats, "writeCompressed", pixels);
+                done += rows;
+        }
+        if (tiles != NULL) {
+                closeTileWriter(&tiles);
+        } else if (entropy != NULL) {
+                closeEntropyWriter(&entropy);
+        }
+        statsMark(stats, "writeCompressed", 0);
+        closePPM(&reader);
+}
+
+/********** newCompress40Buffers ********
+ *
+ * Purpose: Allocate empty working memory for compress40_buffered.
+ *
+ * Parameters: None.
+ * 
+ * Return: A new Compress40_buffers.
+ *      
+ * Expects: None.
+ * 
+ * Notes: Nothing is allocated for the buffers themselves until an image
+ *        needs them. Must be freed with freeCompress40Buffers.
+ *      
+ ************************/
+Compress40_buffers newCompress40Buffers(void)
+{
+        Compress40_buffers buffers;
+        NEW0(buffers);
+        return buffers;
+}
+
+/********** freeCompress40Buffers ********
+ *
+ * Purpose: Free the working memory of compress40_buffered.
+ *
+ * Parameters: 
+ *      Compress40_buffers *buffers: Pointer to the buffers to free.
+ * 
+ * Return: None.
+ *      
+ * Expects: buffers and *buffers are not NULL.
+ * 
+ * Notes: Sets *buffers to NULL.
+ *      
+ ************************/
+void freeCompress40Buffers(Compress40_buffers *buffers)
+{
+        assert(buffers != NULL && *buffers != NULL);
+        Compress40_buffers b = *buffers;
+        FREE(b->scanlines);
+        FREE(b->words);
+        FREE(b->bands);
+        FREE(b->workers);
+        FREE(b->scratch);
+        if (b->fixed != NULL) {
+                freeFixedScale(&b->fixed);
+        }
+        FREE(*buffers);
+}
+
+/********** reserve ********
+ *
+ * Purpose: Make sure a buffer has room for a number of bytes.
+ *
+ * Parameters: 
+ *      void **buffer: Pointer to the buffer, which may be NULL.
+ *      size_t *size: Pointer to the size of the buffer, in bytes.
+ *      size_t bytes: Number of bytes needed.
+ * 
+ * Return: The buffer.
+ *      
+ * Expects: bytes is at least 1.
+ * 
+ * Notes: A buffer that is too small is replaced by a zeroed one of exactly
+ *        the size needed; its contents are not kept, as every caller fills
+ *        the buffer before reading it.
+ *      
+ ************************/
+static void *reserve(void **buffer, size_t *size, size_t bytes)
+{
+        assert(bytes > 0);
+        if (*buffer == NULL || *size < bytes) {
+                FREE(*buffer);
+                *buffer = CALLOC(1, bytes);
+                *size = bytes;
+        }
+        return *buffer;
+}
+
+/********** bufferedScale ********
+ *
+ * Purpose: Get the fixed-point tables for a denominator, built once and kept
+ *          in the buffers.
+ *
+ * Parameters: 
+ *      Compress40_buffers buffers: The buffers holding the tables.
+ *      unsigned denom: Denominator of the RGB values.
+ * 
+ * Return: A FixedScale for denom, owned by buffers.
+ *      
+ * Expects: denom is at least 1 and below 65536.
+ * 
+ * Notes: The tables are rebuilt only when the denominator changes, which for
+ *        a batch of 8-bit images is never.
+ *      
+ ************************/
+static FixedScale bufferedScale(Compress40_buffers buffers, unsigned denom)
+{
+        if (buffers->fixed != NULL && buffers->fixed->denom != denom) {
+                freeFixedScale(&buffers->fixed);
+        }
+        if (buffers->fixed == NULL) {
+                buffers->fixed = newFixedScale(denom);
+        }
+        return buffers->fixed;
+}
+
+/********** compress40_staged ********
+ *
+ * Purpose: Read in a PPM and write out a compressed image.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file to read from.
+ * 
+ * Return: None.
+ *      
+ * Expects: The given file is a valid PPM image.
+ * 
+ * Notes: compress40_staged_stats without timing.
+ *      
+ ************************/
+void compress40_staged(FILE *input)
+{
+        compress40_staged_stats(input, NULL);
+}
+
+/********** compress40_staged_stats ********
+ *
+ * Purpose: Read in a PPM and write out a compressed image, timing each
+ *          stage.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file to read from.
+ *      Stats stats: The Stats to charge each stage to, or NULL.
+ * 
+ * Return: None.
+ *      
+ * Expects: The given file is a valid PPM image.
+ * 
+ * Notes: Utilizes functions hidden in other modules to handle the compression
+ *        process, one full pass over the image per stage. Each stage is
+ *        charged to the function that does it; setting up the code
+ *        information goes to encodeChroma and freeing to none.
+ *      
+ ************************/
+void compress40_staged_stats(FILE *input, Stats stats)
 {
         A2Methods_T methods = uarray2_methods_blocked;
         assert(methods != NULL);
-        Seq_T code_info =  Seq_new(0);
-        Seq_T code_words = Seq_new(0);
+        statsStart(stats);
         Pnm_ppm origImg = readPPM(input);
+        statsMark(stats, "readPPM",
+                  (uint64_t) origImg->width * origImg->height);
         A2 arrayCV = rgbToCV(origImg);
+        uint64_t pixels = (uint64_t) methods->width(arrayCV) *
+                          methods->height(arrayCV);
+        statsMark(stats, "rgbToCV", pixels);
+        int blocks;
+        CodeInfo_T code_info = newCodeInfo(methods->width(arrayCV),
+                                           methods->height(arrayCV), &blocks);
         encodeChroma(arrayCV, code_info);
+        statsMark(stats, "encodeChroma", pixels);
         psToDCT(arrayCV, code_info);
-        packWords(code_info, code_words);
+        statsMark(stats, "psToDCT", pixels);
+        uint32_t *code_words = CALLOC(blocks > 0 ? blocks : 1,
+                                      sizeof(uint32_t));
+        packWords(code_info, blocks, code_words);
+        statsMark(stats, "packWords", pixels);
         writeCompressed(arrayCV, code_words);
+        statsMark(stats, "writeCompressed", pixels);
         methods->free(&arrayCV);
         Pnm_ppmfree(&origImg);
-        clearSeq(code_info);
-        Seq_free(&code_words);
+        FREE(code_info);
+        FREE(code_words);
 }
 
 /********** decompress40 ********
@@ -63,53 +495,783 @@ void compress40(FILE *input)
  *      
  * Expects: The given file is an image that has been compressed.
  * 
- * Notes: Utilizes functions hidden in other modules to handle the decompression
- *        process.
+ * Notes: Streams the image: each row of code words is read, turned into two
+ *        scanlines by the fused kernel and written out before the next row is
+ *        read, so output begins before the input is finished and memory is
+ *        proportional to the width of the image. Entropy-coded images are
+ *        decoded a segment at a time, and tiled ones a row of tiles at a
+ *        time. A sequence is written out as one PPM image per frame.
+ *        Raises a CRE if the file is
+ *        too short or has bytes left over, as readCompressed does; the check
+ *        for leftover bytes comes after the image has been written. This is
+ *        decompress40_stats without timing.
  *      
  ************************/
 void decompress40(FILE *input)
+{
+        decompress40_stats(input, NULL);
+}
+
+/********** decompress40_stats ********
+ *
+ * Purpose: Read in a compressed image and write out a PPM image, timing
+ *          each stage.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file to read from.
+ *      Stats stats: The Stats to charge each stage to, or NULL.
+ * 
+ * Return: None.
+ *      
+ * Expects: The given file is an image that has been compressed.
+ * 
+ * Notes: Decodes as decompress40 does. For formats 2 and 3, reading the
+ *        code words, the kernel and writing are timed as the stages
+ *        readCompressed, decompressRow and writePPM; a tiled image or a
+ *        sequence is timed as a whole, as decompressRegion or
+ *        decompressSequence.
+ *      
+ ************************/
+void decompress40_stats(FILE *input, Stats stats)
+{
+        statsStart(stats);
+        unsigned width, height;
+        int format = readCompressedHeader(input, &width, &height);
+        if (format == FORMAT_SEQUENCE) {
+                unsigned frames = decompressSequence(input, width, height);
+                statsMark(stats, "decompressSequence",
+                          (uint64_t) frames * width * height);
+                return;
+        }
+        if (format == FORMAT_TILED) {
+                struct Compress40_region whole = { 0, 0, width, height };
+                decompressRegion(input, format, width, height, whole,
+                                 false);
+                int extra = getc(input);
+                assert(extra == EOF);
+                statsMark(stats, "decompressRegion",
+                          (uint64_t) width * height);
+                return;
+        }
+        int blocks_in_row = width / 2;
+        int cols = width > 0 ? width : 1;
+        EntropyReader entropy = NULL;
+        if (format == FORMAT_ENTROPY) {
+                entropy = newEntropyReader(input, blocks_in_row, height / 2);
+        }
+        /* Zeroed, so an odd last column or row comes out black as before */
+        struct Pnm_rgb *top = CALLOC(cols, sizeof(struct Pnm_rgb));
+        struct Pnm_rgb *bottom = CALLOC(cols, sizeof(struct Pnm_rgb));
+        uint32_t *words = CALLOC(blocks_in_row > 0 ? blocks_in_row : 1,
+                                 sizeof(uint32_t));
+        unsigned char *raw = ALLOC(3 * (size_t) cols);
+        void *scratch = ALLOC(FUSED_SCRATCH(blocks_in_row > 0 ?
+                                            blocks_in_row : 1));
+        writePPMHeader(width, height, 255);
+        for (unsigned row = 0; row + 1 < height; row += 2) {
+                if (entropy != NULL) {
+                        entropyReadWords(entropy, words, blocks_in_row);
+                } else {
+                        readWords(input, words, blocks_in_row);
+                }
+                statsMark(stats, "readCompressed", 2 * (uint64_t) width);
+                decompressRow(words, blocks_in_row, 255, top, bottom,
+                              scratch);
+                statsMark(stats, "decompressRow", 2 * (uint64_t) width);
+                writeScanline(top, width, raw);
+                writeScanline(bottom, width, raw);
+                statsMark(stats, "writePPM", 2 * (uint64_t) width);
+        }
+        if (height % 2 == 1) {
+                memset(top, 0, cols * sizeof(struct Pnm_rgb));
+                writeScanline(top, width, raw);
+                statsMark(stats, "writePPM", width);
+        }
+        if (entropy != NULL) {
+                freeEntropyReader(&entropy);
+        }
+        FREE(scratch);
+        FREE(raw);
+        FREE(words);
+        FREE(bottom);
+        FREE(top);
+        int extra = getc(input);
+        assert(extra == EOF);
+}
+
+/********** decompress40_region ********
+ *
+ * Purpose: Read in a compressed image and write out one rectangle of it as
+ *          a PPM image.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file to read from.
+ *      const struct Compress40_region *region: The rectangle, in pixels of
+ *                                              the decompressed image.
+ * 
+ * Return: None.
+ *      
+ * Expects: The given file is an image that has been compressed; the top
+ *          left corner of the region lies in the image and the region is
+ *          not empty.
+ * 
+ * Notes: The region is cut at the edges of the image. Only the code words
+ *        of the block rows and columns the region overlaps are decoded;
+ *        for a tiled image only the tiles it overlaps are read, so the work
+ *        follows the size of the region, while the other formats are read
+ *        through from the start to the last block row the region needs.
+ *        The pixels are the same as those of decompress40. Bytes after the
+ *        region's code words are not read. Raises a CRE if the region
+ *        does not start in the image.
+ *      
+ ************************/
+void decompress40_region(FILE *input, const struct Compress40_region *region)
+{
+        assert(region != NULL && region->width > 0 && region->height > 0);
+        unsigned width, height;
+        int format = readCompressedHeader(input, &width, &height);
+        assert(region->x < (width & ~1u) && region->y < (height & ~1u));
+        decompressRegion(input, format, width, height, *region, false);
+}
+
+/********** decompress40_preview ********
+ *
+ * Purpose: Read in a compressed image and write out a PPM image at half
+ *          resolution, one pixel per block.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file to read from.
+ *      const struct Compress40_region *region: A rectangle, in pixels of
+ *                                              the full image, to preview
+ *                                              alone, or NULL for the
+ *                                              whole image.
+ * 
+ * Return: None.
+ *      
+ * Expects: The given file is an image that has been compressed; a region
+ *          is as decompress40_region expects.
+ * 
+ * Notes: Each pixel is the color of a whole block, from its a and chroma
+ *        indices only (previewRow), so the image is (width / 2) by
+ *        (height / 2), or covers every block the region overlaps. The code
+ *        words are read as by decompress40 or decompress40_region, and for
+ *        the whole image a CRE is raised if bytes are left over.
+ *      
+ ************************/
+void decompress40_preview(FILE *input, const struct Compress40_region *region)
+{
+        unsigned width, height;
+        int format = readCompressedHeader(input, &width, &height);
+        if (region != NULL) {
+                assert(region->width > 0 && region->height > 0);
+                assert(region->x < (width & ~1u) &&
+                       region->y < (height & ~1u));
+                decompressRegion(input, format, width, height, *region, true);
+        } else {
+                struct Compress40_region whole = { 0, 0, width, height };
+                decompressRegion(input, format, width, height, whole, true);
+                int extra = getc(input);
+                assert(extra == EOF);
+        }
+}
+
+/********** decompressRegion ********
+ *
+ * Purpose: Decode a rectangle of a compressed image and write it out as a
+ *          PPM image.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file positioned after the header.
+ *      int format: The format from the header.
+ *      unsigned width, height: The size of the image, from the header.
+ *      struct Compress40_region region: The rectangle.
+ *      bool preview: Write one pixel per block the region overlaps.
+ * 
+ * Return: None.
+ *      
+ * Expects: The region starts in the image or is the whole image.
+ * 
+ * Notes: Raises a CRE for a sequence of frames. Only whole blocks are
+ *        decoded, so an odd last row or column is cut off. An image with
+ *        no whole block is written as a header alone, with its trimmed
+ *        size, after the index of a tiled image is read. A tiled image
+ *        is decoded a row of tiles at a time, from the tiles between the
+ *        region's first and last columns; the others a block row at a
+ *        time.
+ *      
+ ************************/
+static void decompressRegion(FILE *input, int format, unsigned width,
+                             unsigned height,
+                             struct Compress40_region region, bool preview)
+{
+        assert(format != FORMAT_SEQUENCE);
+        unsigned w = width & ~1u, h = height & ~1u;
+        /* Each side is cut on its own, so an image with no whole block
+           keeps the size of its other side, as decompress40 writes it */
+        region.width = region.x >= w ? 0 : region.width < w - region.x ?
+                       region.width : w - region.x;
+        region.height = region.y >= h ? 0 : region.height < h - region.y ?
+                        region.height : h - region.y;
+        if (region.width == 0 || region.height == 0) {
+                /* Only the whole image can be empty, so x and y are 0 */
+                if (preview) {
+                        writePPMHeader(region.width / 2, region.height / 2,
+                                       255);
+                } else {
+                        writePPMHeader(region.width, region.height, 255);
+                }
+                if (format == FORMAT_TILED) {
+                        /* Read past the index, which is there regardless */
+                        TileReader tiles = newTileReader(input, width,
+                                                         height);
+                        freeTileReader(&tiles);
+                }
+                return;
+        }
+        int blocks_in_row = width / 2;
+        int first_col = region.x / 2;
+        int last_col = (region.x + region.width - 1) / 2;
+        int first_row = region.y / 2;
+        int last_row = (region.y + region.height - 1) / 2;
+        int blocks = last_col - first_col + 1;
+        if (preview) {
+                writePPMHeader(blocks, last_row - first_row + 1, 255);
+        } else {
+                writePPMHeader(region.width, region.height, 255);
+        }
+        struct Pnm_rgb *top = CALLOC(2 * blocks, sizeof(struct Pnm_rgb));
+        struct Pnm_rgb *bottom = CALLOC(2 * blocks, sizeof(struct Pnm_rgb));
+        unsigned char *raw = ALLOC(6 * (size_t) blocks);
+        void *scratch = ALLOC(FUSED_SCRATCH(blocks));
+
+        if (format == FORMAT_TILED) {
+                TileReader tiles = newTileReader(input, width, height);
+                int first_tile = first_col / TILE_BLOCKS;
+                int last_tile = last_col / TILE_BLOCKS;
+                int end = (last_tile + 1) * TILE_BLOCKS;
+                int stride = (end < blocks_in_row ? end : blocks_in_row) -
+                             first_tile * TILE_BLOCKS;
+                uint32_t *strip = CALLOC(TILE_BLOCKS * stride,
+                                         sizeof(uint32_t));
+                for (int tr = first_row / TILE_BLOCKS;
+                     tr <= last_row / TILE_BLOCKS; tr++) {
+                        for (int tc = first_tile; tc <= last_tile; tc++) {
+                                readTile(tiles, tr, tc, &strip[(tc -
+                                         first_tile) * TILE_BLOCKS], stride);
+                        }
+                        int base = tr * TILE_BLOCKS;
+                        int from = first_row > base ? first_row : base;
+                        int to = last_row < base + TILE_BLOCKS - 1 ?
+                                 last_row : base + TILE_BLOCKS - 1;
+                        for (int r = from; r <= to; r++) {
+                                uint32_t *row = &strip[(r - base) * stride];
+                                writeRegionRow(&row[first_col - first_tile *
+                                                    TILE_BLOCKS], blocks, r,
+                                               &region, preview, top,
+                                               bottom, raw, scratch);
+                        }
+                }
+                FREE(strip);
+                freeTileReader(&tiles);
+        } else {
+                uint32_t *words = CALLOC(blocks_in_row, sizeof(uint32_t));
+                EntropyReader entropy = NULL;
+                if (format == FORMAT_ENTROPY) {
+                        entropy = newEntropyReader(input, blocks_in_row,
+                                                   height / 2);
+                }
+                for (int r = 0; r <= last_row; r++) {
+                        if (entropy != NULL) {
+                                entropyReadWords(entropy, words,
+                                                 blocks_in_row);
+                        } else {
+                                readWords(input, words, blocks_in_row);
+                        }
+                        if (r >= first_row) {
+                                writeRegionRow(&words[first_col], blocks, r,
+                                               &region, preview, top,
+                                               bottom, raw, scratch);
+                        }
+                }
+                if (entropy != NULL) {
+                        freeEntropyReader(&entropy);
+                }
+                FREE(words);
+        }
+        FREE(scratch);
+        FREE(raw);
+        FREE(bottom);
+        FREE(top);
+}
+
+/********** writeRegionRow ********
+ *
+ * Purpose: Write the scanlines of one block row that fall in a region.
+ *
+ * Parameters: 
+ *      uint32_t *words: The code words of the region's columns of blocks.
+ *      int blocks: Number of code words.
+ *      int block_row: The block row they come from.
+ *      const struct Compress40_region *region: The region, already cut at
+ *                                              the edges of the image.
+ *      bool preview: Write one scanline of one pixel per block instead.
+ *      struct Pnm_rgb *top, *bottom: Room for 2 * blocks pixels each.
+ *      unsigned char *raw: Room for 6 * blocks bytes, for writeScanline.
+ *      void *scratch: FUSED_SCRATCH(blocks) bytes, for the kernels.
+ * 
+ * Return: None.
+ *      
+ * Expects: The block row overlaps the region.
+ * 
+ * Notes: An odd left edge of the region starts one pixel into the first
+ *        block.
+ *      
+ ************************/
+static void writeRegionRow(uint32_t *words, int blocks, int block_row,
+                           const struct Compress40_region *region,
+                           bool preview, struct Pnm_rgb *top,
+                           struct Pnm_rgb *bottom, unsigned char *raw,
+                           void *scratch)
+{
+        if (preview) {
+                previewRow(words, blocks, 255, top, scratch);
+                writeScanline(top, blocks, raw);
+                return;
+        }
+        decompressRow(words, blocks, 255, top, bottom, scratch);
+        unsigned skip = region->x % 2;
+        unsigned y = 2 * block_row;
+        if (y >= region->y) {
+                writeScanline(&top[skip], region->width, raw);
+        }
+        if (y + 1 < region->y + region->height) {
+                writeScanline(&bottom[skip], region->width, raw);
+        }
+}
+
+/********** compress40_sequence ********
+ *
+ * Purpose: Read in a sequence of PPM frames and write out a compressed
+ *          sequence in which each frame codes only the blocks that changed.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file holding one or more PPM images, one
+ *                   after another.
+ *      FILE *output: A pointer to a file to write to.
+ *      const struct Compress40_options *options: Whether to use the
+ *                                                fixed-point kernel; the
+ *                                                rest is not used.
+ * 
+ * Return: None.
+ *      
+ * Expects: Every frame is a valid PPM image and has the same size as the
+ *          first once trimmed to even dimensions.
+ * 
+ * Notes: After the header of FORMAT_SEQUENCE, each frame is a bitmap with
+ *        one bit per block, most significant bit first in row-major
+ *        order, padded to a byte, followed by the code words of the blocks
+ *        whose bits are set, written as by writeWords. A bit is set where
+ *        the block's code word differs from the last frame's; before the
+ *        first frame every code word is taken to be 0. For a raw 8-bit
+ *        frame, a block row whose two scanlines are byte for byte the same
+ *        as the last frame's keeps the last frame's code words without
+ *        running the kernel. Frames are compressed on the calling thread.
+ *        Raises a CRE if the input is empty or a frame has another size.
+ *      
+ ************************/
+void compress40_sequence(FILE *input, FILE *output,
+                         const struct Compress40_options *options)
+{
+        assert(input != NULL && output != NULL && options != NULL);
+        Compress40_buffers buffers = newCompress40Buffers();
+        PPMReader reader = openPPM(input);
+        unsigned w = reader->width & ~1u;
+        unsigned h = reader->height & ~1u;
+        int blocks_in_row = w / 2;
+        int block_rows = h / 2;
+        int n = blocks_in_row * block_rows;
+        size_t bitmap_bytes = (n + 7) / 8;
+        uint32_t *words = CALLOC(n > 0 ? n : 1, sizeof(uint32_t));
+        uint32_t *changed = CALLOC(n > 0 ? n : 1, sizeof(uint32_t));
+        uint32_t *row = CALLOC(blocks_in_row > 0 ? blocks_in_row : 1,
+                               sizeof(uint32_t));
+        unsigned char *bitmap = ALLOC(bitmap_bytes > 0 ? bitmap_bytes : 1);
+        unsigned char *previous = NULL;   /* raw scanlines of last frame */
+        size_t previous_stride = 0;
+        unsigned previous_denom = 0;
+        struct Pnm_rgb *scanlines = NULL;
+        void *scratch = reserve((void **) &buffers->scratch,
+                                &buffers->scratch_size,
+                                FUSED_SCRATCH(blocks_in_row > 0 ?
+                                              blocks_in_row : 1));
+        writeCompressedHeader(output, FORMAT_SEQUENCE, w, h);
+
+        while (reader != NULL) {
+                assert((reader->width & ~1u) == w &&
+                       (reader->height & ~1u) == h);
+                int cols = reader->width > 0 ? reader->width : 1;
+                bool raw = rawPPM(reader);
+                FixedScale fixed = NULL;
+                if (options->fixed) {
+                        fixed = bufferedScale(buffers, reader->denominator);
+                }
+                bool compare = raw && previous != NULL &&
+                               reader->stride == previous_stride &&
+                               reader->denominator == previous_denom;
+                if (raw && !compare) {
+                        FREE(previous);
+                        previous = ALLOC(h > 0 ? h * reader->stride : 1);
+                        previous_stride = reader->stride;
+                        previous_denom = reader->denominator;
+                } else if (!raw) {
+                        FREE(previous);
+                        scanlines = reserve((void **) &buffers->scanlines,
+                                            &buffers->scanlines_size,
+                                            2 * cols *
+                                            sizeof(struct Pnm_rgb));
+                }
+                memset(bitmap, 0, bitmap_bytes);
+                int count = 0;
+                for (int r = 0; r < block_rows; r++) {
+                        struct Band band = {
+                                .stride = reader->stride, .cols = cols,
+                                .rows = 1, .blocks_in_row = blocks_in_row,
+                                .denom = reader->denominator, .fixed = fixed,
+                                .words = row, .scratch = scratch
+                        };
+                        if (raw) {
+                                const unsigned char *lines =
+                                        readRawScanlines(reader, 2);
+                                unsigned char *last =
+                                        &previous[2 * r * reader->stride];
+                                if (compare && memcmp(lines, last, 2 *
+                                                      reader->stride) == 0) {
+                                        continue;
+                                }
+                                memcpy(last, lines, 2 * reader->stride);
+                                band.raw = lines;
+                        } else {
+                                readScanline(reader, scanlines);
+                                readScanline(reader, scanlines + cols);
+                                band.scanlines = scanlines;
+                        }
+                        compressBand(&band);
+                        uint32_t *current = &words[r * blocks_in_row];
+                        for (int b = 0; b < blocks_in_row; b++) {
+                                if (row[b] != current[b]) {
+                                        int i = r * blocks_in_row + b;
+                                        bitmap[i / 8] |= 0x80 >> (i % 8);
+                                        changed[count++] = row[b];
+                                        current[b] = row[b];
+                                }
+                        }
+                }
+                finishPPM(reader);
+                closePPM(&reader);
+                size_t written = fwrite(bitmap, 1, bitmap_bytes, output);
+                assert(written == bitmap_bytes);
+                writeWords(output, changed, count);
+
+                int c = getc(input);
+                if (c != EOF) {
+                        ungetc(c, input);
+                        reader = openPPM(input);
+                }
+        }
+        FREE(previous);
+        FREE(bitmap);
+        FREE(row);
+        FREE(changed);
+        FREE(words);
+        freeCompress40Buffers(&buffers);
+}
+
+/********** decompressSequence ********
+ *
+ * Purpose: Decode a compressed sequence and write out each frame as a PPM
+ *          image.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file positioned after the header.
+ *      unsigned width, height: The size of every frame, from the header.
+ * 
+ * Return: The number of frames.
+ *      
+ * Expects: The file is laid out as compress40_sequence writes it.
+ * 
+ * Notes: Keeps the code words and the bytes of the last frame. The whole
+ *        first frame is decoded; after that, each block row is decoded only
+ *        from its first to its last changed block, and the rest of the
+ *        frame keeps the last frame's pixels, which are what those code
+ *        words decode to. Each frame is written with one call. Frames are
+ *        read until the file ends; raises a CRE if it ends within one.
+ *      
+ ************************/
+static unsigned decompressSequence(FILE *input, unsigned width,
+                                   unsigned height)
+{
+        int blocks_in_row = width / 2;
+        int block_rows = height / 2;
+        int n = blocks_in_row * block_rows;
+        size_t bitmap_bytes = (n + 7) / 8;
+        size_t line = 3 * (size_t) width;
+        uint32_t *words = CALLOC(n > 0 ? n : 1, sizeof(uint32_t));
+        uint32_t *changed = CALLOC(n > 0 ? n : 1, sizeof(uint32_t));
+        unsigned char *bitmap = ALLOC(bitmap_bytes > 0 ? bitmap_bytes : 1);
+        /* Zeroed, so an odd last column or row comes out black as before */
+        unsigned char *frame = CALLOC(line * height > 0 ? line * height : 1,
+                                      1);
+        struct Pnm_rgb *top = CALLOC(width > 0 ? width : 1,
+                                     sizeof(struct Pnm_rgb));
+        struct Pnm_rgb *bottom = CALLOC(width > 0 ? width : 1,
+                                        sizeof(struct Pnm_rgb));
+        void *scratch = ALLOC(FUSED_SCRATCH(blocks_in_row > 0 ?
+                                            blocks_in_row : 1));
+        unsigned frames = 0;
+        for (bool first = true; ; first = false) {
+                if (!first) {
+                        int c = getc(input);
+                        if (c == EOF) {
+                                break;
+                        }
+                        ungetc(c, input);
+                }
+                size_t got = fread(bitmap, 1, bitmap_bytes, input);
+                assert(got == bitmap_bytes);
+                int count = 0;
+                for (size_t i = 0; i < bitmap_bytes; i++) {
+                        count += __builtin_popcount(bitmap[i]);
+                }
+                assert(count <= n);
+                readWords(input, changed, count);
+                int next = 0;
+                for (int r = 0; r < block_rows; r++) {
+                        uint32_t *current = &words[r * blocks_in_row];
+                        int lo = first ? 0 : blocks_in_row, hi = first ?
+                                 blocks_in_row - 1 : -1;
+                        for (int b = 0; b < blocks_in_row; b++) {
+                                int i = r * blocks_in_row + b;
+                                if (bitmap[i / 8] & (0x80 >> (i % 8))) {
+                                        current[b] = changed[next++];
+                                        lo = b < lo ? b : lo;
+                                        hi = b;
+                                }
+                        }
+                        if (lo > hi) {
+                                continue;
+                        }
+                        int span = hi - lo + 1;
+                        decompressRow(&current[lo], span, 255, top, bottom,
+                                      scratch);
+                        unsigned char *out = &frame[2 * r * line + 6 * lo];
+                        packScanline(top, 2 * span, out);
+                        packScanline(bottom, 2 * span, out + line);
+                }
+                writePPMHeader(width, height, 255);
+                writeRawScanlines(frame, width, height);
+                frames++;
+        }
+        FREE(scratch);
+        FREE(bottom);
+        FREE(top);
+        FREE(frame);
+        FREE(bitmap);
+        FREE(changed);
+        FREE(words);
+        return frames;
+}
+
+/********** transform40 ********
+ *
+ * Purpose: Read in a compressed image and write out the same image rotated
+ *          or flipped, in the same format.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file to read from.
+ *      FILE *output: A pointer to a file to write to.
+ *      int rotation: 0, 90, 180 or 270 degrees clockwise.
+ *      enum flip flip_type: A flip, or none.
+ * 
+ * Return: None.
+ *      
+ * Expects: The given file is an image that has been compressed; only one
+ *          of rotation and flip_type is given.
+ * 
+ * Notes: Works on the code words alone through transformWords: the pixels
+ *        are never decoded, so nothing is lost, and decompressing the
+ *        result gives exactly what ppmtrans makes of the decompressed
+ *        original, as the decoders group their sums to allow (see
+ *        transform.h). Entropy-coded and tiled images are decoded to code words
+ *        and coded again. Raises a CRE for a sequence of frames, or if the
+ *        file is too short or has bytes left over.
+ *      
+ ************************/
+void transform40(FILE *input, FILE *output, int rotation,
+                 enum flip flip_type)
+{
+        assert(input != NULL && output != NULL);
+        unsigned width, height;
+        int format = readCompressedHeader(input, &width, &height);
+        assert(format != FORMAT_SEQUENCE);
+        int blocks = (width / 2) * (height / 2);
+        uint32_t *words = CALLOC(blocks > 0 ? blocks : 1, sizeof(uint32_t));
+        uint32_t *out = CALLOC(blocks > 0 ? blocks : 1, sizeof(uint32_t));
+        readFormatWords(input, format, width, height, words);
+        int extra = getc(input);
+        assert(extra == EOF);
+        transformWords(words, width, height, rotation, flip_type, out,
+                       &width, &height);
+        writeFormatWords(output, format, width, height, out);
+        FREE(out);
+        FREE(words);
+}
+
+/********** decompress40_staged ********
+ *
+ * Purpose: Read in a compressed image and write out a PPM image.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file to read from.
+ * 
+ * Return: None.
+ *      
+ * Expects: The given file is an image that has been compressed.
+ * 
+ * Notes: decompress40_staged_stats without timing.
+ *      
+ ************************/
+void decompress40_staged(FILE *input)
+{
+        decompress40_staged_stats(input, NULL);
+}
+
+/********** decompress40_staged_stats ********
+ *
+ * Purpose: Read in a compressed image and write out a PPM image, timing
+ *          each stage.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file to read from.
+ *      Stats stats: The Stats to charge each stage to, or NULL.
+ * 
+ * Return: None.
+ *      
+ * Expects: The given file is an image that has been compressed.
+ * 
+ * Notes: Utilizes functions hidden in other modules to handle the decompression
+ *        process, one full pass over the image per stage. Each stage is
+ *        charged to the function that does it; setting up the code
+ *        information and the image goes to unpackWords and freeing to none.
+ *      
+ ************************/
+void decompress40_staged_stats(FILE *input, Stats stats)
 {
         A2Methods_T methods = uarray2_methods_blocked;
         assert(methods != NULL);
-        Seq_T code_words = Seq_new(0);
-        Seq_T code_info =  Seq_new(0);
-        struct Pnm_ppm pixmap = readCompressed(input, code_words);
+        statsStart(stats);
+        uint32_t *code_words;
+        struct Pnm_ppm pixmap = readCompressed(input, &code_words);
+        uint64_t pixels = (uint64_t) pixmap.width * pixmap.height;
+        statsMark(stats, "readCompressed", pixels);
+        int blocks;
+        CodeInfo_T code_info = newCodeInfo(pixmap.width, pixmap.height,
+                                           &blocks);
         A2 arrayCV = methods->new_with_blocksize(pixmap.width, pixmap.height, 
                                                  sizeof(struct Component_T), 
                                                  2);
         assert(arrayCV != NULL);
-        unpackWords(code_words, code_info);
+        unpackWords(code_words, blocks, code_info);
+        statsMark(stats, "unpackWords", pixels);
         dctToPS(arrayCV, code_info);
+        statsMark(stats, "dctToPS", pixels);
         decodeChroma(arrayCV, code_info);
+        statsMark(stats, "decodeChroma", pixels);
         cvToRGB(arrayCV, &pixmap);
+        statsMark(stats, "cvToRGB", pixels);
         writePPM(&pixmap);
+        statsMark(stats, "writePPM", pixels);
         methods->free(&arrayCV);
         methods->free(&(pixmap.pixels));
-        clearSeq(code_info);
-        Seq_free(&code_words);
+        FREE(code_info);
+        FREE(code_words);
 }
 
-/********** clearSeq ********
+/********** compressBand ********
  *
- * Purpose: Deallocates and frees the memory for a sequence containing elements
- *          of the CodeInfo_T struct.
+ * Purpose: Compute the code words of a band of block rows.
  *
  * Parameters: 
- *      Seq_T seq: The sequence to be freed.
+ *      void *cl: Pointer to the struct Band describing the band.
  * 
- * Return: None.
+ * Return: NULL.
  *      
- * Expects: The sequence contains pointers to CodeInfo_T objects.
+ * Expects: The band's scanlines have been read.
  * 
- * Notes: Frees all of the inner CodeInfo_T objects before using the free
- *        function from the Sequence interface.
+ * Notes: Has the signature of a pthread start routine. Raw scanlines go to
+ *        the compressors that read 8-bit samples directly. Only touches the
+ *        band's own scanlines and region of the word buffer, so bands can be
+ *        computed at the same time.
  *      
  ************************/
-void clearSeq(Seq_T seq)
+void *compressBand(void *cl)
 {
-        for (int i = 0; i < Seq_length(seq); i++) {
-                CodeInfo_T ct = Seq_get(seq, i);
-                FREE(ct);
+        struct Band *band = cl;
+        for (int r = 0; r < band->rows; r++) {
+                uint32_t *words = &band->words[r * band->blocks_in_row];
+                if (band->raw != NULL) {
+                        const unsigned char *top = band->raw +
+                                                   2 * r * band->stride;
+                        const unsigned char *bottom = top + band->stride;
+                        if (band->fixed != NULL) {
+                                compressRawRowFixed(top, bottom, band->fixed,
+                                                    band->blocks_in_row,
+                                                    words, band->scratch);
+                        } else {
+                                compressRawRow(top, bottom, band->denom,
+                                               band->blocks_in_row, words,
+                                               band->scratch);
+                        }
+                        continue;
+                }
+                struct Pnm_rgb *top = &band->scanlines[2 * r * band->cols];
+                if (band->fixed != NULL) {
+                        compressRowFixed(top, top + band->cols, band->fixed,
+                                         band->blocks_in_row, words,
+                                         band->scratch);
+                } else {
+                        compressRow(top, top + band->cols, band->denom,
+                                    band->blocks_in_row, words,
+                                    band->scratch);
+                }
         }
-        Seq_free(&seq);
-}
\ No newline at end of file
+        return NULL;
+}
+
+/********** newCodeInfo ********
+ *
+ * Purpose: Allocate the array of CodeInfo_T structs for an image, one struct
+ *          for each 2-by-2 block.
+ *
+ * Parameters: 
+ *      int width: Width of the image, in pixels.
+ *      int height: Height of the image, in pixels.
+ *      int *blocks: Set to the number of blocks in the image.
+ * 
+ * Return: A zeroed array with room for every block, in row-major order of the
+ *         blocks.
+ *      
+ * Expects: width and height are not negative; blocks is not NULL.
+ * 
+ * Notes: An odd last column or row is not part of any block. The array always
+ *        has at least one element so that an image too small to hold a block
+ *        still gets a valid pointer. Must be freed with FREE.
+ *      
+ ************************/
+CodeInfo_T newCodeInfo(int width, int height, int *blocks)
+{
+        assert(width >= 0 && height >= 0 && blocks != NULL);
+        *blocks = (width / 2) * (height / 2);
+        CodeInfo_T code_info = CALLOC(*blocks > 0 ? *blocks : 1,
+                                      sizeof(struct CodeInfo_T));
+        return code_info;
+}
@@ -0,0 +1,68 @@
+/*
+ *     compress40ext.h
+ * 
+ *     Purpose: Entry points beyond the compress40 interface. compress40 and
+ *              decompress40 stream the image through the fused kernels, and
+ *              compress40_opts spreads compression over several threads and
+ *              can use the fixed-point kernel and entropy code the words,
+ *              and compress40_buffered does the same into any file with
+ *              working memory that is kept for the next image;
+ *              decompress40_region decodes one rectangle of an image and
+ *              decompress40_preview a half-resolution image;
+ *              compress40_sequence codes a sequence of frames by what
+ *              changes from one to the next, which decompress40 reads;
+ *              transform40 rotates or flips a compressed image without
+ *              decoding its pixels;
+ *              compress40_staged and decompress40_staged keep the original
+ *              pipeline of separate passes so the two can be checked against
+ *              each other. The _stats forms, and the stats in the options,
+ *              time each stage of one image.
+ */
+
+#ifndef COMPRESS40EXT_H
+#define COMPRESS40EXT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "stats.h"
+#include "transform.h"
+
+/* How compress40_opts computes the code words */
+struct Compress40_options {
+        int threads;    /* threads to compute code words on, at least 1 */
+        bool fixed;     /* integer fixed-point kernel instead of float */
+        bool entropy;   /* entropy-coded format 3 instead of format 2 */
+        bool tiled;     /* entropy coded in tiles, format 4 */
+        Stats stats;    /* times the stages of one image, or NULL */
+};
+
+/* A rectangle of an image, in pixels */
+struct Compress40_region {
+        unsigned x, y;          /* top left corner */
+        unsigned width, height;
+};
+
+/* Working memory of compress40_buffered, kept between images */
+typedef struct Compress40_buffers *Compress40_buffers;
+
+void compress40_opts(FILE *input, const struct Compress40_options *options);
+Compress40_buffers newCompress40Buffers(void);
+void freeCompress40Buffers(Compress40_buffers *buffers);
+void compress40_buffered(FILE *input, FILE *output,
+                         const struct Compress40_options *options,
+                         Compress40_buffers buffers);
+void decompress40_region(FILE *input,
+                         const struct Compress40_region *region);
+void decompress40_preview(FILE *input,
+                          const struct Compress40_region *region);
+void compress40_sequence(FILE *input, FILE *output,
+                         const struct Compress40_options *options);
+void transform40(FILE *input, FILE *output, int rotation,
+                 enum flip flip_type);
+void compress40_staged(FILE *input);
+void decompress40_staged(FILE *input);
+void decompress40_stats(FILE *input, Stats stats);
+void compress40_staged_stats(FILE *input, Stats stats);
+void decompress40_staged_stats(FILE *input, Stats stats);
+
+#endif
@@ -10,9 +10,16 @@
  */
 
 #include "compvideo.h"
+#include <stddef.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 typedef A2Methods_UArray2 A2;
 
+/* Kernel chosen with useCVKernel; CV_KERNEL_AUTO picks the best supported */
+static CVKernel cv_kernel = CV_KERNEL_AUTO;
+
 struct mycl {
         Pnm_ppm pixmap; /* Pixmap of the original image with RGB values */
         A2Methods_T methods; /* Methods to act on a UArray2 */
@@ -20,7 +27,31 @@ struct mycl {
 
 void convertCV(int col, int row, A2 array2, A2Methods_Object *ptr, void *cl);
 void convertRGB(int col, int row, A2 array2, A2Methods_Object *ptr, void *cl);
-float roundRGB(float x, unsigned denom);
+static CVKernel currentKernel(void);
+static void rgbRowToCVScalar(const struct Pnm_rgb *pixels, int n,
+                             unsigned denom, float *Y, float *Pb, float *Pr);
+static void rawRowToCVScalar(const unsigned char *raw, int n, unsigned denom,
+                             float *Y, float *Pb, float *Pr);
+static void cvRowToRGBScalar(const float *Y, const float *Pb, const float *Pr,
+                             int n, unsigned denom, struct Pnm_rgb *pixels);
+#if defined(__x86_64__)
+static void rgbRowToCVSSE2(const struct Pnm_rgb *pixels, int n,
+                           unsigned denom, float *Y, float *Pb, float *Pr);
+static void rawRowToCVSSE2(const unsigned char *raw, int n, unsigned denom,
+                           float *Y, float *Pb, float *Pr);
+static inline void storeCVSSE2(__m128 r, __m128 g, __m128 b, float *Y,
+                               float *Pb, float *Pr);
+static void cvRowToRGBSSE2(const float *Y, const float *Pb, const float *Pr,
+                           int n, unsigned denom, struct Pnm_rgb *pixels);
+static void rgbRowToCVAVX2(const struct Pnm_rgb *pixels, int n,
+                           unsigned denom, float *Y, float *Pb, float *Pr);
+static void rawRowToCVAVX2(const unsigned char *raw, int n, unsigned denom,
+                           float *Y, float *Pb, float *Pr);
+static inline void storeCVAVX2(__m256 r, __m256 g, __m256 b, float *Y,
+                               float *Pb, float *Pr);
+static void cvRowToRGBAVX2(const float *Y, const float *Pb, const float *Pr,
+                           int n, unsigned denom, struct Pnm_rgb *pixels);
+#endif
 
 /********** rgbToCV ********
  *
@@ -212,4 +243,660 @@ float roundRGB(float x, unsigned denom)
         } else {
                 return denom;
         }
-}
\ No newline at end of file
+}
+
+/********** useCVKernel ********
+ *
+ * Purpose: Choose the implementation of rgbRowToCV and cvRowToRGB.
+ *
+ * Parameters: 
+ *      CVKernel kernel: The kernel to use, or CV_KERNEL_AUTO for the best one
+ *                       this CPU supports.
+ *      
+ * Return: true if the kernel is now in use, false if this CPU or build does
+ *         not support it, in which case the choice is unchanged.
+ *      
+ * Expects: No row conversion is running on another thread.
+ * 
+ * Notes: Also chooses the implementation of rawRowToCV. All kernels give the
+ *        same results, so this only matters for testing and timing.
+ *      
+ ************************/
+bool useCVKernel(CVKernel kernel)
+{
+        switch (kernel) {
+        case CV_KERNEL_AUTO:
+        case CV_KERNEL_SCALAR:
+                break;
+#if defined(__x86_64__)
+        case CV_KERNEL_SSE2:
+                break;
+        case CV_KERNEL_AVX2:
+                if (!__builtin_cpu_supports("avx2")) {
+                        return false;
+                }
+                break;
+#endif
+        default:
+                return false;
+        }
+        cv_kernel = kernel;
+        return true;
+}
+
+/********** rgbRowToCV ********
+ *
+ * Purpose: Convert a row of RGB pixels to component video.
+ *
+ * Parameters: 
+ *      const struct Pnm_rgb *pixels: The pixels.
+ *      int n: Number of pixels.
+ *      unsigned denom: Denominator of the RGB values.
+ *      float *Y, *Pb, *Pr: Arrays of n floats to hold the results.
+ *      
+ * Return: None.
+ *      
+ * Expects: denom is at least 1 and below 65536.
+ * 
+ * Notes: The same transformation as convertCV. The vector kernels convert 8
+ *        pixels per step and do the arithmetic in the same float and double
+ *        precision, in the same order, so all kernels agree bit for bit.
+ *      
+ ************************/
+void rgbRowToCV(const struct Pnm_rgb *pixels, int n, unsigned denom,
+                float *Y, float *Pb, float *Pr)
+{
+        switch (currentKernel()) {
+#if defined(__x86_64__)
+        case CV_KERNEL_AVX2:
+                rgbRowToCVAVX2(pixels, n, denom, Y, Pb, Pr);
+                return;
+        case CV_KERNEL_SSE2:
+                rgbRowToCVSSE2(pixels, n, denom, Y, Pb, Pr);
+                return;
+#endif
+        default:
+                rgbRowToCVScalar(pixels, n, denom, Y, Pb, Pr);
+                return;
+        }
+}
+
+/********** rawRowToCV ********
+ *
+ * Purpose: Convert a row of raw 8-bit PPM samples to component video.
+ *
+ * Parameters: 
+ *      const unsigned char *raw: Interleaved red, green and blue bytes.
+ *      int n: Number of pixels.
+ *      unsigned denom: Denominator of the RGB values.
+ *      float *Y, *Pb, *Pr: Arrays of n floats to hold the results.
+ *      
+ * Return: None.
+ *      
+ * Expects: raw holds 3 * n bytes; denom is at least 1 and below 256.
+ * 
+ * Notes: Gives exactly the results of rgbRowToCV on the same pixels, so a
+ *        raw scanline need not be widened into Pnm_rgb structs first.
+ *      
+ ************************/
+void rawRowToCV(const unsigned char *raw, int n, unsigned denom, float *Y,
+                float *Pb, float *Pr)
+{
+        switch (currentKernel()) {
+#if defined(__x86_64__)
+        case CV_KERNEL_AVX2:
+                rawRowToCVAVX2(raw, n, denom, Y, Pb, Pr);
+                return;
+        case CV_KERNEL_SSE2:
+                rawRowToCVSSE2(raw, n, denom, Y, Pb, Pr);
+                return;
+#endif
+        default:
+                rawRowToCVScalar(raw, n, denom, Y, Pb, Pr);
+                return;
+        }
+}
+
+/********** cvRowToRGB ********
+ *
+ * Purpose: Convert a row of component video pixels to RGB.
+ *
+ * Parameters: 
+ *      const float *Y, *Pb, *Pr: Arrays of n component video values.
+ *      int n: Number of pixels.
+ *      unsigned denom: Denominator of the RGB values.
+ *      struct Pnm_rgb *pixels: Array of n pixels to hold the results.
+ *      
+ * Return: None.
+ *      
+ * Expects: denom is below 65536.
+ * 
+ * Notes: The same transformation and bounds as convertRGB, with the same
+ *        agreement between kernels as rgbRowToCV.
+ *      
+ ************************/
+void cvRowToRGB(const float *Y, const float *Pb, const float *Pr, int n,
+                unsigned denom, struct Pnm_rgb *pixels)
+{
+        switch (currentKernel()) {
+#if defined(__x86_64__)
+        case CV_KERNEL_AVX2:
+                cvRowToRGBAVX2(Y, Pb, Pr, n, denom, pixels);
+                return;
+        case CV_KERNEL_SSE2:
+                cvRowToRGBSSE2(Y, Pb, Pr, n, denom, pixels);
+                return;
+#endif
+        default:
+                cvRowToRGBScalar(Y, Pb, Pr, n, denom, pixels);
+                return;
+        }
+}
+
+/********** currentKernel ********
+ *
+ * Purpose: Resolve the kernel in use.
+ *
+ * Parameters: None.
+ *      
+ * Return: The kernel chosen with useCVKernel, or for CV_KERNEL_AUTO the best
+ *         one this CPU supports.
+ *      
+ * Expects: None.
+ * 
+ * Notes: __builtin_cpu_supports reads flags filled in at startup, so this is
+ *        cheap enough to call once per row and safe to call from any thread.
+ *      
+ ************************/
+static CVKernel currentKernel(void)
+{
+        if (cv_kernel != CV_KERNEL_AUTO) {
+                return cv_kernel;
+        }
+#if defined(__x86_64__)
+        if (__builtin_cpu_supports("avx2")) {
+                return CV_KERNEL_AVX2;
+        }
+        return CV_KERNEL_SSE2;
+#else
+        return CV_KERNEL_SCALAR;
+#endif
+}
+
+/********** rgbRowToCVScalar ********
+ *
+ * Purpose: rgbRowToCV one pixel at a time.
+ *
+ * Parameters: As rgbRowToCV.
+ *      
+ * Return: None.
+ *      
+ * Expects: As rgbRowToCV.
+ * 
+ * Notes: Also finishes the pixels left over after the vector kernels' last
+ *        full step of 8.
+ *      
+ ************************/
+static void rgbRowToCVScalar(const struct Pnm_rgb *pixels, int n,
+                             unsigned denom, float *Y, float *Pb, float *Pr)
+{
+        for (int i = 0; i < n; i++) {
+                float r = (float) pixels[i].red / denom;
+                float g = (float) pixels[i].green / denom;
+                float b = (float) pixels[i].blue / denom;
+                Y[i] = 0.299 * r + 0.587 * g + 0.114 * b;
+                Pb[i] = -0.168736 * r - 0.331264 * g + 0.5 * b;
+                Pr[i] = 0.5 * r - 0.418688 * g - 0.081312 * b;
+        }
+}
+
+/********** rawRowToCVScalar ********
+ *
+ * Purpose: rawRowToCV one pixel at a time.
+ *
+ * Parameters: As rawRowToCV.
+ *      
+ * Return: None.
+ *      
+ * Expects: As rawRowToCV.
+ * 
+ * Notes: The same arithmetic as rgbRowToCVScalar. Also finishes the pixels
+ *        left over after the vector kernels' last full step of 8.
+ *      
+ ************************/
+static void rawRowToCVScalar(const unsigned char *raw, int n, unsigned denom,
+                             float *Y, float *Pb, float *Pr)
+{
+        for (int i = 0; i < n; i++, raw += 3) {
+                float r = (float) raw[0] / denom;
+                float g = (float) raw[1] / denom;
+                float b = (float) raw[2] / denom;
+                Y[i] = 0.299 * r + 0.587 * g + 0.114 * b;
+                Pb[i] = -0.168736 * r - 0.331264 * g + 0.5 * b;
+                Pr[i] = 0.5 * r - 0.418688 * g - 0.081312 * b;
+        }
+}
+
+/********** cvRowToRGBScalar ********
+ *
+ * Purpose: cvRowToRGB one pixel at a time.
+ *
+ * Parameters: As cvRowToRGB.
+ *      
+ * Return: None.
+ *      
+ * Expects: As cvRowToRGB.
+ * 
+ * Notes: Also finishes the pixels left over after the vector kernels' last
+ *        full step of 8.
+ *      
+ ************************/
+static void cvRowToRGBScalar(const float *Y, const float *Pb, const float *Pr,
+                             int n, unsigned denom, struct Pnm_rgb *pixels)
+{
+        for (int i = 0; i < n; i++) {
+                float r = (1.0 * Y[i] + 0.0 * Pb[i] + 1.402 * Pr[i]) * denom;
+                float g = (1.0 * Y[i] - 0.344136 * Pb[i] - 0.714136 * Pr[i])
+                          * denom;
+                float b = (1.0 * Y[i] + 1.772 * Pb[i] + 0.0 * Pr[i]) * denom;
+                pixels[i].red = (unsigned) roundRGB(r, denom);
+                pixels[i].green = (unsigned) roundRGB(g, denom);
+                pixels[i].blue = (unsigned) roundRGB(b, denom);
+        }
+}
+
+#if defined(__x86_64__)
+
+/*
+ * The vector kernels widen each float to double before the weighted sums,
+ * exactly as the scalar C expressions do, and use separate multiplies and
+ * adds (no fused multiply-add), so every intermediate rounds the same way.
+ */
+
+/* Weighted sum (w0 * x0 + w1 * x1) + w2 * x2 of two doubles per lane */
+#define SUM3_PD(w0, x0, w1, x1, w2, x2) \
+        _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_set1_pd(w0), x0), \
+                              _mm_mul_pd(_mm_set1_pd(w1), x1)), \
+                   _mm_mul_pd(_mm_set1_pd(w2), x2))
+#define SUM3_PD256(w0, x0, w1, x1, w2, x2) \
+        _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_set1_pd(w0), x0), \
+                                    _mm256_mul_pd(_mm256_set1_pd(w1), x1)), \
+                      _mm256_mul_pd(_mm256_set1_pd(w2), x2))
+
+/********** rgbRowToCVSSE2 ********
+ *
+ * Purpose: rgbRowToCV with SSE2, 8 pixels per step.
+ *
+ * Parameters: As rgbRowToCV.
+ *      
+ * Return: None.
+ *      
+ * Expects: As rgbRowToCV.
+ * 
+ * Notes: SSE2 is part of every x86-64 CPU, so this kernel needs no check.
+ *        The samples of 4 pixels at a time are divided as floats and handed
+ *        to storeCVSSE2.
+ *      
+ ************************/
+static void rgbRowToCVSSE2(const struct Pnm_rgb *pixels, int n,
+                           unsigned denom, float *Y, float *Pb, float *Pr)
+{
+        __m128 d = _mm_set1_ps((float) denom);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+                for (int h = i; h < i + 8; h += 4) {
+                        const struct Pnm_rgb *p = &pixels[h];
+                        __m128 r = _mm_div_ps(_mm_cvtepi32_ps(_mm_setr_epi32(
+                                p[0].red, p[1].red, p[2].red, p[3].red)), d);
+                        __m128 g = _mm_div_ps(_mm_cvtepi32_ps(_mm_setr_epi32(
+                                p[0].green, p[1].green, p[2].green,
+                                p[3].green)), d);
+                        __m128 b = _mm_div_ps(_mm_cvtepi32_ps(_mm_setr_epi32(
+                                p[0].blue, p[1].blue, p[2].blue, p[3].blue)),
+                                d);
+                        storeCVSSE2(r, g, b, &Y[h], &Pb[h], &Pr[h]);
+                }
+        }
+        rgbRowToCVScalar(&pixels[i], n - i, denom, &Y[i], &Pb[i], &Pr[i]);
+}
+
+/********** rawRowToCVSSE2 ********
+ *
+ * Purpose: rawRowToCV with SSE2, 8 pixels per step.
+ *
+ * Parameters: As rawRowToCV.
+ *      
+ * Return: None.
+ *      
+ * Expects: As rawRowToCV.
+ * 
+ * Notes: The same as rgbRowToCVSSE2, with the samples of 4 pixels taken
+ *        from 12 interleaved bytes.
+ *      
+ ************************/
+static void rawRowToCVSSE2(const unsigned char *raw, int n, unsigned denom,
+                           float *Y, float *Pb, float *Pr)
+{
+        __m128 d = _mm_set1_ps((float) denom);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+                for (int h = i; h < i + 8; h += 4) {
+                        const unsigned char *p = &raw[3 * h];
+                        __m128 r = _mm_div_ps(_mm_cvtepi32_ps(_mm_setr_epi32(
+                                p[0], p[3], p[6], p[9])), d);
+                        __m128 g = _mm_div_ps(_mm_cvtepi32_ps(_mm_setr_epi32(
+                                p[1], p[4], p[7], p[10])), d);
+                        __m128 b = _mm_div_ps(_mm_cvtepi32_ps(_mm_setr_epi32(
+                                p[2], p[5], p[8], p[11])), d);
+                        storeCVSSE2(r, g, b, &Y[h], &Pb[h], &Pr[h]);
+                }
+        }
+        rawRowToCVScalar(&raw[3 * i], n - i, denom, &Y[i], &Pb[i], &Pr[i]);
+}
+
+/********** storeCVSSE2 ********
+ *
+ * Purpose: Convert 4 pixels of scaled RGB to component video with SSE2.
+ *
+ * Parameters: 
+ *      __m128 r, g, b: The scaled samples of the 4 pixels.
+ *      float *Y, *Pb, *Pr: Arrays to hold the 4 results.
+ *      
+ * Return: None.
+ *      
+ * Expects: None.
+ * 
+ * Notes: Each group of 4 floats is widened into two pairs of doubles.
+ *        Subtractions are written as additions of negated weights where the
+ *        scalar expression negates a constant, and as subtractions where it
+ *        subtracts.
+ *      
+ ************************/
+static inline void storeCVSSE2(__m128 r, __m128 g, __m128 b, float *Y,
+                               float *Pb, float *Pr)
+{
+        for (int half = 0; half < 2; half++) {
+                __m128d rd = _mm_cvtps_pd(r);
+                __m128d gd = _mm_cvtps_pd(g);
+                __m128d bd = _mm_cvtps_pd(b);
+                __m128d y = SUM3_PD(0.299, rd, 0.587, gd, 0.114, bd);
+                __m128d pb = _mm_add_pd(_mm_sub_pd(
+                        _mm_mul_pd(_mm_set1_pd(-0.168736), rd),
+                        _mm_mul_pd(_mm_set1_pd(0.331264), gd)),
+                        _mm_mul_pd(_mm_set1_pd(0.5), bd));
+                __m128d pr = _mm_sub_pd(_mm_sub_pd(
+                        _mm_mul_pd(_mm_set1_pd(0.5), rd),
+                        _mm_mul_pd(_mm_set1_pd(0.418688), gd)),
+                        _mm_mul_pd(_mm_set1_pd(0.081312), bd));
+                int k = 2 * half;
+                _mm_storel_pi((__m64 *) &Y[k], _mm_cvtpd_ps(y));
+                _mm_storel_pi((__m64 *) &Pb[k], _mm_cvtpd_ps(pb));
+                _mm_storel_pi((__m64 *) &Pr[k], _mm_cvtpd_ps(pr));
+                /* Move the upper two floats down */
+                r = _mm_movehl_ps(r, r);
+                g = _mm_movehl_ps(g, g);
+                b = _mm_movehl_ps(b, b);
+        }
+}
+
+/********** cvRowToRGBSSE2 ********
+ *
+ * Purpose: cvRowToRGB with SSE2, 8 pixels per step.
+ *
+ * Parameters: As cvRowToRGB.
+ *      
+ * Return: None.
+ *      
+ * Expects: As cvRowToRGB.
+ * 
+ * Notes: The bounds of roundRGB become a maximum with 0 and a minimum with
+ *        denom, and the conversion to unsigned truncates toward zero.
+ *      
+ ************************/
+static void cvRowToRGBSSE2(const float *Y, const float *Pb, const float *Pr,
+                           int n, unsigned denom, struct Pnm_rgb *pixels)
+{
+        __m128d dd = _mm_set1_pd((double) denom);
+        __m128 lo = _mm_setzero_ps();
+        __m128 hi = _mm_set1_ps((float) denom);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+                for (int h = i; h < i + 8; h += 2) {
+                        __m128d y = _mm_cvtps_pd(_mm_castsi128_ps(
+                                _mm_loadl_epi64((const __m128i *) &Y[h])));
+                        __m128d pb = _mm_cvtps_pd(_mm_castsi128_ps(
+                                _mm_loadl_epi64((const __m128i *) &Pb[h])));
+                        __m128d pr = _mm_cvtps_pd(_mm_castsi128_ps(
+                                _mm_loadl_epi64((const __m128i *) &Pr[h])));
+                        __m128d rd = _mm_mul_pd(SUM3_PD(1.0, y, 0.0, pb,
+                                                        1.402, pr), dd);
+                        __m128d gd = _mm_mul_pd(_mm_sub_pd(_mm_sub_pd(
+                                _mm_mul_pd(_mm_set1_pd(1.0), y),
+                                _mm_mul_pd(_mm_set1_pd(0.344136), pb)),
+                                _mm_mul_pd(_mm_set1_pd(0.714136), pr)), dd);
+                        __m128d bd = _mm_mul_pd(SUM3_PD(1.0, y, 1.772, pb,
+                                                        0.0, pr), dd);
+                        __m128i r = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(
+                                _mm_cvtpd_ps(rd), lo), hi));
+                        __m128i g = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(
+                                _mm_cvtpd_ps(gd), lo), hi));
+                        __m128i b = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(
+                                _mm_cvtpd_ps(bd), lo), hi));
+                        pixels[h].red = _mm_cvtsi128_si32(r);
+                        pixels[h].green = _mm_cvtsi128_si32(g);
+                        pixels[h].blue = _mm_cvtsi128_si32(b);
+                        pixels[h + 1].red = _mm_cvtsi128_si32(
+                                _mm_srli_si128(r, 4));
+                        pixels[h + 1].green = _mm_cvtsi128_si32(
+                                _mm_srli_si128(g, 4));
+                        pixels[h + 1].blue = _mm_cvtsi128_si32(
+                                _mm_srli_si128(b, 4));
+                }
+        }
+        cvRowToRGBScalar(&Y[i], &Pb[i], &Pr[i], n - i, denom, &pixels[i]);
+}
+
+/********** rgbRowToCVAVX2 ********
+ *
+ * Purpose: rgbRowToCV with AVX2, 8 pixels per step.
+ *
+ * Parameters: As rgbRowToCV.
+ *      
+ * Return: None.
+ *      
+ * Expects: As rgbRowToCV; the CPU supports AVX2.
+ * 
+ * Notes: The 8 reds, greens and blues are gathered out of the interleaved
+ *        Pnm_rgb structs, divided as floats and handed to storeCVAVX2.
+ *      
+ ************************/
+__attribute__((target("avx2")))
+static void rgbRowToCVAVX2(const struct Pnm_rgb *pixels, int n,
+                           unsigned denom, float *Y, float *Pb, float *Pr)
+{
+        /* A channel repeats every stride ints of the Pnm_rgb array */
+        const int stride = sizeof(struct Pnm_rgb) / sizeof(int);
+        const __m256i index = _mm256_mullo_epi32(
+                _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                _mm256_set1_epi32(stride));
+        __m256 d = _mm256_set1_ps((float) denom);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+                const int *base = (const int *) &pixels[i];
+                __m256 r = _mm256_div_ps(_mm256_cvtepi32_ps(
+                        _mm256_i32gather_epi32(base, index, 4)), d);
+                __m256 g = _mm256_div_ps(_mm256_cvtepi32_ps(
+                        _mm256_i32gather_epi32(base + 1, index, 4)), d);
+                __m256 b = _mm256_div_ps(_mm256_cvtepi32_ps(
+                        _mm256_i32gather_epi32(base + 2, index, 4)), d);
+                storeCVAVX2(r, g, b, &Y[i], &Pb[i], &Pr[i]);
+        }
+        rgbRowToCVScalar(&pixels[i], n - i, denom, &Y[i], &Pb[i], &Pr[i]);
+}
+
+/********** rawRowToCVAVX2 ********
+ *
+ * Purpose: rawRowToCV with AVX2, 8 pixels per step.
+ *
+ * Parameters: As rawRowToCV.
+ *      
+ * Return: None.
+ *      
+ * Expects: As rawRowToCV; the CPU supports AVX2.
+ * 
+ * Notes: The 24 bytes of 8 pixels are loaded as 16 + 8 bytes (never past
+ *        the end of the row), the bytes of each channel are shuffled
+ *        together out of both and zero-extended to 8 ints.
+ *      
+ ************************/
+__attribute__((target("avx2")))
+static void rawRowToCVAVX2(const unsigned char *raw, int n, unsigned denom,
+                           float *Y, float *Pb, float *Pr)
+{
+        /* Where each channel's bytes sit in the first 16 and last 8 bytes;
+           -1 makes the shuffle write a zero */
+        const __m128i red_lo = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1,
+                                             -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i red_hi = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5,
+                                             -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i green_lo = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1,
+                                               -1, -1, -1, -1, -1, -1, -1,
+                                               -1);
+        const __m128i green_hi = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6,
+                                               -1, -1, -1, -1, -1, -1, -1,
+                                               -1);
+        const __m128i blue_lo = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1,
+                                              -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i blue_hi = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7,
+                                              -1, -1, -1, -1, -1, -1, -1, -1);
+        __m256 d = _mm256_set1_ps((float) denom);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+                const unsigned char *p = &raw[3 * i];
+                __m128i lo = _mm_loadu_si128((const __m128i *) p);
+                __m128i hi = _mm_loadl_epi64((const __m128i *) (p + 16));
+                __m256 r = _mm256_div_ps(_mm256_cvtepi32_ps(
+                        _mm256_cvtepu8_epi32(_mm_or_si128(
+                        _mm_shuffle_epi8(lo, red_lo),
+                        _mm_shuffle_epi8(hi, red_hi)))), d);
+                __m256 g = _mm256_div_ps(_mm256_cvtepi32_ps(
+                        _mm256_cvtepu8_epi32(_mm_or_si128(
+                        _mm_shuffle_epi8(lo, green_lo),
+                        _mm_shuffle_epi8(hi, green_hi)))), d);
+                __m256 b = _mm256_div_ps(_mm256_cvtepi32_ps(
+                        _mm256_cvtepu8_epi32(_mm_or_si128(
+                        _mm_shuffle_epi8(lo, blue_lo),
+                        _mm_shuffle_epi8(hi, blue_hi)))), d);
+                storeCVAVX2(r, g, b, &Y[i], &Pb[i], &Pr[i]);
+        }
+        rawRowToCVScalar(&raw[3 * i], n - i, denom, &Y[i], &Pb[i], &Pr[i]);
+}
+
+/********** storeCVAVX2 ********
+ *
+ * Purpose: Convert 8 pixels of scaled RGB to component video with AVX2.
+ *
+ * Parameters: 
+ *      __m256 r, g, b: The scaled samples of the 8 pixels.
+ *      float *Y, *Pb, *Pr: Arrays to hold the 8 results.
+ *      
+ * Return: None.
+ *      
+ * Expects: The CPU supports AVX2.
+ * 
+ * Notes: The floats are widened to two vectors of 4 doubles for the
+ *        weighted sums.
+ *      
+ ************************/
+__attribute__((target("avx2")))
+static inline void storeCVAVX2(__m256 r, __m256 g, __m256 b, float *Y,
+                               float *Pb, float *Pr)
+{
+        for (int half = 0; half < 2; half++) {
+                __m256d rd = _mm256_cvtps_pd(half == 0 ?
+                        _mm256_castps256_ps128(r) :
+                        _mm256_extractf128_ps(r, 1));
+                __m256d gd = _mm256_cvtps_pd(half == 0 ?
+                        _mm256_castps256_ps128(g) :
+                        _mm256_extractf128_ps(g, 1));
+                __m256d bd = _mm256_cvtps_pd(half == 0 ?
+                        _mm256_castps256_ps128(b) :
+                        _mm256_extractf128_ps(b, 1));
+                __m256d y = SUM3_PD256(0.299, rd, 0.587, gd, 0.114, bd);
+                __m256d pb = _mm256_add_pd(_mm256_sub_pd(
+                        _mm256_mul_pd(_mm256_set1_pd(-0.168736), rd),
+                        _mm256_mul_pd(_mm256_set1_pd(0.331264), gd)),
+                        _mm256_mul_pd(_mm256_set1_pd(0.5), bd));
+                __m256d pr = _mm256_sub_pd(_mm256_sub_pd(
+                        _mm256_mul_pd(_mm256_set1_pd(0.5), rd),
+                        _mm256_mul_pd(_mm256_set1_pd(0.418688), gd)),
+                        _mm256_mul_pd(_mm256_set1_pd(0.081312), bd));
+                int k = 4 * half;
+                _mm_storeu_ps(&Y[k], _mm256_cvtpd_ps(y));
+                _mm_storeu_ps(&Pb[k], _mm256_cvtpd_ps(pb));
+                _mm_storeu_ps(&Pr[k], _mm256_cvtpd_ps(pr));
+        }
+}
+
+/********** cvRowToRGBAVX2 ********
+ *
+ * Purpose: cvRowToRGB with AVX2, 8 pixels per step.
+ *
+ * Parameters: As cvRowToRGB.
+ *      
+ * Return: None.
+ *      
+ * Expects: As cvRowToRGB; the CPU supports AVX2.
+ * 
+ * Notes: The weighted sums are done on two vectors of 4 doubles, narrowed
+ *        to one vector of 8 floats for the bounds and truncation. The
+ *        results are stored to the interleaved Pnm_rgb structs one lane at a
+ *        time, since AVX2 has no scatter.
+ *      
+ ************************/
+__attribute__((target("avx2")))
+static void cvRowToRGBAVX2(const float *Y, const float *Pb, const float *Pr,
+                           int n, unsigned denom, struct Pnm_rgb *pixels)
+{
+        __m256d dd = _mm256_set1_pd((double) denom);
+        __m256 lo = _mm256_setzero_ps();
+        __m256 hi = _mm256_set1_ps((float) denom);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+                __m128 rf[2], gf[2], bf[2];
+                for (int half = 0; half < 2; half++) {
+                        int k = i + 4 * half;
+                        __m256d y = _mm256_cvtps_pd(_mm_loadu_ps(&Y[k]));
+                        __m256d pb = _mm256_cvtps_pd(_mm_loadu_ps(&Pb[k]));
+                        __m256d pr = _mm256_cvtps_pd(_mm_loadu_ps(&Pr[k]));
+                        rf[half] = _mm256_cvtpd_ps(_mm256_mul_pd(
+                                SUM3_PD256(1.0, y, 0.0, pb, 1.402, pr), dd));
+                        gf[half] = _mm256_cvtpd_ps(_mm256_mul_pd(
+                                _mm256_sub_pd(_mm256_sub_pd(
+                                _mm256_mul_pd(_mm256_set1_pd(1.0), y),
+                                _mm256_mul_pd(_mm256_set1_pd(0.344136), pb)),
+                                _mm256_mul_pd(_mm256_set1_pd(0.714136), pr)),
+                                dd));
+                        bf[half] = _mm256_cvtpd_ps(_mm256_mul_pd(
+                                SUM3_PD256(1.0, y, 1.772, pb, 0.0, pr), dd));
+                }
+                unsigned r[8], g[8], b[8];
+                _mm256_storeu_si256((__m256i *) r, _mm256_cvttps_epi32(
+                        _mm256_min_ps(_mm256_max_ps(
+                        _mm256_set_m128(rf[1], rf[0]), lo), hi)));
+                _mm256_storeu_si256((__m256i *) g, _mm256_cvttps_epi32(
+                        _mm256_min_ps(_mm256_max_ps(
+                        _mm256_set_m128(gf[1], gf[0]), lo), hi)));
+                _mm256_storeu_si256((__m256i *) b, _mm256_cvttps_epi32(
+                        _mm256_min_ps(_mm256_max_ps(
+                        _mm256_set_m128(bf[1], bf[0]), lo), hi)));
+                for (int k = 0; k < 8; k++) {
+                        pixels[i + k].red = r[k];
+                        pixels[i + k].green = g[k];
+                        pixels[i + k].blue = b[k];
+                }
+        }
+        cvRowToRGBScalar(&Y[i], &Pb[i], &Pr[i], n - i, denom, &pixels[i]);
+}
+
+#endif
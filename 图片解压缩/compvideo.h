@@ -3,7 +3,9 @@
  * 
  *     Purpose: Interface for compvideo. Contains two functions that allow for
  *              transformataion between RGB color space and component video
- *              color space.
+ *              color space, and row kernels doing the same for a scanline
+ *              of Pnm_rgb structs or of raw 8-bit samples with SIMD
+ *              instructions when the CPU has them.
  */
 
 #ifndef COMPVIDEO_H
@@ -15,11 +17,26 @@
 #include "a2blocked.h"
 #include "assert.h"
 #include "component.h"
+#include <stdbool.h>
 
 #define A2 A2Methods_UArray2
 
 A2 rgbToCV(Pnm_ppm pixmap);
 void cvToRGB(A2 arrayCV, Pnm_ppm pixmap);
+float roundRGB(float x, unsigned denom);
+
+/* Implementations of the row conversions */
+typedef enum CVKernel {
+        CV_KERNEL_AUTO = 0, CV_KERNEL_SCALAR, CV_KERNEL_SSE2, CV_KERNEL_AVX2
+} CVKernel;
+
+bool useCVKernel(CVKernel kernel);
+void rgbRowToCV(const struct Pnm_rgb *pixels, int n, unsigned denom,
+                float *Y, float *Pb, float *Pr);
+void rawRowToCV(const unsigned char *raw, int n, unsigned denom, float *Y,
+                float *Pb, float *Pr);
+void cvRowToRGB(const float *Y, const float *Pb, const float *Pr, int n,
+                unsigned denom, struct Pnm_rgb *pixels);
 
 #undef A2
 #endif 
\ No newline at end of file
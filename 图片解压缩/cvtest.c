@@ -0,0 +1,116 @@
+/*
+ *     cvtest.c
+ *
+ *     Purpose: Test program for the row kernels of compvideo. Converts rows of
+ *              random pixels with every kernel this CPU supports and checks
+ *              that the results match the scalar kernel: component video
+ *              values within FLOAT_TOLERANCE and RGB values within one step.
+ *              Row lengths that are not a multiple of 8 exercise the scalar
+ *              tail of the vector kernels. For denominators below 256 the
+ *              same pixels are also converted from raw bytes with
+ *              rawRowToCV, which must match rgbRowToCV exactly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "assert.h"
+#include "mem.h"
+#include "compvideo.h"
+
+#define MAX_N 67
+#define TRIALS 200
+#define FLOAT_TOLERANCE 1e-6
+
+static const char *kernel_names[] = { "auto", "scalar", "sse2", "avx2" };
+
+/* Values that matched within tolerance but not exactly */
+static int inexact;
+
+static int checkKernel(CVKernel kernel, unsigned denom, int n);
+
+int main(void)
+{
+        unsigned denoms[] = { 1, 7, 255, 1000, 65535 };
+        int failures = 0;
+        srand(40);
+        for (CVKernel k = CV_KERNEL_SSE2; k <= CV_KERNEL_AVX2; k++) {
+                if (!useCVKernel(k)) {
+                        printf("%-6s not supported, skipped\n",
+                               kernel_names[k]);
+                        continue;
+                }
+                int bad = 0;
+                inexact = 0;
+                for (unsigned d = 0; d < sizeof(denoms) / sizeof(*denoms);
+                     d++) {
+                        for (int t = 0; t < TRIALS; t++) {
+                                bad += checkKernel(k, denoms[d],
+                                                   rand() % (MAX_N + 1));
+                        }
+                }
+                printf("%-6s %s, %d values not bit-identical\n",
+                       kernel_names[k], bad == 0 ? "ok" : "MISMATCH",
+                       inexact);
+                failures += bad;
+        }
+        return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Convert a row of n random pixels to component video and back with both the
+ * given kernel and the scalar one, and count the values that differ by more
+ * than the tolerance. The component video values fed back are the scalar
+ * ones, so the two directions are checked separately. The raw conversion
+ * runs on the given kernel and is compared with its rgbRowToCV results.
+ */
+static int checkKernel(CVKernel kernel, unsigned denom, int n)
+{
+        struct Pnm_rgb pixels[MAX_N], out[2][MAX_N];
+        unsigned char raw[3 * MAX_N];
+        float cv[2][3][MAX_N], cv_raw[3][MAX_N];
+        int bad = 0;
+        for (int i = 0; i < n; i++) {
+                pixels[i].red = rand() % (denom + 1);
+                pixels[i].green = rand() % (denom + 1);
+                pixels[i].blue = rand() % (denom + 1);
+                raw[3 * i] = pixels[i].red;
+                raw[3 * i + 1] = pixels[i].green;
+                raw[3 * i + 2] = pixels[i].blue;
+        }
+        CVKernel kernels[2] = { CV_KERNEL_SCALAR, kernel };
+        for (int k = 0; k < 2; k++) {
+                bool ok = useCVKernel(kernels[k]);
+                assert(ok);
+                rgbRowToCV(pixels, n, denom, cv[k][0], cv[k][1], cv[k][2]);
+                cvRowToRGB(cv[0][0], cv[0][1], cv[0][2], n, denom, out[k]);
+        }
+        if (denom < 256) {
+                rawRowToCV(raw, n, denom, cv_raw[0], cv_raw[1], cv_raw[2]);
+                for (int i = 0; i < n; i++) {
+                        for (int c = 0; c < 3; c++) {
+                                bad += cv_raw[c][i] != cv[1][c][i];
+                        }
+                }
+        }
+        for (int i = 0; i < n; i++) {
+                for (int c = 0; c < 3; c++) {
+                        if (fabs(cv[0][c][i] - cv[1][c][i]) >
+                            FLOAT_TOLERANCE) {
+                                bad++;
+                        } else if (cv[0][c][i] != cv[1][c][i]) {
+                                inexact++;
+                        }
+                }
+                if (abs((int) out[0][i].red - (int) out[1][i].red) > 1 ||
+                    abs((int) out[0][i].green - (int) out[1][i].green) > 1 ||
+                    abs((int) out[0][i].blue - (int) out[1][i].blue) > 1) {
+                        bad++;
+                } else if (out[0][i].red != out[1][i].red ||
+                           out[0][i].green != out[1][i].green ||
+                           out[0][i].blue != out[1][i].blue) {
+                        inexact++;
+                }
+        }
+        return bad;
+}
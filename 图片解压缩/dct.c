@@ -14,8 +14,6 @@ typedef A2Methods_UArray2 A2;
 
 void calcDCT(int col, int row, A2 array2, A2Methods_Object *ptr, void *cl);
 void calc4Y(int col, int row, A2 array2, A2Methods_Object *ptr, void *cl);
-float roundAY(float x);
-float roundBCD(float x);
 
 /********** psToDCT ********
  *
@@ -24,23 +22,23 @@ float roundBCD(float x);
  *
  * Parameters: 
  *      A2 arrayCV: The 2D array with component video values.
- *      Seq_T seq: A sequence containing CodeInfo_T structs for each code word.
+ *      CodeInfo_T code_info: An array with a CodeInfo_T struct for each block.
  * 
  * Return: None.
  *      
- * Expects: The 2D array and the sequence have both been initialized.
+ * Expects: The 2D array and the CodeInfo_T array have both been initialized.
  * 
- * Notes: The sequence is updated with the cosine coefficients of each block.
+ * Notes: The array is updated with the cosine coefficients of each block.
  *        Utilizes an apply function to calculate the cosine coefficients of
  *        each block.
  *      
  ************************/
-void psToDCT(A2 arrayCV, Seq_T seq)
+void psToDCT(A2 arrayCV, CodeInfo_T code_info)
 {
-        assert(arrayCV != NULL && seq != NULL);
+        assert(arrayCV != NULL && code_info != NULL);
         A2Methods_T methods = uarray2_methods_blocked;
         assert(methods != NULL);
-        methods->map_block_major(arrayCV, calcDCT, seq);
+        methods->map_block_major(arrayCV, calcDCT, code_info);
 }
 
 /********** dctToPS ********
@@ -50,24 +48,24 @@ void psToDCT(A2 arrayCV, Seq_T seq)
  *
  * Parameters: 
  *      A2 arrayCV: The 2D array to hold component video values.
- *      Seq_T seq: The sequence pertaining to the code word to store the Y
- *                 values in.
+ *      CodeInfo_T code_info: An array with a CodeInfo_T struct for each code
+ *                            word.
  * 
  * Return: None.
  *      
- * Expects: The 2D array and the sequence have both been initialized.
+ * Expects: The 2D array and the CodeInfo_T array have both been initialized.
  * 
- * Notes: The sequence is updated with the Y values of each block.
+ * Notes: The 2D array is updated with the Y values of each block.
  *        Utilizes an apply function to calculate the Y values for each code
  *        word.
  *      
  ************************/
-void dctToPS(A2 arrayCV, Seq_T seq)
+void dctToPS(A2 arrayCV, CodeInfo_T code_info)
 {
-        assert(arrayCV != NULL && seq != NULL);
+        assert(arrayCV != NULL && code_info != NULL);
         A2Methods_T methods = uarray2_methods_blocked;
         assert(methods != NULL);
-        methods->map_block_major(arrayCV, calc4Y, seq);
+        methods->map_block_major(arrayCV, calc4Y, code_info);
 }
 
 /********** calcDCT ********
@@ -79,7 +77,7 @@ void dctToPS(A2 arrayCV, Seq_T seq)
  *      int row: Row index of the element.
  *      A2 array2: The 2D array with component video pixels.
  *      A2Methods_Object *ptr: Pointer to an element in the 2D array.
- *      void *cl: Pointer to a sequence.
+ *      void *cl: Pointer to the array of CodeInfo_T structs.
  * 
  * Return: None.
  *      
@@ -106,13 +104,9 @@ void calcDCT(int col, int row, A2 array2, A2Methods_Object *ptr, void *cl)
                 float Y2 = cp2->Y;
                 float Y3 = cp3->Y;
                 float Y4 = cp4->Y;
-                unsigned w = methods->width(array2);
-                unsigned blocks_in_row = w / 2;
-                /* Find the index of the block using the given indices */
-                int block = (col / 2) + (row / 2) * blocks_in_row;
-                /* Get the CodeInfo_T struct associated with said block */
-                CodeInfo_T ct = Seq_get((Seq_T)cl, block);
-                assert(ct != NULL);
+                int w = methods->width(array2);
+                /* Get the CodeInfo_T struct associated with the block */
+                CodeInfo_T ct = &((CodeInfo_T)cl)[CodeInfo_block(col, row, w)];
                 /* Transform from pixel space to DCT
                    Code a in 9 unsigned bits and b, c, d in 5 signed bits */
                 float a = roundAY((Y4 + Y3 + Y2 + Y1) / 4.0);
@@ -135,12 +129,12 @@ void calcDCT(int col, int row, A2 array2, A2Methods_Object *ptr, void *cl)
  *      int row: Row index of the element.
  *      A2 array2: The 2D array with component video pixels.
  *      A2Methods_Object *ptr: Pointer to an element in the 2D array.
- *      void *cl: Pointer to a sequence.
+ *      void *cl: Pointer to the array of CodeInfo_T structs.
  * 
  * Return: None.
  *      
- * Expects: The sequence in the closure has been intialized and contains
- *          CodeInfo_T structs whose cosine coefficients are defined.
+ * Expects: The array in the closure holds CodeInfo_T structs whose cosine
+ *          coefficients are defined.
  * 
  * Notes: Binds the Y values to fit within the range 0 to 1.
  *        
@@ -152,13 +146,9 @@ void calc4Y(int col, int row, A2 array2, A2Methods_Object *ptr, void *cl)
                 assert(array2 != NULL);
                 A2Methods_T methods = uarray2_methods_blocked;
                 assert(methods !=  NULL);
-                unsigned w = methods->width(array2);
-                unsigned blocks_in_row = w / 2;
-                /* Find the index of the block using the given indices */
-                int block = (col / 2) + (row / 2) * blocks_in_row;
-                /* Get the CodeInfo_T struct associated with said block */
-                CodeInfo_T ct = Seq_get((Seq_T)cl, block);
-                assert(ct != NULL);
+                int w = methods->width(array2);
+                /* Get the CodeInfo_T struct associated with the block */
+                CodeInfo_T ct = &((CodeInfo_T)cl)[CodeInfo_block(col, row, w)];
 
                 Component_T cp1 = ptr;
                 Component_T cp2 = methods->at(array2, col + 1, row);
@@ -169,10 +159,15 @@ void calc4Y(int col, int row, A2 array2, A2Methods_Object *ptr, void *cl)
                 float b = roundBCD(ct->b / 103.0);
                 float c = roundBCD(ct->c / 103.0);
                 float d = roundBCD(ct->d / 103.0);
-                cp1->Y = roundAY(a - b - c + d);
-                cp2->Y = roundAY(a - b + c - d);
-                cp3->Y = roundAY(a + b - c - d);
-                cp4->Y = roundAY(a + b + c + d);
+                /* a + d and b + c are summed first, and so are a - d and
+                   c - b: negating or swapping b, c and d, as transform
+                   does, then only trades the four sums, with no change
+                   from the order of the float additions */
+                float sum = a + d, diff = a - d, bc = b + c, cb = c - b;
+                cp1->Y = roundAY(sum - bc);
+                cp2->Y = roundAY(diff + cb);
+                cp3->Y = roundAY(diff - cb);
+                cp4->Y = roundAY(sum + bc);
         }
 }
 
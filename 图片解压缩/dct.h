@@ -8,7 +8,6 @@
 #ifndef DCT_H
 #define DCT_H
 
-#include "seq.h"
 #include "a2methods.h"
 #include "a2blocked.h"
 #include "component.h"
@@ -18,8 +17,10 @@
 
 #define A2 A2Methods_UArray2
 
-void psToDCT(A2 arrayCV, Seq_T seq);
-void dctToPS(A2 arrayCV, Seq_T seq);
+void psToDCT(A2 arrayCV, CodeInfo_T code_info);
+void dctToPS(A2 arrayCV, CodeInfo_T code_info);
+float roundAY(float x);
+float roundBCD(float x);
 
 #undef A2
 #endif
\ No newline at end of file
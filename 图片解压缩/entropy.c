@@ -0,0 +1,661 @@
+/*
+ *     entropy.c
+ *
+ *     Purpose: Implementation for entropy. Each field of the words of a
+ *              segment (a, b, c, d, Pb index, Pr index, as packWords lays
+ *              them out) is coded into a bitstream of its own. A segment is
+ *              stored as the number of bytes in each of the six streams (4
+ *              bytes each, big-endian), the code length of every symbol of
+ *              every field (4 bits each, two to a byte, field by field),
+ *              and the six streams, each most significant bit first and
+ *              padded with zero bits to a byte. Codes are canonical and at
+ *              most MAX_CODE_BITS long, so the reader decodes a symbol with
+ *              one lookup in a table indexed by the next MAX_CODE_BITS bits;
+ *              separate streams let it decode two fields at once, as two
+ *              chains of lookups that do not wait on each other.
+ */
+
+#include "entropy.h"
+#include "assert.h"
+#include "mem.h"
+#include <string.h>
+
+/* Fields in a code word, and symbols in the largest field */
+#define FIELDS 6
+#define MAX_SYMBOLS 64
+
+/* Bytes of stream sizes and code lengths at the start of a segment */
+#define HEAD_BYTES (4 * FIELDS + (4 * 64 + 2 * 16) / 2)
+
+/* Width and least significant bit of each field, in the order coded */
+static const int field_width[FIELDS] = { 6, 6, 6, 6, 4, 4 };
+static const int field_lsb[FIELDS] = { 26, 20, 14, 8, 4, 0 };
+
+struct EntropyWriter {
+        FILE *output;
+        int segment_words;      /* words in a full segment */
+        uint32_t *words;        /* words of the segment being filled */
+        int count;              /* words in it so far */
+        unsigned char *payload; /* room to code a full segment */
+};
+
+/* The position of a reader in the stream of one field */
+struct BitStream {
+        const unsigned char *in;        /* the stream's bytes */
+        size_t bytes, pos;              /* its length; next byte to load */
+        uint64_t acc;                   /* the next bits, at the top */
+        int bits;                       /* bits in acc */
+        uint64_t consumed;              /* bits decoded so far */
+};
+
+struct EntropyReader {
+        FILE *input;
+        int segment_words;
+        int remaining;          /* words not yet decoded */
+        uint32_t *words;        /* decoded words of the current segment */
+        int count, next;        /* words in it, and the next to hand out */
+        unsigned char *payload; /* coded bytes of the segment, 8 zeros after */
+        size_t payload_size;
+        /* symbol << 4 | code length, by the next MAX_CODE_BITS bits */
+        uint16_t table[FIELDS][1 << MAX_CODE_BITS];
+};
+
+static void flushSegment(EntropyWriter writer);
+static void decodeSegment(EntropyReader reader);
+static size_t maxStreamBytes(int count);
+static inline unsigned readSymbol(struct BitStream *stream,
+                                  const uint16_t *table);
+static void codeLengths(const uint32_t *freq, int n, uint8_t *lengths);
+static int huffmanLengths(const uint32_t *freq, int n, uint8_t *lengths);
+static void canonicalCodes(const uint8_t *lengths, int n, uint16_t *codes);
+
+/********** newEntropyWriter ********
+ *
+ * Purpose: Start writing the code words of an image in format 3.
+ *
+ * Parameters:
+ *      FILE *output: The file to write to, after the header.
+ *      int blocks_in_row: Number of blocks in a block row of the image.
+ *
+ * Return: A writer for entropyWriteWords.
+ *
+ * Expects: blocks_in_row is not negative.
+ *
+ * Notes: Memory is proportional to blocks_in_row. Must be closed with
+ *        closeEntropyWriter, which writes the last segment.
+ *
+ ************************/
+EntropyWriter newEntropyWriter(FILE *output, int blocks_in_row)
+{
+        assert(output != NULL && blocks_in_row >= 0);
+        EntropyWriter writer;
+        NEW(writer);
+        writer->output = output;
+        writer->segment_words = SEGMENT_ROWS * blocks_in_row;
+        int room = writer->segment_words > 0 ? writer->segment_words : 1;
+        writer->words = CALLOC(room, sizeof(uint32_t));
+        writer->count = 0;
+        writer->payload = ALLOC(FIELDS * maxStreamBytes(room));
+        return writer;
+}
+
+/********** entropyWriteWords ********
+ *
+ * Purpose: Write code words of an image in format 3.
+ *
+ * Parameters:
+ *      EntropyWriter writer: The writer from newEntropyWriter.
+ *      uint32_t *words: The next code words, in row-major order of the
+ *                       blocks.
+ *      int count: Number of code words.
+ *
+ * Return: None.
+ *
+ * Expects: The words of the whole image are written in order, in any
+ *          number of calls.
+ *
+ * Notes: The words are collected until a segment is full, which is then
+ *        coded and written, so the bytes do not depend on how the words are
+ *        split between calls.
+ *
+ ************************/
+void entropyWriteWords(EntropyWriter writer, uint32_t *words, int count)
+{
+        assert(writer != NULL && words != NULL && count >= 0);
+        while (count > 0) {
+                int take = writer->segment_words - writer->count;
+                assert(take > 0);
+                if (take > count) {
+                        take = count;
+                }
+                memcpy(&writer->words[writer->count], words,
+                       take * sizeof(uint32_t));
+                writer->count += take;
+                words += take;
+                count -= take;
+                if (writer->count == writer->segment_words) {
+                        flushSegment(writer);
+                }
+        }
+}
+
+/********** closeEntropyWriter ********
+ *
+ * Purpose: Write the last segment and free a writer.
+ *
+ * Parameters:
+ *      EntropyWriter *writer: Pointer to the writer.
+ *
+ * Return: None.
+ *
+ * Expects: writer and *writer are not NULL.
+ *
+ * Notes: Sets *writer to NULL. Does not close the file.
+ *
+ ************************/
+void closeEntropyWriter(EntropyWriter *writer)
+{
+        assert(writer != NULL && *writer != NULL);
+        flushSegment(*writer);
+        FREE((*writer)->payload);
+        FREE((*writer)->words);
+        FREE(*writer);
+}
+
+/********** newEntropyReader ********
+ *
+ * Purpose: Start reading the code words of an image in format 3.
+ *
+ * Parameters:
+ *      FILE *input: The file to read from, positioned after the header.
+ *      int blocks_in_row: Number of blocks in a block row of the image.
+ *      int block_rows: Number of block rows in the image.
+ *
+ * Return: A reader for entropyReadWords.
+ *
+ * Expects: Neither count is negative.
+ *
+ * Notes: Memory is proportional to blocks_in_row. Must be freed with
+ *        freeEntropyReader.
+ *
+ ************************/
+EntropyReader newEntropyReader(FILE *input, int blocks_in_row, int block_rows)
+{
+        assert(input != NULL && blocks_in_row >= 0 && block_rows >= 0);
+        EntropyReader reader;
+        NEW(reader);
+        reader->input = input;
+        reader->segment_words = SEGMENT_ROWS * blocks_in_row;
+        reader->remaining = blocks_in_row * block_rows;
+        reader->words = CALLOC(reader->segment_words > 0 ?
+                               reader->segment_words : 1, sizeof(uint32_t));
+        reader->count = 0;
+        reader->next = 0;
+        reader->payload = NULL;
+        reader->payload_size = 0;
+        return reader;
+}
+
+/********** entropyReadWords ********
+ *
+ * Purpose: Read code words of an image in format 3.
+ *
+ * Parameters:
+ *      EntropyReader reader: The reader from newEntropyReader.
+ *      uint32_t *words: Array to hold the code words.
+ *      int count: Number of code words to read.
+ *
+ * Return: None.
+ *
+ * Expects: words has room for count code words; no more words are read in
+ *          all than the image has.
+ *
+ * Notes: Segments are read and decoded as they are needed. Raises a CRE if
+ *        the file ends early or a segment is not validly coded.
+ *
+ ************************/
+void entropyReadWords(EntropyReader reader, uint32_t *words, int count)
+{
+        assert(reader != NULL && words != NULL && count >= 0);
+        while (count > 0) {
+                if (reader->next == reader->count) {
+                        decodeSegment(reader);
+                }
+                int take = reader->count - reader->next;
+                if (take > count) {
+                        take = count;
+                }
+                memcpy(words, &reader->words[reader->next],
+                       take * sizeof(uint32_t));
+                reader->next += take;
+                words += take;
+                count -= take;
+        }
+}
+
+/********** freeEntropyReader ********
+ *
+ * Purpose: Free a reader.
+ *
+ * Parameters:
+ *      EntropyReader *reader: Pointer to the reader.
+ *
+ * Return: None.
+ *
+ * Expects: reader and *reader are not NULL.
+ *
+ * Notes: Sets *reader to NULL. Does not close the file.
+ *
+ ************************/
+void freeEntropyReader(EntropyReader *reader)
+{
+        assert(reader != NULL && *reader != NULL);
+        FREE((*reader)->payload);
+        FREE((*reader)->words);
+        FREE(*reader);
+}
+
+/********** flushSegment ********
+ *
+ * Purpose: Code and write the words collected by a writer.
+ *
+ * Parameters:
+ *      EntropyWriter writer: The writer.
+ *
+ * Return: None.
+ *
+ * Expects: None.
+ *
+ * Notes: Does nothing if no words have been collected. Each field gets a
+ *        code built from the counts of its symbols in this segment, and
+ *        its stream is coded in a pass of its own. Codes are put into a
+ *        64-bit accumulator and written 32 bits at a time.
+ *
+ ************************/
+static void flushSegment(EntropyWriter writer)
+{
+        int count = writer->count;
+        if (count == 0) {
+                return;
+        }
+        uint32_t freq[FIELDS][MAX_SYMBOLS] = { { 0 } };
+        for (int i = 0; i < count; i++) {
+                uint32_t word = writer->words[i];
+                for (int f = 0; f < FIELDS; f++) {
+                        unsigned mask = (1u << field_width[f]) - 1;
+                        freq[f][(word >> field_lsb[f]) & mask]++;
+                }
+        }
+        uint8_t lengths[FIELDS][MAX_SYMBOLS];
+        uint16_t codes[FIELDS][MAX_SYMBOLS];
+        unsigned char head[HEAD_BYTES];
+        int nibble = 0;
+        memset(head, 0, sizeof(head));
+        for (int f = 0; f < FIELDS; f++) {
+                int n = 1 << field_width[f];
+                codeLengths(freq[f], n, lengths[f]);
+                canonicalCodes(lengths[f], n, codes[f]);
+                for (int s = 0; s < n; s++, nibble++) {
+                        head[4 * FIELDS + nibble / 2] |=
+                                lengths[f][s] << (nibble % 2 == 0 ? 4 : 0);
+                }
+        }
+
+        unsigned char *out = writer->payload;
+        size_t pos = 0;
+        for (int f = 0; f < FIELDS; f++) {
+                size_t start = pos;
+                unsigned mask = (1u << field_width[f]) - 1;
+                uint64_t acc = 0;
+                int bits = 0;           /* bits in acc not yet written */
+                for (int i = 0; i < count; i++) {
+                        unsigned s = (writer->words[i] >> field_lsb[f]) &
+                                     mask;
+                        acc = (acc << lengths[f][s]) | codes[f][s];
+                        bits += lengths[f][s];
+                        if (bits >= 32) {
+                                bits -= 32;
+                                uint32_t top = acc >> bits;
+                                out[pos] = top >> 24;
+                                out[pos + 1] = top >> 16;
+                                out[pos + 2] = top >> 8;
+                                out[pos + 3] = top;
+                                pos += 4;
+                        }
+                }
+                while (bits > 0) {
+                        if (bits >= 8) {
+                                bits -= 8;
+                                out[pos++] = acc >> bits;
+                        } else {
+                                out[pos++] = acc << (8 - bits);
+                                bits = 0;
+                        }
+                }
+                size_t bytes = pos - start;
+                head[4 * f] = bytes >> 24;
+                head[4 * f + 1] = bytes >> 16;
+                head[4 * f + 2] = bytes >> 8;
+                head[4 * f + 3] = bytes;
+        }
+
+        size_t written = fwrite(head, 1, sizeof(head), writer->output);
+        assert(written == sizeof(head));
+        written = fwrite(out, 1, pos, writer->output);
+        assert(written == pos);
+        writer->count = 0;
+}
+
+/********** decodeSegment ********
+ *
+ * Purpose: Read and decode the next segment of a reader.
+ *
+ * Parameters:
+ *      EntropyReader reader: The reader.
+ *
+ * Return: None.
+ *
+ * Expects: Words remain to be decoded.
+ *
+ * Notes: Raises a CRE if the file ends early, a stream is longer than a
+ *        segment of words could need, a code length is out of range, the
+ *        lengths of a field do not form a prefix code, a code is not in the
+ *        table, or a field takes more bits than its stream has.
+ *
+ ************************/
+static void decodeSegment(EntropyReader reader)
+{
+        int count = reader->remaining < reader->segment_words ?
+                    reader->remaining : reader->segment_words;
+        assert(count > 0);
+        unsigned char head[HEAD_BYTES];
+        size_t got = fread(head, 1, sizeof(head), reader->input);
+        assert(got == sizeof(head));
+        struct BitStream streams[FIELDS];
+        size_t total = 0;
+        for (int f = 0; f < FIELDS; f++) {
+                const unsigned char *b = &head[4 * f];
+                size_t bytes = ((size_t) b[0] << 24) | ((size_t) b[1] << 16) |
+                               ((size_t) b[2] << 8) | b[3];
+                assert(bytes <= maxStreamBytes(count));
+                streams[f] = (struct BitStream) {
+                        .bytes = bytes, .pos = total, .acc = 0, .bits = 0,
+                        .consumed = 0
+                };
+                total += bytes;
+        }
+        if (total > reader->payload_size || reader->payload == NULL) {
+                FREE(reader->payload);
+                reader->payload = ALLOC(total + 8);
+                reader->payload_size = total;
+        }
+        got = fread(reader->payload, 1, total, reader->input);
+        assert(got == total);
+        memset(reader->payload + total, 0, 8);
+        for (int f = 0; f < FIELDS; f++) {
+                streams[f].in = reader->payload + streams[f].pos;
+                streams[f].pos = 0;
+        }
+
+        int nibble = 0;
+        for (int f = 0; f < FIELDS; f++) {
+                int n = 1 << field_width[f];
+                uint8_t lengths[MAX_SYMBOLS];
+                uint16_t codes[MAX_SYMBOLS];
+                uint32_t kraft = 0;
+                for (int s = 0; s < n; s++, nibble++) {
+                        lengths[s] = (head[4 * FIELDS + nibble / 2] >>
+                                      (nibble % 2 == 0 ? 4 : 0)) & 0xF;
+                        assert(lengths[s] <= MAX_CODE_BITS);
+                        if (lengths[s] > 0) {
+                                kraft += 1u << (MAX_CODE_BITS - lengths[s]);
+                        }
+                }
+                assert(kraft <= 1u << MAX_CODE_BITS);
+                canonicalCodes(lengths, n, codes);
+                uint16_t *table = reader->table[f];
+                memset(table, 0, sizeof(reader->table[f]));
+                for (int s = 0; s < n; s++) {
+                        if (lengths[s] == 0) {
+                                continue;
+                        }
+                        int spread = MAX_CODE_BITS - lengths[s];
+                        uint16_t entry = (s << 4) | lengths[s];
+                        for (int k = 0; k < 1 << spread; k++) {
+                                table[(codes[s] << spread) | k] = entry;
+                        }
+                }
+        }
+
+        /* Two fields at a time, in locals the compiler can keep in
+           registers */
+        uint32_t *words = reader->words;
+        memset(words, 0, count * sizeof(uint32_t));
+        for (int f = 0; f < FIELDS; f += 2) {
+                struct BitStream first = streams[f];
+                struct BitStream second = streams[f + 1];
+                const uint16_t *first_table = reader->table[f];
+                const uint16_t *second_table = reader->table[f + 1];
+                int first_lsb = field_lsb[f], second_lsb = field_lsb[f + 1];
+                for (int i = 0; i < count; i++) {
+                        uint32_t x = readSymbol(&first, first_table);
+                        uint32_t y = readSymbol(&second, second_table);
+                        words[i] |= (x << first_lsb) | (y << second_lsb);
+                }
+                assert(first.consumed <= 8 * (uint64_t) first.bytes);
+                assert(second.consumed <= 8 * (uint64_t) second.bytes);
+        }
+        reader->count = count;
+        reader->next = 0;
+        reader->remaining -= count;
+}
+
+/********** readSymbol ********
+ *
+ * Purpose: Decode the next symbol of a field's stream.
+ *
+ * Parameters:
+ *      struct BitStream *stream: The stream.
+ *      const uint16_t *table: The field's decode table.
+ *
+ * Return: The symbol.
+ *
+ * Expects: None.
+ *
+ * Notes: The accumulator is refilled with the next 8 bytes whenever fewer
+ *        bits than the longest code are left in it; bytes past the end of
+ *        the stream are those of the next stream or the zeros after the
+ *        last, and are only decoded from a stream that is too short, which
+ *        the caller catches through consumed. Raises a CRE if the next bits
+ *        are not a code.
+ *
+ ************************/
+static inline unsigned readSymbol(struct BitStream *stream,
+                                  const uint16_t *table)
+{
+        if (stream->bits < MAX_CODE_BITS) {
+                size_t pos = stream->pos < stream->bytes ? stream->pos :
+                             stream->bytes;
+                const unsigned char *b = &stream->in[pos];
+                uint64_t next = ((uint64_t) b[0] << 56) |
+                                ((uint64_t) b[1] << 48) |
+                                ((uint64_t) b[2] << 40) |
+                                ((uint64_t) b[3] << 32) |
+                                ((uint64_t) b[4] << 24) |
+                                ((uint64_t) b[5] << 16) |
+                                ((uint64_t) b[6] << 8) | b[7];
+                stream->acc |= next >> stream->bits;
+                stream->pos = pos + ((63 - stream->bits) >> 3);
+                stream->bits |= 56;
+        }
+        uint16_t entry = table[stream->acc >> (64 - MAX_CODE_BITS)];
+        int length = entry & 0xF;
+        assert(length != 0);
+        stream->acc <<= length;
+        stream->bits -= length;
+        stream->consumed += length;
+        return entry >> 4;
+}
+
+/********** maxStreamBytes ********
+ *
+ * Purpose: Bound the size of a field's stream.
+ *
+ * Parameters:
+ *      int count: Number of words in the segment.
+ *
+ * Return: The most bytes count symbols of at most MAX_CODE_BITS can take.
+ *
+ * Expects: count is not negative.
+ *
+ * Notes: None.
+ *
+ ************************/
+static size_t maxStreamBytes(int count)
+{
+        return ((size_t) count * MAX_CODE_BITS + 7) / 8;
+}
+
+/********** codeLengths ********
+ *
+ * Purpose: Choose the code length of each symbol of a field.
+ *
+ * Parameters:
+ *      const uint32_t *freq: Count of each symbol.
+ *      int n: Number of symbols.
+ *      uint8_t *lengths: Set to the code length of each symbol, 0 for a
+ *                        symbol that does not occur.
+ *
+ * Return: None.
+ *
+ * Expects: n is at most MAX_SYMBOLS.
+ *
+ * Notes: Huffman code lengths. If a code would be longer than
+ *        MAX_CODE_BITS, the counts are halved (a count of 1 stays 1) and the
+ *        code is built again, which flattens the tree until it fits; with
+ *        every count 1 no code is longer than log2(n) bits.
+ *
+ ************************/
+static void codeLengths(const uint32_t *freq, int n, uint8_t *lengths)
+{
+        uint32_t scaled[MAX_SYMBOLS];
+        memcpy(scaled, freq, n * sizeof(uint32_t));
+        while (huffmanLengths(scaled, n, lengths) > MAX_CODE_BITS) {
+                for (int s = 0; s < n; s++) {
+                        scaled[s] = (scaled[s] + 1) / 2;
+                }
+        }
+}
+
+/********** huffmanLengths ********
+ *
+ * Purpose: Compute Huffman code lengths.
+ *
+ * Parameters:
+ *      const uint32_t *freq: Count of each symbol.
+ *      int n: Number of symbols.
+ *      uint8_t *lengths: Set to the code length of each symbol.
+ *
+ * Return: The longest code length.
+ *
+ * Expects: n is at most MAX_SYMBOLS.
+ *
+ * Notes: Uses the two-queue construction: symbols sorted by count (then by
+ *        symbol, so the result is deterministic) are merged with the
+ *        internal nodes in the order they are made, taking a leaf on ties.
+ *        A single symbol gets a 1-bit code.
+ *
+ ************************/
+static int huffmanLengths(const uint32_t *freq, int n, uint8_t *lengths)
+{
+        int order[MAX_SYMBOLS];
+        int used = 0;
+        for (int s = 0; s < n; s++) {
+                lengths[s] = 0;
+                if (freq[s] > 0) {
+                        /* Insertion sort by count, stable in symbol */
+                        int k = used++;
+                        while (k > 0 && freq[order[k - 1]] > freq[s]) {
+                                order[k] = order[k - 1];
+                                k--;
+                        }
+                        order[k] = s;
+                }
+        }
+        if (used <= 1) {
+                if (used == 1) {
+                        lengths[order[0]] = 1;
+                }
+                return used;
+        }
+        uint64_t weight[2 * MAX_SYMBOLS];
+        int parent[2 * MAX_SYMBOLS];
+        for (int i = 0; i < used; i++) {
+                weight[i] = freq[order[i]];
+        }
+        int leaf = 0, node = used, made = used;
+        while (made < 2 * used - 1) {
+                int pick[2];
+                for (int k = 0; k < 2; k++) {
+                        if (leaf < used &&
+                            (node >= made || weight[leaf] <= weight[node])) {
+                                pick[k] = leaf++;
+                        } else {
+                                pick[k] = node++;
+                        }
+                }
+                weight[made] = weight[pick[0]] + weight[pick[1]];
+                parent[pick[0]] = parent[pick[1]] = made;
+                made++;
+        }
+        /* Parents come after their children, so depths fill in backwards */
+        int depth[2 * MAX_SYMBOLS];
+        int longest = 0;
+        depth[made - 1] = 0;
+        for (int i = made - 2; i >= 0; i--) {
+                depth[i] = depth[parent[i]] + 1;
+        }
+        for (int i = 0; i < used; i++) {
+                lengths[order[i]] = depth[i];
+                if (depth[i] > longest) {
+                        longest = depth[i];
+                }
+        }
+        return longest;
+}
+
+/********** canonicalCodes ********
+ *
+ * Purpose: Assign canonical codes from code lengths.
+ *
+ * Parameters:
+ *      const uint8_t *lengths: Code length of each symbol, 0 if unused.
+ *      int n: Number of symbols.
+ *      uint16_t *codes: Set to the code of each symbol.
+ *
+ * Return: None.
+ *
+ * Expects: Every length is at most MAX_CODE_BITS and the lengths satisfy
+ *          the Kraft inequality.
+ *
+ * Notes: Shorter codes come first, and codes of the same length are in
+ *        order of symbol, so the lengths alone determine the codes.
+ *
+ ************************/
+static void canonicalCodes(const uint8_t *lengths, int n, uint16_t *codes)
+{
+        int per_length[MAX_CODE_BITS + 1] = { 0 };
+        for (int s = 0; s < n; s++) {
+                per_length[lengths[s]]++;
+        }
+        per_length[0] = 0;
+        uint16_t next[MAX_CODE_BITS + 1];
+        uint16_t code = 0;
+        for (int bits = 1; bits <= MAX_CODE_BITS; bits++) {
+                code = (code + per_length[bits - 1]) << 1;
+                next[bits] = code;
+        }
+        for (int s = 0; s < n; s++) {
+                codes[s] = lengths[s] > 0 ? next[lengths[s]]++ : 0;
+        }
+}
@@ -0,0 +1,38 @@
+/*
+ *     entropy.h
+ *
+ *     Purpose: Interface for entropy. Reads and writes the code words of a
+ *              compressed image in format 3, where the six fields of each
+ *              word are coded with canonical Huffman codes instead of being
+ *              stored as fixed 32-bit words. The words are coded in
+ *              segments of SEGMENT_ROWS block rows, each with its own code
+ *              tables, so a writer needs only one segment of words in
+ *              memory and a reader can hand out words a block row at a
+ *              time.
+ */
+
+#ifndef ENTROPY_H
+#define ENTROPY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Block rows of code words in each coded segment */
+#define SEGMENT_ROWS 64
+
+/* Longest Huffman code, in bits; also the index width of the decode table */
+#define MAX_CODE_BITS 12
+
+typedef struct EntropyWriter *EntropyWriter;
+typedef struct EntropyReader *EntropyReader;
+
+EntropyWriter newEntropyWriter(FILE *output, int blocks_in_row);
+void entropyWriteWords(EntropyWriter writer, uint32_t *words, int count);
+void closeEntropyWriter(EntropyWriter *writer);
+
+EntropyReader newEntropyReader(FILE *input, int blocks_in_row,
+                               int block_rows);
+void entropyReadWords(EntropyReader reader, uint32_t *words, int count);
+void freeEntropyReader(EntropyReader *reader);
+
+#endif
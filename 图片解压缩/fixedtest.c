@@ -0,0 +1,154 @@
+/*
+ *     fixedtest.c
+ *
+ *     Purpose: Test program for the fixed-point compressor of fused. Builds
+ *              smooth images with a little noise, compresses each with both
+ *              compressRow and compressRowFixed, decompresses both sets of
+ *              code words with decompressRow and measures the PSNR of each
+ *              result against the original. The fixed-point result must
+ *              reach MIN_PSNR and come within PSNR_MARGIN of the float one.
+ *              Also reports how many code words the two compressors agree
+ *              on.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdbool.h>
+#include "assert.h"
+#include "mem.h"
+#include "fused.h"
+
+#define WIDTH 96
+#define HEIGHT 64
+#define IMAGES 20
+
+/* Lowest acceptable PSNR of the fixed-point result, in dB; the 4-bit chroma
+ * keeps the float result of these images near 21.7 dB */
+#define MIN_PSNR 20.0
+
+/* How far below the float result's PSNR the fixed-point one may fall, in dB */
+#define PSNR_MARGIN 0.1
+
+static void makeImage(struct Pnm_rgb *pixels, unsigned denom, int seed);
+static double roundTrip(struct Pnm_rgb *pixels, unsigned denom, bool fixed,
+                        uint32_t *words);
+
+int main(void)
+{
+        unsigned denoms[] = { 255, 1000, 65535 };
+        struct Pnm_rgb *pixels = CALLOC(WIDTH * HEIGHT,
+                                        sizeof(struct Pnm_rgb));
+        int n = (WIDTH / 2) * (HEIGHT / 2);
+        uint32_t *float_words = CALLOC(n, sizeof(uint32_t));
+        uint32_t *fixed_words = CALLOC(n, sizeof(uint32_t));
+        int failures = 0;
+        srand(40);
+        for (unsigned d = 0; d < sizeof(denoms) / sizeof(*denoms); d++) {
+                double worst = INFINITY, worst_drop = -INFINITY;
+                long same = 0, total = 0;
+                for (int i = 0; i < IMAGES; i++) {
+                        makeImage(pixels, denoms[d], i);
+                        double float_psnr = roundTrip(pixels, denoms[d],
+                                                      false, float_words);
+                        double fixed_psnr = roundTrip(pixels, denoms[d],
+                                                      true, fixed_words);
+                        for (int w = 0; w < n; w++) {
+                                same += float_words[w] == fixed_words[w];
+                        }
+                        total += n;
+                        if (fixed_psnr < worst) {
+                                worst = fixed_psnr;
+                        }
+                        if (float_psnr - fixed_psnr > worst_drop) {
+                                worst_drop = float_psnr - fixed_psnr;
+                        }
+                }
+                bool ok = worst >= MIN_PSNR && worst_drop <= PSNR_MARGIN;
+                printf("denom %-5u %s, worst PSNR %.2f dB, at most %.3f dB "
+                       "below float, %.2f%% of words identical\n", denoms[d],
+                       ok ? "ok" : "FAIL", worst, worst_drop,
+                       100.0 * same / total);
+                failures += !ok;
+        }
+        FREE(fixed_words);
+        FREE(float_words);
+        FREE(pixels);
+        return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Fill a WIDTH by HEIGHT image with smooth gradients and ripples that differ
+ * with the seed, plus up to 2% of noise, clamped to the denominator.
+ */
+static void makeImage(struct Pnm_rgb *pixels, unsigned denom, int seed)
+{
+        for (int row = 0; row < HEIGHT; row++) {
+                for (int col = 0; col < WIDTH; col++) {
+                        double x = (double) col / WIDTH;
+                        double y = (double) row / HEIGHT;
+                        double v[3] = {
+                                0.5 + 0.4 * sin(6 * x + seed),
+                                x * y + 0.1 * cos(9 * y - seed),
+                                0.5 + 0.3 * sin(4 * (x + y) * (seed + 1))
+                        };
+                        unsigned out[3];
+                        for (int c = 0; c < 3; c++) {
+                                v[c] += 0.02 * (rand() / (double) RAND_MAX -
+                                                0.5);
+                                v[c] = v[c] < 0 ? 0 : v[c] > 1 ? 1 : v[c];
+                                out[c] = lround(v[c] * denom);
+                        }
+                        pixels[row * WIDTH + col] = (struct Pnm_rgb) {
+                                out[0], out[1], out[2]
+                        };
+                }
+        }
+}
+
+/*
+ * Compress the image one block row at a time with the float or fixed-point
+ * compressor, keeping the code words in words, decompress them with
+ * decompressRow and return the PSNR of the result against the image, with
+ * samples measured as fractions of the denominator.
+ */
+static double roundTrip(struct Pnm_rgb *pixels, unsigned denom, bool fixed,
+                        uint32_t *words)
+{
+        int blocks = WIDTH / 2;
+        struct Pnm_rgb top[WIDTH], bottom[WIDTH];
+        FixedScale scale = fixed ? newFixedScale(denom) : NULL;
+        void *scratch = ALLOC(FUSED_SCRATCH(blocks));
+        double squared = 0;
+        for (int row = 0; row < HEIGHT; row += 2) {
+                struct Pnm_rgb *in = &pixels[row * WIDTH];
+                uint32_t *row_words = &words[(row / 2) * blocks];
+                if (fixed) {
+                        compressRowFixed(in, in + WIDTH, scale, blocks,
+                                         row_words, scratch);
+                } else {
+                        compressRow(in, in + WIDTH, denom, blocks,
+                                    row_words, scratch);
+                }
+                decompressRow(row_words, blocks, denom, top, bottom,
+                              scratch);
+                for (int col = 0; col < WIDTH; col++) {
+                        struct Pnm_rgb *out[2] = { &top[col], &bottom[col] };
+                        for (int l = 0; l < 2; l++) {
+                                struct Pnm_rgb *p = &in[l * WIDTH + col];
+                                double dr = (double) p->red - out[l]->red;
+                                double dg = (double) p->green -
+                                            out[l]->green;
+                                double db = (double) p->blue - out[l]->blue;
+                                squared += dr * dr + dg * dg + db * db;
+                        }
+                }
+        }
+        if (scale != NULL) {
+                freeFixedScale(&scale);
+        }
+        FREE(scratch);
+        double mse = squared / (3.0 * WIDTH * HEIGHT * denom * denom);
+        assert(mse > 0);
+        return 10 * log10(1 / mse);
+}
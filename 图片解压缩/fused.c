@@ -0,0 +1,524 @@
+/*
+ *     fused.c
+ * 
+ *     Purpose: Implementation for fused. Converts the two scanlines of a block
+ *              row to component video with the row kernels of compvideo, then
+ *              for each block averages the chroma, takes the discrete cosine
+ *              transform of the Y values and packs the code word in local
+ *              variables, and stores the word in the output buffer. The
+ *              arithmetic repeats the staged modules operation for operation,
+ *              in the same float and double precision, so the words are
+ *              bit-for-bit the same. The decompressor does the reverse for a
+ *              row of code words. A second compressor does the same work in
+ *              fixed-point integer arithmetic.
+ */
+
+#include "fused.h"
+#include "dct.h"
+#include "compvideo.h"
+#include "arith40.h"
+#include "assert.h"
+#include "mem.h"
+
+static void packRow(float *cv, int blocks, uint32_t *words);
+static inline void fixedCV(int32_t r, int32_t g, int32_t b, int32_t *Y,
+                           int32_t *Pb, int32_t *Pr);
+static void packRowFixed(int32_t *cv, FixedScale scale, int blocks,
+                         uint32_t *words);
+static inline int32_t fixedRound(int32_t x, int32_t lo, int32_t hi);
+
+/********** compressRow ********
+ *
+ * Purpose: Compute the code words of one row of 2-by-2 blocks.
+ *
+ * Parameters: 
+ *      struct Pnm_rgb *top: The upper scanline of the block row.
+ *      struct Pnm_rgb *bottom: The lower scanline of the block row.
+ *      unsigned denom: Denominator of the RGB values.
+ *      int blocks: Number of blocks in the row.
+ *      uint32_t *words: Buffer to hold the code words.
+ *      void *scratch: FUSED_SCRATCH(blocks) bytes of working memory.
+ * 
+ * Return: None.
+ *      
+ * Expects: Both scanlines hold at least 2 * blocks pixels; words has room for
+ *          blocks code words.
+ * 
+ * Notes: A pixel past the last block (an odd last column) is ignored, as in
+ *        rgbToCV.
+ *      
+ ************************/
+void compressRow(struct Pnm_rgb *top, struct Pnm_rgb *bottom, unsigned denom,
+                 int blocks, uint32_t *words, void *scratch)
+{
+        assert(top != NULL && bottom != NULL && words != NULL);
+        assert(scratch != NULL);
+        if (blocks == 0) {
+                return;
+        }
+        /* Convert both scanlines to component video with the row kernel */
+        int n = 2 * blocks;
+        float *cv = scratch;
+        rgbRowToCV(top, n, denom, cv, cv + n, cv + 2 * n);
+        rgbRowToCV(bottom, n, denom, cv + 3 * n, cv + 4 * n, cv + 5 * n);
+        packRow(cv, blocks, words);
+}
+
+/********** compressRawRow ********
+ *
+ * Purpose: Compute the code words of one row of 2-by-2 blocks from raw 8-bit
+ *          scanlines.
+ *
+ * Parameters: 
+ *      const unsigned char *top: The upper scanline, as interleaved bytes.
+ *      const unsigned char *bottom: The lower scanline, as interleaved bytes.
+ *      unsigned denom: Denominator of the RGB values.
+ *      int blocks: Number of blocks in the row.
+ *      uint32_t *words: Buffer to hold the code words.
+ *      void *scratch: FUSED_SCRATCH(blocks) bytes of working memory.
+ * 
+ * Return: None.
+ *      
+ * Expects: Both scanlines hold at least 6 * blocks bytes; denom is below
+ *          256; words has room for blocks code words.
+ * 
+ * Notes: Produces the same words as compressRow on the same pixels, reading
+ *        the samples straight out of the scanlines of readRawScanlines.
+ *      
+ ************************/
+void compressRawRow(const unsigned char *top, const unsigned char *bottom,
+                    unsigned denom, int blocks, uint32_t *words,
+                    void *scratch)
+{
+        assert(top != NULL && bottom != NULL && words != NULL);
+        assert(scratch != NULL);
+        if (blocks == 0) {
+                return;
+        }
+        int n = 2 * blocks;
+        float *cv = scratch;
+        rawRowToCV(top, n, denom, cv, cv + n, cv + 2 * n);
+        rawRowToCV(bottom, n, denom, cv + 3 * n, cv + 4 * n, cv + 5 * n);
+        packRow(cv, blocks, words);
+}
+
+/********** packRow ********
+ *
+ * Purpose: Compute the code words of a row of blocks from the component video
+ *          values of its two scanlines.
+ *
+ * Parameters: 
+ *      float *cv: Y, Pb and Pr of the upper scanline, then of the lower one,
+ *                 each an array of 2 * blocks floats.
+ *      int blocks: Number of blocks in the row.
+ *      uint32_t *words: Buffer to hold the code words.
+ * 
+ * Return: None.
+ *      
+ * Expects: words has room for blocks code words.
+ * 
+ * Notes: The arithmetic of chroma, dct and codeword, in the same order.
+ *      
+ ************************/
+static void packRow(float *cv, int blocks, uint32_t *words)
+{
+        int n = 2 * blocks;
+        float *Yt = cv, *Pbt = cv + n, *Prt = cv + 2 * n;
+        float *Yb = cv + 3 * n, *Pbb = cv + 4 * n, *Prb = cv + 5 * n;
+        for (int block = 0; block < blocks; block++) {
+                int col = 2 * block;
+                float Y1 = Yt[col], Y2 = Yt[col + 1];
+                float Y3 = Yb[col], Y4 = Yb[col + 1];
+                float sumPb = 0.0, sumPr = 0.0;
+                /* Same pixel order as map_block_major in chroma */
+                sumPb += Pbt[col];
+                sumPr += Prt[col];
+                sumPb += Pbt[col + 1];
+                sumPr += Prt[col + 1];
+                sumPb += Pbb[col];
+                sumPr += Prb[col];
+                sumPb += Pbb[col + 1];
+                sumPr += Prb[col + 1];
+                float Pb_avg = sumPb / 4.0;
+                float Pr_avg = sumPr / 4.0;
+                unsigned Pb_index = Arith40_index_of_chroma(Pb_avg);
+                unsigned Pr_index = Arith40_index_of_chroma(Pr_avg);
+
+                float a = roundAY((Y4 + Y3 + Y2 + Y1) / 4.0);
+                float b = roundBCD((Y4 + Y3 - Y2 - Y1) / 4.0);
+                float c = roundBCD((Y4 - Y3 + Y2 - Y1) / 4.0);
+                float d = roundBCD((Y4 - Y3 - Y2 + Y1) / 4.0);
+                uint32_t ia = (unsigned) round(a * 63);
+                int ib = (int) round(b * 103);
+                int ic = (int) round(c * 103);
+                int id = (int) round(d * 103);
+
+                /* The layout of packWords; a, b, c and d are within the
+                   range of their six bits after rounding */
+                words[block] = (ia << 26) |
+                               (((uint32_t) ib & 0x3F) << 20) |
+                               (((uint32_t) ic & 0x3F) << 14) |
+                               (((uint32_t) id & 0x3F) << 8) |
+                               (Pb_index << 4) | Pr_index;
+        }
+}
+
+/********** newFixedScale ********
+ *
+ * Purpose: Build the tables the fixed-point compressor needs for one image.
+ *
+ * Parameters: 
+ *      unsigned denom: Denominator of the RGB values.
+ * 
+ * Return: A FixedScale for compressRowFixed.
+ *      
+ * Expects: denom is at least 1 and below 65536.
+ * 
+ * Notes: norm maps every sample value to v / denom in Q14, rounded to
+ *        nearest. chroma_mid holds, in Q16, the 15 points halfway between
+ *        consecutive chroma levels of Arith40_chroma_of_index, so a chroma
+ *        average is quantized to the nearest level by counting the points
+ *        below it, as Arith40_index_of_chroma does. These are the only
+ *        values derived from floating point, once per image and from
+ *        constants, so the code words do not depend on the compiler's
+ *        floating-point choices. Must be freed with freeFixedScale.
+ *      
+ ************************/
+FixedScale newFixedScale(unsigned denom)
+{
+        assert(denom >= 1 && denom <= 65535);
+        FixedScale scale;
+        NEW(scale);
+        scale->denom = denom;
+        scale->norm = CALLOC(denom + 1, sizeof(int32_t));
+        for (unsigned v = 0; v <= denom; v++) {
+                scale->norm[v] = (((uint64_t) v << (FIXED_BITS + 1)) + denom)
+                                 / (2 * denom);
+        }
+        for (int i = 0; i < 15; i++) {
+                double mid = ((double) Arith40_chroma_of_index(i) +
+                              Arith40_chroma_of_index(i + 1)) / 2;
+                scale->chroma_mid[i] = lround(mid * 65536);
+        }
+        return scale;
+}
+
+/********** freeFixedScale ********
+ *
+ * Purpose: Free a FixedScale.
+ *
+ * Parameters: 
+ *      FixedScale *scale: Pointer to the FixedScale to free.
+ * 
+ * Return: None.
+ *      
+ * Expects: scale and *scale are not NULL.
+ * 
+ * Notes: Sets *scale to NULL.
+ *      
+ ************************/
+void freeFixedScale(FixedScale *scale)
+{
+        assert(scale != NULL && *scale != NULL);
+        FREE((*scale)->norm);
+        FREE(*scale);
+}
+
+/********** compressRowFixed ********
+ *
+ * Purpose: Compute the code words of one row of 2-by-2 blocks with integer
+ *          arithmetic only.
+ *
+ * Parameters: 
+ *      struct Pnm_rgb *top: The upper scanline of the block row.
+ *      struct Pnm_rgb *bottom: The lower scanline of the block row.
+ *      FixedScale scale: Tables for the image's denominator.
+ *      int blocks: Number of blocks in the row.
+ *      uint32_t *words: Buffer to hold the code words.
+ *      void *scratch: FUSED_SCRATCH(blocks) bytes of working memory.
+ * 
+ * Return: None.
+ *      
+ * Expects: As compressRow; every sample is at most scale->denom.
+ * 
+ * Notes: Samples are normalized to Q14 and weighted with the color transform
+ *        coefficients scaled by 2^16 (each row of weights sums exactly to
+ *        2^16 or 0), giving Y, Pb and Pr in Q14 in 32-bit integers. The sum
+ *        of a block's four values is their average in Q16, from which a, b,
+ *        c and d are quantized by multiplying by 63 or 103 and rounding,
+ *        then bounded to the same ranges as roundAY and roundBCD allow. The
+ *        words usually equal compressRow's and otherwise differ by one
+ *        quantization step; they are the same on every machine.
+ *      
+ ************************/
+void compressRowFixed(struct Pnm_rgb *top, struct Pnm_rgb *bottom,
+                      FixedScale scale, int blocks, uint32_t *words,
+                      void *scratch)
+{
+        assert(top != NULL && bottom != NULL && scale != NULL);
+        assert(words != NULL && scratch != NULL);
+        if (blocks == 0) {
+                return;
+        }
+        int n = 2 * blocks;
+        int32_t *cv = scratch;
+        const int32_t *norm = scale->norm;
+        struct Pnm_rgb *lines[2] = { top, bottom };
+        for (int l = 0; l < 2; l++) {
+                int32_t *Y = cv + 3 * l * n;
+                for (int i = 0; i < n; i++) {
+                        fixedCV(norm[lines[l][i].red],
+                                norm[lines[l][i].green],
+                                norm[lines[l][i].blue],
+                                &Y[i], &Y[n + i], &Y[2 * n + i]);
+                }
+        }
+        packRowFixed(cv, scale, blocks, words);
+}
+
+/********** compressRawRowFixed ********
+ *
+ * Purpose: compressRowFixed on raw 8-bit scanlines.
+ *
+ * Parameters: 
+ *      const unsigned char *top: The upper scanline, as interleaved bytes.
+ *      const unsigned char *bottom: The lower scanline, as interleaved bytes.
+ *      FixedScale scale: Tables for the image's denominator.
+ *      int blocks: Number of blocks in the row.
+ *      uint32_t *words: Buffer to hold the code words.
+ *      void *scratch: FUSED_SCRATCH(blocks) bytes of working memory.
+ * 
+ * Return: None.
+ *      
+ * Expects: As compressRawRow; every sample is at most scale->denom.
+ * 
+ * Notes: Produces the same words as compressRowFixed on the same pixels.
+ *      
+ ************************/
+void compressRawRowFixed(const unsigned char *top,
+                         const unsigned char *bottom, FixedScale scale,
+                         int blocks, uint32_t *words, void *scratch)
+{
+        assert(top != NULL && bottom != NULL && scale != NULL);
+        assert(words != NULL && scratch != NULL);
+        if (blocks == 0) {
+                return;
+        }
+        int n = 2 * blocks;
+        int32_t *cv = scratch;
+        const int32_t *norm = scale->norm;
+        const unsigned char *lines[2] = { top, bottom };
+        for (int l = 0; l < 2; l++) {
+                int32_t *Y = cv + 3 * l * n;
+                const unsigned char *p = lines[l];
+                for (int i = 0; i < n; i++, p += 3) {
+                        fixedCV(norm[p[0]], norm[p[1]], norm[p[2]],
+                                &Y[i], &Y[n + i], &Y[2 * n + i]);
+                }
+        }
+        packRowFixed(cv, scale, blocks, words);
+}
+
+/********** fixedCV ********
+ *
+ * Purpose: Convert one pixel of normalized samples to fixed-point component
+ *          video.
+ *
+ * Parameters: 
+ *      int32_t r, g, b: The samples, normalized to Q14.
+ *      int32_t *Y, *Pb, *Pr: Set to the component video values, in Q14.
+ * 
+ * Return: None.
+ *      
+ * Expects: None.
+ * 
+ * Notes: The weights are the color transform coefficients scaled by 2^16;
+ *        each row of them sums exactly to 2^16 or 0.
+ *      
+ ************************/
+static inline void fixedCV(int32_t r, int32_t g, int32_t b, int32_t *Y,
+                           int32_t *Pb, int32_t *Pr)
+{
+        *Y = (19595 * r + 38470 * g + 7471 * b + 32768) >> 16;
+        *Pb = (-11058 * r - 21710 * g + 32768 * b + 32768) >> 16;
+        *Pr = (32768 * r - 27439 * g - 5329 * b + 32768) >> 16;
+}
+
+/********** packRowFixed ********
+ *
+ * Purpose: Compute the code words of a row of blocks from the fixed-point
+ *          component video values of its two scanlines.
+ *
+ * Parameters: 
+ *      int32_t *cv: Y, Pb and Pr of the upper scanline, then of the lower
+ *                   one, each an array of 2 * blocks values in Q14.
+ *      FixedScale scale: Tables for the image's denominator.
+ *      int blocks: Number of blocks in the row.
+ *      uint32_t *words: Buffer to hold the code words.
+ * 
+ * Return: None.
+ *      
+ * Expects: words has room for blocks code words.
+ * 
+ * Notes: See compressRowFixed.
+ *      
+ ************************/
+static void packRowFixed(int32_t *cv, FixedScale scale, int blocks,
+                         uint32_t *words)
+{
+        int n = 2 * blocks;
+        int32_t *Y[2] = { cv, cv + 3 * n };
+        int32_t *Pb[2] = { cv + n, cv + 4 * n };
+        int32_t *Pr[2] = { cv + 2 * n, cv + 5 * n };
+        for (int block = 0; block < blocks; block++) {
+                int col = 2 * block;
+                int32_t Y1 = Y[0][col], Y2 = Y[0][col + 1];
+                int32_t Y3 = Y[1][col], Y4 = Y[1][col + 1];
+                int32_t sumPb = Pb[0][col] + Pb[0][col + 1] +
+                                Pb[1][col] + Pb[1][col + 1];
+                int32_t sumPr = Pr[0][col] + Pr[0][col + 1] +
+                                Pr[1][col] + Pr[1][col + 1];
+                unsigned Pb_index = 0, Pr_index = 0;
+                for (int i = 0; i < 15; i++) {
+                        Pb_index += sumPb > scale->chroma_mid[i];
+                        Pr_index += sumPr > scale->chroma_mid[i];
+                }
+                int32_t ia = fixedRound(63 * (Y4 + Y3 + Y2 + Y1), 0, 63);
+                int32_t ib = fixedRound(103 * (Y4 + Y3 - Y2 - Y1), -31, 31);
+                int32_t ic = fixedRound(103 * (Y4 - Y3 + Y2 - Y1), -31, 31);
+                int32_t id = fixedRound(103 * (Y4 - Y3 - Y2 + Y1), -31, 31);
+                words[block] = ((uint32_t) ia << 26) |
+                               (((uint32_t) ib & 0x3F) << 20) |
+                               (((uint32_t) ic & 0x3F) << 14) |
+                               (((uint32_t) id & 0x3F) << 8) |
+                               (Pb_index << 4) | Pr_index;
+        }
+}
+
+/********** decompressRow ********
+ *
+ * Purpose: Reconstruct the two scanlines of one row of 2-by-2 blocks from
+ *          their code words.
+ *
+ * Parameters: 
+ *      uint32_t *words: The code words of the block row.
+ *      int blocks: Number of blocks in the row.
+ *      unsigned denom: Denominator of the RGB values to produce.
+ *      struct Pnm_rgb *top: Set to the upper scanline of the block row.
+ *      struct Pnm_rgb *bottom: Set to the lower scanline of the block row.
+ *      void *scratch: FUSED_SCRATCH(blocks) bytes of working memory.
+ * 
+ * Return: None.
+ *      
+ * Expects: words holds blocks code words; both scanlines have room for at
+ *          least 2 * blocks pixels.
+ * 
+ * Notes: Repeats unpackWords, decodeChroma and dctToPS for each block, then
+ *        converts both scanlines with the row kernel of compvideo, so the
+ *        pixels are the same as the staged decompressor's.
+ *        Pixels past the last block are left untouched.
+ *      
+ ************************/
+void decompressRow(uint32_t *words, int blocks, unsigned denom,
+                   struct Pnm_rgb *top, struct Pnm_rgb *bottom,
+                   void *scratch)
+{
+        assert(words != NULL && top != NULL && bottom != NULL);
+        assert(scratch != NULL);
+        if (blocks == 0) {
+                return;
+        }
+        /* Y of both scanlines, and Pb and Pr, which they share */
+        int n = 2 * blocks;
+        float *cv = scratch;
+        float *Yt = cv, *Yb = cv + n, *Pb = cv + 2 * n, *Pr = cv + 3 * n;
+        for (int block = 0; block < blocks; block++) {
+                uint32_t word = words[block];
+                unsigned ia = word >> 26;
+                /* Sign-extend the six-bit fields */
+                int ib = ((int32_t) (word << 6)) >> 26;
+                int ic = ((int32_t) (word << 12)) >> 26;
+                int id = ((int32_t) (word << 18)) >> 26;
+                int col = 2 * block;
+                Pb[col] = Pb[col + 1] = Arith40_chroma_of_index((word >> 4) &
+                                                                0xF);
+                Pr[col] = Pr[col + 1] = Arith40_chroma_of_index(word & 0xF);
+
+                float a = roundAY(ia / 63.0);
+                float b = roundBCD(ib / 103.0);
+                float c = roundBCD(ic / 103.0);
+                float d = roundBCD(id / 103.0);
+                /* Grouped as in calc4Y so that negating or swapping
+                   b, c and d only trades the four sums */
+                float sum = a + d, diff = a - d, bc = b + c, cb = c - b;
+                Yt[col] = roundAY(sum - bc);
+                Yt[col + 1] = roundAY(diff + cb);
+                Yb[col] = roundAY(diff - cb);
+                Yb[col + 1] = roundAY(sum + bc);
+        }
+        cvRowToRGB(Yt, Pb, Pr, n, denom, top);
+        cvRowToRGB(Yb, Pb, Pr, n, denom, bottom);
+}
+
+/********** previewRow ********
+ *
+ * Purpose: Turn a row of code words into one scanline at half resolution.
+ *
+ * Parameters:
+ *      uint32_t *words: The code words of one row of blocks.
+ *      int blocks: Number of blocks in the row.
+ *      unsigned denom: Denominator of the pixels.
+ *      struct Pnm_rgb *row: Set to one pixel per block.
+ *      void *scratch: FUSED_SCRATCH(blocks) bytes of working memory.
+ *
+ * Return: None.
+ *
+ * Expects: row has room for blocks pixels.
+ *
+ * Notes: Each pixel is the block's average luma a with its chroma averages,
+ *        the color of the block as a whole, so b, c and d are never
+ *        unpacked and only a quarter as many pixels are converted as by
+ *        decompressRow.
+ *
+ ************************/
+void previewRow(uint32_t *words, int blocks, unsigned denom,
+                struct Pnm_rgb *row, void *scratch)
+{
+        assert(words != NULL && row != NULL && scratch != NULL);
+        if (blocks == 0) {
+                return;
+        }
+        float *cv = scratch;
+        float *Y = cv, *Pb = cv + blocks, *Pr = cv + 2 * blocks;
+        for (int block = 0; block < blocks; block++) {
+                uint32_t word = words[block];
+                Y[block] = roundAY((word >> 26) / 63.0);
+                Pb[block] = Arith40_chroma_of_index((word >> 4) & 0xF);
+                Pr[block] = Arith40_chroma_of_index(word & 0xF);
+        }
+        cvRowToRGB(Y, Pb, Pr, blocks, denom, row);
+}
+
+/********** fixedRound ********
+ *
+ * Purpose: Round a Q16 value to an integer and bound it.
+ *
+ * Parameters: 
+ *      int32_t x: The value, in Q16.
+ *      int32_t lo: The smallest result.
+ *      int32_t hi: The largest result.
+ *      
+ * Return: x / 2^16 rounded to nearest, halves up, and bounded to [lo, hi].
+ *      
+ * Expects: lo <= hi.
+ * 
+ * Notes: Bounding after rounding gives the same result as the float path's
+ *        bounding before it, since the bounds are round(63 * 1) and
+ *        round(103 * 0.3).
+ *      
+ ************************/
+static inline int32_t fixedRound(int32_t x, int32_t lo, int32_t hi)
+{
+        int32_t q = (x + 32768) >> 16;
+        return q < lo ? lo : q > hi ? hi : q;
+}
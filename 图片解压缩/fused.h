@@ -0,0 +1,59 @@
+/*
+ *     fused.h
+ * 
+ *     Purpose: Interface for fused. Contains a single-pass compressor that
+ *              turns each 2-by-2 block of RGB pixels straight into its 32-bit
+ *              code word, producing the same words as the staged pipeline of
+ *              compvideo, chroma, dct and codeword. It works on one row of
+ *              blocks at a time, given the two scanlines that hold it, and
+ *              has a matching decompressor, and previewRow decodes a row at
+ *              half resolution. compressRowFixed is an integer fixed-point
+ *              version whose code words are the same on every machine and
+ *              compiler. Both compressors have versions that take
+ *              scanlines of raw 8-bit samples. Every kernel works in
+ *              scratch memory its caller keeps from one row to the next, so
+ *              nothing is allocated per row.
+ */
+
+#ifndef FUSED_H
+#define FUSED_H
+
+#include "pnm.h"
+#include <stdint.h>
+
+/* Bytes of scratch memory any row kernel, float or fixed-point, needs for a
+   row of blocks */
+#define FUSED_SCRATCH(blocks) (12 * (size_t) (blocks) * \
+                               (sizeof(float) > sizeof(int32_t) ? \
+                                sizeof(float) : sizeof(int32_t)))
+
+/* Fractional bits of a normalized sample in the fixed-point compressor */
+#define FIXED_BITS 14
+
+/* Tables for the fixed-point compressor, built once per image */
+typedef struct FixedScale {
+        unsigned denom;
+        int32_t *norm;          /* sample / denom in Q14, denom + 1 entries */
+        int32_t chroma_mid[15]; /* points between chroma levels, in Q16 */
+} *FixedScale;
+
+void compressRow(struct Pnm_rgb *top, struct Pnm_rgb *bottom, unsigned denom,
+                 int blocks, uint32_t *words, void *scratch);
+void compressRawRow(const unsigned char *top, const unsigned char *bottom,
+                    unsigned denom, int blocks, uint32_t *words,
+                    void *scratch);
+FixedScale newFixedScale(unsigned denom);
+void freeFixedScale(FixedScale *scale);
+void compressRowFixed(struct Pnm_rgb *top, struct Pnm_rgb *bottom,
+                      FixedScale scale, int blocks, uint32_t *words,
+                      void *scratch);
+void compressRawRowFixed(const unsigned char *top,
+                         const unsigned char *bottom, FixedScale scale,
+                         int blocks, uint32_t *words, void *scratch);
+void decompressRow(uint32_t *words, int blocks, unsigned denom,
+                   struct Pnm_rgb *top, struct Pnm_rgb *bottom,
+                   void *scratch);
+void previewRow(uint32_t *words, int blocks, unsigned denom,
+                struct Pnm_rgb *row, void *scratch);
+
+#endif
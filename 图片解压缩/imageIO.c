@@ -4,13 +4,29 @@
  *     Purpose: Implementation for imageIO. Utilizes the pnm interface to handle
  *              reading and writing a PPM image. Compressed images are
  *              represented with a 2D array in order to store each pixel and
- *              the information related to each pixel. Utilizes Hanson's
- *              sequences as a dynamic array to store code words and information
- *              related to code words.
+ *              the information related to each pixel. Code words are kept in
+ *              plain arrays and moved to and from the file in big-endian
+ *              order, read with a single fread per call and written a
+ *              stack buffer at a time, or entropy coded through entropy in
+ *              format 3 and tiles in format 4. A raw PPM in a regular file
+ *              is mapped into memory, and its scanlines are handed out as
+ *              pointers into the mapping.
  */
 
 #include "imageIO.h"
+#include "entropy.h"
+#include "tiles.h"
 #include "assert.h"
+#include "mem.h"
+#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Code words writeWords byte-swaps per fwrite, from a buffer on the stack */
+#define WRITE_WORDS 1024
+
+unsigned readHeaderNumber(FILE *input);
+void mapPPM(PPMReader reader);
 
 /********** readPPM ********
  *
@@ -64,11 +80,12 @@ void writePPM(Pnm_ppm pixmap)
  *
  * Parameters: 
  *      A2 uarray2b: A 2D array representing the original image.
- *      Seq_T seq: A sequence storing all of the code words.
+ *      uint32_t *words: Array storing all of the code words.
  * 
  * Return: None.
  *      
- * Expects: The code words stored in the sequence are stored in row-major order.
+ * Expects: The array holds a code word for each 2-by-2 block, in row-major
+ *          order.
  * 
  * Notes: The width and height included in the header are the width and height
  *        of the original image after trimming off any odd column or row. The
@@ -76,28 +93,83 @@ void writePPM(Pnm_ppm pixmap)
  *        written to disk in big-endian order.
  *      
  ************************/
-void writeCompressed(A2 uarray2b, Seq_T seq)
+void writeCompressed(A2 uarray2b, uint32_t *words)
 {
         assert(uarray2b != NULL);
-        assert(seq != NULL);
+        assert(words != NULL);
         A2Methods_T methods = uarray2_methods_blocked;
         assert(methods != NULL);
         int width = methods->width(uarray2b);
         int height = methods->height(uarray2b);
-        printf("COMP40 Compressed image format 2\n%u %u", width, height);
-        printf("\n");
-        for (int i = 0; i < Seq_length(seq); i++) {
-                uint64_t codeword = (uint64_t) Seq_get(seq, i);
-                uint8_t byte0, byte1, byte2, byte3;
-                uint8_t mask = 0xFF;
-                byte0 = (codeword >> 24) & mask;
-                byte1 = (codeword >> 16) & mask;
-                byte2 = (codeword >> 8) & mask;
-                byte3 = codeword & mask;
-                putchar(byte0);
-                putchar(byte1);
-                putchar(byte2);
-                putchar(byte3);
+        writeCompressedHeader(stdout, FORMAT_WORDS, width, height);
+        writeWords(stdout, words, (width / 2) * (height / 2));
+}
+
+/********** writeCompressedHeader ********
+ *
+ * Purpose: Write the header of a compressed binary image.
+ *
+ * Parameters: 
+ *      FILE *output: The file to write to.
+ *      int format: FORMAT_WORDS, FORMAT_ENTROPY, FORMAT_TILED or
+ *                  FORMAT_SEQUENCE.
+ *      unsigned width: Width of the image after trimming.
+ *      unsigned height: Height of the image after trimming.
+ * 
+ * Return: None.
+ *      
+ * Expects: None.
+ * 
+ * Notes: The same header as writeCompressed, with the format number
+ *        changed for the other formats. The code words follow through
+ *        writeWords, an EntropyWriter or a TileWriter, to match.
+ *      
+ ************************/
+void writeCompressedHeader(FILE *output, int format, unsigned width,
+                           unsigned height)
+{
+        assert(output != NULL);
+        assert(format >= FORMAT_WORDS && format <= FORMAT_SEQUENCE);
+        fprintf(output, "COMP40 Compressed image format %d\n%u %u", format,
+                width, height);
+        fprintf(output, "\n");
+}
+
+/********** writeWords ********
+ *
+ * Purpose: Write code words to a compressed binary image.
+ *
+ * Parameters: 
+ *      FILE *output: The file to write to.
+ *      uint32_t *words: The code words, in row-major order of the blocks.
+ *      int count: Number of code words.
+ * 
+ * Return: None.
+ *      
+ * Expects: words holds count code words.
+ * 
+ * Notes: Each word is written in big-endian order. The words are
+ *        byte-swapped WRITE_WORDS at a time into a buffer on the stack, each
+ *        piece written with a single fwrite, so nothing is allocated.
+ *      
+ ************************/
+void writeWords(FILE *output, uint32_t *words, int count)
+{
+        assert(output != NULL && words != NULL && count >= 0);
+        unsigned char raw[4 * WRITE_WORDS];
+        for (int done = 0; done < count; ) {
+                int n = count - done < WRITE_WORDS ? count - done :
+                        WRITE_WORDS;
+                for (int i = 0; i < n; i++) {
+                        uint32_t codeword = words[done + i];
+                        raw[4 * i] = codeword >> 24;
+                        raw[4 * i + 1] = codeword >> 16;
+                        raw[4 * i + 2] = codeword >> 8;
+                        raw[4 * i + 3] = codeword;
+                }
+                size_t written = fwrite(raw, 4, n, output);
+                assert(written == (size_t) n);
+                done += n;
         }
 }
 
@@ -107,7 +179,7 @@ void writeCompressed(A2 uarray2b, Seq_T seq)
  *
  * Parameters: 
  *      FILE *input: A pointer to a file to read from.
- *      Seq_T seq: A sequence to store all of the code words read in.
+ *      uint32_t **words: Set to a new array holding all of the code words.
  * 
  * Return: A struct Pnm_ppm pixmap for the decompressed image.
  *      
@@ -116,20 +188,22 @@ void writeCompressed(A2 uarray2b, Seq_T seq)
  * 
  * Notes: The code words read in are stored in big-endian order. Raises a CRE
  *        if the supplied file is too short (number of codewords is too low
- *        for stated width and height or last codeword is incomplete). Memory
- *        is allocated for an A2 that gets stored in struct Pnm_ppm pixmap;
- *        this must be freed in the decompress40 function.
+ *        for stated width and height or last codeword is incomplete) or has
+ *        bytes left over. Images in FORMAT_ENTROPY are decoded with an
+ *        EntropyReader, and in FORMAT_TILED tile by tile with a TileReader;
+ *        a sequence of frames raises a CRE.
+ *        Memory is allocated for an A2 that gets stored in struct Pnm_ppm
+ *        pixmap and for the array of code words, which has
+ *        (width / 2) * (height / 2) elements, or one if that is zero; both
+ *        must be freed in the decompress40 function.
  *      
  ************************/
-struct Pnm_ppm readCompressed(FILE *input, Seq_T seq)
+struct Pnm_ppm readCompressed(FILE *input, uint32_t **words)
 {
-        assert(seq != NULL);
+        assert(words != NULL);
         unsigned height, width;
-        int read = fscanf(input, "COMP40 Compressed image format 2\n%u %u", 
-                          &width, &height);
-        assert(read == 2);
-        int c = getc(input);
-        assert(c == '\n');
+        int format = readCompressedHeader(input, &width, &height);
+        assert(format != FORMAT_SEQUENCE);
         A2Methods_T methods = uarray2_methods_blocked;
         assert(methods != NULL);
         A2 array = methods->new_with_blocksize(width, height, 
@@ -139,21 +213,591 @@ struct Pnm_ppm readCompressed(FILE *input, Seq_T seq)
                                 , .methods = methods
                                 };
         int total_codewords = (width / 2) * (height / 2);
-        int total_bytes = 4 * total_codewords;
-        int bytes_read = 0;
-        uint64_t codeword = 0;
-        uint8_t byte;
-        int byte_int;
-        while ((byte_int = getc(input)) != EOF) {
-                byte = (uint8_t) byte_int;
-                codeword = (codeword << 8) | byte;
-                bytes_read += 1;
-                if (bytes_read % 4 == 0) {
-                        Seq_addhi(seq, (void *) codeword);
-                        codeword = 0;
+        *words = CALLOC(total_codewords > 0 ? total_codewords : 1,
+                        sizeof(uint32_t));
+        readFormatWords(input, format, width, height, *words);
+        int extra = getc(input);
+        assert(extra == EOF);
+        return pixmap;
+}
+
+/********** readFormatWords ********
+ *
+ * Purpose: Read all of the code words of a compressed image.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file positioned after the header.
+ *      int format: FORMAT_WORDS, FORMAT_ENTROPY or FORMAT_TILED, from the
+ *                  header.
+ *      unsigned width: Width of the image, from the header.
+ *      unsigned height: Height of the image, from the header.
+ *      uint32_t *words: Set to the code words, in row-major order of the
+ *                       blocks.
+ * 
+ * Return: None.
+ *      
+ * Expects: words holds (width / 2) * (height / 2) code words.
+ * 
+ * Notes: Images in FORMAT_ENTROPY are decoded with an EntropyReader, and in
+ *        FORMAT_TILED tile by tile with a TileReader. Raises a CRE if the
+ *        file is too short or the format is a sequence. Bytes after the
+ *        code words are not read.
+ *      
+ ************************/
+void readFormatWords(FILE *input, int format, unsigned width,
+                     unsigned height, uint32_t *words)
+{
+        assert(words != NULL);
+        assert(format != FORMAT_SEQUENCE);
+        int total_codewords = (width / 2) * (height / 2);
+        if (format == FORMAT_ENTROPY) {
+                EntropyReader entropy = newEntropyReader(input, width / 2,
+                                                         height / 2);
+                entropyReadWords(entropy, words, total_codewords);
+                freeEntropyReader(&entropy);
+        } else if (format == FORMAT_TILED) {
+                TileReader tiles = newTileReader(input, width, height);
+                int blocks_in_row = width / 2;
+                int tile_rows = (height / 2 + TILE_BLOCKS - 1) / TILE_BLOCKS;
+                int tile_cols = (blocks_in_row + TILE_BLOCKS - 1) /
+                                TILE_BLOCKS;
+                for (int tr = 0; tr < tile_rows; tr++) {
+                        for (int tc = 0; tc < tile_cols; tc++) {
+                                uint32_t *tile = &words[(tr * blocks_in_row +
+                                                         tc) * TILE_BLOCKS];
+                                readTile(tiles, tr, tc, tile, blocks_in_row);
+                        }
                 }
+                freeTileReader(&tiles);
+        } else {
+                readWords(input, words, total_codewords);
         }
-        assert(bytes_read == total_bytes);
-        assert(bytes_read % 4 == 0);
-        return pixmap;
-}
\ No newline at end of file
+}
+
+/********** writeFormatWords ********
+ *
+ * Purpose: Write a whole compressed image from its code words.
+ *
+ * Parameters: 
+ *      FILE *output: The file to write to.
+ *      int format: FORMAT_WORDS, FORMAT_ENTROPY or FORMAT_TILED.
+ *      unsigned width: Width of the image after trimming.
+ *      unsigned height: Height of the image after trimming.
+ *      uint32_t *words: The code words, in row-major order of the blocks.
+ * 
+ * Return: None.
+ *      
+ * Expects: width and height are even; words holds (width / 2) *
+ *          (height / 2) code words.
+ * 
+ * Notes: Writes the header and then the words through writeWords, an
+ *        EntropyWriter or a TileWriter, to match the format, giving the
+ *        same bytes as compressing an image with these words. Raises a CRE
+ *        for a sequence.
+ *      
+ ************************/
+void writeFormatWords(FILE *output, int format, unsigned width,
+                      unsigned height, uint32_t *words)
+{
+        assert(output != NULL && words != NULL);
+        assert(format != FORMAT_SEQUENCE);
+        int total_codewords = (width / 2) * (height / 2);
+        if (format == FORMAT_TILED) {
+                TileWriter tiles = newTileWriter(output, width, height);
+                tileWriteWords(tiles, words, total_codewords);
+                closeTileWriter(&tiles);
+                return;
+        }
+        writeCompressedHeader(output, format, width, height);
+        if (format == FORMAT_ENTROPY) {
+                EntropyWriter entropy = newEntropyWriter(output, width / 2);
+                entropyWriteWords(entropy, words, total_codewords);
+                closeEntropyWriter(&entropy);
+        } else {
+                writeWords(output, words, total_codewords);
+        }
+}
+
+/********** readCompressedHeader ********
+ *
+ * Purpose: Read the header of a compressed binary image so its code words can
+ *          be read one block row at a time.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file to read from.
+ *      unsigned *width: Set to the width of the image.
+ *      unsigned *height: Set to the height of the image.
+ * 
+ * Return: The format of the code words, FORMAT_WORDS, FORMAT_ENTROPY or
+ *         FORMAT_TILED, or FORMAT_SEQUENCE for a sequence of frames.
+ *      
+ * Expects: The given file contains a compressed binary image.
+ * 
+ * Notes: Raises a CRE if the header is malformed or names another format,
+ *        as readCompressed does.
+ *      
+ ************************/
+int readCompressedHeader(FILE *input, unsigned *width, unsigned *height)
+{
+        assert(input != NULL && width != NULL && height != NULL);
+        int format;
+        int read = fscanf(input, "COMP40 Compressed image format %d\n%u %u",
+                          &format, width, height);
+        assert(read == 3);
+        assert(format >= FORMAT_WORDS && format <= FORMAT_SEQUENCE);
+        int c = getc(input);
+        assert(c == '\n');
+        return format;
+}
+
+/********** readWords ********
+ *
+ * Purpose: Read code words from a compressed binary image.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file positioned at a code word.
+ *      uint32_t *words: Array to hold the code words.
+ *      int count: Number of code words to read.
+ * 
+ * Return: None.
+ *      
+ * Expects: words has room for count code words.
+ * 
+ * Notes: The code words are stored in big-endian order. Raises a CRE if the
+ *        file ends before count complete code words have been read. The
+ *        bytes are read with a single fread straight into words and then
+ *        byte-swapped in place, so no other buffer is needed.
+ *      
+ ************************/
+void readWords(FILE *input, uint32_t *words, int count)
+{
+        assert(input != NULL && words != NULL && count >= 0);
+        size_t read = fread(words, 4, count, input);
+        assert(read == (size_t) count);
+        unsigned char *raw = (unsigned char *) words;
+        for (int i = 0; i < count; i++) {
+                unsigned char *b = &raw[4 * i];
+                words[i] = ((uint32_t) b[0] << 24) | ((uint32_t) b[1] << 16) |
+                           ((uint32_t) b[2] << 8) | b[3];
+        }
+}
+
+/********** writePPMHeader ********
+ *
+ * Purpose: Write the header of a raw PPM image to standard output.
+ *
+ * Parameters: 
+ *      unsigned width: Width of the image.
+ *      unsigned height: Height of the image.
+ *      unsigned denominator: Maximum value of an RGB sample.
+ * 
+ * Return: None.
+ *      
+ * Expects: denominator is below 256; the scanlines follow through
+ *          writeScanline.
+ * 
+ * Notes: The same header as Pnm_ppmwrite.
+ *      
+ ************************/
+void writePPMHeader(unsigned width, unsigned height, unsigned denominator)
+{
+        assert(denominator < 256);
+        printf("P6\n%u %u\n%u\n", width, height, denominator);
+}
+
+/********** writeScanline ********
+ *
+ * Purpose: Write one scanline of a raw PPM image to standard output.
+ *
+ * Parameters: 
+ *      struct Pnm_rgb *row: The pixels of the scanline.
+ *      unsigned width: Number of pixels in the scanline.
+ *      unsigned char *raw: Room for 3 * width bytes, kept by the caller
+ *                          from one scanline to the next.
+ * 
+ * Return: None.
+ *      
+ * Expects: Every sample fits in one byte.
+ * 
+ * Notes: The scanline is converted to bytes in raw with packScanline and
+ *        written with a single fwrite, so writing an image allocates
+ *        nothing per scanline.
+ *      
+ ************************/
+void writeScanline(struct Pnm_rgb *row, unsigned width, unsigned char *raw)
+{
+        assert(row != NULL && raw != NULL);
+        if (width == 0) {
+                return;
+        }
+        packScanline(row, width, raw);
+        size_t written = fwrite(raw, 1, 3 * (size_t) width, stdout);
+        assert(written == 3 * (size_t) width);
+}
+
+/********** packScanline ********
+ *
+ * Purpose: Convert pixels to the bytes of a raw PPM scanline.
+ *
+ * Parameters: 
+ *      struct Pnm_rgb *row: The pixels.
+ *      unsigned width: Number of pixels.
+ *      unsigned char *raw: Set to 3 * width bytes, red, green and blue of
+ *                          each pixel.
+ * 
+ * Return: None.
+ *      
+ * Expects: Every sample fits in one byte.
+ * 
+ * Notes: None.
+ *      
+ ************************/
+void packScanline(struct Pnm_rgb *row, unsigned width, unsigned char *raw)
+{
+        assert(row != NULL && raw != NULL);
+        for (unsigned i = 0; i < width; i++) {
+                raw[3 * i] = row[i].red;
+                raw[3 * i + 1] = row[i].green;
+                raw[3 * i + 2] = row[i].blue;
+        }
+}
+
+/********** writeRawScanlines ********
+ *
+ * Purpose: Write scanlines of a raw PPM image, already in bytes, to
+ *          standard output.
+ *
+ * Parameters: 
+ *      const unsigned char *raw: The scanlines, 3 * width bytes each.
+ *      unsigned width: Number of pixels in a scanline.
+ *      unsigned count: Number of scanlines.
+ * 
+ * Return: None.
+ *      
+ * Expects: raw holds count scanlines.
+ * 
+ * Notes: A single fwrite.
+ *      
+ ************************/
+void writeRawScanlines(const unsigned char *raw, unsigned width,
+                       unsigned count)
+{
+        assert(raw != NULL);
+        size_t bytes = 3 * (size_t) width * count;
+        size_t written = fwrite(raw, 1, bytes, stdout);
+        assert(written == bytes);
+}
+
+/********** openPPM ********
+ *
+ * Purpose: Read the header of a PPM image so its scanlines can be read one at
+ *          a time.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file to read from.
+ * 
+ * Return: A PPMReader positioned at the first scanline.
+ *      
+ * Expects: The given file contains a PPM image, raw (P6) or plain (P3).
+ * 
+ * Notes: Raises Pnm_Badformat if the header is not a valid PPM header. A raw
+ *        image in a regular file that holds every scanline is mapped into
+ *        memory with mapPPM; otherwise scanlines are read as they are asked
+ *        for, so memory does not grow with the height of the image. The
+ *        reader must be freed with closePPM.
+ *      
+ ************************/
+PPMReader openPPM(FILE *input)
+{
+        assert(input != NULL);
+        int c1 = getc(input);
+        int c2 = getc(input);
+        if (c1 != 'P' || (c2 != '6' && c2 != '3')) {
+                RAISE(Pnm_Badformat);
+        }
+        PPMReader reader;
+        NEW(reader);
+        reader->input = input;
+        reader->plain = (c2 == '3');
+        reader->width = readHeaderNumber(input);
+        reader->height = readHeaderNumber(input);
+        reader->denominator = readHeaderNumber(input);
+        if (reader->denominator < 1 || reader->denominator > 65535) {
+                FREE(reader);
+                RAISE(Pnm_Badformat);
+        }
+        reader->sample_bytes = reader->denominator < 256 ? 1 : 2;
+        reader->stride = 3 * reader->sample_bytes * (size_t) reader->width;
+        reader->lines_read = 0;
+        reader->map = NULL;
+        reader->map_length = 0;
+        reader->next = NULL;
+        reader->chunk = NULL;
+        reader->chunk_size = 0;
+        if (!reader->plain) {
+                mapPPM(reader);
+        }
+        return reader;
+}
+
+/********** mapPPM ********
+ *
+ * Purpose: Map the file of a raw PPM image into memory.
+ *
+ * Parameters: 
+ *      PPMReader reader: A raw reader positioned at its first scanline.
+ * 
+ * Return: None.
+ *      
+ * Expects: No scanline has been read yet.
+ * 
+ * Notes: Only a regular file long enough to hold every scanline is mapped;
+ *        a pipe, a terminal or a short file is left to fread, which raises a
+ *        CRE at the scanline that is missing, as before. Failure to map is
+ *        not an error. The mapping is read-only and private, and is undone
+ *        by closePPM.
+ *      
+ ************************/
+void mapPPM(PPMReader reader)
+{
+        struct stat st;
+        int fd = fileno(reader->input);
+        if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+                return;
+        }
+        long offset = ftell(reader->input);
+        size_t raster = reader->height * reader->stride;
+        if (offset < 0 || raster == 0 ||
+            (uint64_t) st.st_size < (uint64_t) offset + raster) {
+                return;
+        }
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+                return;
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        reader->map = map;
+        reader->map_length = st.st_size;
+        reader->next = reader->map + offset;
+}
+
+/********** rawPPM ********
+ *
+ * Purpose: Tell whether the scanlines of a PPM image can be used as raw
+ *          8-bit samples.
+ *
+ * Parameters: 
+ *      PPMReader reader: The reader returned by openPPM.
+ * 
+ * Return: true for a raw (P6) image with a denominator below 256.
+ *      
+ * Expects: reader is not NULL.
+ * 
+ * Notes: The scanlines of such an image come from readRawScanlines as rows
+ *        of interleaved red, green and blue bytes.
+ *      
+ ************************/
+bool rawPPM(PPMReader reader)
+{
+        assert(reader != NULL);
+        return !reader->plain && reader->sample_bytes == 1;
+}
+
+/********** readRawScanlines ********
+ *
+ * Purpose: Read the next scanlines of a raw PPM image without converting
+ *          them.
+ *
+ * Parameters: 
+ *      PPMReader reader: The reader returned by openPPM.
+ *      int count: Number of scanlines to read.
+ * 
+ * Return: A pointer to count scanlines of raw samples, reader->stride bytes
+ *         apart, valid until the next read from the reader.
+ *      
+ * Expects: The image is raw (P6), and at most reader->height scanlines are
+ *          read in all.
+ * 
+ * Notes: Raises a CRE if the file ends early. A mapped image is not copied:
+ *        the pointer is into the mapping. Otherwise the scanlines are read
+ *        with a single fread into a buffer that grows to the largest count
+ *        asked for.
+ *      
+ ************************/
+const unsigned char *readRawScanlines(PPMReader reader, int count)
+{
+        assert(reader != NULL && !reader->plain && count >= 0);
+        assert(reader->lines_read + count <= reader->height);
+        reader->lines_read += count;
+        size_t bytes = count * reader->stride;
+        if (reader->map != NULL) {
+                const unsigned char *lines = reader->next;
+                reader->next += bytes;
+                return lines;
+        }
+        if (bytes > reader->chunk_size) {
+                FREE(reader->chunk);
+                reader->chunk = ALLOC(bytes);
+                reader->chunk_size = bytes;
+        }
+        size_t read = fread(reader->chunk, 1, bytes, reader->input);
+        assert(read == bytes);
+        return reader->chunk;
+}
+
+/********** readScanline ********
+ *
+ * Purpose: Read the next scanline of a PPM image.
+ *
+ * Parameters: 
+ *      PPMReader reader: The reader returned by openPPM.
+ *      struct Pnm_rgb *row: Array to hold the pixels of the scanline.
+ * 
+ * Return: None.
+ *      
+ * Expects: row has room for reader->width pixels, and fewer than
+ *          reader->height scanlines have been read.
+ * 
+ * Notes: Raises a CRE if the file ends early. The samples of a raw scanline
+ *        come from readRawScanlines.
+ *      
+ ************************/
+void readScanline(PPMReader reader, struct Pnm_rgb *row)
+{
+        assert(reader != NULL && row != NULL);
+        unsigned w = reader->width;
+        if (reader->plain) {
+                assert(reader->lines_read < reader->height);
+                reader->lines_read++;
+                for (unsigned i = 0; i < w; i++) {
+                        row[i].red = readHeaderNumber(reader->input);
+                        row[i].green = readHeaderNumber(reader->input);
+                        row[i].blue = readHeaderNumber(reader->input);
+                }
+                return;
+        }
+        const unsigned char *p = readRawScanlines(reader, 1);
+        if (reader->sample_bytes == 1) {
+                for (unsigned i = 0; i < w; i++, p += 3) {
+                        row[i].red = p[0];
+                        row[i].green = p[1];
+                        row[i].blue = p[2];
+                }
+        } else {
+                for (unsigned i = 0; i < w; i++, p += 6) {
+                        row[i].red = (p[0] << 8) | p[1];
+                        row[i].green = (p[2] << 8) | p[3];
+                        row[i].blue = (p[4] << 8) | p[5];
+                }
+        }
+}
+
+/********** finishPPM ********
+ *
+ * Purpose: Skip the scanlines of an image that have not been read, so the
+ *          file is positioned just after it.
+ *
+ * Parameters: 
+ *      PPMReader reader: The reader.
+ * 
+ * Return: None.
+ *      
+ * Expects: reader is not NULL.
+ * 
+ * Notes: Needed before reading another image from the same file, since
+ *        the reader may stop short of an odd last row and a mapped image
+ *        is read without moving the file position. Raises a CRE if the
+ *        file ends early.
+ *      
+ ************************/
+void finishPPM(PPMReader reader)
+{
+        assert(reader != NULL);
+        unsigned left = reader->height - reader->lines_read;
+        if (reader->plain) {
+                struct Pnm_rgb *row = CALLOC(reader->width > 0 ?
+                                             reader->width : 1,
+                                             sizeof(struct Pnm_rgb));
+                for (unsigned i = 0; i < left; i++) {
+                        readScanline(reader, row);
+                }
+                FREE(row);
+                return;
+        }
+        if (left > 0) {
+                readRawScanlines(reader, left);
+        }
+        if (reader->map != NULL) {
+                int moved = fseek(reader->input, reader->next - reader->map,
+                                  SEEK_SET);
+                assert(moved == 0);
+        }
+}
+
+/********** closePPM ********
+ *
+ * Purpose: Free a PPMReader.
+ *
+ * Parameters: 
+ *      PPMReader *reader: Pointer to the reader to free.
+ * 
+ * Return: None.
+ *      
+ * Expects: reader and *reader are not NULL.
+ * 
+ * Notes: Unmaps a mapped image but does not close the underlying file. Sets
+ *        *reader to NULL.
+ *      
+ ************************/
+void closePPM(PPMReader *reader)
+{
+        assert(reader != NULL && *reader != NULL);
+        if ((*reader)->map != NULL) {
+                munmap((void *) (*reader)->map, (*reader)->map_length);
+        }
+        FREE((*reader)->chunk);
+        FREE(*reader);
+}
+
+/********** readHeaderNumber ********
+ *
+ * Purpose: Read an unsigned decimal number from a PPM header or plain
+ *          raster, skipping whitespace and comments before it.
+ *
+ * Parameters: 
+ *      FILE *input: A pointer to a file to read from.
+ * 
+ * Return: The number read.
+ *      
+ * Expects: None.
+ * 
+ * Notes: A comment runs from '#' to the end of the line. Raises Pnm_Badformat
+ *        if no digit is found or the number is not followed by whitespace.
+ *        The whitespace character after the number is consumed, so after
+ *        the maxval of a raw image the raster comes next.
+ *      
+ ************************/
+unsigned readHeaderNumber(FILE *input)
+{
+        int c = getc(input);
+        while (isspace(c) || c == '#') {
+                if (c == '#') {
+                        while (c != '\n' && c != EOF) {
+                                c = getc(input);
+                        }
+                }
+                c = getc(input);
+        }
+        if (!isdigit(c)) {
+                RAISE(Pnm_Badformat);
+        }
+        unsigned n = 0;
+        while (isdigit(c)) {
+                n = 10 * n + (c - '0');
+                c = getc(input);
+        }
+        if (c != EOF && !isspace(c)) {
+                RAISE(Pnm_Badformat);
+        }
+        return n;
+}
@@ -14,14 +14,60 @@
 #include "a2methods.h"
 #include "a2blocked.h"
 #include "pnm.h"
-#include "seq.h"
+#include <stdint.h>
+#include <stdbool.h>
 
 typedef A2Methods_UArray2 A2;
 
+/* Formats of compressed images: fixed 32-bit code words, entropy coded, or
+   entropy coded in tiles with an index */
+#define FORMAT_WORDS 2
+#define FORMAT_ENTROPY 3
+#define FORMAT_TILED 4
+
+/* A sequence of frames, each coding only the blocks that changed */
+#define FORMAT_SEQUENCE 5
+
 Pnm_ppm readPPM(FILE *input);
 void writePPM(Pnm_ppm pixmap);
-void writeCompressed(A2 uarray2b, Seq_T seq);
-struct Pnm_ppm readCompressed(FILE *input, Seq_T seq);
+void writeCompressed(A2 uarray2b, uint32_t *words);
+struct Pnm_ppm readCompressed(FILE *input, uint32_t **words);
+void writeCompressedHeader(FILE *output, int format, unsigned width,
+                           unsigned height);
+void writeWords(FILE *output, uint32_t *words, int count);
+int readCompressedHeader(FILE *input, unsigned *width, unsigned *height);
+void readWords(FILE *input, uint32_t *words, int count);
+void readFormatWords(FILE *input, int format, unsigned width,
+                     unsigned height, uint32_t *words);
+void writeFormatWords(FILE *output, int format, unsigned width,
+                      unsigned height, uint32_t *words);
+void writePPMHeader(unsigned width, unsigned height, unsigned denominator);
+void writeScanline(struct Pnm_rgb *row, unsigned width, unsigned char *raw);
+void packScanline(struct Pnm_rgb *row, unsigned width, unsigned char *raw);
+void writeRawScanlines(const unsigned char *raw, unsigned width,
+                       unsigned count);
+
+/* A PPM image being read one scanline at a time */
+typedef struct PPMReader {
+        FILE *input;
+        unsigned width, height, denominator;
+        bool plain;             /* P3 rather than P6 */
+        int sample_bytes;       /* bytes per raw sample, 1 or 2 */
+        size_t stride;          /* bytes in one raw scanline */
+        unsigned lines_read;    /* scanlines handed out so far */
+        const unsigned char *map;  /* the whole file when mapped, or NULL */
+        size_t map_length;
+        const unsigned char *next; /* next raw scanline in the map */
+        unsigned char *chunk;   /* raw scanlines read when not mapped */
+        size_t chunk_size;
+} *PPMReader;
+
+PPMReader openPPM(FILE *input);
+bool rawPPM(PPMReader reader);
+const unsigned char *readRawScanlines(PPMReader reader, int count);
+void readScanline(PPMReader reader, struct Pnm_rgb *row);
+void finishPPM(PPMReader reader);
+void closePPM(PPMReader *reader);
 
 
 #endif 
\ No newline at end of file
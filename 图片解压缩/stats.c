@@ -0,0 +1,287 @@
+/*
+ *     stats.c
+ *
+ *     Purpose: Implementation for stats. Works like CPUTime_T from the
+ *              rotation program, but reads CLOCK_MONOTONIC instead of the
+ *              process CPU clock, so a stage spread over several threads is
+ *              charged the time it actually took. A Stats keeps a clock
+ *              reading and a running total for each stage it has seen;
+ *              statsMark charges the time since the last mark to a stage
+ *              and starts timing the next one. Allocations are counted by
+ *              standing in for malloc, calloc and realloc in front of the C
+ *              library's own, which every allocation of the program,
+ *              including those through Hanson's Mem interface, goes
+ *              through. Since that replaces them for the whole process, it
+ *              is built only when asked for with -DCOUNT_ALLOCATIONS, with
+ *              the GNU C library and without a sanitizer, which needs the
+ *              allocator to itself; otherwise the counts are reported as
+ *              null.
+ */
+
+#include "stats.h"
+#include "assert.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+/* Most stages a Stats keeps apart */
+#define MAX_STAGES 16
+
+struct Stage {
+        const char *name;
+        uint64_t nanoseconds;
+        uint64_t pixels;
+        uint64_t allocations;
+};
+
+struct Stats {
+        uint64_t created, last;         /* clock readings, in nanoseconds */
+        uint64_t initial, allocations;  /* counts at newStats, last mark */
+        int count;
+        struct Stage stages[MAX_STAGES];  /* in the order first marked */
+};
+
+static uint64_t monotonicNanoseconds(void);
+static uint64_t allocationCount(void);
+static void writeCount(FILE *output, uint64_t count);
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) || \
+    __has_feature(memory_sanitizer)
+#define SANITIZED 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define SANITIZED 1
+#endif
+
+/* Whether malloc, calloc and realloc are replaced to count allocations */
+#if defined(COUNT_ALLOCATIONS) && defined(__GLIBC__) && !defined(SANITIZED)
+#define COUNTING 1
+#endif
+
+#ifdef COUNTING
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+
+/* Allocations made so far by any thread */
+static uint64_t allocations = 0;
+
+void *malloc(size_t size)
+{
+        __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+        return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+        __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+        return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+        __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+        return __libc_realloc(pointer, size);
+}
+
+static uint64_t allocationCount(void)
+{
+        return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+}
+
+#else
+
+static uint64_t allocationCount(void)
+{
+        return 0;
+}
+
+#endif
+
+/********** newStats ********
+ *
+ * Purpose: Make a Stats with no stages.
+ *
+ * Parameters: None.
+ *
+ * Return: The new Stats, timing from now.
+ *
+ * Expects: None.
+ *
+ * Notes: Must be freed with freeStats.
+ *
+ ************************/
+Stats newStats(void)
+{
+        Stats stats;
+        NEW0(stats);
+        stats->created = monotonicNanoseconds();
+        stats->last = stats->created;
+        stats->initial = allocationCount();
+        stats->allocations = stats->initial;
+        return stats;
+}
+
+/********** statsStart ********
+ *
+ * Purpose: Start timing a stage.
+ *
+ * Parameters:
+ *      Stats stats: The Stats, or NULL.
+ *
+ * Return: None.
+ *
+ * Expects: None.
+ *
+ * Notes: The time and allocations since the last mark are not charged to
+ *        any stage, though they still count in the totals.
+ *
+ ************************/
+void statsStart(Stats stats)
+{
+        if (stats == NULL) {
+                return;
+        }
+        stats->last = monotonicNanoseconds();
+        stats->allocations = allocationCount();
+}
+
+/********** statsMark ********
+ *
+ * Purpose: Charge the time and allocations since the last mark to a stage,
+ *          and start timing the next one.
+ *
+ * Parameters:
+ *      Stats stats: The Stats, or NULL.
+ *      const char *stage: Name of the stage, kept as it is.
+ *      uint64_t pixels: Pixels the stage handled in this time.
+ *
+ * Return: None.
+ *
+ * Expects: stage lives as long as stats and needs no escaping in JSON, as a
+ *          string literal naming a function does.
+ *
+ * Notes: A stage marked several times adds up. Raises a CRE if there would
+ *        be more than MAX_STAGES stages.
+ *
+ ************************/
+void statsMark(Stats stats, const char *stage, uint64_t pixels)
+{
+        if (stats == NULL) {
+                return;
+        }
+        assert(stage != NULL);
+        uint64_t now = monotonicNanoseconds();
+        uint64_t count = allocationCount();
+        int i = 0;
+        while (i < stats->count && strcmp(stats->stages[i].name, stage) != 0) {
+                i++;
+        }
+        if (i == stats->count) {
+                assert(stats->count < MAX_STAGES);
+                stats->stages[i] = (struct Stage) { .name = stage };
+                stats->count++;
+        }
+        stats->stages[i].nanoseconds += now - stats->last;
+        stats->stages[i].pixels += pixels;
+        stats->stages[i].allocations += count - stats->allocations;
+        stats->last = now;
+        stats->allocations = count;
+}
+
+/********** statsReport ********
+ *
+ * Purpose: Write the stages as one JSON object.
+ *
+ * Parameters:
+ *      Stats stats: The Stats, or NULL.
+ *      FILE *output: The file to write to, usually standard error.
+ *
+ * Return: None.
+ *
+ * Expects: None.
+ *
+ * Notes: Each stage has its seconds, megapixels, megapixels per second and
+ *        allocations, on a line of its own; then come the seconds and
+ *        allocations since newStats and the peak resident set size in
+ *        kilobytes. Megapixels per second is null for a stage that took no
+ *        measurable time.
+ *
+ ************************/
+void statsReport(Stats stats, FILE *output)
+{
+        if (stats == NULL) {
+                return;
+        }
+        assert(output != NULL);
+        uint64_t now = monotonicNanoseconds();
+        fprintf(output, "{\"stages\": [");
+        for (int i = 0; i < stats->count; i++) {
+                struct Stage *stage = &stats->stages[i];
+                double seconds = stage->nanoseconds / 1e9;
+                double megapixels = stage->pixels / 1e6;
+                fprintf(output, "%s\n  {\"stage\": \"%s\", \"seconds\": %.6f, "
+                        "\"megapixels\": %.3f, \"megapixels_per_second\": ",
+                        i > 0 ? "," : "", stage->name, seconds, megapixels);
+                if (stage->nanoseconds > 0) {
+                        fprintf(output, "%.1f", megapixels / seconds);
+                } else {
+                        fprintf(output, "null");
+                }
+                fprintf(output, ", \"allocations\": ");
+                writeCount(output, stage->allocations);
+                fprintf(output, "}");
+        }
+        struct rusage usage;
+        int got = getrusage(RUSAGE_SELF, &usage);
+        assert(got == 0);
+        fprintf(output, "\n ], \"seconds\": %.6f, \"allocations\": ",
+                (now - stats->created) / 1e9);
+        writeCount(output, allocationCount() - stats->initial);
+        fprintf(output, ", \"peak_rss_kb\": %ld}\n", usage.ru_maxrss);
+}
+
+/********** freeStats ********
+ *
+ * Purpose: Free a Stats.
+ *
+ * Parameters:
+ *      Stats *stats: Pointer to the Stats.
+ *
+ * Return: None.
+ *
+ * Expects: stats and *stats are not NULL.
+ *
+ * Notes: Sets *stats to NULL.
+ *
+ ************************/
+void freeStats(Stats *stats)
+{
+        assert(stats != NULL && *stats != NULL);
+        FREE(*stats);
+}
+
+/* Reading of the monotonic clock, in nanoseconds */
+static uint64_t monotonicNanoseconds(void)
+{
+        struct timespec now;
+        int got = clock_gettime(CLOCK_MONOTONIC, &now);
+        assert(got == 0);
+        return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* A count of allocations in JSON, or null if they are not counted */
+static void writeCount(FILE *output, uint64_t count)
+{
+#ifdef COUNTING
+        fprintf(output, "%llu", (unsigned long long) count);
+#else
+        (void) count;
+        fprintf(output, "null");
+#endif
+}
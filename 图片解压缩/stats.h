@@ -0,0 +1,27 @@
+/*
+ *     stats.h
+ *
+ *     Purpose: Interface for stats. Times the stages of one compression or
+ *              decompression with the monotonic clock and reports, as JSON,
+ *              the time and megapixels per second of each stage, the memory
+ *              allocations made in it (in a build that counts them) and the
+ *              peak resident set size of the process. Calls on a NULL Stats
+ *              do nothing, so the stages can be marked whether or not
+ *              anyone is timing them.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef struct Stats *Stats;
+
+Stats newStats(void);
+void statsStart(Stats stats);
+void statsMark(Stats stats, const char *stage, uint64_t pixels);
+void statsReport(Stats stats, FILE *output);
+void freeStats(Stats *stats);
+
+#endif
@@ -0,0 +1,350 @@
+/*
+ *     tiles.c
+ *
+ *     Purpose: Implementation for tiles. A file in format 4 is the usual
+ *              header, then the index: the offset of each tile from the end
+ *              of the index, tiles in row-major order, and then the total
+ *              length of the tiles, each as 8 bytes big-endian. Each tile is
+ *              one segment of entropy holding the tile's code words in
+ *              row-major order; tiles in the last row or column are cut
+ *              short by the edge of the image. Since the index comes before
+ *              the tiles, the writer collects the coded tiles in memory and
+ *              writes everything when it is closed; only one row of tiles
+ *              of code words is kept before coding. The reader reads tiles
+ *              in increasing order of offset and skips forward over the
+ *              others, by seeking when the file allows it and by reading
+ *              otherwise, so it also works on a pipe.
+ */
+
+#include "tiles.h"
+#include "entropy.h"
+#include "imageIO.h"
+#include "assert.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if TILE_BLOCKS > SEGMENT_ROWS
+#error "a tile must fit in one segment of entropy"
+#endif
+
+struct TileWriter {
+        FILE *output;
+        unsigned width, height;
+        int blocks_in_row, block_rows;
+        int tile_cols, tile_rows;
+        uint32_t *strip;        /* code words of one row of tiles */
+        int strip_count;        /* words in it so far */
+        int tile_row;           /* next row of tiles to code */
+        uint64_t *offsets;      /* of each tile, then the total */
+        FILE *tiles;            /* the coded tiles, in memory */
+        char *buffer;           /* behind tiles */
+        size_t size;
+};
+
+struct TileReader {
+        FILE *input;
+        int blocks_in_row, block_rows;
+        int tile_cols, tile_rows;
+        uint64_t *offsets;      /* of each tile, then the total */
+        uint64_t position;      /* bytes after the index read so far */
+};
+
+static void flushStrip(TileWriter writer);
+static int tilesAcross(int blocks);
+static int tileSpan(int blocks, int tile);
+
+/********** newTileWriter ********
+ *
+ * Purpose: Start writing a compressed image in format 4.
+ *
+ * Parameters:
+ *      FILE *output: The file to write to.
+ *      unsigned width: Width of the image after trimming.
+ *      unsigned height: Height of the image after trimming.
+ *
+ * Return: A writer for tileWriteWords.
+ *
+ * Expects: width and height are even.
+ *
+ * Notes: Nothing is written until closeTileWriter, which also writes the
+ *        header.
+ *
+ ************************/
+TileWriter newTileWriter(FILE *output, unsigned width, unsigned height)
+{
+        assert(output != NULL);
+        TileWriter writer;
+        NEW(writer);
+        writer->output = output;
+        writer->width = width;
+        writer->height = height;
+        writer->blocks_in_row = width / 2;
+        writer->block_rows = height / 2;
+        writer->tile_cols = tilesAcross(writer->blocks_in_row);
+        writer->tile_rows = writer->tile_cols > 0 ?
+                            tilesAcross(writer->block_rows) : 0;
+        int strip = TILE_BLOCKS * writer->blocks_in_row;
+        writer->strip = CALLOC(strip > 0 ? strip : 1, sizeof(uint32_t));
+        writer->strip_count = 0;
+        writer->tile_row = 0;
+        writer->offsets = CALLOC(writer->tile_cols * writer->tile_rows + 1,
+                                 sizeof(uint64_t));
+        writer->buffer = NULL;
+        writer->size = 0;
+        writer->tiles = open_memstream(&writer->buffer, &writer->size);
+        assert(writer->tiles != NULL);
+        return writer;
+}
+
+/********** tileWriteWords ********
+ *
+ * Purpose: Write code words of an image in format 4.
+ *
+ * Parameters:
+ *      TileWriter writer: The writer from newTileWriter.
+ *      uint32_t *words: The next code words, in row-major order of the
+ *                       blocks of the whole image.
+ *      int count: Number of code words.
+ *
+ * Return: None.
+ *
+ * Expects: The words of the whole image are written in order, in any
+ *          number of calls.
+ *
+ * Notes: Each row of tiles is coded as soon as its words are all in, so
+ *        the bytes do not depend on how the words are split between calls.
+ *
+ ************************/
+void tileWriteWords(TileWriter writer, uint32_t *words, int count)
+{
+        assert(writer != NULL && words != NULL && count >= 0);
+        while (count > 0) {
+                int rows = writer->block_rows - TILE_BLOCKS * writer->tile_row;
+                if (rows > TILE_BLOCKS) {
+                        rows = TILE_BLOCKS;
+                }
+                int take = rows * writer->blocks_in_row - writer->strip_count;
+                assert(take > 0);
+                if (take > count) {
+                        take = count;
+                }
+                memcpy(&writer->strip[writer->strip_count], words,
+                       take * sizeof(uint32_t));
+                writer->strip_count += take;
+                words += take;
+                count -= take;
+                if (writer->strip_count == rows * writer->blocks_in_row) {
+                        flushStrip(writer);
+                }
+        }
+}
+
+/********** closeTileWriter ********
+ *
+ * Purpose: Write a compressed image in format 4 and free the writer.
+ *
+ * Parameters:
+ *      TileWriter *writer: Pointer to the writer.
+ *
+ * Return: None.
+ *
+ * Expects: Every code word of the image has been written.
+ *
+ * Notes: Writes the header, the index and the coded tiles. Sets *writer
+ *        to NULL. Does not close the file.
+ *
+ ************************/
+void closeTileWriter(TileWriter *writer)
+{
+        assert(writer != NULL && *writer != NULL);
+        TileWriter w = *writer;
+        assert(w->tile_row == w->tile_rows);
+        int closed = fclose(w->tiles);
+        assert(closed == 0);
+        int tiles = w->tile_cols * w->tile_rows;
+        w->offsets[tiles] = w->size;
+
+        writeCompressedHeader(w->output, FORMAT_TILED, w->width, w->height);
+        unsigned char *index = ALLOC(8 * (size_t) (tiles + 1));
+        for (int t = 0; t <= tiles; t++) {
+                for (int b = 0; b < 8; b++) {
+                        index[8 * t + b] = w->offsets[t] >> (56 - 8 * b);
+                }
+        }
+        size_t written = fwrite(index, 8, tiles + 1, w->output);
+        assert(written == (size_t) tiles + 1);
+        written = fwrite(w->buffer, 1, w->size, w->output);
+        assert(written == w->size);
+
+        FREE(index);
+        free(w->buffer);
+        FREE(w->offsets);
+        FREE(w->strip);
+        FREE(*writer);
+}
+
+/********** newTileReader ********
+ *
+ * Purpose: Start reading the tiles of a compressed image in format 4.
+ *
+ * Parameters:
+ *      FILE *input: The file to read from, positioned after the header.
+ *      unsigned width: Width of the image, from the header.
+ *      unsigned height: Height of the image, from the header.
+ *
+ * Return: A reader for readTile.
+ *
+ * Expects: None.
+ *
+ * Notes: Reads the index. Raises a CRE if the file ends within it or the
+ *        offsets go backwards. Must be freed with freeTileReader.
+ *
+ ************************/
+TileReader newTileReader(FILE *input, unsigned width, unsigned height)
+{
+        assert(input != NULL);
+        TileReader reader;
+        NEW(reader);
+        reader->input = input;
+        reader->blocks_in_row = width / 2;
+        reader->block_rows = height / 2;
+        reader->tile_cols = tilesAcross(reader->blocks_in_row);
+        reader->tile_rows = reader->tile_cols > 0 ?
+                            tilesAcross(reader->block_rows) : 0;
+        int tiles = reader->tile_cols * reader->tile_rows;
+        reader->offsets = CALLOC(tiles + 1, sizeof(uint64_t));
+        unsigned char *index = ALLOC(8 * (size_t) (tiles + 1));
+        size_t got = fread(index, 8, tiles + 1, input);
+        assert(got == (size_t) tiles + 1);
+        for (int t = 0; t <= tiles; t++) {
+                uint64_t offset = 0;
+                for (int b = 0; b < 8; b++) {
+                        offset = (offset << 8) | index[8 * t + b];
+                }
+                assert(t == 0 ? offset == 0 :
+                                offset >= reader->offsets[t - 1]);
+                reader->offsets[t] = offset;
+        }
+        FREE(index);
+        reader->position = 0;
+        return reader;
+}
+
+/********** readTile ********
+ *
+ * Purpose: Decode the code words of one tile.
+ *
+ * Parameters:
+ *      TileReader reader: The reader from newTileReader.
+ *      int tile_row: Row of the tile, counted in tiles.
+ *      int tile_col: Column of the tile, counted in tiles.
+ *      uint32_t *words: Set to the tile's code words, row by row.
+ *      int stride: Words from the start of one row of the tile in words to
+ *                  the start of the next.
+ *
+ * Return: None.
+ *
+ * Expects: The tile exists and comes after the last tile read; stride is
+ *          at least the width of the tile in blocks, which is TILE_BLOCKS
+ *          except in the last column.
+ *
+ * Notes: Skips to the tile from the last one read. Raises a CRE if the file
+ *        ends early or the tile is not validly coded.
+ *
+ ************************/
+void readTile(TileReader reader, int tile_row, int tile_col,
+              uint32_t *words, int stride)
+{
+        assert(reader != NULL && words != NULL);
+        assert(tile_row >= 0 && tile_row < reader->tile_rows);
+        assert(tile_col >= 0 && tile_col < reader->tile_cols);
+        int t = tile_row * reader->tile_cols + tile_col;
+        assert(reader->offsets[t] >= reader->position);
+        uint64_t skip = reader->offsets[t] - reader->position;
+        if (skip > 0 && fseek(reader->input, skip, SEEK_CUR) != 0) {
+                for (uint64_t i = 0; i < skip; i++) {
+                        int c = getc(reader->input);
+                        assert(c != EOF);
+                }
+        }
+        int cols = tileSpan(reader->blocks_in_row, tile_col);
+        int rows = tileSpan(reader->block_rows, tile_row);
+        assert(stride >= cols);
+        EntropyReader entropy = newEntropyReader(reader->input, cols, rows);
+        for (int r = 0; r < rows; r++) {
+                entropyReadWords(entropy, &words[r * stride], cols);
+        }
+        freeEntropyReader(&entropy);
+        reader->position = reader->offsets[t + 1];
+}
+
+/********** freeTileReader ********
+ *
+ * Purpose: Free a reader.
+ *
+ * Parameters:
+ *      TileReader *reader: Pointer to the reader.
+ *
+ * Return: None.
+ *
+ * Expects: reader and *reader are not NULL.
+ *
+ * Notes: Sets *reader to NULL. Does not close the file.
+ *
+ ************************/
+void freeTileReader(TileReader *reader)
+{
+        assert(reader != NULL && *reader != NULL);
+        FREE((*reader)->offsets);
+        FREE(*reader);
+}
+
+/********** flushStrip ********
+ *
+ * Purpose: Code the row of tiles held by a writer.
+ *
+ * Parameters:
+ *      TileWriter writer: The writer, with the words of a whole row of
+ *                         tiles.
+ *
+ * Return: None.
+ *
+ * Expects: None.
+ *
+ * Notes: Each tile is coded as one segment through its own EntropyWriter
+ *        into the in-memory file, after noting its offset.
+ *
+ ************************/
+static void flushStrip(TileWriter writer)
+{
+        int rows = tileSpan(writer->block_rows, writer->tile_row);
+        for (int tc = 0; tc < writer->tile_cols; tc++) {
+                int cols = tileSpan(writer->blocks_in_row, tc);
+                int t = writer->tile_row * writer->tile_cols + tc;
+                writer->offsets[t] = ftell(writer->tiles);
+                EntropyWriter entropy = newEntropyWriter(writer->tiles, cols);
+                for (int r = 0; r < rows; r++) {
+                        uint32_t *row = &writer->strip[r *
+                                                       writer->blocks_in_row];
+                        entropyWriteWords(entropy, &row[tc * TILE_BLOCKS],
+                                          cols);
+                }
+                closeEntropyWriter(&entropy);
+        }
+        writer->strip_count = 0;
+        writer->tile_row++;
+}
+
+/* Number of tiles needed to cover a number of blocks */
+static int tilesAcross(int blocks)
+{
+        return (blocks + TILE_BLOCKS - 1) / TILE_BLOCKS;
+}
+
+/* Number of blocks a tile covers, at most TILE_BLOCKS */
+static int tileSpan(int blocks, int tile)
+{
+        int span = blocks - tile * TILE_BLOCKS;
+        return span < TILE_BLOCKS ? span : TILE_BLOCKS;
+}
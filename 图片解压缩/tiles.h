@@ -0,0 +1,33 @@
+/*
+ *     tiles.h
+ *
+ *     Purpose: Interface for tiles. Reads and writes the code words of a
+ *              compressed image in format 4, where the blocks are grouped
+ *              into square tiles of TILE_BLOCKS blocks on a side, each tile
+ *              is entropy coded on its own, and an index after the header
+ *              gives the offset of every tile, so a rectangle of the image
+ *              can be decoded from only the tiles it overlaps.
+ */
+
+#ifndef TILES_H
+#define TILES_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Blocks on a side of a tile, so a tile is one segment of entropy */
+#define TILE_BLOCKS 64
+
+typedef struct TileWriter *TileWriter;
+typedef struct TileReader *TileReader;
+
+TileWriter newTileWriter(FILE *output, unsigned width, unsigned height);
+void tileWriteWords(TileWriter writer, uint32_t *words, int count);
+void closeTileWriter(TileWriter *writer);
+
+TileReader newTileReader(FILE *input, unsigned width, unsigned height);
+void readTile(TileReader reader, int tile_row, int tile_col,
+              uint32_t *words, int stride);
+void freeTileReader(TileReader *reader);
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ *     tiletest.c
+ *
+ *     Purpose: Test program for the tiled format. Compresses images into
+ *              format 2 and format 4 and checks that decompress40 and
+ *              decompress40_preview write the same bytes for both, and
+ *              that the preview header has half the trimmed size. The
+ *              sizes include images with no whole block (1x1, 1xN, Nx1),
+ *              whose tiled files hold only a header and an empty index, and
+ *              an image wider than one tile. For two images of several
+ *              tiles, it checks that decompress40_region of either format
+ *              writes the rectangle cut from the full decode, and the
+ *              preview of a region the blocks cut from the full preview,
+ *              for rectangles across tile boundaries, at odd positions and
+ *              sizes, and running past the edge.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "assert.h"
+#include "mem.h"
+#include "compress40.h"
+#include "compress40ext.h"
+
+#define IMAGES 7
+#define CROPPED 2
+#define REGIONS 8
+
+static struct Compress40_region crop;
+
+static FILE *makeImage(unsigned width, unsigned height);
+static FILE *compressTo(FILE *image, bool tiled);
+static FILE *capture(void (*decode)(FILE *input), FILE *input);
+static void previewWhole(FILE *input);
+static bool sameBytes(FILE *a, FILE *b);
+static bool previewHeader(FILE *preview, unsigned width, unsigned height);
+static void decodeCrop(FILE *input);
+static void previewCrop(FILE *input);
+static unsigned char *readImage(FILE *image, unsigned *width,
+                                unsigned *height);
+static bool isCut(FILE *whole, FILE *part, unsigned x, unsigned y,
+                  unsigned width, unsigned height);
+static bool regionsMatch(FILE *words, FILE *tiled, unsigned width,
+                         unsigned height);
+
+int main(void)
+{
+        unsigned sizes[IMAGES][2] = {
+                { 1, 1 }, { 1, 6 }, { 6, 1 }, { 3, 1 }, { 2, 2 },
+                { 131, 5 }, { 20, 139 }
+        };
+        int failures = 0;
+        srand(40);
+        for (int i = 0; i < IMAGES; i++) {
+                unsigned width = sizes[i][0], height = sizes[i][1];
+                FILE *image = makeImage(width, height);
+                FILE *words = compressTo(image, false);
+                FILE *tiled = compressTo(image, true);
+                FILE *decoded = capture(decompress40, words);
+                FILE *tiled_decoded = capture(decompress40, tiled);
+                FILE *preview = capture(previewWhole, words);
+                FILE *tiled_preview = capture(previewWhole, tiled);
+                bool ok = sameBytes(decoded, tiled_decoded) &&
+                          sameBytes(preview, tiled_preview) &&
+                          previewHeader(tiled_preview, width, height);
+                printf("%3ux%-3u %s\n", width, height, ok ? "ok" : "FAIL");
+                failures += !ok;
+                fclose(tiled_preview);
+                fclose(preview);
+                fclose(tiled_decoded);
+                fclose(decoded);
+                fclose(tiled);
+                fclose(words);
+                fclose(image);
+        }
+        unsigned cropped[CROPPED][2] = { { 300, 270 }, { 389, 131 } };
+        for (int i = 0; i < CROPPED; i++) {
+                unsigned width = cropped[i][0], height = cropped[i][1];
+                FILE *image = makeImage(width, height);
+                FILE *words = compressTo(image, false);
+                FILE *tiled = compressTo(image, true);
+                bool ok = regionsMatch(words, tiled, width, height);
+                printf("%3ux%-3u regions %s\n", width, height,
+                       ok ? "ok" : "FAIL");
+                failures += !ok;
+                fclose(tiled);
+                fclose(words);
+                fclose(image);
+        }
+        return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* A raw PPM image of random pixels in a temporary file, rewound */
+static FILE *makeImage(unsigned width, unsigned height)
+{
+        FILE *image = tmpfile();
+        assert(image != NULL);
+        fprintf(image, "P6\n%u %u\n255\n", width, height);
+        for (unsigned i = 0; i < 3 * width * height; i++) {
+                putc(rand() & 0xFF, image);
+        }
+        rewind(image);
+        return image;
+}
+
+/* The image compressed into format 2 or 4 in a temporary file, rewound;
+   the image is rewound too */
+static FILE *compressTo(FILE *image, bool tiled)
+{
+        struct Compress40_options options = { .threads = 1, .fixed = false,
+                                              .entropy = false,
+                                              .tiled = tiled };
+        FILE *output = tmpfile();
+        assert(output != NULL);
+        Compress40_buffers buffers = newCompress40Buffers();
+        compress40_buffered(image, output, &options, buffers);
+        freeCompress40Buffers(&buffers);
+        rewind(image);
+        rewind(output);
+        return output;
+}
+
+/* What decode writes to standard output for input, in a temporary file,
+   rewound */
+static FILE *capture(void (*decode)(FILE *input), FILE *input)
+{
+        FILE *output = tmpfile();
+        assert(output != NULL);
+        fflush(stdout);
+        int saved = dup(STDOUT_FILENO);
+        assert(saved >= 0);
+        int moved = dup2(fileno(output), STDOUT_FILENO);
+        assert(moved >= 0);
+        decode(input);
+        fflush(stdout);
+        moved = dup2(saved, STDOUT_FILENO);
+        assert(moved >= 0);
+        close(saved);
+        rewind(input);
+        rewind(output);
+        return output;
+}
+
+/* decompress40_preview of the whole image */
+static void previewWhole(FILE *input)
+{
+        decompress40_preview(input, NULL);
+}
+
+/* Whether two files hold the same bytes; both are rewound after */
+static bool sameBytes(FILE *a, FILE *b)
+{
+        int ca, cb;
+        do {
+                ca = getc(a);
+                cb = getc(b);
+        } while (ca == cb && ca != EOF);
+        rewind(a);
+        rewind(b);
+        return ca == cb;
+}
+
+/* Whether a preview starts with the header of an image of one pixel per
+   whole block; the preview is rewound after */
+static bool previewHeader(FILE *preview, unsigned width, unsigned height)
+{
+        char expected[64], header[64];
+        int length = snprintf(expected, sizeof(expected), "P6\n%u %u\n255\n",
+                              width / 2, height / 2);
+        size_t got = fread(header, 1, length, preview);
+        rewind(preview);
+        return got == (size_t) length &&
+               memcmp(header, expected, length) == 0;
+}
+
+/* decompress40_region of the rectangle in crop */
+static void decodeCrop(FILE *input)
+{
+        decompress40_region(input, &crop);
+}
+
+/* decompress40_preview of the rectangle in crop */
+static void previewCrop(FILE *input)
+{
+        decompress40_preview(input, &crop);
+}
+
+/* The pixels of a raw PPM image with maxval 255, 3 bytes each, row after
+   row, in a new array that the caller frees; the image is rewound after */
+static unsigned char *readImage(FILE *image, unsigned *width,
+                                unsigned *height)
+{
+        int read = fscanf(image, "P6 %u %u 255", width, height);
+        assert(read == 2 && getc(image) == '\n');
+        size_t size = 3 * (size_t) *width * *height;
+        unsigned char *pixels = ALLOC(size > 0 ? size : 1);
+        size_t got = fread(pixels, 1, size, image);
+        assert(got == size);
+        rewind(image);
+        return pixels;
+}
+
+/* Whether the image in part is the width by height rectangle of whole at
+   (x, y); both are rewound after */
+static bool isCut(FILE *whole, FILE *part, unsigned x, unsigned y,
+                  unsigned width, unsigned height)
+{
+        unsigned whole_width, whole_height, part_width, part_height;
+        unsigned char *all = readImage(whole, &whole_width, &whole_height);
+        unsigned char *cut = readImage(part, &part_width, &part_height);
+        bool same = part_width == width && part_height == height &&
+                    x + width <= whole_width && y + height <= whole_height;
+        for (unsigned row = 0; same && row < height; row++) {
+                same = memcmp(cut + 3 * (size_t) row * width,
+                              all + 3 * ((size_t) (y + row) * whole_width +
+                                         x),
+                              3 * (size_t) width) == 0;
+        }
+        FREE(cut);
+        FREE(all);
+        return same;
+}
+
+/* Whether decompress40_region of format 2 and format 4 both write each
+   test rectangle cut from the full decode, trimmed to the image, and
+   decompress40_preview of the rectangle the blocks it overlaps cut from
+   the full preview; the files are rewound after */
+static bool regionsMatch(FILE *words, FILE *tiled, unsigned width,
+                         unsigned height)
+{
+        unsigned w = width & ~1u, h = height & ~1u;
+        struct Compress40_region regions[REGIONS] = {
+                { 0, 0, w, h }, { 0, 0, 1, 1 }, { 127, 127, 3, 3 },
+                { 126, 0, 4, h }, { 1, 5, 255, 1 }, { 129, 67, 171, 63 },
+                { w - 1, h - 1, 1, 1 }, { w - 3, 255 % h, 100, 100 }
+        };
+        FILE *decoded = capture(decompress40, words);
+        FILE *preview = capture(previewWhole, words);
+        bool ok = true;
+        for (int i = 0; ok && i < REGIONS; i++) {
+                crop = regions[i];
+                unsigned cut_width = w - crop.x < crop.width ?
+                                     w - crop.x : crop.width;
+                unsigned cut_height = h - crop.y < crop.height ?
+                                      h - crop.y : crop.height;
+                unsigned first_col = crop.x / 2, first_row = crop.y / 2;
+                unsigned blocks = (crop.x + cut_width - 1) / 2 - first_col + 1;
+                unsigned rows = (crop.y + cut_height - 1) / 2 - first_row + 1;
+                FILE *inputs[2] = { words, tiled };
+                for (int j = 0; ok && j < 2; j++) {
+                        FILE *part = capture(decodeCrop, inputs[j]);
+                        FILE *small = capture(previewCrop, inputs[j]);
+                        ok = isCut(decoded, part, crop.x, crop.y, cut_width,
+                                   cut_height) &&
+                             isCut(preview, small, first_col, first_row,
+                                   blocks, rows);
+                        if (!ok) {
+                                printf("region %u,%u,%u,%u of format %d "
+                                       "FAIL\n", crop.x, crop.y,
+                                       crop.width, crop.height,
+                                       j == 0 ? 2 : 4);
+                        }
+                        fclose(small);
+                        fclose(part);
+                }
+        }
+        fclose(preview);
+        fclose(decoded);
+        return ok;
+}
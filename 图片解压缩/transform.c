@@ -0,0 +1,157 @@
+/*
+ *     transform.c
+ *
+ *     Purpose: Implementation for transform. In a block Y1 is the top left
+ *              pixel, Y2 the top right, Y3 the bottom left and Y4 the bottom
+ *              right, and b = (Y4 + Y3 - Y2 - Y1) / 4 goes from top to
+ *              bottom, c = (Y4 - Y3 + Y2 - Y1) / 4 from left to right and
+ *              d = (Y4 - Y3 - Y2 + Y1) / 4 along the diagonals. Moving the
+ *              pixels within the block turns these into each other:
+ *
+ *                  rotation 90:      b' =  c   c' = -b   d' = -d
+ *                  rotation 180:     b' = -b   c' = -c   d' =  d
+ *                  rotation 270:     b' = -c   c' =  b   d' = -d
+ *                  flip horizontal:  b' =  b   c' = -c   d' = -d
+ *                  flip vertical:    b' = -b   c' =  c   d' = -d
+ *                  transpose:        b' =  c   c' =  b   d' =  d
+ *
+ *              a and the chroma of the block are unchanged. The quantized
+ *              coefficients lie in -31..31 and decode symmetrically about
+ *              zero, so negating one is exact.
+ */
+
+#include "transform.h"
+#include "assert.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Offsets of the fields of a code word, as in fused */
+#define B_LSB 20
+#define C_LSB 14
+#define D_LSB 8
+#define BCD_MASK 0x3Fu
+
+static int coefficient(uint32_t word, int lsb);
+static uint32_t withCoefficients(uint32_t word, int b, int c, int d);
+
+/********** transformWord ********
+ *
+ * Purpose: Transform the pixels of one block.
+ *
+ * Parameters:
+ *      uint32_t word: The code word of the block.
+ *      int rotation: 0, 90, 180 or 270 degrees clockwise.
+ *      enum flip flip_type: A flip, or none.
+ *
+ * Return: The code word of the block with its pixels rotated or flipped.
+ *
+ * Expects: Only one of rotation and flip_type is given.
+ *
+ * Notes: Raises a CRE for any other rotation.
+ *
+ ************************/
+uint32_t transformWord(uint32_t word, int rotation, enum flip flip_type)
+{
+        int b = coefficient(word, B_LSB);
+        int c = coefficient(word, C_LSB);
+        int d = coefficient(word, D_LSB);
+        if (flip_type == horizontal) {
+                return withCoefficients(word, b, -c, -d);
+        } else if (flip_type == vertical) {
+                return withCoefficients(word, -b, c, -d);
+        } else if (flip_type == transpose) {
+                return withCoefficients(word, c, b, d);
+        }
+        assert(flip_type == none);
+        if (rotation == 90) {
+                return withCoefficients(word, c, -b, -d);
+        } else if (rotation == 180) {
+                return withCoefficients(word, -b, -c, d);
+        } else if (rotation == 270) {
+                return withCoefficients(word, -c, b, -d);
+        }
+        assert(rotation == 0);
+        return word;
+}
+
+/********** transformWords ********
+ *
+ * Purpose: Rotate or flip an image given by its code words.
+ *
+ * Parameters:
+ *      uint32_t *words: The code words of the image, in row-major order of
+ *                       the blocks.
+ *      unsigned width: Width of the image, in pixels.
+ *      unsigned height: Height of the image, in pixels.
+ *      int rotation: 0, 90, 180 or 270 degrees clockwise.
+ *      enum flip flip_type: A flip, or none.
+ *      uint32_t *out: Set to the code words of the transformed image.
+ *      unsigned *new_width: Set to the width of the transformed image.
+ *      unsigned *new_height: Set to the height of the transformed image.
+ *
+ * Return: None.
+ *
+ * Expects: out holds as many words as words and does not overlap it; only
+ *          one of rotation and flip_type is given.
+ *
+ * Notes: The block at column i and row j goes where ppmtrans would put the
+ *        pixel at (i, j) in an image of the blocks, so a rotation by 90 or
+ *        270 degrees and a transpose swap the width and height. Any odd
+ *        last column or row is dropped, as it is by compression.
+ *
+ ************************/
+void transformWords(uint32_t *words, unsigned width, unsigned height,
+                    int rotation, enum flip flip_type, uint32_t *out,
+                    unsigned *new_width, unsigned *new_height)
+{
+        assert(words != NULL && out != NULL);
+        assert(new_width != NULL && new_height != NULL);
+        int w = width / 2, h = height / 2;
+        bool turned = rotation == 90 || rotation == 270 ||
+                      flip_type == transpose;
+        int out_w = turned ? h : w;
+        for (int j = 0; j < h; j++) {
+                for (int i = 0; i < w; i++) {
+                        int col = i, row = j;
+                        if (flip_type == horizontal) {
+                                col = w - i - 1;
+                        } else if (flip_type == vertical) {
+                                row = h - j - 1;
+                        } else if (flip_type == transpose) {
+                                col = j;
+                                row = i;
+                        } else if (rotation == 90) {
+                                col = h - j - 1;
+                                row = i;
+                        } else if (rotation == 180) {
+                                col = w - i - 1;
+                                row = h - j - 1;
+                        } else if (rotation == 270) {
+                                col = j;
+                                row = w - i - 1;
+                        }
+                        out[row * out_w + col] =
+                                transformWord(words[j * w + i], rotation,
+                                              flip_type);
+                }
+        }
+        *new_width = 2 * (turned ? h : w);
+        *new_height = 2 * (turned ? w : h);
+}
+
+/* The signed coefficient whose field starts at lsb */
+static int coefficient(uint32_t word, int lsb)
+{
+        return ((int32_t) (word << (26 - lsb))) >> 26;
+}
+
+/* word with its coefficients b, c and d replaced */
+static uint32_t withCoefficients(uint32_t word, int b, int c, int d)
+{
+        uint32_t fields = (BCD_MASK << B_LSB) | (BCD_MASK << C_LSB) |
+                          (BCD_MASK << D_LSB);
+        return (word & ~fields) |
+               (((uint32_t) b & BCD_MASK) << B_LSB) |
+               (((uint32_t) c & BCD_MASK) << C_LSB) |
+               (((uint32_t) d & BCD_MASK) << D_LSB);
+}
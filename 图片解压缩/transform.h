@@ -0,0 +1,28 @@
+/*
+ *     transform.h
+ *
+ *     Purpose: Interface for transform. Rotates or flips an image by its
+ *              code words alone: every block moves to where ppmtrans would
+ *              put its pixels, and within the block the four pixels trade
+ *              places, which only swaps and negates the cosine coefficients
+ *              b, c and d. The decoded image is exactly the one ppmtrans
+ *              makes from the decoded original: the decoder adds a + d,
+ *              a - d, b + c and c - b before anything else, and negating
+ *              or swapping b, c and d only trades those sums, so no float
+ *              rounding comes out differently.
+ */
+
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <stdint.h>
+
+/* The flips of ppmtrans; a rotation is in degrees, 0, 90, 180 or 270 */
+enum flip {none = 0, horizontal = 1, vertical = 2, transpose = 3};
+
+uint32_t transformWord(uint32_t word, int rotation, enum flip flip_type);
+void transformWords(uint32_t *words, unsigned width, unsigned height,
+                    int rotation, enum flip flip_type, uint32_t *out,
+                    unsigned *new_width, unsigned *new_height);
+
+#endif
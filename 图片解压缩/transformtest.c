@@ -0,0 +1,297 @@
+/*
+ *     transformtest.c
+ *
+ *     Purpose: Test program for transform. For every code word with its b,
+ *              c and d in range and every A_STEP-th a, checks that
+ *              decompressRow of the word transformWord makes holds the four
+ *              pixels of the original block where ppmtrans would put them,
+ *              with nothing changed by float rounding. Then compresses
+ *              images of even and odd size into formats 2, 3 and 4, and
+ *              checks that decompressing what transform40 makes of each
+ *              gives the same bytes as rotating or flipping the decompressed
+ *              original.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "assert.h"
+#include "mem.h"
+#include "fused.h"
+#include "transform.h"
+#include "compress40.h"
+#include "compress40ext.h"
+
+#define TRANSFORMS 6
+#define IMAGES 3
+#define FORMATS 3
+
+/* Quantized b, c and d lie in -31..31, so a row of 63 blocks sweeps d */
+#define LEVELS 63
+
+/* Every A_STEP-th a, from 0 to 63, keeps the sweep of code words short */
+#define A_STEP 7
+
+static const struct {
+        const char *name;
+        int rotation;
+        enum flip flip_type;
+} transforms[TRANSFORMS] = {
+        { "rotate90", 90, none }, { "rotate180", 180, none },
+        { "rotate270", 270, none }, { "flip-h", 0, horizontal },
+        { "flip-v", 0, vertical }, { "transpose", 0, transpose }
+};
+
+static void place(int t, unsigned width, unsigned height, unsigned col,
+                  unsigned row, unsigned *new_col, unsigned *new_row);
+static bool sameRGB(struct Pnm_rgb x, struct Pnm_rgb y);
+static bool blocksMatch(void);
+static bool rowMatches(uint32_t *words, struct Pnm_rgb *top,
+                       struct Pnm_rgb *bottom, int t, void *scratch);
+static FILE *makeImage(unsigned width, unsigned height);
+static FILE *compressTo(FILE *image, int format);
+static FILE *capture(void (*decode)(FILE *input), FILE *input);
+static unsigned char *readImage(FILE *image, unsigned *width,
+                                unsigned *height);
+static bool isTransformed(FILE *original, FILE *transformed, int t);
+
+int main(void)
+{
+        int failures = 0;
+        bool ok = blocksMatch();
+        printf("all code words %s\n", ok ? "ok" : "FAIL");
+        failures += !ok;
+
+        unsigned sizes[IMAGES][2] = { { 2, 2 }, { 6, 4 }, { 257, 131 } };
+        srand(40);
+        for (int i = 0; i < IMAGES; i++) {
+                unsigned width = sizes[i][0], height = sizes[i][1];
+                FILE *image = makeImage(width, height);
+                for (int format = 2; format < 2 + FORMATS; format++) {
+                        FILE *words = compressTo(image, format);
+                        FILE *decoded = capture(decompress40, words);
+                        ok = true;
+                        for (int t = 0; ok && t < TRANSFORMS; t++) {
+                                FILE *moved = tmpfile();
+                                assert(moved != NULL);
+                                transform40(words, moved,
+                                            transforms[t].rotation,
+                                            transforms[t].flip_type);
+                                rewind(words);
+                                rewind(moved);
+                                FILE *moved_decoded = capture(decompress40,
+                                                              moved);
+                                ok = isTransformed(decoded, moved_decoded,
+                                                   t);
+                                if (!ok) {
+                                        printf("%s FAIL\n",
+                                               transforms[t].name);
+                                }
+                                fclose(moved_decoded);
+                                fclose(moved);
+                        }
+                        printf("%3ux%-3u format %d %s\n", width, height,
+                               format, ok ? "ok" : "FAIL");
+                        failures += !ok;
+                        fclose(decoded);
+                        fclose(words);
+                }
+                fclose(image);
+        }
+        return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Where ppmtrans puts the pixel at (col, row) of a width by height image
+   under transformation t */
+static void place(int t, unsigned width, unsigned height, unsigned col,
+                  unsigned row, unsigned *new_col, unsigned *new_row)
+{
+        int rotation = transforms[t].rotation;
+        enum flip flip_type = transforms[t].flip_type;
+        if (rotation == 90) {
+                *new_col = height - row - 1;
+                *new_row = col;
+        } else if (rotation == 180) {
+                *new_col = width - col - 1;
+                *new_row = height - row - 1;
+        } else if (rotation == 270) {
+                *new_col = row;
+                *new_row = width - col - 1;
+        } else if (flip_type == horizontal) {
+                *new_col = width - col - 1;
+                *new_row = row;
+        } else if (flip_type == vertical) {
+                *new_col = col;
+                *new_row = height - row - 1;
+        } else {
+                *new_col = row;
+                *new_row = col;
+        }
+}
+
+/* Whether two pixels are the same */
+static bool sameRGB(struct Pnm_rgb x, struct Pnm_rgb y)
+{
+        return x.red == y.red && x.green == y.green && x.blue == y.blue;
+}
+
+/* Whether, for every a, b, c and d and every transformation, the decoded
+   pixels of the transformed code word are those of the original moved
+   within the block; the chroma indices vary along with the coefficients */
+static bool blocksMatch(void)
+{
+        uint32_t words[LEVELS];
+        struct Pnm_rgb top[2 * LEVELS], bottom[2 * LEVELS];
+        void *scratch = ALLOC(FUSED_SCRATCH(LEVELS));
+        bool ok = true;
+        for (int a = 0; ok && a < 64; a += A_STEP) {
+                for (int b = -31; ok && b <= 31; b++) {
+                        for (int c = -31; ok && c <= 31; c++) {
+                                for (int k = 0; k < LEVELS; k++) {
+                                        int d = k - 31;
+                                        words[k] = (uint32_t) a << 26 |
+                                                   (b & 0x3Fu) << 20 |
+                                                   (c & 0x3Fu) << 14 |
+                                                   (d & 0x3Fu) << 8 |
+                                                   ((a + k) & 0xFu) << 4 |
+                                                   ((b - c) & 0xFu);
+                                }
+                                decompressRow(words, LEVELS, 255, top, bottom,
+                                              scratch);
+                                for (int t = 0; ok && t < TRANSFORMS; t++) {
+                                        ok = rowMatches(words, top, bottom, t,
+                                                        scratch);
+                                }
+                        }
+                }
+        }
+        FREE(scratch);
+        return ok;
+}
+
+/* Whether decompressRow of the LEVELS code words in words, each
+   transformed by t, moves the pixels of the decoded scanlines top and
+   bottom within each block as ppmtrans would */
+static bool rowMatches(uint32_t *words, struct Pnm_rgb *top,
+                       struct Pnm_rgb *bottom, int t, void *scratch)
+{
+        uint32_t moved[LEVELS];
+        struct Pnm_rgb moved_top[2 * LEVELS], moved_bottom[2 * LEVELS];
+        for (int k = 0; k < LEVELS; k++) {
+                moved[k] = transformWord(words[k], transforms[t].rotation,
+                                         transforms[t].flip_type);
+        }
+        decompressRow(moved, LEVELS, 255, moved_top, moved_bottom, scratch);
+        for (int k = 0; k < LEVELS; k++) {
+                for (unsigned p = 0; p < 4; p++) {
+                        unsigned col, row;
+                        place(t, 2, 2, p % 2, p / 2, &col, &row);
+                        struct Pnm_rgb pixel = (p < 2 ? top : bottom)
+                                               [2 * k + p % 2];
+                        struct Pnm_rgb moved_pixel =
+                                (row == 0 ? moved_top : moved_bottom)
+                                [2 * k + col];
+                        if (!sameRGB(pixel, moved_pixel)) {
+                                return false;
+                        }
+                }
+        }
+        return true;
+}
+
+/* A raw PPM image of random pixels in a temporary file, rewound */
+static FILE *makeImage(unsigned width, unsigned height)
+{
+        FILE *image = tmpfile();
+        assert(image != NULL);
+        fprintf(image, "P6\n%u %u\n255\n", width, height);
+        for (unsigned i = 0; i < 3 * width * height; i++) {
+                putc(rand() & 0xFF, image);
+        }
+        rewind(image);
+        return image;
+}
+
+/* The image compressed into format 2, 3 or 4 in a temporary file, rewound;
+   the image is rewound too */
+static FILE *compressTo(FILE *image, int format)
+{
+        struct Compress40_options options = { .threads = 1, .fixed = false,
+                                              .entropy = format == 3,
+                                              .tiled = format == 4 };
+        FILE *output = tmpfile();
+        assert(output != NULL);
+        Compress40_buffers buffers = newCompress40Buffers();
+        compress40_buffered(image, output, &options, buffers);
+        freeCompress40Buffers(&buffers);
+        rewind(image);
+        rewind(output);
+        return output;
+}
+
+/* What decode writes to standard output for input, in a temporary file,
+   rewound */
+static FILE *capture(void (*decode)(FILE *input), FILE *input)
+{
+        FILE *output = tmpfile();
+        assert(output != NULL);
+        fflush(stdout);
+        int saved = dup(STDOUT_FILENO);
+        assert(saved >= 0);
+        int moved = dup2(fileno(output), STDOUT_FILENO);
+        assert(moved >= 0);
+        decode(input);
+        fflush(stdout);
+        moved = dup2(saved, STDOUT_FILENO);
+        assert(moved >= 0);
+        close(saved);
+        rewind(input);
+        rewind(output);
+        return output;
+}
+
+/* The pixels of a raw PPM image with maxval 255, 3 bytes each, row after
+   row, in a new array that the caller frees; the image is rewound after */
+static unsigned char *readImage(FILE *image, unsigned *width,
+                                unsigned *height)
+{
+        int read = fscanf(image, "P6 %u %u 255", width, height);
+        assert(read == 2 && getc(image) == '\n');
+        size_t size = 3 * (size_t) *width * *height;
+        unsigned char *pixels = ALLOC(size > 0 ? size : 1);
+        size_t got = fread(pixels, 1, size, image);
+        assert(got == size);
+        rewind(image);
+        return pixels;
+}
+
+/* Whether transformed is original under transformation t, pixel for
+   pixel; both are rewound after */
+static bool isTransformed(FILE *original, FILE *transformed, int t)
+{
+        unsigned width, height, new_width, new_height;
+        unsigned char *before = readImage(original, &width, &height);
+        unsigned char *after = readImage(transformed, &new_width,
+                                         &new_height);
+        bool turned = transforms[t].rotation % 180 == 90 ||
+                      transforms[t].flip_type == transpose;
+        bool same = new_width == (turned ? height : width) &&
+                    new_height == (turned ? width : height);
+        for (unsigned row = 0; same && row < height; row++) {
+                for (unsigned col = 0; same && col < width; col++) {
+                        unsigned new_col, new_row;
+                        place(t, width, height, col, row, &new_col,
+                              &new_row);
+                        same = memcmp(before + 3 * ((size_t) row * width +
+                                                    col),
+                                      after + 3 * ((size_t) new_row *
+                                                   new_width + new_col),
+                                      3) == 0;
+                }
+        }
+        FREE(after);
+        FREE(before);
+        return same;
+}
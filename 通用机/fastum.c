@@ -0,0 +1,397 @@
+/**************************************************************
+ *
+ *     fastum.c
+ *
+ *
+ *     implementation for fastum.h
+ *
+ **************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "mem.h"
+#include "fastum.h"
+#include "type.h"
+
+struct Fastum_T {
+        Umem_T mem;             /* segment storage */
+        uint32_t *freeq;        /* ring of unmapped ids, reused FIFO */
+        uint64_t free_head, free_count, free_cap;
+        uint64_t id_counter;    /* next never-used id */
+        uint32_t regs[8];
+        uint32_t prg_counter;
+        bool halted;
+        UmIO_getfun *get;
+        UmIO_putfun *put;
+        void *cl;
+};
+
+static uint32_t newSegment(Fastum_T um, uint32_t size);
+static void freeSegment(Fastum_T um, uint32_t id);
+
+/********** Fastum_new ********
+ *
+ * Create a fast machine whose segment 0 is a copy of a program.
+ *
+ * Parameters:
+ *      Umem_T mem:             empty segment memory, owned by the
+ *                              machine from now on
+ *      const uint32_t *words:  the program, one instruction per word
+ *      uint32_t length:        number of words
+ *      UmIO_getfun *get:       source of input bytes
+ *      UmIO_putfun *put:       sink for output bytes
+ *      void *cl:               closure passed to get and put
+ *
+ * Return:
+ *      Fastum_T: the machine, with all registers and the program
+ *                counter at 0
+ *
+ * Expects:
+ *      mem must not be NULL; words may be NULL only if length is 0;
+ *      get and put must not be NULL.
+ * Notes:
+ *      CRE if memory allocation fails.
+ ************************/
+Fastum_T Fastum_new(Umem_T mem, const uint32_t *words, uint32_t length,
+                    UmIO_getfun *get, UmIO_putfun *put, void *cl)
+{
+        assert(mem != NULL && (words != NULL || length == 0) &&
+               get != NULL && put != NULL);
+        Fastum_T um;
+        NEW0(um);
+        um->mem = mem;
+        um->free_cap = 64;
+        um->freeq = CALLOC(um->free_cap, sizeof(*um->freeq));
+        um->id_counter = 1;
+        um->get = get;
+        um->put = put;
+        um->cl = cl;
+
+        uint32_t *seg0 = Umem_map(mem, 0, length);
+        if (length > 0) {
+                memcpy(seg0, words, length * sizeof(uint32_t));
+        }
+        return um;
+}
+
+/********** Fastum_run ********
+ *
+ * Execute instructions until the machine halts or a step budget is
+ * used up.
+ *
+ * Parameters:
+ *      Fastum_T um:            the machine
+ *      uint64_t max_steps:     most instructions to execute
+ *
+ * Return:
+ *      uint64_t: number of instructions executed, counting Halt
+ *
+ * Expects:
+ *      um must not be NULL.
+ * Notes:
+ *      Registers and the program counter live in locals while the
+ *      loop runs and are written back before returning, so the
+ *      accessors below see the state after the last executed step.
+ *      Map, Unmap and Load Program may move segments, so the cached
+ *      segment table and segment 0 are reloaded after each.
+ *      Failures the um specification leaves unchecked are unchecked
+ *      here too; a program the reference engine accepts behaves the
+ *      same on both.
+ ************************/
+uint64_t Fastum_run(Fastum_T um, uint64_t max_steps)
+{
+        assert(um != NULL);
+        uint32_t *r = um->regs;
+        uint32_t pc = um->prg_counter;
+        Umem_T mem = um->mem;
+        uint32_t **segs = mem->segs;
+        uint32_t *code = segs[0];
+        uint64_t steps = 0;
+
+        while (!um->halted && steps < max_steps) {
+                uint32_t inst = code[pc];
+                uint32_t a = (inst >> 6) & 7;
+                uint32_t b = (inst >> 3) & 7;
+                uint32_t c = inst & 7;
+                steps++;
+
+                switch (inst >> 28) {
+                case CMOV:
+                        if (r[c] != 0) {
+                                r[a] = r[b];
+                        }
+                        pc++;
+                        break;
+                case SLOAD:
+                        r[a] = segs[r[b]][r[c]];
+                        pc++;
+                        break;
+                case SSTORE:
+                        segs[r[a]][r[b]] = r[c];
+                        pc++;
+                        break;
+                case ADD:
+                        r[a] = r[b] + r[c];
+                        pc++;
+                        break;
+                case MUL:
+                        r[a] = r[b] * r[c];
+                        pc++;
+                        break;
+                case DIV:
+                        assert(r[c] != 0);
+                        r[a] = r[b] / r[c];
+                        pc++;
+                        break;
+                case NAND:
+                        r[a] = ~(r[b] & r[c]);
+                        pc++;
+                        break;
+                case HALT:
+                        um->halted = true;
+                        break;
+                case ACTIVATE:
+                        r[b] = newSegment(um, r[c]);
+                        segs = mem->segs;
+                        code = segs[0];
+                        pc++;
+                        break;
+                case INACTIVATE:
+                        freeSegment(um, r[c]);
+                        segs = mem->segs;
+                        code = segs[0];
+                        pc++;
+                        break;
+                case OUT:
+                        um->put(r[c], um->cl);
+                        pc++;
+                        break;
+                case IN: {
+                        int ch = um->get(um->cl);
+                        r[c] = ch == EOF ? 0xFFFFFFFF : (uint32_t)ch;
+                        pc++;
+                        break;
+                }
+                case LOADP:
+                        if (r[b] != 0) {
+                                Umem_dup(mem, 0, r[b]);
+                                segs = mem->segs;
+                                code = segs[0];
+                        }
+                        pc = r[c];
+                        break;
+                case LV:
+                        r[(inst >> 25) & 7] = inst & 0x1FFFFFF;
+                        pc++;
+                        break;
+                default:
+                        assert(0);
+                }
+        }
+        um->prg_counter = pc;
+        return steps;
+}
+
+/********** Fastum_halted ********
+ *
+ * Tell whether the machine has executed Halt.
+ *
+ * Parameters:
+ *      Fastum_T um: the machine
+ *
+ * Return:
+ *      bool: true once Halt has executed
+ *
+ * Expects:
+ *      um must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+bool Fastum_halted(Fastum_T um)
+{
+        assert(um != NULL);
+        return um->halted;
+}
+
+/********** Fastum_pc ********
+ *
+ * Return the program counter.
+ *
+ * Parameters:
+ *      Fastum_T um: the machine
+ *
+ * Return:
+ *      uint32_t: index in segment 0 of the next instruction
+ *
+ * Expects:
+ *      um must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+uint32_t Fastum_pc(Fastum_T um)
+{
+        assert(um != NULL);
+        return um->prg_counter;
+}
+
+/********** Fastum_regs ********
+ *
+ * Return the eight general-purpose registers.
+ *
+ * Parameters:
+ *      Fastum_T um: the machine
+ *
+ * Return:
+ *      const uint32_t *: the registers, valid until Fastum_free
+ *
+ * Expects:
+ *      um must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+const uint32_t *Fastum_regs(Fastum_T um)
+{
+        assert(um != NULL);
+        return um->regs;
+}
+
+/********** Fastum_segment ********
+ *
+ * Look up a mapped segment by its um identifier.
+ *
+ * Parameters:
+ *      Fastum_T um:            the machine
+ *      uint32_t id:            segment identifier
+ *      uint32_t *length:       set to the number of words, if not NULL
+ *
+ * Return:
+ *      const uint32_t *: the words, or NULL if id is not mapped
+ *
+ * Expects:
+ *      um must not be NULL.
+ * Notes:
+ *      The pointer is invalidated by the next Fastum_run.
+ ************************/
+const uint32_t *Fastum_segment(Fastum_T um, uint32_t id, uint32_t *length)
+{
+        assert(um != NULL);
+        Umem_T mem = um->mem;
+        if (id >= mem->seg_cap || mem->segs[id] == NULL) {
+                return NULL;
+        }
+        if (length != NULL) {
+                *length = mem->lens[id];
+        }
+        return mem->segs[id];
+}
+
+/********** Fastum_mem ********
+ *
+ * Return the machine's segment memory, for statistics.
+ *
+ * Parameters:
+ *      Fastum_T um: the machine
+ *
+ * Return:
+ *      Umem_T: the memory, freed with the machine
+ *
+ * Expects:
+ *      um must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+Umem_T Fastum_mem(Fastum_T um)
+{
+        assert(um != NULL);
+        return um->mem;
+}
+
+/********** Fastum_free ********
+ *
+ * Release a machine, its memory and all of its segments.
+ *
+ * Parameters:
+ *      Fastum_T *um: pointer to the machine, set to NULL
+ *
+ * Return: void
+ *
+ * Expects:
+ *      um and *um must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+void Fastum_free(Fastum_T *um)
+{
+        assert(um != NULL && *um != NULL);
+        Umem_free(&(*um)->mem);
+        FREE((*um)->freeq);
+        FREE(*um);
+}
+
+/********** newSegment ********
+ *
+ * Map a zero-filled segment and pick its identifier.
+ *
+ * Parameters:
+ *      Fastum_T um:    the machine
+ *      uint32_t size:  number of words
+ *
+ * Return:
+ *      uint32_t: the new segment's identifier
+ *
+ * Expects:
+ *      um must not be NULL.
+ * Notes:
+ *      The oldest unmapped identifier is reused first, otherwise the
+ *      next never-used one, exactly as Map in operation.c does.
+ *      CRE if identifiers or memory run out.
+ ************************/
+static uint32_t newSegment(Fastum_T um, uint32_t size)
+{
+        uint32_t id;
+        if (um->free_count > 0) {
+                id = um->freeq[um->free_head];
+                um->free_head = (um->free_head + 1) % um->free_cap;
+                um->free_count--;
+        } else {
+                assert(um->id_counter < 0x100000000);
+                id = um->id_counter++;
+        }
+        Umem_map(um->mem, id, size);
+        return id;
+}
+
+/********** freeSegment ********
+ *
+ * Unmap a segment and queue its identifier for reuse.
+ *
+ * Parameters:
+ *      Fastum_T um:    the machine
+ *      uint32_t id:    identifier of a mapped segment other than 0
+ *
+ * Return: void
+ *
+ * Expects:
+ *      um must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+static void freeSegment(Fastum_T um, uint32_t id)
+{
+        Umem_unmap(um->mem, id);
+        if (um->free_count == um->free_cap) {
+                /* unwrap the ring into a buffer twice the size */
+                uint64_t cap = um->free_cap * 2;
+                uint32_t *q = CALLOC(cap, sizeof(*q));
+                for (uint64_t i = 0; i < um->free_count; i++) {
+                        q[i] = um->freeq[(um->free_head + i) % um->free_cap];
+                }
+                FREE(um->freeq);
+                um->freeq = q;
+                um->free_head = 0;
+                um->free_cap = cap;
+        }
+        um->freeq[(um->free_head + um->free_count) % um->free_cap] = id;
+        um->free_count++;
+}
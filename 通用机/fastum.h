@@ -0,0 +1,37 @@
+/**************************************************************
+ *
+ *     fastum.h
+ *
+ *
+ *     fastum.h declares the fast engine. Segments are flat arrays
+ *     of words kept in a Umem_T and indexed straight from the
+ *     segment identifier, and instructions are dispatched through
+ *     a single switch, so no Seq_T or Table_T is touched while
+ *     the program runs. It
+ *     hands out and reuses segment identifiers in the same order
+ *     as the reference engine, which lets the two be compared
+ *     step by step.
+ *
+ **************************************************************/
+
+#ifndef FASTUM_H
+#define FASTUM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "umio.h"
+#include "umem.h"
+
+typedef struct Fastum_T *Fastum_T;
+
+Fastum_T Fastum_new(Umem_T mem, const uint32_t *words, uint32_t length,
+                    UmIO_getfun *get, UmIO_putfun *put, void *cl);
+uint64_t Fastum_run(Fastum_T um, uint64_t max_steps);
+bool Fastum_halted(Fastum_T um);
+uint32_t Fastum_pc(Fastum_T um);
+const uint32_t *Fastum_regs(Fastum_T um);
+const uint32_t *Fastum_segment(Fastum_T um, uint32_t id, uint32_t *length);
+Umem_T Fastum_mem(Fastum_T um);
+void Fastum_free(Fastum_T *um);
+
+#endif
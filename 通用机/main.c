@@ -9,139 +9,313 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
 #include "read.h"
 #include "operation.h"
+#include "profile.h"
+#include "segpool.h"
+#include "umio.h"
+#include "refum.h"
+#include "fastum.h"
+#include "verify.h"
 
-/********** hash ********
+/* default sampling frequency of --profile, in samples per CPU second */
+#define PROFILE_HZ 1000
+
+/* smallest Map, in words, served from the pre-zeroed segment pool */
+#define POOL_THRESHOLD 16384
+
+static void usage(const char *progname);
+static void runRef(char *filename, char *profile_file, unsigned profile_hz,
+                   bool use_pool, UmIO_getfun *get, void *cl);
+static void runFast(char *filename, UmIO_getfun *get, void *cl, bool stats,
+                    uint64_t huge);
+
+/********** main ********
  *
- * Compute the hash value for a given key.
- * This hash function uses modular arithmetic to ensure the result fits
- * within a 32-bit integer range.
+ * Entry point for the program. It initializes and runs the um.
  *
  * Parameters:
- *      const void *key: Pointer to the key whose hash value is to be computed.
+ *      int argc: Number of command-line arguments.
+ *      char* argv[]: Array of command-line argument strings.
  *
  * Return:
- *      uint32_t: A 32-bit hash value computed based on the input key.
+ *      int: EXIT_SUCCESS if the program runs successfully,
+ *           EXIT_FAILURE if an error occurs (e.g., incorrect arguments).
  *
  * Expects:
- *      The key must not exceed 2^32 - 1.
- *      Behavior is undefined if the key exceeds this limit.
+ *      The last argument must point to a valid file path. It may be
+ *      preceded by options:
+ *          --profile <file>    write SIGPROF samples as folded stacks
+ *          --profile-hz <n>    sampling frequency (default PROFILE_HZ)
+ *          --no-pool           zero every Map on the interpreter thread
+ *          --engine ref|fast   which engine runs the program (default ref)
+ *          --verify [n]        run both engines in lockstep, comparing
+ *                              registers every n steps (default 1)
+ *          --record-input <f>  save every byte Input delivers, and EOF
+ *          --replay-input <f>  take Input bytes from a saved recording
+ *          --stats             print segment memory statistics on exit
+ *          --huge-pages <n>    back segment 0 and segments of at least n
+ *                              words with huge pages (default
+ *                              UMEM_HUGE_WORDS)
+ *          --no-huge-pages     keep every segment in the ordinary heap
  *
  * Notes:
- *      This function will CRE if the key is NULL.
+ *      - The profiler and the segment pool only apply to the reference
+ *        engine; --profile with --engine fast is rejected. Memory
+ *        statistics come from the fast engine's compacting heap, so
+ *        --stats needs --engine fast.
+ *      - A replayed recording is read into memory before the program
+ *        starts, so timed runs do not wait on a terminal or pipe.
+ *      - Unless --no-pool is given, a helper thread keeps pre-zeroed
+ *        segments ready for large Maps. With a single CPU online the
+ *        helper could only run by preempting the interpreter, so the
+ *        pool is not started.
  ************************/
-
-unsigned hash(const void *key) 
+int main (int argc, char* argv[])
 {
-        uint64_t size = 0x100000000;/* 2^32 */
-        uint64_t slot_id = (uint64_t)(uintptr_t)key % size;
-        return (uint32_t)slot_id;
+        char *profile_file = NULL;
+        unsigned profile_hz = PROFILE_HZ;
+        bool use_pool = true;
+        bool fast = false;
+        uint32_t verify = 0;
+        char *record_file = NULL;
+        char *replay_file = NULL;
+        bool stats = false;
+        uint64_t huge = UMEM_HUGE_WORDS;
+        int i;
+
+        for (i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "--profile") == 0) {
+                        if (!(i + 1 < argc)) {
+                                usage(argv[0]);
+                        }
+                        profile_file = argv[++i];
+                } else if (strcmp(argv[i], "--profile-hz") == 0) {
+                        if (!(i + 1 < argc)) {
+                                usage(argv[0]);
+                        }
+                        char *endptr;
+                        long hz = strtol(argv[++i], &endptr, 10);
+                        if (*endptr != '\0' || hz < 1 || hz > 1000000) {
+                                usage(argv[0]);
+                        }
+                        profile_hz = hz;
+                } else if (strcmp(argv[i], "--no-pool") == 0) {
+                        use_pool = false;
+                } else if (strcmp(argv[i], "--engine") == 0) {
+                        if (!(i + 1 < argc)) {
+                                usage(argv[0]);
+                        }
+                        i++;
+                        if (strcmp(argv[i], "ref") == 0) {
+                                fast = false;
+                        } else if (strcmp(argv[i], "fast") == 0) {
+                                fast = true;
+                        } else {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "--stats") == 0) {
+                        stats = true;
+                } else if (strcmp(argv[i], "--huge-pages") == 0) {
+                        if (!(i + 1 < argc)) {
+                                usage(argv[0]);
+                        }
+                        char *endptr;
+                        long long n = strtoll(argv[++i], &endptr, 10);
+                        if (*endptr != '\0' || n < 1) {
+                                usage(argv[0]);
+                        }
+                        huge = n;
+                } else if (strcmp(argv[i], "--no-huge-pages") == 0) {
+                        huge = 0;
+                } else if (strcmp(argv[i], "--record-input") == 0) {
+                        if (!(i + 1 < argc)) {
+                                usage(argv[0]);
+                        }
+                        record_file = argv[++i];
+                } else if (strcmp(argv[i], "--replay-input") == 0) {
+                        if (!(i + 1 < argc)) {
+                                usage(argv[0]);
+                        }
+                        replay_file = argv[++i];
+                } else if (strcmp(argv[i], "--verify") == 0) {
+                        verify = 1;
+                        /* the interval is optional; the file name is not */
+                        if (i + 2 < argc && *argv[i + 1] != '-') {
+                                char *endptr;
+                                long n = strtol(argv[i + 1], &endptr, 10);
+                                if (*endptr != '\0' || n < 1 ||
+                                    n > 0xFFFFFFFF) {
+                                        usage(argv[0]);
+                                }
+                                verify = n;
+                                i++;
+                        }
+                } else if (*argv[i] == '-') {
+                        fprintf(stderr, "%s: unknown option '%s'\n",
+                                argv[0], argv[i]);
+                        usage(argv[0]);
+                } else {
+                        break;
+                }
+        }
+        if (argc - i != 1) {
+                usage(argv[0]);
+        }
+
+        if (profile_file != NULL && (fast || verify > 0)) {
+                fprintf(stderr, "%s: --profile needs the reference engine\n",
+                        argv[0]);
+                usage(argv[0]);
+        }
+
+        if (stats && (!fast || verify > 0)) {
+                fprintf(stderr, "%s: --stats needs --engine fast\n",
+                        argv[0]);
+                usage(argv[0]);
+        }
+        if (record_file != NULL && replay_file != NULL) {
+                usage(argv[0]);
+        }
+
+        UmIO_getfun *get = UmIO_stdinGet;
+        void *cl = NULL;
+        UmIO_Tape tape = NULL;
+        if (record_file != NULL) {
+                tape = UmIO_record(record_file, UmIO_stdinGet, NULL);
+        } else if (replay_file != NULL) {
+                tape = UmIO_replay(replay_file);
+        }
+        if (tape != NULL) {
+                get = UmIO_tapeGet;
+                cl = tape;
+        }
+
+        int status = EXIT_SUCCESS;
+        if (verify > 0) {
+                status = Verify_run(argv[i], verify, get, cl);
+        } else if (fast) {
+                runFast(argv[i], get, cl, stats, huge);
+        } else {
+                runRef(argv[i], profile_file, profile_hz, use_pool, get, cl);
+        }
+
+        if (tape != NULL) {
+                UmIO_close(&tape);
+        }
+        return status;
 }
 
-/********** cmp ********
+/********** runRef ********
  *
- * Compare two keys represented as pointers and determine their order.
+ * Run a program on the reference engine.
  *
  * Parameters:
- *      const void *x: Pointer to the first key to compare.
- *      const void *y: Pointer to the second key to compare.
+ *      char *filename:         path of the .um file
+ *      char *profile_file:     where to write samples, or NULL
+ *      unsigned profile_hz:    sampling frequency
+ *      bool use_pool:          whether large Maps may use a segment pool
+ *      UmIO_getfun *get:       input source
+ *      void *cl:               closure for get
  *
- * Return:
- *      int: -1 if the first key is less than the second key,
- *           0 if the keys are equal,
- *           1 if the first key is greater than the second key.
+ * Return: void
  *
  * Expects:
- *      x and y must not be NULL.
- *
+ *      filename must not be NULL.
  * Notes:
- *      The keys are expected to be 32-bit integers cast as pointers.
+ *      When profiling, Load Program instructions are reported to the
+ *      profiler before they execute so it can track the call stack.
  ************************/
-int cmp(const void *x, const void *y)
+static void runRef(char *filename, char *profile_file, unsigned profile_hz,
+                   bool use_pool, UmIO_getfun *get, void *cl)
 {
-        uint32_t key1 = (uint32_t)(uintptr_t)x;
-        uint32_t key2 = (uint32_t)(uintptr_t)y;
+        Refum_T um = Refum_new(filename);
+        UmIO_use(get, UmIO_stdoutPut, cl);
+        Segpool_T pool = NULL;
+        if (use_pool && sysconf(_SC_NPROCESSORS_ONLN) > 1) {
+                pool = Segpool_new(POOL_THRESHOLD);
+                useSegpool(pool);
+        }
+        if (profile_file != NULL) {
+                Profile_start(profile_file, profile_hz, &um->prg_counter);
+        }
 
-        if (key1 < key2) {
-                return -1;
-        } else if (key1 == key2) {
-                return 0;
-        } else {
-                return 1;
+        while (um->notHalt == true) {
+                Um_instruction inst = Refum_fetch(um);
+                if (profile_file != NULL && readOP(inst) == LOADP) {
+                        Profile_branch(um->regs, um->prg_counter, inst);
+                }
+                Refum_exec(um, inst);
+        }
+
+        if (profile_file != NULL) {
+                Profile_stop();
+        }
+        if (pool != NULL) {
+                useSegpool(NULL);
+                Segpool_free(&pool);
         }
+        Refum_free(&um);
 }
 
-/********** operations ********
+/********** runFast ********
  *
- * Array of function pointers for operations supported by the um.
+ * Run a program on the fast engine with stdout as its output.
  *
- * Each function performs a specific operation on a table, sequence, registers,
- * and other parameters based on the provided instruction.
+ * Parameters:
+ *      char *filename:         path of the .um file
+ *      UmIO_getfun *get:       input source
+ *      void *cl:               closure for get
+ *      bool stats:             print memory statistics to stderr
+ *      uint64_t huge:          huge page threshold in words, 0 for none
  *
- * Notes:
- *      Each function has the following prototype:
- *          void function(Table_T, Seq_T, uint32_t*, uint32_t*, uint64_t*,
- *                        Um_instruction, bool*)
+ * Return: void
  *
- *      The operations include: ConMov, SegLoad, SegStore, Add, Mul, Div,
- *      NotAnd, Halt, Map, UnMap, Output, Input, LoadProgram, LoadValue.
+ * Expects:
+ *      filename must not be NULL.
+ * Notes:
+ *      None
  ************************/
-void (*operations[])(Table_T, Seq_T, uint32_t*, uint32_t*, uint64_t*,
-                     Um_instruction, bool*) = {
-        ConMov, SegLoad, SegStore, Add, Mul, Div, NotAnd, Halt, Map, UnMap,
-        Output, Input, LoadProgram, LoadValue
-};
+static void runFast(char *filename, UmIO_getfun *get, void *cl, bool stats,
+                    uint64_t huge)
+{
+        uint32_t length;
+        uint32_t *words = readProgram(filename, &length);
+        Umem_T mem = Umem_new(UMEM_FRAG_PERCENT);
+        Umem_hugepages(mem, huge);
+        Fastum_T um = Fastum_new(mem, words, length, get, UmIO_stdoutPut, cl);
+        FREE(words);
+        Fastum_run(um, UINT64_MAX);
+        if (stats) {
+                fflush(stdout);
+                Umem_report(Fastum_mem(um), stderr);
+        }
+        Fastum_free(&um);
+}
 
-/********** main ********
+/********** usage ********
  *
- * Entry point for the program. It initializes and runs the um.
+ * Print the command line synopsis and exit with failure.
  *
  * Parameters:
- *      int argc: Number of command-line arguments.
- *      char* argv[]: Array of command-line argument strings.
+ *      const char *progname: name the program was invoked as
  *
- * Return:
- *      int: EXIT_SUCCESS if the program runs successfully,
- *           EXIT_FAILURE if an error occurs (e.g., incorrect arguments).
+ * Return: does not return
  *
  * Expects:
- *      argc must be 2 (program name and filename argument).
- *      argv[1] must point to a valid file path.
- *
+ *      progname must not be NULL.
  * Notes:
- *      - Initializes registers, tables, and sequences for the um.
- *      - Reads input file using `readUM` and processes instructions until Halt.
- *      - Calls operation functions based on opcode extracted from instructions.
+ *      None
  ************************/
-int main (int argc, char* argv[])
+static void usage(const char *progname)
 {
-        if (argc != 2) {
-                fprintf(stderr, "Usage: %s [filename]\n", argv[0]);
-                exit(EXIT_FAILURE);
-        }
-
-        uint32_t regs[8] = {0, 0, 0, 0, 0, 0, 0, 0};
-        Table_T address_table = Table_new(3, cmp, hash);
-        Seq_T segid_bin = Seq_new(3);/* store used and freed id */
-        assert(address_table != NULL && segid_bin != NULL);
-        uint64_t id_counter = 1;/* keep track of # of id we have used */
-        uint32_t prg_counter = 0;/* programer counter */
-        bool notHalt = true;
-
-        readUM(argv[1], address_table);
-
-        while (notHalt == true) {
-                /* 0 mod 0x100000000 == 0x100000000 mod 0x100000000  */
-                /* 0x100000000 help us avoid null pointer which is 0 */
-                uint64_t id = 0x100000000;
-                Seq_T seg0 = Table_get(address_table, (void *)(uintptr_t)(id));
-                void *value = Seq_get(seg0, prg_counter);
-                Um_instruction inst = (uint32_t)(uintptr_t)value;
-                Um_opcode op = readOP(inst);
-                operations[op](address_table, segid_bin, regs, &prg_counter,
-                               &id_counter, inst, &notHalt);
-        }
-
-        return EXIT_SUCCESS;
+        fprintf(stderr, "Usage: %s [--profile file] [--profile-hz n] "
+                        "[--no-pool] [--engine ref|fast] [--verify [n]] "
+                        "[--record-input file | --replay-input file] "
+                        "[--stats] [--huge-pages n | --no-huge-pages] "
+                        "[filename]\n", progname);
+        exit(EXIT_FAILURE);
 }
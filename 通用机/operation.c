@@ -9,6 +9,13 @@
 
 #include "operation.h"
 #include "read.h"
+#include "umio.h"
+
+/* pool serving large Maps; NULL means every Map builds its own segment */
+static Segpool_T segpool = NULL;
+
+static void releaseSeg(Seq_T seg);
+
 /********** ConMov ********
  *
  * Copies the value from register rb to register ra if register rc is not zero,
@@ -341,6 +348,8 @@ void Halt(Table_T table, Seq_T segid_bin, uint32_t* arr, uint32_t* ptr,
  *      
  * Notes:
  *      A new segment of size `arr[reg3.rc]` is created and stored in `table`.
+ *      Large segments are taken pre-zeroed from the segment pool when one
+ *      of the right size is ready.
  *      ID is either reused from `segid_bin` or generated using `id_counter`.
  *      Updates `arr[reg3.rb]` with the new segment ID.
  ************************/
@@ -352,10 +361,16 @@ void Map(Table_T table, Seq_T segid_bin, uint32_t* arr, uint32_t* ptr,
         /* construct a new segment */
         struct Register3_T reg3 = read_3Register(inst);
         uint32_t size = arr[reg3.rc];
-        Seq_T new_seg = Seq_new(size);
-        assert(new_seg != NULL);
-        for (uint32_t i = 0; i < size; i++) {
-                Seq_addhi(new_seg, (void *)(uintptr_t)0);
+        Seq_T new_seg = NULL;
+        if (segpool != NULL) {
+                new_seg = Segpool_get(segpool, size);
+        }
+        if (new_seg == NULL) {
+                new_seg = Seq_new(size);
+                assert(new_seg != NULL);
+                for (uint32_t i = 0; i < size; i++) {
+                        Seq_addhi(new_seg, (void *)(uintptr_t)0);
+                }
         }
 
         /* find seg_id and insert new_seg into table */
@@ -399,7 +414,8 @@ void Map(Table_T table, Seq_T segid_bin, uint32_t* arr, uint32_t* ptr,
  *      table, segid_bin, arr, and ptr must not be NULL.
  * Notes:
  *      Frees memory associated with the segment ID in `arr[reg3.rc]` 
- *      and stores the ID back into `segid_bin`.
+ *      and stores the ID back into `segid_bin`. Large segments may be
+ *      handed to the segment pool for re-zeroing instead.
  ************************/
 void UnMap(Table_T table, Seq_T segid_bin, uint32_t* arr, uint32_t* ptr, 
            uint64_t* id_counter, Um_instruction inst, bool* notHalt)
@@ -414,7 +430,7 @@ void UnMap(Table_T table, Seq_T segid_bin, uint32_t* arr, uint32_t* ptr,
         void *key = (void *)(uintptr_t)id;
 
         Seq_T seg_rm = Table_remove(table, key);/* remove seg from table */
-        Seq_free(&seg_rm);
+        releaseSeg(seg_rm);
         Seq_addhi(segid_bin, key);/* add used key to segid_bin*/
         *ptr = *ptr + 1;
 
@@ -440,7 +456,8 @@ void UnMap(Table_T table, Seq_T segid_bin, uint32_t* arr, uint32_t* ptr,
  * Expects:
  *      arr and ptr must not be NULL.
  * Notes:
- *      Outputs `arr[reg3.rc]` as a character to standard output.
+ *      Outputs `arr[reg3.rc]` as a character through UmIO_put, which
+ *      writes to standard output unless another sink is installed.
  ************************/
 void Output(Table_T table, Seq_T segid_bin, uint32_t* arr, uint32_t* ptr, 
             uint64_t* id_counter, Um_instruction inst, bool* notHalt)
@@ -448,7 +465,7 @@ void Output(Table_T table, Seq_T segid_bin, uint32_t* arr, uint32_t* ptr,
         assert(table != NULL && segid_bin != NULL && arr != NULL &&
                ptr != NULL && id_counter != NULL && notHalt != NULL);
         struct Register3_T reg3 = read_3Register(inst);
-        putc(arr[reg3.rc], stdout);
+        UmIO_put(arr[reg3.rc]);
         *ptr = *ptr + 1;
 
         (void)table;
@@ -477,7 +494,8 @@ void Output(Table_T table, Seq_T segid_bin, uint32_t* arr, uint32_t* ptr,
  * Expects:
  *      arr and ptr must not be NULL.
  * Notes:
- *      Read a character from stdin. Store its value in `arr[reg3.rc]`.
+ *      Read a character through UmIO_get (stdin by default). Store its
+ *      value in `arr[reg3.rc]`.
  *      Stores `0xFFFFFFFF` if EOF is encountered.
  ************************/
 void Input(Table_T table, Seq_T segid_bin, uint32_t* arr, uint32_t* ptr, 
@@ -486,7 +504,7 @@ void Input(Table_T table, Seq_T segid_bin, uint32_t* arr, uint32_t* ptr,
         assert(table != NULL && segid_bin != NULL && arr != NULL &&
                ptr != NULL && id_counter != NULL && notHalt != NULL);
         struct Register3_T reg3 = read_3Register(inst);
-        int c = getc(stdin);
+        int c = UmIO_get();
         if (c != EOF) {
                 arr[reg3.rc] = c;
         } else {
@@ -544,7 +562,7 @@ void LoadProgram(Table_T table, Seq_T segid_bin, uint32_t* arr, uint32_t* ptr,
                 /* replace old m[0] by new one*/
                 key = (void*)(uintptr_t)0x100000000;
                 Seq_T old_0 = Table_put(table, key, new_0);
-                Seq_free(&old_0);
+                releaseSeg(old_0);
         }
         *ptr = (uint32_t)(uintptr_t)arr[reg3.rc];
 
@@ -612,3 +630,44 @@ void vfree(const void *key, void **value, void *cl)
         (void)key;
         (void)cl;
 }
+
+/********** useSegpool ********
+ *
+ * Set the pool that Map and UnMap use for large segments.
+ *
+ * Parameters:
+ *      Segpool_T pool:        the pool, or NULL to stop using one.
+ *
+ * Return: void
+ *
+ * Expects:
+ *      pool must outlive every Map and UnMap executed while it is set.
+ * Notes:
+ *      None
+ ************************/
+void useSegpool(Segpool_T pool)
+{
+        segpool = pool;
+}
+
+/********** releaseSeg ********
+ *
+ * Free a segment that is no longer mapped, or give it to the segment
+ * pool so it can be re-zeroed and reused.
+ *
+ * Parameters:
+ *      Seq_T seg:             the released segment.
+ *
+ * Return: void
+ *
+ * Expects:
+ *      seg must not be NULL.
+ * Notes:
+ *      The caller must not use seg afterwards.
+ ************************/
+static void releaseSeg(Seq_T seg)
+{
+        if (segpool == NULL || !Segpool_recycle(segpool, seg)) {
+                Seq_free(&seg);
+        }
+}
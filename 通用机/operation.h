@@ -5,7 +5,7 @@
  *
  *     operation.h contains functions for each opcode, from 0 to 13.
  *     Each function executes a operator, plus a helper for freeing
- *     sequence.
+ *     sequence and a hook for serving large Maps from a segment pool.
  *     
  *
  **************************************************************/
@@ -18,6 +18,7 @@
 #include "table.h"
 #include "seq.h"
 #include "type.h"
+#include "segpool.h"
 
 
 void ConMov     (Table_T table, Seq_T segid_bin, uint32_t* arr, uint32_t* ptr, 
@@ -64,4 +65,6 @@ void LoadValue  (Table_T table, Seq_T segid_bin, uint32_t* arr, uint32_t* ptr,
 
 void vfree(const void *key, void **value, void *cl);
 
+void useSegpool(Segpool_T pool);
+
 #endif
\ No newline at end of file
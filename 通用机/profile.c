@@ -0,0 +1,428 @@
+/**************************************************************
+ *
+ *     profile.c
+ *
+ *
+ *     implementation for profile.h
+ *
+ *     The shadow call stack is a calling context tree: every node
+ *     is a (parent node, entry address) pair. Profile_branch runs
+ *     on the interpreter thread before each Load Program and moves
+ *     the current node up or down the tree. The SIGPROF handler
+ *     only reads the current node and the program counter and
+ *     bumps a counter in a preallocated open-addressing table, so
+ *     it never allocates and never touches the tree.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+#include "assert.h"
+#include "mem.h"
+#include "table.h"
+#include "read.h"
+#include "profile.h"
+
+#define SAMPLE_SLOTS  (1 << 16) /* distinct (context, pc) pairs kept */
+#define MAX_DEPTH     1024      /* deepest shadow stack we track */
+#define RETURN_SEARCH 8         /* frames searched for a non-local return */
+#define ROOT          1         /* node 0 is unused so keys are never NULL */
+#define CALL_CACHE    256       /* direct-mapped cache in front of the tree */
+
+struct Sample {
+        uint32_t node;          /* 0 marks an empty slot */
+        uint32_t pc;
+        uint64_t count;
+};
+
+struct Node {
+        uint32_t parent;
+        uint32_t entry;         /* segment-0 address the call jumped to */
+};
+
+struct Frame {
+        uint32_t node;
+        uint32_t ret;           /* address the callee is expected to return */
+};
+
+static FILE *out = NULL;
+static const volatile uint32_t *sampled_pc = NULL;
+static volatile uint32_t current_node = ROOT;
+static struct Sample *samples = NULL;
+static volatile uint64_t dropped = 0;
+
+static struct Node *nodes = NULL;
+static uint32_t node_count = 0;
+static uint32_t node_capacity = 0;
+static Table_T children = NULL;
+static struct CacheLine {
+        uint32_t parent, entry, child;
+} call_cache[CALL_CACHE];
+
+static struct Frame stack[MAX_DEPTH];
+static uint32_t depth = 0;
+
+static struct sigaction old_action;
+
+static void onSample(int signo);
+static uint32_t childOf(uint32_t parent, uint32_t entry);
+static void pushFrame(uint32_t node, uint32_t ret);
+static void popFrames(uint32_t n);
+static void writeStack(uint32_t node);
+
+/********** node_hash ********
+ *
+ * Hash a calling context tree key, which packs the parent node into
+ * the high 32 bits and the entry address into the low 32 bits.
+ *
+ * Parameters:
+ *      const void *key: the packed key
+ *
+ * Return:
+ *      unsigned: hash value of key
+ *
+ * Expects:
+ *      None
+ * Notes:
+ *      main.c's hash only looks at 32 bits, which is why the tree uses
+ *      its own pair of functions.
+ ************************/
+static unsigned node_hash(const void *key)
+{
+        uint64_t k = (uint64_t)(uintptr_t)key;
+        return (unsigned)((k >> 32) * 0x9E3779B1u) ^ (unsigned)k;
+}
+
+/********** node_cmp ********
+ *
+ * Compare two packed calling context tree keys.
+ *
+ * Parameters:
+ *      const void *x, const void *y: the packed keys
+ *
+ * Return:
+ *      int: -1, 0 or 1 as x is less than, equal to or greater than y
+ *
+ * Expects:
+ *      None
+ * Notes:
+ *      None
+ ************************/
+static int node_cmp(const void *x, const void *y)
+{
+        uint64_t kx = (uint64_t)(uintptr_t)x;
+        uint64_t ky = (uint64_t)(uintptr_t)y;
+        return (kx > ky) - (kx < ky);
+}
+
+/********** Profile_start ********
+ *
+ * Open the output file, allocate the sample table and arm a SIGPROF
+ * interval timer firing hz times per second of CPU time.
+ *
+ * Parameters:
+ *      const char *path:       file that receives the folded stacks
+ *      unsigned hz:            sampling frequency
+ *      const uint32_t *prg_counter: the interpreter's program counter
+ *
+ * Return: void
+ *
+ * Expects:
+ *      path and prg_counter must not be NULL, hz must be in [1, 1000000].
+ *      prg_counter must stay valid until Profile_stop.
+ * Notes:
+ *      CRE if the file cannot be opened or the timer cannot be armed.
+ ************************/
+void Profile_start(const char *path, unsigned hz, const uint32_t *prg_counter)
+{
+        assert(path != NULL && prg_counter != NULL);
+        assert(hz >= 1 && hz <= 1000000);
+        out = fopen(path, "w");
+        assert(out != NULL);
+
+        samples = CALLOC(SAMPLE_SLOTS, sizeof(*samples));
+        node_capacity = 64;
+        nodes = ALLOC(node_capacity * sizeof(*nodes));
+        nodes[0].parent = 0;
+        nodes[0].entry = 0;
+        nodes[ROOT].parent = 0;
+        nodes[ROOT].entry = 0;
+        node_count = ROOT + 1;
+        children = Table_new(64, node_cmp, node_hash);
+        memset(call_cache, 0, sizeof(call_cache));
+        current_node = ROOT;
+        depth = 0;
+        dropped = 0;
+        sampled_pc = prg_counter;
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = onSample;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        assert(sigaction(SIGPROF, &sa, &old_action) == 0);
+
+        struct itimerval timer;
+        unsigned usec = 1000000 / hz;
+        timer.it_interval.tv_sec = usec / 1000000;
+        timer.it_interval.tv_usec = usec % 1000000;
+        timer.it_value = timer.it_interval;
+        assert(setitimer(ITIMER_PROF, &timer, NULL) == 0);
+}
+
+/********** Profile_branch ********
+ *
+ * Update the shadow call stack for a Load Program instruction that is
+ * about to execute.
+ *
+ * Parameters:
+ *      const uint32_t *regs:   the um registers before the jump
+ *      uint32_t prg_counter:   address of the Load Program instruction
+ *      Um_instruction inst:    the Load Program instruction
+ *
+ * Return: void
+ *
+ * Expects:
+ *      regs must not be NULL; the profiler must be started.
+ * Notes:
+ *      Loading a segment other than 0 replaces the program, so the
+ *      stack is reset to the root. Within segment 0 a jump to an
+ *      address we expect some frame to return to pops back to that
+ *      frame; otherwise, if a register holds the address right after
+ *      this instruction (the return-address idiom), it is a call.
+ *      Anything else is a plain jump and leaves the stack alone.
+ ************************/
+void Profile_branch(const uint32_t *regs, uint32_t prg_counter,
+                    Um_instruction inst)
+{
+        assert(regs != NULL && samples != NULL);
+        struct Register3_T reg3 = read_3Register(inst);
+        uint32_t target = regs[reg3.rc];
+
+        if (regs[reg3.rb] != 0) {
+                popFrames(depth);
+                return;
+        }
+
+        for (uint32_t i = 0; i < RETURN_SEARCH && i < depth; i++) {
+                if (stack[depth - 1 - i].ret == target) {
+                        popFrames(i + 1);
+                        return;
+                }
+        }
+
+        uint32_t ret = prg_counter + 1;
+        for (int r = 0; r < 8; r++) {
+                if (regs[r] == ret) {
+                        pushFrame(childOf(current_node, target), ret);
+                        return;
+                }
+        }
+}
+
+/********** Profile_stop ********
+ *
+ * Disarm the timer, write every recorded sample as a folded stack and
+ * release the profiler's memory.
+ *
+ * Parameters: None
+ *
+ * Return: void
+ *
+ * Expects:
+ *      The profiler must be started.
+ * Notes:
+ *      Frames are named "um" for the root, "sub_<entry>" for each call
+ *      and "pc_<address>" for the sampled instruction, all in hex.
+ ************************/
+void Profile_stop(void)
+{
+        assert(samples != NULL && out != NULL);
+        struct itimerval off;
+        memset(&off, 0, sizeof(off));
+        setitimer(ITIMER_PROF, &off, NULL);
+        sigaction(SIGPROF, &old_action, NULL);
+
+        for (uint32_t i = 0; i < SAMPLE_SLOTS; i++) {
+                if (samples[i].node == 0) {
+                        continue;
+                }
+                writeStack(samples[i].node);
+                fprintf(out, ";pc_%x %llu\n", samples[i].pc,
+                        (unsigned long long)samples[i].count);
+        }
+        if (dropped != 0) {
+                fprintf(stderr, "um: profile table full, %llu samples "
+                        "dropped\n", (unsigned long long)dropped);
+        }
+        fclose(out);
+        out = NULL;
+
+        FREE(samples);
+        FREE(nodes);
+        Table_free(&children);
+        sampled_pc = NULL;
+}
+
+/********** onSample ********
+ *
+ * SIGPROF handler: count one sample for the current (node, pc) pair.
+ *
+ * Parameters:
+ *      int signo: unused
+ *
+ * Return: void
+ *
+ * Expects:
+ *      None
+ * Notes:
+ *      Async-signal-safe: no allocation, no stdio. If the table is
+ *      full the sample is counted as dropped.
+ ************************/
+static void onSample(int signo)
+{
+        (void)signo;
+        uint32_t node = current_node;
+        uint32_t pc = *sampled_pc;
+        uint32_t slot = ((node * 0x9E3779B1u) ^ (pc * 0x85EBCA77u)) &
+                        (SAMPLE_SLOTS - 1);
+        for (uint32_t probe = 0; probe < SAMPLE_SLOTS; probe++) {
+                struct Sample *s = &samples[slot];
+                if (s->node == node && s->pc == pc) {
+                        s->count++;
+                        return;
+                }
+                if (s->node == 0) {
+                        s->node = node;
+                        s->pc = pc;
+                        s->count = 1;
+                        return;
+                }
+                slot = (slot + 1) & (SAMPLE_SLOTS - 1);
+        }
+        dropped++;
+}
+
+/********** childOf ********
+ *
+ * Find or create the calling context tree node reached by calling
+ * entry from parent.
+ *
+ * Parameters:
+ *      uint32_t parent: the caller's node
+ *      uint32_t entry:  the callee's entry address
+ *
+ * Return:
+ *      uint32_t: index of the child node
+ *
+ * Expects:
+ *      parent is a valid node.
+ * Notes:
+ *      Runs on the interpreter thread only, so it may allocate. Hot call
+ *      sites are answered from call_cache without touching the table.
+ ************************/
+static uint32_t childOf(uint32_t parent, uint32_t entry)
+{
+        struct CacheLine *line = &call_cache[(parent ^ entry) %
+                                             CALL_CACHE];
+        if (line->child != 0 && line->parent == parent &&
+            line->entry == entry) {
+                return line->child;
+        }
+
+        void *key = (void *)(uintptr_t)(((uint64_t)parent << 32) | entry);
+        uint32_t child = (uint32_t)(uintptr_t)Table_get(children, key);
+        if (child == 0) {
+                if (node_count == node_capacity) {
+                        node_capacity *= 2;
+                        RESIZE(nodes, node_capacity * sizeof(*nodes));
+                }
+                child = node_count++;
+                nodes[child].parent = parent;
+                nodes[child].entry = entry;
+                Table_put(children, key, (void *)(uintptr_t)child);
+        }
+        line->parent = parent;
+        line->entry = entry;
+        line->child = child;
+        return child;
+}
+
+/********** pushFrame ********
+ *
+ * Enter node, expecting the callee to come back to ret.
+ *
+ * Parameters:
+ *      uint32_t node: the callee's node
+ *      uint32_t ret:  expected return address
+ *
+ * Return: void
+ *
+ * Expects:
+ *      None
+ * Notes:
+ *      Once MAX_DEPTH frames are live further calls are treated as
+ *      plain jumps, so runaway recursion is attributed to the deepest
+ *      tracked frame.
+ ************************/
+static void pushFrame(uint32_t node, uint32_t ret)
+{
+        if (depth == MAX_DEPTH) {
+                return;
+        }
+        stack[depth].node = current_node;
+        stack[depth].ret = ret;
+        depth++;
+        current_node = node;
+}
+
+/********** popFrames ********
+ *
+ * Leave n frames, restoring the node of the outermost one left.
+ *
+ * Parameters:
+ *      uint32_t n: number of frames to pop, at most depth
+ *
+ * Return: void
+ *
+ * Expects:
+ *      n <= depth
+ * Notes:
+ *      None
+ ************************/
+static void popFrames(uint32_t n)
+{
+        assert(n <= depth);
+        if (n == 0) {
+                return;
+        }
+        depth -= n;
+        current_node = stack[depth].node;
+}
+
+/********** writeStack ********
+ *
+ * Write the frames from the root down to node, separated by ';'.
+ *
+ * Parameters:
+ *      uint32_t node: the innermost frame
+ *
+ * Return: void
+ *
+ * Expects:
+ *      node is a valid node.
+ * Notes:
+ *      Recursion depth is bounded by MAX_DEPTH.
+ ************************/
+static void writeStack(uint32_t node)
+{
+        if (node == ROOT) {
+                fputs("um", out);
+                return;
+        }
+        writeStack(nodes[node].parent);
+        fprintf(out, ";sub_%x", nodes[node].entry);
+}
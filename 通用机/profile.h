@@ -0,0 +1,26 @@
+/**************************************************************
+ *
+ *     profile.h
+ *
+ *
+ *     profile.h declares a SIGPROF sampling profiler for the um.
+ *     A profiling timer periodically records the current segment-0
+ *     program counter together with a shadow call stack inferred
+ *     from Load Program instructions. On stop, the samples are
+ *     written as folded stacks ("frame;frame;leaf count") which can
+ *     be fed straight into flame graph tools.
+ *
+ **************************************************************/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include "type.h"
+
+void Profile_start(const char *path, unsigned hz, const uint32_t *prg_counter);
+void Profile_branch(const uint32_t *regs, uint32_t prg_counter,
+                    Um_instruction inst);
+void Profile_stop(void);
+
+#endif
@@ -8,10 +8,14 @@
  *     It handles file validation, reads data in 32-bit chunks, 
  *     and stores it in a sequence within segment 0, ensuring 
  *     proper error handling for file and input issues.     
+ *     `readProgram` does the same reading for engines that keep
+ *     segments as flat arrays of words, and `loadUM` stores words
+ *     already in memory into segment 0.
  *
  **************************************************************/
 
 #include "read.h"
+#include "mem.h"
 
 /********** readUM ********
  * read UM instruction sets and store into segment 0
@@ -33,16 +37,80 @@
  *
  ************************/
 void readUM(char* filename, Table_T table)
+{
+        assert(table != NULL);
+        uint32_t inst_size;
+        uint32_t *words = readProgram(filename, &inst_size);
+        loadUM(words, inst_size, table);
+        FREE(words);
+}
+
+/********** loadUM ********
+ * store UM instructions that are already in memory into segment 0
+ * which is implemented by Hanson's Sequence
+ * 
+ * Parameters:
+ *      const uint32_t *words: the instructions
+ *      uint32_t length: number of instructions
+ *      Table_t table: store all segments 
+ *     
+ * Return: 
+ *      None
+ * Expects:
+ *      - If table is NULL, raise exception
+ *      - words may be NULL only if length is 0
+ *
+ * Notes:
+ *      - the words are copied; the caller still owns them
+ *
+ ************************/
+void loadUM(const uint32_t *words, uint32_t length, Table_T table)
+{
+        assert(table != NULL && (words != NULL || length == 0));
+        Seq_T inst_set = Seq_new(length);
+        assert(inst_set != NULL);
+
+        for (uint32_t i = 0; i < length; i++) {
+                Seq_addhi(inst_set, (void *)(uintptr_t)words[i]);
+        }
+
+        uint64_t id = 0;
+        uint64_t offset = 0x100000000;
+        /* to avoid (void *)(uintptr_t)(id) to be null pointer, we add offset*/
+        id = id + offset;
+        Table_put(table, (void *)(uintptr_t)(id), inst_set);
+}
+
+/********** readProgram ********
+ * read UM instruction sets into a flat array of words
+ * 
+ * Parameters:
+ *      char* filename：a string represents file that we want to read
+ *      uint32_t *length: set to the number of words read
+ *     
+ * Return: 
+ *      uint32_t *: the instructions, in file order; the caller frees it
+ * Expects:
+ *      - If we fail to open UM file, raise exception 
+ *      - If length is NULL, raise exception
+ *
+ * Notes:
+ *      - each word is stored big-endian in the file
+ *      - the array always has room for at least one word, so an empty
+ *        program still gets a non-NULL array
+ *
+ ************************/
+uint32_t *readProgram(char* filename, uint32_t *length)
 {
         struct stat sb;
         /* stat read info of file. 
            if 0 is returned, on success; 
            if -1 is returned, on error. */
         assert(stat(filename, &sb) == 0);
-        assert(table != NULL);
+        assert(length != NULL);
         uint64_t inst_size = sb.st_size / 4;
-        Seq_T inst_set = Seq_new(inst_size);
-        assert(inst_set != NULL);
+        assert(inst_size < 0x100000000);
+        uint32_t *words = ALLOC((inst_size + 1) * sizeof(uint32_t));
 
         FILE *fp = fopen(filename, "rb");
         assert(fp != NULL);
@@ -55,14 +123,10 @@ void readUM(char* filename, Table_T table)
                         word = word << 8;
                         word |= c;
                 }
-                Seq_addhi(inst_set, (void *)(uintptr_t)word);
+                words[i] = word;
         }
         
         fclose(fp);
-
-        uint64_t id = 0;
-        uint64_t offset = 0x100000000;
-        /* to avoid (void *)(uintptr_t)(id) to be null pointer, we add offset*/
-        id = id + offset;
-        Table_put(table, (void *)(uintptr_t)(id), inst_set);
+        *length = inst_size;
+        return words;
 }
@@ -5,7 +5,9 @@
  *
  *     The `read.h` file defines functions and data structures 
  *     for reading UM instructions. It declares `readUM`, which reads UM 
- *     files, and several inline functions for extracting specific parts 
+ *     files into segment 0, `readProgram`, which reads them into a flat
+ *     array of words, `loadUM`, which puts such an array into segment 0,
+ *     and several inline functions for extracting specific parts 
  *     of instructions, including operation codes (`readOP`), register 
  *     codes (`read_3Register`), and register values (`read_RegVal`). 
  *     
@@ -28,6 +30,8 @@
 
 
 void readUM(char* filename, Table_T table);
+uint32_t *readProgram(char* filename, uint32_t *length);
+void loadUM(const uint32_t *words, uint32_t length, Table_T table);
 
 /********** readOP ********
  * read operation code from an instruction code
@@ -0,0 +1,300 @@
+/**************************************************************
+ *
+ *     refum.c
+ *
+ *
+ *     implementation for refum.h
+ *
+ **************************************************************/
+
+#include "assert.h"
+#include "mem.h"
+#include "read.h"
+#include "operation.h"
+#include "refum.h"
+
+static Refum_T newMachine(void);
+
+/********** hash ********
+ *
+ * Compute the hash value for a given key.
+ * This hash function uses modular arithmetic to ensure the result fits
+ * within a 32-bit integer range.
+ *
+ * Parameters:
+ *      const void *key: Pointer to the key whose hash value is to be computed.
+ *
+ * Return:
+ *      uint32_t: A 32-bit hash value computed based on the input key.
+ *
+ * Expects:
+ *      The key must not exceed 2^32 - 1.
+ *      Behavior is undefined if the key exceeds this limit.
+ *
+ * Notes:
+ *      This function will CRE if the key is NULL.
+ ************************/
+
+static unsigned hash(const void *key) 
+{
+        uint64_t size = 0x100000000;/* 2^32 */
+        uint64_t slot_id = (uint64_t)(uintptr_t)key % size;
+        return (uint32_t)slot_id;
+}
+
+/********** cmp ********
+ *
+ * Compare two keys represented as pointers and determine their order.
+ *
+ * Parameters:
+ *      const void *x: Pointer to the first key to compare.
+ *      const void *y: Pointer to the second key to compare.
+ *
+ * Return:
+ *      int: -1 if the first key is less than the second key,
+ *           0 if the keys are equal,
+ *           1 if the first key is greater than the second key.
+ *
+ * Expects:
+ *      x and y must not be NULL.
+ *
+ * Notes:
+ *      The keys are expected to be 32-bit integers cast as pointers.
+ ************************/
+static int cmp(const void *x, const void *y)
+{
+        uint32_t key1 = (uint32_t)(uintptr_t)x;
+        uint32_t key2 = (uint32_t)(uintptr_t)y;
+
+        if (key1 < key2) {
+                return -1;
+        } else if (key1 == key2) {
+                return 0;
+        } else {
+                return 1;
+        }
+}
+
+/********** operations ********
+ *
+ * Array of function pointers for operations supported by the um.
+ *
+ * Each function performs a specific operation on a table, sequence, registers,
+ * and other parameters based on the provided instruction.
+ *
+ * Notes:
+ *      Each function has the following prototype:
+ *          void function(Table_T, Seq_T, uint32_t*, uint32_t*, uint64_t*,
+ *                        Um_instruction, bool*)
+ *
+ *      The operations include: ConMov, SegLoad, SegStore, Add, Mul, Div,
+ *      NotAnd, Halt, Map, UnMap, Output, Input, LoadProgram, LoadValue.
+ ************************/
+static void (*operations[])(Table_T, Seq_T, uint32_t*, uint32_t*, uint64_t*,
+                            Um_instruction, bool*) = {
+        ConMov, SegLoad, SegStore, Add, Mul, Div, NotAnd, Halt, Map, UnMap,
+        Output, Input, LoadProgram, LoadValue
+};
+
+/********** Refum_new ********
+ *
+ * Create a reference machine with the given program in segment 0.
+ *
+ * Parameters:
+ *      char *filename: path of the .um file
+ *
+ * Return:
+ *      Refum_T: the machine, with all registers and the program
+ *               counter at 0
+ *
+ * Expects:
+ *      filename must name a readable file.
+ * Notes:
+ *      CRE if memory allocation fails.
+ ************************/
+Refum_T Refum_new(char *filename)
+{
+        Refum_T um = newMachine();
+        readUM(filename, um->address_table);
+        return um;
+}
+
+/********** Refum_fromProgram ********
+ *
+ * Create a reference machine from a program already in memory.
+ *
+ * Parameters:
+ *      const uint32_t *words: the program, one instruction per word
+ *      uint32_t length:       number of words
+ *
+ * Return:
+ *      Refum_T: the machine, with all registers and the program
+ *               counter at 0
+ *
+ * Expects:
+ *      words may be NULL only if length is 0.
+ * Notes:
+ *      The words are copied. CRE if memory allocation fails.
+ ************************/
+Refum_T Refum_fromProgram(const uint32_t *words, uint32_t length)
+{
+        Refum_T um = newMachine();
+        loadUM(words, length, um->address_table);
+        return um;
+}
+
+/********** Refum_fetch ********
+ *
+ * Read the instruction the program counter points at.
+ *
+ * Parameters:
+ *      Refum_T um: a machine that has not halted
+ *
+ * Return:
+ *      Um_instruction: the word $m[0][pc]
+ *
+ * Expects:
+ *      um must not be NULL.
+ * Notes:
+ *      CRE if the program counter is outside segment 0.
+ ************************/
+Um_instruction Refum_fetch(Refum_T um)
+{
+        assert(um != NULL && um->notHalt);
+        Seq_T seg0 = Refum_segment(um, 0);
+        void *value = Seq_get(seg0, um->prg_counter);
+        return (uint32_t)(uintptr_t)value;
+}
+
+/********** Refum_exec ********
+ *
+ * Execute one instruction through its handler in operation.c.
+ *
+ * Parameters:
+ *      Refum_T um:          a machine that has not halted
+ *      Um_instruction inst: the instruction, normally from Refum_fetch
+ *
+ * Return: void
+ *
+ * Expects:
+ *      um must not be NULL.
+ * Notes:
+ *      Halt frees the segments, so afterwards the table and id bin are
+ *      cleared here and only the registers remain meaningful.
+ ************************/
+void Refum_exec(Refum_T um, Um_instruction inst)
+{
+        assert(um != NULL && um->notHalt);
+        Um_opcode op = readOP(inst);
+        operations[op](um->address_table, um->segid_bin, um->regs,
+                       &um->prg_counter, &um->id_counter, inst, &um->notHalt);
+        if (!um->notHalt) {
+                um->address_table = NULL;
+                um->segid_bin = NULL;
+        }
+}
+
+/********** Refum_run ********
+ *
+ * Execute instructions until the machine halts.
+ *
+ * Parameters:
+ *      Refum_T um: the machine
+ *
+ * Return: void
+ *
+ * Expects:
+ *      um must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+void Refum_run(Refum_T um)
+{
+        assert(um != NULL);
+        while (um->notHalt == true) {
+                Refum_exec(um, Refum_fetch(um));
+        }
+}
+
+/********** Refum_segment ********
+ *
+ * Look up a mapped segment by its um identifier.
+ *
+ * Parameters:
+ *      Refum_T um:  a machine that has not halted
+ *      uint32_t id: segment identifier
+ *
+ * Return:
+ *      Seq_T: the segment, or NULL if id is not mapped
+ *
+ * Expects:
+ *      um must not be NULL.
+ * Notes:
+ *      Segment 0 is stored under 2^32 so that its key is not NULL.
+ ************************/
+Seq_T Refum_segment(Refum_T um, uint32_t id)
+{
+        assert(um != NULL && um->address_table != NULL);
+        /* 0 mod 0x100000000 == 0x100000000 mod 0x100000000  */
+        /* 0x100000000 help us avoid null pointer which is 0 */
+        uint64_t key = id == 0 ? 0x100000000 : id;
+        return Table_get(um->address_table, (void *)(uintptr_t)key);
+}
+
+/********** Refum_free ********
+ *
+ * Release a machine and, if it has not halted, all of its segments.
+ *
+ * Parameters:
+ *      Refum_T *um: pointer to the machine, set to NULL
+ *
+ * Return: void
+ *
+ * Expects:
+ *      um and *um must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+void Refum_free(Refum_T *um)
+{
+        assert(um != NULL && *um != NULL);
+        if ((*um)->address_table != NULL) {
+                Table_map((*um)->address_table, vfree, NULL);
+                Table_free(&(*um)->address_table);
+        }
+        if ((*um)->segid_bin != NULL) {
+                Seq_free(&(*um)->segid_bin);
+        }
+        FREE(*um);
+}
+
+/********** newMachine ********
+ *
+ * Allocate a machine with no segments mapped.
+ *
+ * Parameters: None
+ *
+ * Return:
+ *      Refum_T: the machine, with all registers and the program
+ *               counter at 0
+ *
+ * Expects:
+ *      None
+ * Notes:
+ *      CRE if memory allocation fails.
+ ************************/
+static Refum_T newMachine(void)
+{
+        Refum_T um;
+        NEW(um);
+        for (int i = 0; i < 8; i++) {
+                um->regs[i] = 0;
+        }
+        um->address_table = Table_new(3, cmp, hash);
+        um->segid_bin = Seq_new(3);
+        assert(um->address_table != NULL && um->segid_bin != NULL);
+        um->id_counter = 1;
+        um->prg_counter = 0;
+        um->notHalt = true;
+        return um;
+}
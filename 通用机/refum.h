@@ -0,0 +1,39 @@
+/**************************************************************
+ *
+ *     refum.h
+ *
+ *
+ *     refum.h declares the reference engine: the machine state
+ *     that the handlers in operation.c act on, and the loop that
+ *     fetches an instruction from segment 0 and dispatches it to
+ *     its handler. Every other engine is checked against this one.
+ *
+ **************************************************************/
+
+#ifndef REFUM_H
+#define REFUM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "table.h"
+#include "seq.h"
+#include "type.h"
+
+typedef struct Refum_T {
+        Table_T address_table;  /* segment id (0 stored as 2^32) -> Seq_T */
+        Seq_T segid_bin;        /* store used and freed id */
+        uint32_t regs[8];
+        uint32_t prg_counter;
+        uint64_t id_counter;    /* keep track of # of id we have used */
+        bool notHalt;
+} *Refum_T;
+
+Refum_T Refum_new(char *filename);
+Refum_T Refum_fromProgram(const uint32_t *words, uint32_t length);
+Um_instruction Refum_fetch(Refum_T um);
+void Refum_exec(Refum_T um, Um_instruction inst);
+void Refum_run(Refum_T um);
+Seq_T Refum_segment(Refum_T um, uint32_t id);
+void Refum_free(Refum_T *um);
+
+#endif
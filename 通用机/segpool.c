@@ -0,0 +1,444 @@
+/**************************************************************
+ *
+ *     segpool.c
+ *
+ *
+ *     implementation for segpool.h
+ *
+ *     Every large Map size is remembered in a small ring. The
+ *     CLASSES most frequent sizes in the ring (seen at least twice)
+ *     are the hot size classes; each keeps up to DEPTH zero-filled
+ *     segments ready. All shared state is guarded by one mutex and
+ *     the helper sleeps on a condition variable whenever it has no
+ *     segment to build or re-zero. Zeroing and allocation happen
+ *     with the lock released.
+ *
+ *     Segments cross threads, but each one is only ever touched by
+ *     one thread at a time, so Hanson's sequences need no locking
+ *     of their own.
+ *
+ **************************************************************/
+
+#include <pthread.h>
+#include "assert.h"
+#include "mem.h"
+#include "segpool.h"
+
+#define HISTORY 64      /* recent large Map sizes remembered */
+#define CLASSES 4       /* hot sizes kept warm */
+#define DEPTH   2       /* ready segments per hot size */
+#define PENDING 8       /* unmapped segments waiting to be re-zeroed */
+
+struct SizeClass {
+        uint32_t size;          /* 0 marks an unused class */
+        int ready_count;
+        Seq_T ready[DEPTH];
+};
+
+struct Segpool_T {
+        pthread_t helper;
+        pthread_mutex_t lock;
+        pthread_cond_t wake;
+        bool stop;
+
+        uint32_t threshold;
+        uint32_t history[HISTORY];
+        int history_next;
+        int history_len;
+
+        struct SizeClass classes[CLASSES];
+        Seq_T pending[PENDING];
+        int pending_count;
+};
+
+static void *helperMain(void *cl);
+static void learn(Segpool_T pool, uint32_t size, Seq_T *evicted,
+                  int *evicted_count);
+static struct SizeClass *findClass(Segpool_T pool, uint32_t size);
+static Seq_T fileReady(Segpool_T pool, Seq_T seg);
+static Seq_T newZeroSeg(uint32_t size);
+static void zeroSeg(Seq_T seg);
+
+/********** Segpool_new ********
+ *
+ * Create a pool and start its helper thread.
+ *
+ * Parameters:
+ *      uint32_t threshold: smallest Map size, in words, the pool serves
+ *
+ * Return:
+ *      Segpool_T: the new pool
+ *
+ * Expects:
+ *      threshold > 0
+ * Notes:
+ *      CRE if the helper thread cannot be started.
+ ************************/
+Segpool_T Segpool_new(uint32_t threshold)
+{
+        assert(threshold > 0);
+        Segpool_T pool;
+        NEW0(pool);
+        pool->threshold = threshold;
+        pool->stop = false;
+        assert(pthread_mutex_init(&pool->lock, NULL) == 0);
+        assert(pthread_cond_init(&pool->wake, NULL) == 0);
+        assert(pthread_create(&pool->helper, NULL, helperMain, pool) == 0);
+        return pool;
+}
+
+/********** Segpool_get ********
+ *
+ * Take a zero-filled segment of exactly size words, if one is ready.
+ *
+ * Parameters:
+ *      Segpool_T pool: the pool
+ *      uint32_t size:  number of words requested by Map
+ *
+ * Return:
+ *      Seq_T: a segment of length size with every word 0, or NULL if
+ *             the request is small or no segment of that size is ready
+ *
+ * Expects:
+ *      pool must not be NULL.
+ * Notes:
+ *      Every large request is recorded, whether it hits or not, so the
+ *      pool follows the guest's current size distribution. The caller
+ *      owns the returned segment.
+ ************************/
+Seq_T Segpool_get(Segpool_T pool, uint32_t size)
+{
+        assert(pool != NULL);
+        if (size < pool->threshold) {
+                return NULL;
+        }
+        Seq_T evicted[CLASSES * DEPTH];
+        int evicted_count = 0;
+        Seq_T seg = NULL;
+
+        pthread_mutex_lock(&pool->lock);
+        learn(pool, size, evicted, &evicted_count);
+        struct SizeClass *class = findClass(pool, size);
+        if (class != NULL && class->ready_count > 0) {
+                seg = class->ready[--class->ready_count];
+        }
+        pthread_cond_signal(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+
+        for (int i = 0; i < evicted_count; i++) {
+                Seq_free(&evicted[i]);
+        }
+        return seg;
+}
+
+/********** Segpool_recycle ********
+ *
+ * Offer an unmapped segment to the pool for re-zeroing.
+ *
+ * Parameters:
+ *      Segpool_T pool: the pool
+ *      Seq_T seg:      the segment being released
+ *
+ * Return:
+ *      bool: true if the pool took ownership of seg, false if the
+ *            caller must free it as usual
+ *
+ * Expects:
+ *      pool and seg must not be NULL.
+ * Notes:
+ *      Only segments whose length is a hot size are accepted, and only
+ *      while the helper's queue has room.
+ ************************/
+bool Segpool_recycle(Segpool_T pool, Seq_T seg)
+{
+        assert(pool != NULL && seg != NULL);
+        uint32_t size = Seq_length(seg);
+        if (size < pool->threshold) {
+                return false;
+        }
+        bool taken = false;
+        pthread_mutex_lock(&pool->lock);
+        if (pool->pending_count < PENDING && findClass(pool, size) != NULL) {
+                pool->pending[pool->pending_count++] = seg;
+                pthread_cond_signal(&pool->wake);
+                taken = true;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        return taken;
+}
+
+/********** Segpool_free ********
+ *
+ * Stop the helper thread and free every segment the pool still holds.
+ *
+ * Parameters:
+ *      Segpool_T *pool: pointer to the pool, set to NULL
+ *
+ * Return: void
+ *
+ * Expects:
+ *      pool and *pool must not be NULL.
+ * Notes:
+ *      Blocks until the helper finishes the segment it is working on.
+ ************************/
+void Segpool_free(Segpool_T *pool)
+{
+        assert(pool != NULL && *pool != NULL);
+        Segpool_T p = *pool;
+        pthread_mutex_lock(&p->lock);
+        p->stop = true;
+        pthread_cond_signal(&p->wake);
+        pthread_mutex_unlock(&p->lock);
+        pthread_join(p->helper, NULL);
+
+        for (int i = 0; i < CLASSES; i++) {
+                for (int j = 0; j < p->classes[i].ready_count; j++) {
+                        Seq_free(&p->classes[i].ready[j]);
+                }
+        }
+        for (int i = 0; i < p->pending_count; i++) {
+                Seq_free(&p->pending[i]);
+        }
+        pthread_cond_destroy(&p->wake);
+        pthread_mutex_destroy(&p->lock);
+        FREE(*pool);
+}
+
+/********** helperMain ********
+ *
+ * Body of the helper thread: re-zero pending segments first, then top
+ * up any hot size class that has fewer than DEPTH ready segments.
+ *
+ * Parameters:
+ *      void *cl: the Segpool_T
+ *
+ * Return:
+ *      void *: always NULL
+ *
+ * Expects:
+ *      cl must not be NULL.
+ * Notes:
+ *      The lock is dropped around every zeroing, allocation and free.
+ ************************/
+static void *helperMain(void *cl)
+{
+        Segpool_T pool = cl;
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stop) {
+                Seq_T seg = NULL;
+                if (pool->pending_count > 0) {
+                        seg = pool->pending[--pool->pending_count];
+                        pthread_mutex_unlock(&pool->lock);
+                        zeroSeg(seg);
+                } else {
+                        uint32_t size = 0;
+                        for (int i = 0; i < CLASSES && size == 0; i++) {
+                                if (pool->classes[i].size != 0 &&
+                                    pool->classes[i].ready_count < DEPTH) {
+                                        size = pool->classes[i].size;
+                                }
+                        }
+                        if (size == 0) {
+                                pthread_cond_wait(&pool->wake, &pool->lock);
+                                continue;
+                        }
+                        pthread_mutex_unlock(&pool->lock);
+                        seg = newZeroSeg(size);
+                }
+
+                pthread_mutex_lock(&pool->lock);
+                seg = fileReady(pool, seg);
+                if (seg != NULL) {
+                        pthread_mutex_unlock(&pool->lock);
+                        Seq_free(&seg);
+                        pthread_mutex_lock(&pool->lock);
+                }
+        }
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+}
+
+/********** learn ********
+ *
+ * Record a large Map size and recompute the hot size classes.
+ *
+ * Parameters:
+ *      Segpool_T pool:     the pool, locked by the caller
+ *      uint32_t size:      the size just requested
+ *      Seq_T *evicted:     receives ready segments of classes that are
+ *                          no longer hot
+ *      int *evicted_count: number of segments stored in evicted
+ *
+ * Return: void
+ *
+ * Expects:
+ *      evicted has room for CLASSES * DEPTH segments.
+ * Notes:
+ *      A size must appear at least twice in the last HISTORY requests
+ *      to become hot. Classes that stay hot keep their ready segments;
+ *      the caller frees evicted ones after dropping the lock.
+ ************************/
+static void learn(Segpool_T pool, uint32_t size, Seq_T *evicted,
+                  int *evicted_count)
+{
+        pool->history[pool->history_next] = size;
+        pool->history_next = (pool->history_next + 1) % HISTORY;
+        if (pool->history_len < HISTORY) {
+                pool->history_len++;
+        }
+
+        uint32_t hot[CLASSES] = {0};
+        int hot_count[CLASSES] = {0};
+        for (int i = 0; i < pool->history_len; i++) {
+                uint32_t s = pool->history[i];
+                int count = 0;
+                for (int j = 0; j < pool->history_len; j++) {
+                        count += pool->history[j] == s;
+                }
+                if (count < 2) {
+                        continue;
+                }
+                int slot = -1;
+                for (int k = 0; k < CLASSES && slot < 0; k++) {
+                        if (hot[k] == s) {
+                                slot = CLASSES;
+                        } else if (count > hot_count[k]) {
+                                slot = k;
+                        }
+                }
+                if (slot >= 0 && slot < CLASSES) {
+                        for (int k = CLASSES - 1; k > slot; k--) {
+                                hot[k] = hot[k - 1];
+                                hot_count[k] = hot_count[k - 1];
+                        }
+                        hot[slot] = s;
+                        hot_count[slot] = count;
+                }
+        }
+
+        /* keep classes that are still hot, evict the rest */
+        struct SizeClass next[CLASSES];
+        for (int k = 0; k < CLASSES; k++) {
+                next[k].size = hot[k];
+                next[k].ready_count = 0;
+                struct SizeClass *old = hot[k] != 0 ? findClass(pool, hot[k])
+                                                    : NULL;
+                if (old != NULL) {
+                        next[k] = *old;
+                        old->size = 0;
+                }
+        }
+        for (int k = 0; k < CLASSES; k++) {
+                struct SizeClass *old = &pool->classes[k];
+                if (old->size == 0) {
+                        continue;
+                }
+                for (int j = 0; j < old->ready_count; j++) {
+                        evicted[(*evicted_count)++] = old->ready[j];
+                }
+        }
+        for (int k = 0; k < CLASSES; k++) {
+                pool->classes[k] = next[k];
+        }
+}
+
+/********** findClass ********
+ *
+ * Find the hot size class for size.
+ *
+ * Parameters:
+ *      Segpool_T pool: the pool, locked by the caller
+ *      uint32_t size:  segment length in words
+ *
+ * Return:
+ *      struct SizeClass *: the class, or NULL if size is not hot
+ *
+ * Expects:
+ *      size > 0
+ * Notes:
+ *      None
+ ************************/
+static struct SizeClass *findClass(Segpool_T pool, uint32_t size)
+{
+        for (int k = 0; k < CLASSES; k++) {
+                if (pool->classes[k].size == size) {
+                        return &pool->classes[k];
+                }
+        }
+        return NULL;
+}
+
+/********** fileReady ********
+ *
+ * Put a zero-filled segment into its size class.
+ *
+ * Parameters:
+ *      Segpool_T pool: the pool, locked by the caller
+ *      Seq_T seg:      a zero-filled segment
+ *
+ * Return:
+ *      Seq_T: NULL if the segment was filed, otherwise seg, which the
+ *             caller must free because its size went cold or its class
+ *             is already full
+ *
+ * Expects:
+ *      seg must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+static Seq_T fileReady(Segpool_T pool, Seq_T seg)
+{
+        struct SizeClass *class = findClass(pool, Seq_length(seg));
+        if (class == NULL || class->ready_count == DEPTH) {
+                return seg;
+        }
+        class->ready[class->ready_count++] = seg;
+        return NULL;
+}
+
+/********** newZeroSeg ********
+ *
+ * Build a segment of size words, all 0, exactly as Map does.
+ *
+ * Parameters:
+ *      uint32_t size: number of words
+ *
+ * Return:
+ *      Seq_T: the new segment
+ *
+ * Expects:
+ *      None
+ * Notes:
+ *      CRE if memory allocation fails.
+ ************************/
+static Seq_T newZeroSeg(uint32_t size)
+{
+        Seq_T seg = Seq_new(size);
+        assert(seg != NULL);
+        for (uint32_t i = 0; i < size; i++) {
+                Seq_addhi(seg, (void *)(uintptr_t)0);
+        }
+        return seg;
+}
+
+/********** zeroSeg ********
+ *
+ * Overwrite every word of a used segment with 0.
+ *
+ * Parameters:
+ *      Seq_T seg: the segment
+ *
+ * Return: void
+ *
+ * Expects:
+ *      seg must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+static void zeroSeg(Seq_T seg)
+{
+        int length = Seq_length(seg);
+        for (int i = 0; i < length; i++) {
+                Seq_put(seg, i, (void *)(uintptr_t)0);
+        }
+}
@@ -0,0 +1,29 @@
+/**************************************************************
+ *
+ *     segpool.h
+ *
+ *
+ *     segpool.h declares a pool of pre-zeroed segments for large
+ *     Map requests. A helper thread learns which large sizes the
+ *     guest maps most often, keeps a few zero-filled segments of
+ *     those sizes ready, and re-zeroes unmapped segments of a hot
+ *     size off the interpreter thread so they can be handed out
+ *     again.
+ *
+ **************************************************************/
+
+#ifndef SEGPOOL_H
+#define SEGPOOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "seq.h"
+
+typedef struct Segpool_T *Segpool_T;
+
+Segpool_T Segpool_new(uint32_t threshold);
+Seq_T Segpool_get(Segpool_T pool, uint32_t size);
+bool Segpool_recycle(Segpool_T pool, Seq_T seg);
+void Segpool_free(Segpool_T *pool);
+
+#endif
@@ -0,0 +1,624 @@
+/**************************************************************
+ *
+ *     umbench.c
+ *
+ *
+ *     Entry point of the um-microbench program. For each of the 14
+ *     opcodes it builds a program whose loop body repeats that
+ *     instruction, runs it on every engine in the tree, and reports
+ *     the time per instruction after subtracting the cost of the
+ *     same loop with an empty body. Each measurement is preceded by
+ *     warm-up runs and the median of several timed runs is kept.
+ *
+ *     It also runs a sweep over a large segment on the fast engine,
+ *     in order and with a page-sized stride, with and without huge
+ *     pages.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "assert.h"
+#include "mem.h"
+#include "umio.h"
+#include "refum.h"
+#include "fastum.h"
+#include "type.h"
+
+#define BODY       1000         /* copies of the instruction per iteration */
+#define ITERATIONS 200          /* default loop iterations */
+#define RUNS       11           /* default timed runs; the median is kept */
+#define WARMUP     2            /* untimed runs before them */
+#define SWEEP_LOG  22           /* the sweep segment has 2^22 words */
+#define SWEEP_RUNS 5
+
+/*
+ * Register use in generated programs: r0 stays 0, r1 is the scratch
+ * destination, r2 = 3 and r3 = 7 are operands, r4 holds a mapped
+ * segment, r5 = ~0 counts down the loop, r6 is the counter and r7 and
+ * r1 are clobbered by the loop branch.
+ */
+enum { R0, R1, R2, R3, R4, R5, R6, R7 };
+
+typedef struct Program {
+        uint32_t *words;
+        uint32_t length, capacity;
+} Program;
+
+typedef enum { REF, FAST, ENGINES } Engine;
+
+static const char *engine_names[] = { "ref", "fast" };
+
+static const char *op_names[] = {
+        "cmov", "sload", "sstore", "add", "mul", "div", "nand", "halt",
+        "map", "unmap", "out", "in", "loadp", "lv"
+};
+
+static void usage(const char *progname);
+static void emit(Program *p, uint32_t word);
+static uint32_t op3(unsigned op, unsigned a, unsigned b, unsigned c);
+static uint32_t lv(unsigned a, uint32_t value);
+static Program loopProgram(int op, unsigned iterations);
+static Program sweepProgram(uint32_t stride, unsigned passes);
+static double runOnce(Engine engine, Program *p, uint64_t huge);
+static double measure(Engine engine, Program *p, unsigned runs,
+                      uint64_t huge);
+static double haltCost(Engine engine, unsigned runs);
+static double now(void);
+static int cmpDouble(const void *x, const void *y);
+static int nullGet(void *cl);
+static void nullPut(int c, void *cl);
+
+/********** main ********
+ *
+ * Measure and print the per-opcode costs and the sweep.
+ *
+ * Parameters:
+ *      int argc: Number of command-line arguments.
+ *      char* argv[]: Array of command-line argument strings.
+ *
+ * Return:
+ *      int: EXIT_SUCCESS, or EXIT_FAILURE on incorrect arguments.
+ *
+ * Expects:
+ *      um-microbench [-n runs] [-i iterations]
+ *
+ * Notes:
+ *      Costs are wall-clock nanoseconds from CLOCK_MONOTONIC, which
+ *      resolves single runs of a few milliseconds well; dividing by
+ *      BODY * iterations brings them down to one instruction.
+ *      Map is measured by mapping without unmapping, Unmap as a
+ *      Map/Unmap pair minus Map, and Load Program as a Load Value /
+ *      Load Program pair minus Load Value, since neither can repeat
+ *      on its own. Every Map in the Map body gets a fresh identifier
+ *      and grows the machine's segment table, while the pair reuses
+ *      one, so the derived Unmap can come out below zero; the pair's
+ *      own cost is printed too. Halt can only run once per machine,
+ *      so it is timed across many fresh machines.
+ ************************/
+int main(int argc, char *argv[])
+{
+        unsigned runs = RUNS, iterations = ITERATIONS;
+        for (int i = 1; i < argc; i++) {
+                char *endptr;
+                long n;
+                if ((strcmp(argv[i], "-n") == 0 ||
+                     strcmp(argv[i], "-i") == 0) && i + 1 < argc) {
+                        n = strtol(argv[i + 1], &endptr, 10);
+                        if (*endptr != '\0' || n < 1 || n > 1000000) {
+                                usage(argv[0]);
+                        }
+                        if (argv[i][1] == 'n') {
+                                runs = n;
+                        } else {
+                                iterations = n;
+                        }
+                        i++;
+                } else {
+                        usage(argv[0]);
+                }
+        }
+        UmIO_use(nullGet, nullPut, NULL);
+
+        double base[ENGINES], cost[14][ENGINES], pair[ENGINES];
+        Program empty = loopProgram(-1, iterations);
+        for (Engine e = REF; e < ENGINES; e++) {
+                base[e] = measure(e, &empty, runs, UMEM_HUGE_WORDS);
+        }
+        FREE(empty.words);
+
+        double per = (double)BODY * iterations;
+        for (int op = 0; op < 14; op++) {
+                if (op == HALT) {
+                        for (Engine e = REF; e < ENGINES; e++) {
+                                cost[op][e] = haltCost(e, runs);
+                        }
+                        continue;
+                }
+                Program p = loopProgram(op, iterations);
+                for (Engine e = REF; e < ENGINES; e++) {
+                        cost[op][e] = (measure(e, &p, runs, UMEM_HUGE_WORDS)
+                                       - base[e])
+                                      / per;
+                }
+                FREE(p.words);
+        }
+        /* Unmap and Load Program were timed with their partners */
+        for (Engine e = REF; e < ENGINES; e++) {
+                pair[e] = cost[INACTIVATE][e];
+                cost[INACTIVATE][e] -= cost[ACTIVATE][e];
+                cost[LOADP][e] -= cost[LV][e];
+        }
+
+        printf("per-instruction cost, ns (median of %u runs, "
+               "%u x %u instructions, loop overhead removed)\n",
+               runs, iterations, BODY);
+        printf("%-10s", "opcode");
+        for (Engine e = REF; e < ENGINES; e++) {
+                printf("%12s", engine_names[e]);
+        }
+        printf("\n");
+        for (int op = 0; op < 14; op++) {
+                printf("%2d %-7s", op, op_names[op]);
+                for (Engine e = REF; e < ENGINES; e++) {
+                        printf("%12.2f", cost[op][e]);
+                }
+                printf("\n");
+        }
+        printf("%-10s", "map+unmap");
+        for (Engine e = REF; e < ENGINES; e++) {
+                printf("%12.2f", pair[e]);
+        }
+        printf("\n%-10s", "loop");
+        for (Engine e = REF; e < ENGINES; e++) {
+                printf("%12.2f", base[e] / iterations);
+        }
+        printf("   (ns per iteration, branch included)\n");
+
+        printf("\nsweep of a %u-word segment on the fast engine, "
+               "ns per access (median of %u runs)\n",
+               1u << SWEEP_LOG, SWEEP_RUNS);
+        printf("%-12s%14s%14s\n", "access", "huge pages", "ordinary");
+        uint32_t strides[] = { 1, 1025 };
+        const char *labels[] = { "sequential", "strided" };
+        for (int k = 0; k < 2; k++) {
+                Program p = sweepProgram(strides[k], 2);
+                double accesses = 2.0 * (1u << SWEEP_LOG);
+                double huge = measure(FAST, &p, SWEEP_RUNS, UMEM_HUGE_WORDS);
+                double plain = measure(FAST, &p, SWEEP_RUNS, 0);
+                printf("%-12s%14.2f%14.2f\n", labels[k], huge / accesses,
+                       plain / accesses);
+                FREE(p.words);
+        }
+        return EXIT_SUCCESS;
+}
+
+/********** usage ********
+ *
+ * Print the command line synopsis and exit with failure.
+ *
+ * Parameters:
+ *      const char *progname: name the program was invoked as
+ *
+ * Return: does not return
+ *
+ * Expects:
+ *      progname must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+static void usage(const char *progname)
+{
+        fprintf(stderr, "Usage: %s [-n runs] [-i iterations]\n", progname);
+        exit(EXIT_FAILURE);
+}
+
+/********** emit ********
+ *
+ * Append a word to a program.
+ *
+ * Parameters:
+ *      Program *p:    the program
+ *      uint32_t word: the instruction
+ *
+ * Return: void
+ *
+ * Expects:
+ *      p must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+static void emit(Program *p, uint32_t word)
+{
+        if (p->length == p->capacity) {
+                p->capacity = p->capacity > 0 ? 2 * p->capacity : 256;
+                RESIZE(p->words, p->capacity * sizeof(uint32_t));
+        }
+        p->words[p->length++] = word;
+}
+
+/********** op3 ********
+ *
+ * Encode a three-register instruction.
+ *
+ * Parameters:
+ *      unsigned op:            opcode
+ *      unsigned a, b, c:       registers
+ *
+ * Return:
+ *      uint32_t: the instruction
+ *
+ * Expects:
+ *      op < 13, registers < 8
+ * Notes:
+ *      None
+ ************************/
+static uint32_t op3(unsigned op, unsigned a, unsigned b, unsigned c)
+{
+        return (op << 28) | (a << 6) | (b << 3) | c;
+}
+
+/********** lv ********
+ *
+ * Encode a Load Value instruction.
+ *
+ * Parameters:
+ *      unsigned a:     register
+ *      uint32_t value: value, below 2^25
+ *
+ * Return:
+ *      uint32_t: the instruction
+ *
+ * Expects:
+ *      a < 8
+ * Notes:
+ *      None
+ ************************/
+static uint32_t lv(unsigned a, uint32_t value)
+{
+        return ((uint32_t)LV << 28) | (a << 25) | value;
+}
+
+/********** loopProgram ********
+ *
+ * Build a program whose loop body repeats one instruction.
+ *
+ * Parameters:
+ *      int op:              opcode to repeat, -1 for an empty body
+ *      unsigned iterations: loop iterations
+ *
+ * Return:
+ *      Program: the program, whose words the caller frees
+ *
+ * Expects:
+ *      op is not HALT.
+ * Notes:
+ *      Unmap is repeated after a Map and Load Program after the Load
+ *      Value that names its target, so those bodies hold pairs.
+ *      Every instruction is set up to take its ordinary path: the
+ *      conditional move moves, division is by 3, loads and stores hit
+ *      a mapped segment, and Load Program stays in segment 0 and
+ *      jumps to the next instruction.
+ ************************/
+static Program loopProgram(int op, unsigned iterations)
+{
+        Program p = { NULL, 0, 0 };
+        emit(&p, lv(R2, 3));
+        emit(&p, lv(R3, 7));
+        emit(&p, lv(R5, 0));
+        emit(&p, op3(NAND, R5, R5, R5));
+        emit(&p, op3(ACTIVATE, 0, R4, R3));
+        emit(&p, lv(R6, iterations));
+        uint32_t loop = p.length;
+
+        for (int i = 0; op >= 0 && i < BODY; i++) {
+                switch (op) {
+                case CMOV:   emit(&p, op3(CMOV, R1, R2, R3));   break;
+                case SLOAD:  emit(&p, op3(SLOAD, R1, R4, R0));  break;
+                case SSTORE: emit(&p, op3(SSTORE, R4, R0, R2)); break;
+                case ADD:
+                case MUL:
+                case DIV:
+                case NAND:   emit(&p, op3(op, R1, R3, R2));     break;
+                case ACTIVATE:
+                        emit(&p, op3(ACTIVATE, 0, R1, R2));
+                        break;
+                case INACTIVATE:
+                        emit(&p, op3(ACTIVATE, 0, R1, R2));
+                        emit(&p, op3(INACTIVATE, 0, 0, R1));
+                        break;
+                case OUT:    emit(&p, op3(OUT, 0, 0, R2));      break;
+                case IN:     emit(&p, op3(IN, 0, 0, R1));       break;
+                case LOADP:
+                        emit(&p, lv(R7, p.length + 2));
+                        emit(&p, op3(LOADP, 0, R0, R7));
+                        break;
+                case LV:     emit(&p, lv(R1, 5));               break;
+                default:     assert(0);
+                }
+        }
+
+        /* r6--; if r6 != 0 goto loop */
+        emit(&p, op3(ADD, R6, R6, R5));
+        emit(&p, lv(R7, p.length + 4));
+        emit(&p, lv(R1, loop));
+        emit(&p, op3(CMOV, R7, R1, R6));
+        emit(&p, op3(LOADP, 0, R0, R7));
+        emit(&p, op3(HALT, 0, 0, 0));
+        return p;
+}
+
+/********** sweepProgram ********
+ *
+ * Build a program that reads and writes every word of a large
+ * segment.
+ *
+ * Parameters:
+ *      uint32_t stride: distance between consecutive accesses, odd
+ *      unsigned passes: times the whole segment is visited
+ *
+ * Return:
+ *      Program: the program, whose words the caller frees
+ *
+ * Expects:
+ *      None
+ * Notes:
+ *      Access i touches word (i * stride) mod 2^SWEEP_LOG, so an odd
+ *      stride still visits every word once per pass. A stride above
+ *      a page's worth of words moves to another page on every access,
+ *      which is what makes the TLB matter.
+ ************************/
+static Program sweepProgram(uint32_t stride, unsigned passes)
+{
+        Program p = { NULL, 0, 0 };
+        uint32_t words = 1u << SWEEP_LOG;
+        emit(&p, lv(R2, stride));
+        emit(&p, lv(R3, words - 1));
+        emit(&p, lv(R5, 0));
+        emit(&p, op3(NAND, R5, R5, R5));
+        emit(&p, lv(R1, 1 << (SWEEP_LOG / 2)));
+        emit(&p, lv(R7, 1 << (SWEEP_LOG - SWEEP_LOG / 2)));
+        emit(&p, op3(MUL, R1, R1, R7));
+        emit(&p, op3(ACTIVATE, 0, R4, R1));
+        emit(&p, lv(R6, passes));
+        emit(&p, op3(MUL, R6, R6, R1));
+        uint32_t loop = p.length;
+
+        /* r1 = (r6 * stride) & mask; m[r4][r1] += r6 */
+        emit(&p, op3(MUL, R1, R6, R2));
+        emit(&p, op3(NAND, R1, R1, R3));
+        emit(&p, op3(NAND, R1, R1, R1));
+        emit(&p, op3(SLOAD, R7, R4, R1));
+        emit(&p, op3(ADD, R7, R7, R6));
+        emit(&p, op3(SSTORE, R4, R1, R7));
+
+        emit(&p, op3(ADD, R6, R6, R5));
+        emit(&p, lv(R7, p.length + 4));
+        emit(&p, lv(R1, loop));
+        emit(&p, op3(CMOV, R7, R1, R6));
+        emit(&p, op3(LOADP, 0, R0, R7));
+        emit(&p, op3(HALT, 0, 0, 0));
+        return p;
+}
+
+/********** runOnce ********
+ *
+ * Time one run of a program from a fresh machine to Halt.
+ *
+ * Parameters:
+ *      Engine engine:  which engine
+ *      Program *p:     the program
+ *      uint64_t huge:  fast engine huge page threshold, 0 for none
+ *
+ * Return:
+ *      double: nanoseconds spent executing; building and freeing the
+ *              machine are not counted
+ *
+ * Expects:
+ *      p must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+static double runOnce(Engine engine, Program *p, uint64_t huge)
+{
+        double start, end;
+        if (engine == REF) {
+                Refum_T um = Refum_fromProgram(p->words, p->length);
+                start = now();
+                Refum_run(um);
+                end = now();
+                Refum_free(&um);
+        } else {
+                Umem_T mem = Umem_new(UMEM_FRAG_PERCENT);
+                Umem_hugepages(mem, huge);
+                Fastum_T um = Fastum_new(mem, p->words, p->length,
+                                         nullGet, nullPut, NULL);
+                start = now();
+                Fastum_run(um, UINT64_MAX);
+                end = now();
+                Fastum_free(&um);
+        }
+        return end - start;
+}
+
+/********** measure ********
+ *
+ * Median time of several runs of a program, after warming up.
+ *
+ * Parameters:
+ *      Engine engine:  which engine
+ *      Program *p:     the program
+ *      unsigned runs:  timed runs
+ *      uint64_t huge:  fast engine huge page threshold, 0 for none
+ *
+ * Return:
+ *      double: the median, in nanoseconds
+ *
+ * Expects:
+ *      p must not be NULL; runs >= 1.
+ * Notes:
+ *      None
+ ************************/
+static double measure(Engine engine, Program *p, unsigned runs,
+                      uint64_t huge)
+{
+        double *times = CALLOC(runs, sizeof(double));
+        for (int i = 0; i < WARMUP; i++) {
+                runOnce(engine, p, huge);
+        }
+        for (unsigned i = 0; i < runs; i++) {
+                times[i] = runOnce(engine, p, huge);
+        }
+        qsort(times, runs, sizeof(double), cmpDouble);
+        double median = times[runs / 2];
+        FREE(times);
+        return median;
+}
+
+/********** haltCost ********
+ *
+ * Median time for a fresh machine to execute a lone Halt.
+ *
+ * Parameters:
+ *      Engine engine:  which engine
+ *      unsigned runs:  timed batches
+ *
+ * Return:
+ *      double: nanoseconds per Halt
+ *
+ * Expects:
+ *      runs >= 1.
+ * Notes:
+ *      Each batch builds BODY machines first and then times running
+ *      all of them, so only the Halt itself (and, for the reference
+ *      engine, the teardown it performs) is counted.
+ ************************/
+static double haltCost(Engine engine, unsigned runs)
+{
+        uint32_t halt = op3(HALT, 0, 0, 0);
+        double *times = CALLOC(runs + WARMUP, sizeof(double));
+        Refum_T *refs = CALLOC(BODY, sizeof(Refum_T));
+        Fastum_T *fasts = CALLOC(BODY, sizeof(Fastum_T));
+
+        for (unsigned r = 0; r < runs + WARMUP; r++) {
+                for (int i = 0; i < BODY; i++) {
+                        if (engine == REF) {
+                                refs[i] = Refum_fromProgram(&halt, 1);
+                        } else {
+                                fasts[i] = Fastum_new(
+                                        Umem_new(UMEM_FRAG_PERCENT), &halt,
+                                        1, nullGet, nullPut, NULL);
+                        }
+                }
+                double start = now();
+                for (int i = 0; i < BODY; i++) {
+                        if (engine == REF) {
+                                Refum_run(refs[i]);
+                        } else {
+                                Fastum_run(fasts[i], UINT64_MAX);
+                        }
+                }
+                times[r] = (now() - start) / BODY;
+                for (int i = 0; i < BODY; i++) {
+                        if (engine == REF) {
+                                Refum_free(&refs[i]);
+                        } else {
+                                Fastum_free(&fasts[i]);
+                        }
+                }
+        }
+
+        qsort(times + WARMUP, runs, sizeof(double), cmpDouble);
+        double median = times[WARMUP + runs / 2];
+        FREE(times);
+        FREE(refs);
+        FREE(fasts);
+        return median;
+}
+
+/********** now ********
+ *
+ * Read the monotonic clock.
+ *
+ * Parameters: None
+ *
+ * Return:
+ *      double: nanoseconds since an arbitrary point
+ *
+ * Expects:
+ *      None
+ * Notes:
+ *      None
+ ************************/
+static double now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/********** cmpDouble ********
+ *
+ * qsort comparison for doubles.
+ *
+ * Parameters:
+ *      const void *x, *y: the doubles
+ *
+ * Return:
+ *      int: negative, zero or positive as *x is below, equal to or
+ *           above *y
+ *
+ * Expects:
+ *      x and y must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+static int cmpDouble(const void *x, const void *y)
+{
+        double a = *(const double *)x, b = *(const double *)y;
+        return (a > b) - (a < b);
+}
+
+/********** nullGet ********
+ *
+ * Input source for benchmarks: always the same byte.
+ *
+ * Parameters:
+ *      void *cl: unused
+ *
+ * Return:
+ *      int: 'x'
+ *
+ * Expects:
+ *      None
+ * Notes:
+ *      None
+ ************************/
+static int nullGet(void *cl)
+{
+        (void)cl;
+        return 'x';
+}
+
+/********** nullPut ********
+ *
+ * Output sink for benchmarks: discard the byte.
+ *
+ * Parameters:
+ *      int c:    the byte
+ *      void *cl: unused
+ *
+ * Return: void
+ *
+ * Expects:
+ *      None
+ * Notes:
+ *      None
+ ************************/
+static void nullPut(int c, void *cl)
+{
+        (void)c;
+        (void)cl;
+}
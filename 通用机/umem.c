@@ -0,0 +1,626 @@
+/**************************************************************
+ *
+ *     umem.c
+ *
+ *
+ *     implementation for umem.h
+ *
+ *     Each segment in the heap is preceded by a two-word header
+ *     holding its length and identifier. A block is live when the
+ *     segment table still points at it, so unmapping only clears
+ *     the table entry and compaction can walk the heap from the
+ *     bottom, keeping exactly the blocks the table points at.
+ *
+ *     Large segments have no header: a segment whose words lie
+ *     outside the heap is a mapping of its own, whose size follows
+ *     from the segment length.
+ *
+ **************************************************************/
+
+#define _GNU_SOURCE     /* mremap, MAP_HUGETLB */
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "assert.h"
+#include "mem.h"
+#include "umem.h"
+
+#define HEADER        2         /* words before each segment: length, id */
+#define INITIAL_WORDS (1 << 20) /* first heap reservation, 4 MiB */
+#define MIN_COMPACT   (1 << 16) /* dead words not worth compacting for */
+#define MIN_RELEASE   (1 << 20) /* free words worth returning to the system */
+#define HUGE_BYTES    (2 << 20) /* huge page size */
+
+struct Umem_heap {
+        uint32_t *base;
+        uint64_t cap;           /* words reserved */
+        uint64_t top;           /* words handed out, headers included */
+        uint64_t clean;         /* every word from here up is zero */
+        uint64_t page_words;
+        unsigned frag_percent;
+        uint64_t huge_threshold;        /* 0: every segment in the heap */
+        Umem_stats stats;
+};
+
+static uint32_t *place(Umem_T mem, uint32_t id, uint32_t length, bool zero);
+static bool fragmented(struct Umem_heap *heap);
+static void compact(Umem_T mem);
+static void grow(Umem_T mem, uint64_t words);
+static bool inHeap(struct Umem_heap *heap, const uint32_t *words);
+static size_t largeBytes(struct Umem_heap *heap, uint32_t length);
+static uint32_t *mapLarge(struct Umem_heap *heap, uint32_t length);
+
+/********** Umem_new ********
+ *
+ * Create an empty segment memory.
+ *
+ * Parameters:
+ *      unsigned frag_percent: compact once unmapped segments make up
+ *                             at least this percentage of the heap
+ *
+ * Return:
+ *      Umem_T: memory with no segments mapped
+ *
+ * Expects:
+ *      frag_percent is in [1, 100].
+ * Notes:
+ *      CRE if memory allocation fails. The heap is reserved with mmap
+ *      and only touched pages use physical memory.
+ ************************/
+Umem_T Umem_new(unsigned frag_percent)
+{
+        assert(frag_percent >= 1 && frag_percent <= 100);
+        Umem_T mem;
+        NEW0(mem);
+        mem->seg_cap = 64;
+        mem->segs = CALLOC(mem->seg_cap, sizeof(*mem->segs));
+        mem->lens = CALLOC(mem->seg_cap, sizeof(*mem->lens));
+
+        struct Umem_heap *heap;
+        NEW0(heap);
+        heap->cap = INITIAL_WORDS;
+        heap->base = mmap(NULL, heap->cap * sizeof(uint32_t),
+                          PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        assert(heap->base != MAP_FAILED);
+        heap->page_words = sysconf(_SC_PAGESIZE) / sizeof(uint32_t);
+        heap->frag_percent = frag_percent;
+        heap->stats.reserved_words = heap->cap;
+        mem->heap = heap;
+        return mem;
+}
+
+/********** Umem_hugepages ********
+ *
+ * Set which segments are mapped on their own with huge pages.
+ *
+ * Parameters:
+ *      Umem_T mem:         the memory
+ *      uint64_t threshold: segment 0 and every segment of at least
+ *                          this many words; 0 keeps all in the heap
+ *
+ * Return: void
+ *
+ * Expects:
+ *      mem must not be NULL.
+ * Notes:
+ *      Applies to segments mapped from now on. MAP_HUGETLB is tried
+ *      first for segments of a huge page or more; without reserved
+ *      huge pages that fails and the mapping is aligned to a huge
+ *      page and advised MADV_HUGEPAGE instead. Smaller ones, and all
+ *      of them where neither is available, get ordinary pages.
+ ************************/
+void Umem_hugepages(Umem_T mem, uint64_t threshold)
+{
+        assert(mem != NULL);
+        mem->heap->huge_threshold = threshold;
+}
+
+/********** Umem_map ********
+ *
+ * Map a zero-filled segment under a given identifier.
+ *
+ * Parameters:
+ *      Umem_T mem:      the memory
+ *      uint32_t id:     an identifier that is not mapped
+ *      uint32_t length: number of words
+ *
+ * Return:
+ *      uint32_t *: the new segment's words
+ *
+ * Expects:
+ *      mem must not be NULL.
+ * Notes:
+ *      May compact or move the heap; see umem.h.
+ ************************/
+uint32_t *Umem_map(Umem_T mem, uint32_t id, uint32_t length)
+{
+        assert(mem != NULL);
+        return place(mem, id, length, true);
+}
+
+/********** Umem_unmap ********
+ *
+ * Unmap a segment.
+ *
+ * Parameters:
+ *      Umem_T mem:  the memory
+ *      uint32_t id: a mapped identifier
+ *
+ * Return: void
+ *
+ * Expects:
+ *      mem must not be NULL.
+ * Notes:
+ *      The newest segment is popped off the top of the heap. Any
+ *      other stays in the heap until the next compaction, which
+ *      happens here once the fragmentation threshold is reached.
+ ************************/
+void Umem_unmap(Umem_T mem, uint32_t id)
+{
+        assert(mem != NULL && id < mem->seg_cap && mem->segs[id] != NULL);
+        struct Umem_heap *heap = mem->heap;
+        uint64_t size = HEADER + (uint64_t)mem->lens[id];
+        heap->stats.unmaps++;
+        heap->stats.live_words -= mem->lens[id];
+        if (!inHeap(heap, mem->segs[id])) {
+                munmap(mem->segs[id], largeBytes(heap, mem->lens[id]));
+                mem->segs[id] = NULL;
+                return;
+        }
+        if (mem->segs[id] + mem->lens[id] == heap->base + heap->top) {
+                /* the newest segment: just lower the top */
+                heap->top -= size;
+        } else {
+                heap->stats.dead_words += size;
+        }
+        mem->segs[id] = NULL;
+        if (heap->stats.dead_words >= MIN_COMPACT && fragmented(heap)) {
+                compact(mem);
+        }
+}
+
+/********** Umem_dup ********
+ *
+ * Replace one segment with a copy of another.
+ *
+ * Parameters:
+ *      Umem_T mem:   the memory
+ *      uint32_t dst: identifier to replace; unmapped first if mapped
+ *      uint32_t src: a mapped identifier other than dst
+ *
+ * Return:
+ *      uint32_t *: the words of the new dst
+ *
+ * Expects:
+ *      mem must not be NULL.
+ * Notes:
+ *      Used by Load Program. src is looked up again after dst is
+ *      placed, since placing it may move src.
+ ************************/
+uint32_t *Umem_dup(Umem_T mem, uint32_t dst, uint32_t src)
+{
+        assert(mem != NULL && dst != src);
+        assert(src < mem->seg_cap && mem->segs[src] != NULL);
+        if (dst < mem->seg_cap && mem->segs[dst] != NULL) {
+                Umem_unmap(mem, dst);
+        }
+        uint32_t length = mem->lens[src];
+        uint32_t *words = place(mem, dst, length, false);
+        memcpy(words, mem->segs[src], length * sizeof(uint32_t));
+        return words;
+}
+
+/********** Umem_getStats ********
+ *
+ * Return counters describing how the memory has been used.
+ *
+ * Parameters:
+ *      Umem_T mem: the memory
+ *
+ * Return:
+ *      Umem_stats: a copy of the counters
+ *
+ * Expects:
+ *      mem must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+Umem_stats Umem_getStats(Umem_T mem)
+{
+        assert(mem != NULL);
+        Umem_stats stats = mem->heap->stats;
+        stats.heap_words = mem->heap->top;
+        stats.reserved_words = mem->heap->cap;
+        return stats;
+}
+
+/********** Umem_report ********
+ *
+ * Print the memory statistics.
+ *
+ * Parameters:
+ *      Umem_T mem: the memory
+ *      FILE *out:  where to print them, normally stderr
+ *
+ * Return: void
+ *
+ * Expects:
+ *      mem and out must not be NULL.
+ * Notes:
+ *      Sizes are in 32-bit words; heap figures include the headers.
+ ************************/
+void Umem_report(Umem_T mem, FILE *out)
+{
+        assert(mem != NULL && out != NULL);
+        Umem_stats s = Umem_getStats(mem);
+        fprintf(out, "mem: maps %llu, unmaps %llu\n",
+                (unsigned long long)s.maps, (unsigned long long)s.unmaps);
+        fprintf(out, "mem: live words %llu (peak %llu), dead words %llu\n",
+                (unsigned long long)s.live_words,
+                (unsigned long long)s.peak_live_words,
+                (unsigned long long)s.dead_words);
+        fprintf(out, "mem: heap words %llu (peak %llu), reserved %llu\n",
+                (unsigned long long)s.heap_words,
+                (unsigned long long)s.peak_heap_words,
+                (unsigned long long)s.reserved_words);
+        fprintf(out, "mem: compactions %llu, words moved %llu, "
+                "heap grown %llu times\n",
+                (unsigned long long)s.compactions,
+                (unsigned long long)s.moved_words,
+                (unsigned long long)s.grows);
+        fprintf(out, "mem: large segments %llu (hugetlb %llu, "
+                "MADV_HUGEPAGE %llu)\n",
+                (unsigned long long)s.large_maps,
+                (unsigned long long)s.hugetlb_maps,
+                (unsigned long long)s.thp_maps);
+}
+
+/********** Umem_free ********
+ *
+ * Release the memory and every segment in it.
+ *
+ * Parameters:
+ *      Umem_T *mem: pointer to the memory, set to NULL
+ *
+ * Return: void
+ *
+ * Expects:
+ *      mem and *mem must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+void Umem_free(Umem_T *mem)
+{
+        assert(mem != NULL && *mem != NULL);
+        struct Umem_heap *heap = (*mem)->heap;
+        for (uint64_t id = 0; id < (*mem)->seg_cap; id++) {
+                uint32_t *words = (*mem)->segs[id];
+                if (words != NULL && !inHeap(heap, words)) {
+                        munmap(words, largeBytes(heap, (*mem)->lens[id]));
+                }
+        }
+        munmap(heap->base, heap->cap * sizeof(uint32_t));
+        FREE(heap);
+        FREE((*mem)->segs);
+        FREE((*mem)->lens);
+        FREE(*mem);
+}
+
+/********** place ********
+ *
+ * Bump-allocate a segment at the top of the heap.
+ *
+ * Parameters:
+ *      Umem_T mem:      the memory
+ *      uint32_t id:     an identifier that is not mapped
+ *      uint32_t length: number of words
+ *      bool zero:       whether the caller needs the words zeroed
+ *
+ * Return:
+ *      uint32_t *: the segment's words
+ *
+ * Expects:
+ *      mem must not be NULL.
+ * Notes:
+ *      When the top reaches the end of the reservation, the heap is
+ *      compacted if that is worthwhile and grown if that was not
+ *      enough. Words above the clean mark are still zero from the
+ *      system, so only reused words are cleared. Segments the huge
+ *      page policy selects get a fresh mapping instead, already zero.
+ ************************/
+static uint32_t *place(Umem_T mem, uint32_t id, uint32_t length, bool zero)
+{
+        struct Umem_heap *heap = mem->heap;
+        if (id >= mem->seg_cap) {
+                uint64_t cap = mem->seg_cap;
+                while (cap <= id) {
+                        cap *= 2;
+                }
+                RESIZE(mem->segs, cap * sizeof(*mem->segs));
+                RESIZE(mem->lens, cap * sizeof(*mem->lens));
+                memset(mem->segs + mem->seg_cap, 0,
+                       (cap - mem->seg_cap) * sizeof(*mem->segs));
+                mem->seg_cap = cap;
+        }
+        assert(mem->segs[id] == NULL);
+        Umem_stats *s = &heap->stats;
+
+        if (heap->huge_threshold > 0 &&
+            (id == 0 || length >= heap->huge_threshold)) {
+                mem->segs[id] = mapLarge(heap, length);
+                mem->lens[id] = length;
+                s->maps++;
+                s->large_maps++;
+                s->live_words += length;
+                if (s->live_words > s->peak_live_words) {
+                        s->peak_live_words = s->live_words;
+                }
+                return mem->segs[id];
+        }
+
+        uint64_t need = HEADER + (uint64_t)length;
+        /* the top stays below the end, so every heap segment starts
+           strictly inside the reservation; see inHeap */
+        if (heap->top + need >= heap->cap) {
+                if (heap->stats.dead_words > 0 && fragmented(heap)) {
+                        compact(mem);
+                }
+                if (heap->top + need >= heap->cap) {
+                        grow(mem, heap->top + need + 1);
+                }
+        }
+
+        uint32_t *block = heap->base + heap->top;
+        if (zero && heap->top < heap->clean) {
+                uint64_t dirty = heap->clean - heap->top;
+                memset(block, 0, (dirty < need ? dirty : need) *
+                                 sizeof(uint32_t));
+        }
+        heap->top += need;
+        if (heap->clean < heap->top) {
+                heap->clean = heap->top;
+        }
+        block[0] = length;
+        block[1] = id;
+        mem->segs[id] = block + HEADER;
+        mem->lens[id] = length;
+
+        s->maps++;
+        s->live_words += length;
+        if (s->live_words > s->peak_live_words) {
+                s->peak_live_words = s->live_words;
+        }
+        if (heap->top > s->peak_heap_words) {
+                s->peak_heap_words = heap->top;
+        }
+        return mem->segs[id];
+}
+
+/********** fragmented ********
+ *
+ * Tell whether unmapped segments have reached the threshold.
+ *
+ * Parameters:
+ *      struct Umem_heap *heap: the heap
+ *
+ * Return:
+ *      bool: true if compacting is due
+ *
+ * Expects:
+ *      heap must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+static bool fragmented(struct Umem_heap *heap)
+{
+        return heap->stats.dead_words * 100 >=
+               (uint64_t)heap->frag_percent * heap->top;
+}
+
+/********** compact ********
+ *
+ * Slide every live segment down over the unmapped ones.
+ *
+ * Parameters:
+ *      Umem_T mem: the memory
+ *
+ * Return: void
+ *
+ * Expects:
+ *      mem must not be NULL.
+ * Notes:
+ *      Segments keep their order, so neighbours stay neighbours. If
+ *      enough pages were freed above the new top, they are given back
+ *      with MADV_DONTNEED, which also leaves them zeroed; a few pages
+ *      are cheaper to keep and clear again when reused.
+ ************************/
+static void compact(Umem_T mem)
+{
+        struct Umem_heap *heap = mem->heap;
+        uint64_t src = 0, dst = 0;
+        while (src < heap->top) {
+                uint32_t *block = heap->base + src;
+                uint32_t length = block[0], id = block[1];
+                uint64_t size = HEADER + (uint64_t)length;
+                if (id < mem->seg_cap && mem->segs[id] == block + HEADER) {
+                        if (dst != src) {
+                                memmove(heap->base + dst, block,
+                                        size * sizeof(uint32_t));
+                                mem->segs[id] = heap->base + dst + HEADER;
+                                heap->stats.moved_words += length;
+                        }
+                        dst += size;
+                }
+                src += size;
+        }
+        heap->top = dst;
+        heap->stats.dead_words = 0;
+        heap->stats.compactions++;
+
+        uint64_t page = heap->page_words;
+        uint64_t from = (heap->top + page - 1) / page * page;
+        uint64_t to = (heap->clean + page - 1) / page * page;
+        if (to > heap->cap) {
+                to = heap->cap;
+        }
+        if (to > from && to - from >= MIN_RELEASE) {
+                madvise(heap->base + from, (to - from) * sizeof(uint32_t),
+                        MADV_DONTNEED);
+                heap->clean = from;
+        }
+}
+
+/********** grow ********
+ *
+ * Enlarge the heap reservation.
+ *
+ * Parameters:
+ *      Umem_T mem:     the memory
+ *      uint64_t words: the reservation must hold at least this much
+ *
+ * Return: void
+ *
+ * Expects:
+ *      mem must not be NULL.
+ * Notes:
+ *      mremap may move the heap, in which case every pointer into it
+ *      is rebased. CRE if the address space is exhausted.
+ ************************/
+static void grow(Umem_T mem, uint64_t words)
+{
+        struct Umem_heap *heap = mem->heap;
+        uint64_t cap = heap->cap;
+        while (cap < words) {
+                cap *= 2;
+        }
+        uint32_t *base = mremap(heap->base, heap->cap * sizeof(uint32_t),
+                                cap * sizeof(uint32_t), MREMAP_MAYMOVE);
+        assert(base != MAP_FAILED);
+        if (base != heap->base) {
+                uint32_t *old_end = heap->base + heap->cap;
+                for (uint64_t id = 0; id < mem->seg_cap; id++) {
+                        uint32_t *words = mem->segs[id];
+                        if (words != NULL && words >= heap->base &&
+                            words < old_end) {
+                                mem->segs[id] = base + (words - heap->base);
+                        }
+                }
+        }
+        heap->base = base;
+        heap->cap = cap;
+        heap->stats.grows++;
+        if (cap > heap->stats.reserved_words) {
+                heap->stats.reserved_words = cap;
+        }
+}
+
+/********** inHeap ********
+ *
+ * Tell whether a segment lives in the heap.
+ *
+ * Parameters:
+ *      struct Umem_heap *heap:  the heap
+ *      const uint32_t *words:   a mapped segment
+ *
+ * Return:
+ *      bool: false for a segment with a mapping of its own
+ *
+ * Expects:
+ *      heap and words must not be NULL.
+ * Notes:
+ *      place keeps the top below the end of the reservation, so even
+ *      a zero-length segment points strictly inside it, and a mapping
+ *      that happens to follow the heap is not mistaken for part of it.
+ ************************/
+static bool inHeap(struct Umem_heap *heap, const uint32_t *words)
+{
+        return words >= heap->base && words < heap->base + heap->cap;
+}
+
+/********** largeBytes ********
+ *
+ * Size of the mapping that holds a large segment.
+ *
+ * Parameters:
+ *      struct Umem_heap *heap:  the heap, for its page size
+ *      uint32_t length:         the segment length in words
+ *
+ * Return:
+ *      size_t: bytes mapped, a whole number of huge pages for a
+ *              segment of at least one, of pages otherwise
+ *
+ * Expects:
+ *      heap must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+static size_t largeBytes(struct Umem_heap *heap, uint32_t length)
+{
+        size_t bytes = (length > 0 ? length : 1) * sizeof(uint32_t);
+        size_t unit = bytes >= HUGE_BYTES ? HUGE_BYTES :
+                      heap->page_words * sizeof(uint32_t);
+        return (bytes + unit - 1) / unit * unit;
+}
+
+/********** mapLarge ********
+ *
+ * Map a zero-filled segment outside the heap.
+ *
+ * Parameters:
+ *      struct Umem_heap *heap:  the heap, for its page size and stats
+ *      uint32_t length:         the segment length in words
+ *
+ * Return:
+ *      uint32_t *: the segment's words, largeBytes(length) mapped
+ *
+ * Expects:
+ *      heap must not be NULL.
+ * Notes:
+ *      Tries MAP_HUGETLB, then an ordinary mapping trimmed to start on
+ *      a huge page boundary and advised MADV_HUGEPAGE, so the kernel
+ *      can back all of it with huge pages. Where either flag is not
+ *      defined that step is skipped. CRE if no mapping can be made.
+ ************************/
+static uint32_t *mapLarge(struct Umem_heap *heap, uint32_t length)
+{
+        size_t bytes = largeBytes(heap, length);
+        void *p;
+        if (bytes < HUGE_BYTES) {
+                p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                assert(p != MAP_FAILED);
+                return p;
+        }
+
+#ifdef MAP_HUGETLB
+        p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+                heap->stats.hugetlb_maps++;
+                return p;
+        }
+#endif
+
+        /* over-map by one huge page, then trim both ends to align */
+        char *raw = mmap(NULL, bytes + HUGE_BYTES, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        assert(raw != MAP_FAILED);
+        uintptr_t start = ((uintptr_t)raw + HUGE_BYTES - 1) &
+                          ~(uintptr_t)(HUGE_BYTES - 1);
+        size_t head = start - (uintptr_t)raw;
+        if (head > 0) {
+                munmap(raw, head);
+        }
+        if (HUGE_BYTES - head > 0) {
+                munmap((char *)start + bytes, HUGE_BYTES - head);
+        }
+        p = (void *)start;
+#ifdef MADV_HUGEPAGE
+        if (madvise(p, bytes, MADV_HUGEPAGE) == 0) {
+                heap->stats.thp_maps++;
+        }
+#endif
+        return p;
+}
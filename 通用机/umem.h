@@ -0,0 +1,65 @@
+/**************************************************************
+ *
+ *     umem.h
+ *
+ *
+ *     umem.h declares the segment memory of the fast engine. All
+ *     segments live in one heap that is filled by bumping a top
+ *     pointer. Since the guest names segments only by identifier,
+ *     the heap is free to move them: once unmapped segments make
+ *     up enough of it, live segments are slid down in address
+ *     order and the space above them is returned to the system.
+ *
+ *     Optionally, segment 0 and segments above a size threshold
+ *     are kept out of the heap in mappings of their own, backed by
+ *     huge pages where the system provides them, so sweeping a big
+ *     segment does not thrash the TLB.
+ *
+ **************************************************************/
+
+#ifndef UMEM_H
+#define UMEM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* compact once this percentage of the heap holds unmapped segments */
+#define UMEM_FRAG_PERCENT 50
+
+/* default size, in words, from which segments get huge pages (2 MiB) */
+#define UMEM_HUGE_WORDS (1 << 19)
+
+/*
+ * The engine reads segs and lens directly on its fast path. Any call
+ * that maps, unmaps or duplicates a segment may move every segment and
+ * reallocate segs, so pointers taken from it must be reloaded after.
+ */
+typedef struct Umem_T {
+        uint32_t **segs;        /* segs[id] is NULL when id is unmapped */
+        uint32_t *lens;
+        uint64_t seg_cap;
+        struct Umem_heap *heap;
+} *Umem_T;
+
+typedef struct Umem_stats {
+        uint64_t maps, unmaps;
+        uint64_t live_words, peak_live_words;   /* mapped segment words */
+        uint64_t dead_words;                    /* unmapped, not reclaimed */
+        uint64_t heap_words, peak_heap_words;   /* bump top, with headers */
+        uint64_t reserved_words;                /* heap address space */
+        uint64_t compactions, moved_words, grows;
+        uint64_t large_maps;            /* segments mapped on their own */
+        uint64_t hugetlb_maps;          /* ... from MAP_HUGETLB */
+        uint64_t thp_maps;              /* ... advised MADV_HUGEPAGE */
+} Umem_stats;
+
+Umem_T Umem_new(unsigned frag_percent);
+void Umem_hugepages(Umem_T mem, uint64_t threshold);
+uint32_t *Umem_map(Umem_T mem, uint32_t id, uint32_t length);
+void Umem_unmap(Umem_T mem, uint32_t id);
+uint32_t *Umem_dup(Umem_T mem, uint32_t dst, uint32_t src);
+Umem_stats Umem_getStats(Umem_T mem);
+void Umem_report(Umem_T mem, FILE *out);
+void Umem_free(Umem_T *mem);
+
+#endif
@@ -0,0 +1,286 @@
+/**************************************************************
+ *
+ *     umio.c
+ *
+ *
+ *     implementation for umio.h
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "assert.h"
+#include "mem.h"
+#include "umio.h"
+
+/* a recording: this header, a newline, then the bytes themselves */
+#define TAPE_HEADER "UM input 1\n%u %u"
+
+struct UmIO_Tape {
+        FILE *out;              /* recording destination, NULL on replay */
+        UmIO_getfun *get;       /* recorded source */
+        void *cl;
+        unsigned char *bytes;
+        uint32_t length, capacity;
+        uint32_t next;          /* replay position */
+        bool eof;               /* the guest was handed EOF */
+};
+
+static UmIO_getfun *io_get = UmIO_stdinGet;
+static UmIO_putfun *io_put = UmIO_stdoutPut;
+static void *io_cl = NULL;
+
+/********** UmIO_use ********
+ *
+ * Install the functions used by the Input and Output instructions.
+ *
+ * Parameters:
+ *      UmIO_getfun *get:       source of input bytes
+ *      UmIO_putfun *put:       sink for output bytes
+ *      void *cl:               closure passed to both
+ *
+ * Return: void
+ *
+ * Expects:
+ *      get and put must not be NULL.
+ * Notes:
+ *      UmIO_use(UmIO_stdinGet, UmIO_stdoutPut, NULL) restores the default.
+ ************************/
+void UmIO_use(UmIO_getfun *get, UmIO_putfun *put, void *cl)
+{
+        assert(get != NULL && put != NULL);
+        io_get = get;
+        io_put = put;
+        io_cl = cl;
+}
+
+/********** UmIO_get ********
+ *
+ * Read one byte from the installed input source.
+ *
+ * Parameters: None
+ *
+ * Return:
+ *      int: a value in [0, 255], or EOF if input has ended
+ *
+ * Expects:
+ *      None
+ * Notes:
+ *      None
+ ************************/
+int UmIO_get(void)
+{
+        return io_get(io_cl);
+}
+
+/********** UmIO_put ********
+ *
+ * Write one byte to the installed output sink.
+ *
+ * Parameters:
+ *      int c: the byte
+ *
+ * Return: void
+ *
+ * Expects:
+ *      c is in [0, 255]
+ * Notes:
+ *      None
+ ************************/
+void UmIO_put(int c)
+{
+        io_put(c, io_cl);
+}
+
+/********** UmIO_stdinGet ********
+ *
+ * Default input source: read a byte from stdin.
+ *
+ * Parameters:
+ *      void *cl: unused
+ *
+ * Return:
+ *      int: the byte, or EOF
+ *
+ * Expects:
+ *      None
+ * Notes:
+ *      None
+ ************************/
+int UmIO_stdinGet(void *cl)
+{
+        (void)cl;
+        return getc(stdin);
+}
+
+/********** UmIO_stdoutPut ********
+ *
+ * Default output sink: write a byte to stdout.
+ *
+ * Parameters:
+ *      int c:    the byte
+ *      void *cl: unused
+ *
+ * Return: void
+ *
+ * Expects:
+ *      None
+ * Notes:
+ *      None
+ ************************/
+void UmIO_stdoutPut(int c, void *cl)
+{
+        (void)cl;
+        putc(c, stdout);
+}
+
+/********** UmIO_record ********
+ *
+ * Start recording the bytes an input source hands to the guest.
+ *
+ * Parameters:
+ *      const char *path:       file the recording is written to
+ *      UmIO_getfun *get:       the source being recorded
+ *      void *cl:               closure for get
+ *
+ * Return:
+ *      UmIO_Tape: the tape; pass UmIO_tapeGet and it as the input
+ *                 source, and UmIO_close it after the run
+ *
+ * Expects:
+ *      path and get must not be NULL.
+ * Notes:
+ *      CRE if path cannot be opened for writing. The file is opened
+ *      here so a bad path fails before the program runs, but it is
+ *      only written by UmIO_close.
+ ************************/
+UmIO_Tape UmIO_record(const char *path, UmIO_getfun *get, void *cl)
+{
+        assert(path != NULL && get != NULL);
+        UmIO_Tape tape;
+        NEW0(tape);
+        tape->out = fopen(path, "wb");
+        assert(tape->out != NULL);
+        tape->get = get;
+        tape->cl = cl;
+        tape->capacity = 256;
+        tape->bytes = ALLOC(tape->capacity);
+        return tape;
+}
+
+/********** UmIO_replay ********
+ *
+ * Load a recording made by UmIO_record.
+ *
+ * Parameters:
+ *      const char *path: the recording
+ *
+ * Return:
+ *      UmIO_Tape: the tape, with every byte already in memory
+ *
+ * Expects:
+ *      path must not be NULL.
+ * Notes:
+ *      CRE if path cannot be read or is not a complete recording.
+ ************************/
+UmIO_Tape UmIO_replay(const char *path)
+{
+        assert(path != NULL);
+        FILE *fp = fopen(path, "rb");
+        assert(fp != NULL);
+        unsigned length, eof;
+        /* the data may start with white space, so the newline ending
+           the header is read on its own rather than by fscanf */
+        int n = fscanf(fp, TAPE_HEADER, &length, &eof);
+        int nl = getc(fp);
+        assert(n == 2 && eof <= 1 && nl == '\n');
+
+        UmIO_Tape tape;
+        NEW0(tape);
+        tape->length = tape->capacity = length;
+        tape->bytes = ALLOC(length > 0 ? length : 1);
+        size_t got = fread(tape->bytes, 1, length, fp);
+        assert(got == length);
+        tape->eof = eof;
+        fclose(fp);
+        return tape;
+}
+
+/********** UmIO_tapeGet ********
+ *
+ * Input source for a tape: pass through and record, or replay.
+ *
+ * Parameters:
+ *      void *cl: the UmIO_Tape
+ *
+ * Return:
+ *      int: the next byte, or EOF
+ *
+ * Expects:
+ *      cl must not be NULL.
+ * Notes:
+ *      A replayed guest that reads past the end of a recording which
+ *      never reached EOF is not seeing the run that was recorded; that
+ *      is reported and the um exits with failure.
+ ************************/
+int UmIO_tapeGet(void *cl)
+{
+        UmIO_Tape tape = cl;
+        assert(tape != NULL);
+        if (tape->out == NULL) {
+                if (tape->next < tape->length) {
+                        return tape->bytes[tape->next++];
+                }
+                if (!tape->eof) {
+                        fprintf(stderr, "um: replay: guest read past the "
+                                        "end of the recorded input\n");
+                        exit(EXIT_FAILURE);
+                }
+                return EOF;
+        }
+
+        int c = tape->get(tape->cl);
+        if (c == EOF) {
+                tape->eof = true;
+                return c;
+        }
+        /* nothing is delivered after EOF in a recording */
+        assert(!tape->eof && tape->length < 0xFFFFFFFF);
+        if (tape->length == tape->capacity) {
+                tape->capacity = tape->capacity < 0x80000000 ?
+                                 tape->capacity * 2 : 0xFFFFFFFF;
+                RESIZE(tape->bytes, tape->capacity);
+        }
+        tape->bytes[tape->length++] = c;
+        return c;
+}
+
+/********** UmIO_close ********
+ *
+ * Finish with a tape, writing it out if it was recording.
+ *
+ * Parameters:
+ *      UmIO_Tape *tape: pointer to the tape, set to NULL
+ *
+ * Return: void
+ *
+ * Expects:
+ *      tape and *tape must not be NULL.
+ * Notes:
+ *      CRE if the recording cannot be written.
+ ************************/
+void UmIO_close(UmIO_Tape *tape)
+{
+        assert(tape != NULL && *tape != NULL);
+        FILE *out = (*tape)->out;
+        if (out != NULL) {
+                fprintf(out, TAPE_HEADER "\n", (*tape)->length,
+                        (unsigned)(*tape)->eof);
+                size_t n = fwrite((*tape)->bytes, 1, (*tape)->length, out);
+                int closed = fclose(out);
+                assert(n == (*tape)->length && closed == 0);
+        }
+        FREE((*tape)->bytes);
+        FREE(*tape);
+}
@@ -0,0 +1,44 @@
+/**************************************************************
+ *
+ *     umio.h
+ *
+ *
+ *     umio.h declares the um's I/O device. The Input and Output
+ *     instructions go through UmIO_get and UmIO_put, which call
+ *     whichever pair of byte functions was installed last; by
+ *     default those are stdin and stdout. Engines other than the
+ *     reference handlers take the same function types directly.
+ *
+ *     A tape sits in front of an input source. A recording tape
+ *     passes bytes through and remembers them, together with
+ *     whether the guest was handed EOF; a replaying tape hands back
+ *     a recording from memory, so repeated runs see the same input
+ *     without waiting on a terminal or pipe.
+ *
+ **************************************************************/
+
+#ifndef UMIO_H
+#define UMIO_H
+
+#include <stdint.h>
+
+/* return the next input byte (0 to 255), or EOF once input has ended */
+typedef int UmIO_getfun(void *cl);
+/* write one output byte */
+typedef void UmIO_putfun(int c, void *cl);
+
+void UmIO_use(UmIO_getfun *get, UmIO_putfun *put, void *cl);
+int UmIO_get(void);
+void UmIO_put(int c);
+
+int UmIO_stdinGet(void *cl);
+void UmIO_stdoutPut(int c, void *cl);
+
+typedef struct UmIO_Tape *UmIO_Tape;
+
+UmIO_Tape UmIO_record(const char *path, UmIO_getfun *get, void *cl);
+UmIO_Tape UmIO_replay(const char *path);
+int UmIO_tapeGet(void *cl);
+void UmIO_close(UmIO_Tape *tape);
+
+#endif
@@ -0,0 +1,769 @@
+/**************************************************************
+ *
+ *     umopt.c
+ *
+ *
+ *     Entry point of the um-opt program, an offline optimizer for
+ *     .um images. It splits segment 0 into basic blocks, finds the
+ *     blocks reachable from address 0 through fall-through and
+ *     Load Program edges, and rewrites instructions inside those
+ *     blocks in place:
+ *
+ *       - arithmetic on registers whose values are known becomes
+ *         a single Load Value,
+ *       - conditional moves whose condition is known to be zero
+ *         become a no-op,
+ *       - a NAND that undoes an earlier NAND-based NOT becomes a
+ *         move (or a no-op),
+ *       - pure instructions whose result is overwritten before it
+ *         is read become a no-op.
+ *
+ *     Every instruction keeps its address, so jump targets held in
+ *     registers or memory stay valid. Words that a Segmented Store
+ *     may overwrite or a Segmented Load may read are left alone,
+ *     and if any reachable access to segment 0 has an offset that
+ *     cannot be worked out, nothing is rewritten at all.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "assert.h"
+#include "mem.h"
+#include "read.h"
+
+/* cmov r0, r0, r0: whatever r0 holds, it is left holding it */
+#define NOP 0x00000000u
+
+/* largest value a Load Value instruction can hold, plus one */
+#define LV_LIMIT 0x2000000u
+
+/* what is known about a register inside a basic block */
+typedef enum { UNKNOWN = 0, NONZERO, CONST } Kind;
+
+typedef struct Reg {
+        Kind kind;
+        uint32_t value;         /* meaningful when kind is CONST */
+        int notof;              /* register this one is the NOT of, or -1 */
+} Reg;
+
+typedef struct Image {
+        uint32_t *words;        /* segment 0, rewritten in place */
+        uint32_t length;
+        bool *leader;           /* a basic block starts here */
+        bool *taken;            /* value seen as a constant: may be jumped to */
+        bool *stored;           /* may be overwritten by a Segmented Store */
+        bool *loaded;           /* may be read as data by a Segmented Load */
+        bool *reached;
+        bool changed;           /* taken, stored or loaded grew this round */
+        bool dynamic;           /* a Load Program has an unknown target */
+        const char *refuse;     /* why nothing may be rewritten, or NULL */
+        uint32_t refuse_at;
+} *Image;
+
+typedef struct Stats {
+        unsigned folded, dead_cmov, not_fused, dead_defs;
+} Stats;
+
+/* where control may go when a block ends */
+typedef struct Exits {
+        int64_t fall;           /* next address, or -1 */
+        int64_t jump;           /* Load Program target in segment 0, or -1 */
+        bool dynamic;           /* Load Program to an unknown address */
+} Exits;
+
+static void usage(const char *progname);
+static Image newImage(uint32_t *words, uint32_t length);
+static void freeImage(Image *im);
+static void findLeaders(Image im);
+static void analyze(Image im);
+static Exits simulate(Image im, uint32_t start, Stats *stats);
+static void removeDeadDefs(Image im, uint32_t start, uint32_t end,
+                           Stats *stats);
+static void define(Reg *regs, unsigned r, Reg value);
+static void escape(Image im, Reg value);
+static void access0(Image im, Reg *regs, unsigned seg, unsigned off,
+                    bool store, uint32_t addr);
+static void writeProgram(const char *filename, const uint32_t *words,
+                         uint32_t length);
+
+/********** main ********
+ *
+ * Optimize a .um image.
+ *
+ * Parameters:
+ *      int argc: Number of command-line arguments.
+ *      char* argv[]: Array of command-line argument strings.
+ *
+ * Return:
+ *      int: EXIT_SUCCESS if an equivalent image was written,
+ *           EXIT_FAILURE on incorrect arguments.
+ *
+ * Expects:
+ *      um-opt [-v] input.um output.um
+ *      -v reports what was rewritten on stderr.
+ *
+ * Notes:
+ *      Analysis repeats until the sets of possible jump targets and
+ *      of words touched by segmented loads and stores stop growing,
+ *      as each new one can split blocks and reach new code. When a
+ *      rewrite would not be safe, the input is written out unchanged
+ *      and the reason is given on stderr.
+ ************************/
+int main(int argc, char *argv[])
+{
+        bool verbose = false;
+        int i = 1;
+        if (i < argc && strcmp(argv[i], "-v") == 0) {
+                verbose = true;
+                i++;
+        }
+        if (argc - i != 2) {
+                usage(argv[0]);
+        }
+
+        uint32_t length;
+        uint32_t *words = readProgram(argv[i], &length);
+        Image im = newImage(words, length);
+
+        do {
+                im->changed = false;
+                findLeaders(im);
+                analyze(im);
+        } while (im->changed && im->refuse == NULL);
+
+        Stats stats = { 0, 0, 0, 0 };
+        unsigned blocks = 0, reached = 0;
+        for (uint32_t a = 0; a < length; a++) {
+                if (!im->leader[a]) {
+                        continue;
+                }
+                blocks++;
+                if (im->reached[a]) {
+                        reached++;
+                        if (im->refuse == NULL) {
+                                simulate(im, a, &stats);
+                        }
+                }
+        }
+
+        if (im->refuse != NULL) {
+                fprintf(stderr, "%s: not optimizing: %s at m[0][%u]\n",
+                        argv[0], im->refuse, im->refuse_at);
+        } else if (verbose) {
+                fprintf(stderr, "%s: %u blocks, %u reachable; %u folded, "
+                        "%u dead cmov, %u double not, %u dead results\n",
+                        argv[0], blocks, reached, stats.folded,
+                        stats.dead_cmov, stats.not_fused, stats.dead_defs);
+        }
+        writeProgram(argv[i + 1], im->words, length);
+        freeImage(&im);
+        return EXIT_SUCCESS;
+}
+
+/********** usage ********
+ *
+ * Print the command line synopsis and exit with failure.
+ *
+ * Parameters:
+ *      const char *progname: name the program was invoked as
+ *
+ * Return: does not return
+ *
+ * Expects:
+ *      progname must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+static void usage(const char *progname)
+{
+        fprintf(stderr, "Usage: %s [-v] input.um output.um\n", progname);
+        exit(EXIT_FAILURE);
+}
+
+/********** newImage ********
+ *
+ * Wrap a program for analysis.
+ *
+ * Parameters:
+ *      uint32_t *words:   the program, owned by the image from now on
+ *      uint32_t length:   number of words
+ *
+ * Return:
+ *      Image: with no targets, loads or stores recorded yet
+ *
+ * Expects:
+ *      words must not be NULL.
+ * Notes:
+ *      CRE if memory allocation fails.
+ ************************/
+static Image newImage(uint32_t *words, uint32_t length)
+{
+        assert(words != NULL);
+        Image im;
+        NEW0(im);
+        im->words = words;
+        im->length = length;
+        /* one spare entry so address length can be marked freely */
+        im->leader = CALLOC(length + 1, sizeof(bool));
+        im->taken = CALLOC(length + 1, sizeof(bool));
+        im->stored = CALLOC(length + 1, sizeof(bool));
+        im->loaded = CALLOC(length + 1, sizeof(bool));
+        im->reached = CALLOC(length + 1, sizeof(bool));
+        return im;
+}
+
+/********** freeImage ********
+ *
+ * Release an image and its words.
+ *
+ * Parameters:
+ *      Image *im: pointer to the image, set to NULL
+ *
+ * Return: void
+ *
+ * Expects:
+ *      im and *im must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+static void freeImage(Image *im)
+{
+        assert(im != NULL && *im != NULL);
+        FREE((*im)->words);
+        FREE((*im)->leader);
+        FREE((*im)->taken);
+        FREE((*im)->stored);
+        FREE((*im)->loaded);
+        FREE((*im)->reached);
+        FREE(*im);
+}
+
+/********** findLeaders ********
+ *
+ * Mark the first word of every basic block.
+ *
+ * Parameters:
+ *      Image im: the image
+ *
+ * Return: void
+ *
+ * Expects:
+ *      im must not be NULL.
+ * Notes:
+ *      A block starts at 0, at every possible jump target, after
+ *      every instruction that does not fall through (Halt, Load
+ *      Program or an invalid opcode), and around every word that may
+ *      be stored to, so such a word is a block on its own.
+ ************************/
+static void findLeaders(Image im)
+{
+        memset(im->leader, 0, im->length + 1);
+        im->leader[0] = true;
+        for (uint32_t a = 0; a < im->length; a++) {
+                uint32_t op = im->words[a] >> 28;
+                if (op == HALT || op == LOADP || op > LV) {
+                        im->leader[a + 1] = true;
+                }
+                if (im->taken[a]) {
+                        im->leader[a] = true;
+                }
+                if (im->stored[a]) {
+                        im->leader[a] = true;
+                        im->leader[a + 1] = true;
+                }
+        }
+}
+
+/********** analyze ********
+ *
+ * Find the blocks reachable from address 0 under the current leaders.
+ *
+ * Parameters:
+ *      Image im: the image
+ *
+ * Return: void
+ *
+ * Expects:
+ *      im must not be NULL.
+ * Notes:
+ *      Sets im->changed if simulating the reachable blocks found new
+ *      jump targets or segment 0 accesses, in which case the caller
+ *      recomputes the leaders and analyzes again. Once any Load
+ *      Program with an unknown target is reachable, so is every
+ *      possible jump target.
+ ************************/
+static void analyze(Image im)
+{
+        if (im->length == 0) {
+                return;
+        }
+        memset(im->reached, 0, im->length + 1);
+        im->dynamic = false;
+
+        uint32_t *work = CALLOC(im->length, sizeof(uint32_t));
+        uint32_t top = 0;
+        work[top++] = 0;
+        im->reached[0] = true;
+        for (;;) {
+                while (top > 0) {
+                        Exits ex = simulate(im, work[--top], NULL);
+                        int64_t next[2] = { ex.fall, ex.jump };
+                        for (int k = 0; k < 2; k++) {
+                                if (next[k] >= 0 && next[k] < im->length &&
+                                    !im->reached[next[k]]) {
+                                        im->reached[next[k]] = true;
+                                        work[top++] = next[k];
+                                }
+                        }
+                        im->dynamic = im->dynamic || ex.dynamic;
+                }
+                if (!im->dynamic) {
+                        break;
+                }
+                for (uint32_t a = 0; a < im->length; a++) {
+                        if (im->taken[a] && im->leader[a] &&
+                            !im->reached[a]) {
+                                im->reached[a] = true;
+                                work[top++] = a;
+                        }
+                }
+                if (top == 0) {
+                        break;
+                }
+        }
+        FREE(work);
+}
+
+/********** simulate ********
+ *
+ * Run one basic block symbolically, optionally rewriting it.
+ *
+ * Parameters:
+ *      Image im:       the image
+ *      uint32_t start: first word of the block
+ *      Stats *stats:   NULL to only analyze; otherwise rewrite the
+ *                      block and count the rewrites here
+ *
+ * Return:
+ *      Exits: where control may go when the block ends
+ *
+ * Expects:
+ *      im must not be NULL; start is a leader.
+ * Notes:
+ *      Nothing is known about the registers on entry. A word that
+ *      may be stored to is not simulated: it may hold any
+ *      instruction by the time it runs, so it may fall through or
+ *      jump to any target. Words read as data are simulated but
+ *      never rewritten.
+ ************************/
+static Exits simulate(Image im, uint32_t start, Stats *stats)
+{
+        Exits ex = { -1, -1, false };
+        Reg regs[8];
+        for (int r = 0; r < 8; r++) {
+                regs[r] = (Reg){ UNKNOWN, 0, -1 };
+        }
+        if (im->stored[start]) {
+                ex.fall = start + 1;
+                ex.dynamic = true;
+                return ex;
+        }
+
+        uint32_t a;
+        for (a = start; a < im->length && (a == start || !im->leader[a]);
+             a++) {
+                uint32_t w = im->words[a];
+                uint32_t op = w >> 28;
+                unsigned ra = (w >> 6) & 7, rb = (w >> 3) & 7, rc = w & 7;
+                Reg *b = &regs[rb], *c = &regs[rc];
+                uint32_t rewrite = w;
+
+                switch (op) {
+                case CMOV:
+                        if (ra == rb) {
+                                break;
+                        }
+                        if (c->kind == CONST && c->value == 0) {
+                                rewrite = NOP;
+                                if (stats != NULL && !im->loaded[a]) {
+                                        stats->dead_cmov++;
+                                }
+                        } else if (c->kind != UNKNOWN) {
+                                Reg copy = *b;
+                                if (copy.notof == (int)ra) {
+                                        copy.notof = -1;
+                                }
+                                if (copy.kind == CONST &&
+                                    copy.value < LV_LIMIT) {
+                                        rewrite = (LV << 28) | (ra << 25) |
+                                                  copy.value;
+                                        if (stats != NULL && !im->loaded[a]) {
+                                                stats->folded++;
+                                        }
+                                }
+                                define(regs, ra, copy);
+                        } else {
+                                Reg *x = &regs[ra];
+                                Reg merged = { UNKNOWN, 0, -1 };
+                                escape(im, *x);
+                                escape(im, *b);
+                                if (x->kind == CONST && b->kind == CONST &&
+                                    x->value == b->value) {
+                                        merged = (Reg){ CONST, x->value, -1 };
+                                } else if (x->kind != UNKNOWN &&
+                                           b->kind != UNKNOWN) {
+                                        merged.kind = NONZERO;
+                                        if (x->kind == CONST &&
+                                            x->value == 0) {
+                                                merged.kind = UNKNOWN;
+                                        }
+                                        if (b->kind == CONST &&
+                                            b->value == 0) {
+                                                merged.kind = UNKNOWN;
+                                        }
+                                }
+                                define(regs, ra, merged);
+                        }
+                        break;
+                case SLOAD:
+                        access0(im, regs, rb, rc, false, a);
+                        define(regs, ra, (Reg){ UNKNOWN, 0, -1 });
+                        break;
+                case SSTORE:
+                        access0(im, regs, ra, rb, true, a);
+                        escape(im, *c);
+                        break;
+                case ADD:
+                case MUL:
+                case DIV:
+                case NAND: {
+                        Reg result = { UNKNOWN, 0, -1 };
+                        if (b->kind == CONST && c->kind == CONST &&
+                            !(op == DIV && c->value == 0)) {
+                                uint32_t x = b->value, y = c->value;
+                                uint32_t v = op == ADD ? x + y :
+                                             op == MUL ? x * y :
+                                             op == DIV ? x / y : ~(x & y);
+                                result = (Reg){ CONST, v, -1 };
+                                if (v < LV_LIMIT) {
+                                        rewrite = (LV << 28) | (ra << 25) | v;
+                                }
+                        } else if (op == NAND && rb == rc &&
+                                   b->notof >= 0) {
+                                /* NOT of a NOT: a move from the original */
+                                unsigned y = b->notof;
+                                result = regs[y];
+                                if (result.notof == (int)ra) {
+                                        result.notof = -1;
+                                }
+                                if (y == ra) {
+                                        rewrite = NOP;
+                                }
+                                for (unsigned k = 0; k < 8 && y != ra &&
+                                     rewrite == w; k++) {
+                                        if (regs[k].kind == NONZERO ||
+                                            (regs[k].kind == CONST &&
+                                             regs[k].value != 0)) {
+                                                rewrite = (CMOV << 28) |
+                                                          (ra << 6) |
+                                                          (y << 3) | k;
+                                        }
+                                }
+                        } else if (op == NAND && rb == rc && rb != ra) {
+                                result.notof = rb;
+                        } else {
+                                escape(im, *b);
+                                escape(im, *c);
+                        }
+                        if (stats != NULL && rewrite != w &&
+                            !im->loaded[a]) {
+                                if (rewrite >> 28 == LV) {
+                                        stats->folded++;
+                                } else {
+                                        stats->not_fused++;
+                                }
+                        }
+                        define(regs, ra, result);
+                        break;
+                }
+                case HALT:
+                        break;
+                case ACTIVATE:
+                        define(regs, rb, (Reg){ NONZERO, 0, -1 });
+                        break;
+                case INACTIVATE:
+                case OUT:
+                        break;
+                case IN:
+                        define(regs, rc, (Reg){ UNKNOWN, 0, -1 });
+                        break;
+                case LOADP:
+                        escape(im, *c);
+                        if (b->kind == UNKNOWN ||
+                            (b->kind == CONST && b->value == 0)) {
+                                if (c->kind == CONST) {
+                                        ex.jump = c->value;
+                                } else {
+                                        ex.dynamic = true;
+                                }
+                        }
+                        break;
+                case LV:
+                        define(regs, (w >> 25) & 7,
+                               (Reg){ CONST, w & (LV_LIMIT - 1), -1 });
+                        break;
+                default:
+                        break;
+                }
+
+                if (stats != NULL && rewrite != w && !im->loaded[a]) {
+                        im->words[a] = rewrite;
+                }
+                if (op == HALT || op == LOADP || op > LV) {
+                        a++;
+                        break;
+                }
+        }
+
+        uint32_t last = im->words[a - 1] >> 28;
+        if (last != HALT && last != LOADP && last <= LV && a < im->length) {
+                ex.fall = a;
+        }
+        if (last != HALT) {
+                for (int r = 0; r < 8; r++) {
+                        escape(im, regs[r]);
+                }
+        }
+        if (stats != NULL) {
+                removeDeadDefs(im, start, a, stats);
+        }
+        return ex;
+}
+
+/********** removeDeadDefs ********
+ *
+ * Turn pure instructions whose result is never read into no-ops.
+ *
+ * Parameters:
+ *      Image im:       the image
+ *      uint32_t start: first word of the block
+ *      uint32_t end:   one past its last word
+ *      Stats *stats:   where the rewrites are counted
+ *
+ * Return: void
+ *
+ * Expects:
+ *      im and stats must not be NULL.
+ * Notes:
+ *      Liveness is tracked backwards within the block only. Every
+ *      register is live when the block falls through or loads a
+ *      program, and none is after Halt. Only Add, Multiply, NAND and
+ *      Load Value are removed: they cannot fail and have no effect
+ *      other than their result.
+ ************************/
+static void removeDeadDefs(Image im, uint32_t start, uint32_t end,
+                           Stats *stats)
+{
+        bool live[8];
+        uint32_t last = im->words[end - 1] >> 28;
+        for (int r = 0; r < 8; r++) {
+                live[r] = last != HALT;
+        }
+
+        for (uint32_t a = end; a-- > start; ) {
+                uint32_t w = im->words[a];
+                uint32_t op = w >> 28;
+                unsigned ra = (w >> 6) & 7, rb = (w >> 3) & 7, rc = w & 7;
+                if (op == LV) {
+                        ra = (w >> 25) & 7;
+                }
+                bool pure = op == ADD || op == MUL || op == NAND || op == LV;
+                if (pure && !live[ra] && !im->loaded[a]) {
+                        im->words[a] = NOP;
+                        stats->dead_defs++;
+                        continue;
+                }
+                switch (op) {
+                case CMOV:
+                        if (ra != rb) {
+                                live[ra] = live[rb] = live[rc] = true;
+                        }
+                        break;
+                case SLOAD:
+                case ADD:
+                case MUL:
+                case DIV:
+                case NAND:
+                        live[ra] = false;
+                        live[rb] = live[rc] = true;
+                        break;
+                case SSTORE:
+                        live[ra] = live[rb] = live[rc] = true;
+                        break;
+                case ACTIVATE:
+                        live[rb] = false;
+                        live[rc] = true;
+                        break;
+                case INACTIVATE:
+                case OUT:
+                        live[rc] = true;
+                        break;
+                case IN:
+                        live[rc] = false;
+                        break;
+                case LV:
+                        live[ra] = false;
+                        break;
+                case HALT:
+                        break;
+                default:
+                        for (int r = 0; r < 8; r++) {
+                                live[r] = true;
+                        }
+                        break;
+                }
+        }
+}
+
+/********** define ********
+ *
+ * Give a register a new value during simulation.
+ *
+ * Parameters:
+ *      Reg *regs:      the register file
+ *      unsigned r:     register written
+ *      Reg value:      what is known about its new value
+ *
+ * Return: void
+ *
+ * Expects:
+ *      regs must not be NULL; r < 8.
+ * Notes:
+ *      Facts "x is NOT r" about other registers die with the old
+ *      value.
+ ************************/
+static void define(Reg *regs, unsigned r, Reg value)
+{
+        for (int k = 0; k < 8; k++) {
+                if (regs[k].notof == (int)r) {
+                        regs[k].notof = -1;
+                }
+        }
+        regs[r] = value;
+}
+
+/********** escape ********
+ *
+ * Note a value that may end up as a Load Program target.
+ *
+ * Parameters:
+ *      Image im:       the image, whose jump targets may grow
+ *      Reg value:      the value
+ *
+ * Return: void
+ *
+ * Expects:
+ *      im must not be NULL.
+ * Notes:
+ *      Called for a constant that reaches Load Program, is stored to
+ *      memory, is still in a register when its block ends, is moved
+ *      by a conditional move that may or may not happen, or is
+ *      combined with a value that is not known. If it is an address
+ *      in segment 0, it becomes a block leader. Constants used only
+ *      within their block, such as conditions, sizes and characters
+ *      for Output, do not split blocks.
+ ************************/
+static void escape(Image im, Reg value)
+{
+        if (value.kind == CONST && value.value < im->length &&
+            !im->taken[value.value]) {
+                im->taken[value.value] = true;
+                im->changed = true;
+        }
+}
+
+/********** access0 ********
+ *
+ * Record a segmented load or store that may touch segment 0.
+ *
+ * Parameters:
+ *      Image im:       the image
+ *      Reg *regs:      the register file before the access
+ *      unsigned seg:   register holding the segment identifier
+ *      unsigned off:   register holding the offset
+ *      bool store:     true for Segmented Store
+ *      uint32_t addr:  address of the instruction
+ *
+ * Return: void
+ *
+ * Expects:
+ *      im and regs must not be NULL.
+ * Notes:
+ *      An access to a segment known to be nonzero is ignored. One to
+ *      segment 0 at a known offset protects that word, and a word
+ *      loaded this way may be a code address; otherwise any word may
+ *      be touched and optimization is refused.
+ ************************/
+static void access0(Image im, Reg *regs, unsigned seg, unsigned off,
+                    bool store, uint32_t addr)
+{
+        Reg s = regs[seg], o = regs[off];
+        if (s.kind == NONZERO || (s.kind == CONST && s.value != 0)) {
+                return;
+        }
+        if (o.kind != CONST) {
+                if (im->refuse == NULL) {
+                        im->refuse = store ?
+                                "segmented store may write segment 0" :
+                                "segmented load may read segment 0";
+                        im->refuse_at = addr;
+                }
+                return;
+        }
+        if (o.value >= im->length) {
+                return;
+        }
+        bool *mark = store ? im->stored : im->loaded;
+        if (!mark[o.value]) {
+                mark[o.value] = true;
+                im->changed = true;
+        }
+        if (!store) {
+                /* the word may be a jump table entry */
+                escape(im, (Reg){ CONST, im->words[o.value], -1 });
+        }
+}
+
+/********** writeProgram ********
+ *
+ * Write words to a .um file, most significant byte first.
+ *
+ * Parameters:
+ *      const char *filename:   output path
+ *      const uint32_t *words:  the program
+ *      uint32_t length:        number of words
+ *
+ * Return: void
+ *
+ * Expects:
+ *      filename and words must not be NULL.
+ * Notes:
+ *      CRE if the file cannot be written.
+ ************************/
+static void writeProgram(const char *filename, const uint32_t *words,
+                         uint32_t length)
+{
+        assert(filename != NULL && words != NULL);
+        FILE *fp = fopen(filename, "wb");
+        assert(fp != NULL);
+        for (uint32_t i = 0; i < length; i++) {
+                for (int shift = 24; shift >= 0; shift -= 8) {
+                        putc((words[i] >> shift) & 0xFF, fp);
+                }
+        }
+        int closed = fclose(fp);
+        assert(closed == 0);
+}
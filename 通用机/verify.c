@@ -0,0 +1,365 @@
+/**************************************************************
+ *
+ *     verify.c
+ *
+ *
+ *     implementation for verify.h
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "mem.h"
+#include "read.h"
+#include "umio.h"
+#include "refum.h"
+#include "fastum.h"
+
+/*
+ * Bytes passed from the reference engine to the fast one. The engines
+ * take turns one instruction at a time and an instruction moves at
+ * most one byte, so a single slot in each direction is enough.
+ */
+struct Shared {
+        UmIO_getfun *src_get;   /* input source of the reference engine */
+        void *src_cl;
+        int in_byte;            /* what the reference engine read */
+        bool in_ready;
+        int out_byte;           /* what the reference engine wrote */
+        bool out_ready;
+        const char *mismatch;   /* first I/O disagreement, or NULL */
+};
+
+static const char *opnames[] = {
+        "cmov", "sload", "sstore", "add", "mul", "div", "nand", "halt",
+        "map", "unmap", "out", "in", "loadp", "lv"
+};
+
+static int recordGet(void *cl);
+static void recordPut(int c, void *cl);
+static int replayGet(void *cl);
+static void checkPut(int c, void *cl);
+static bool sameState(Refum_T ref, Fastum_T fast);
+static void report(uint64_t step, uint64_t last_good, uint32_t pc,
+                   Um_instruction inst, Refum_T ref, Fastum_T fast,
+                   const char *why);
+static void reportSegments(Refum_T ref, Fastum_T fast);
+
+/********** Verify_run ********
+ *
+ * Run a program on both engines in lockstep and compare them.
+ *
+ * Parameters:
+ *      char *filename:     path of the .um file
+ *      uint32_t interval:  compare registers and the program counter
+ *                          every this many steps
+ *      UmIO_getfun *get:   input source, normally UmIO_stdinGet
+ *      void *cl:           closure for get
+ *
+ * Return:
+ *      int: EXIT_SUCCESS if the engines agreed until Halt,
+ *           EXIT_FAILURE at the first divergence
+ *
+ * Expects:
+ *      filename names a readable file; interval is at least 1.
+ * Notes:
+ *      The reference engine reads from get and writes stdout as usual.
+ *      The fast engine is fed the byte the reference engine just read
+ *      and every byte it writes is checked against the reference
+ *      output immediately, whatever the interval. On divergence the
+ *      step, both program counters, the last instruction, both
+ *      register sets and the segments whose contents differ are
+ *      written to stderr.
+ ************************/
+int Verify_run(char *filename, uint32_t interval, UmIO_getfun *get,
+               void *cl)
+{
+        assert(filename != NULL && interval >= 1 && get != NULL);
+        struct Shared io = { get, cl, 0, false, 0, false, NULL };
+        uint32_t length;
+        uint32_t *words = readProgram(filename, &length);
+        Fastum_T fast = Fastum_new(Umem_new(UMEM_FRAG_PERCENT), words, length,
+                                   replayGet, checkPut, &io);
+        FREE(words);
+        Refum_T ref = Refum_new(filename);
+        UmIO_use(recordGet, recordPut, &io);
+
+        uint64_t step = 0, last_good = 0;
+        int status = EXIT_SUCCESS;
+        while (ref->notHalt) {
+                uint32_t pc = ref->prg_counter;
+                Um_instruction inst = Refum_fetch(ref);
+                Refum_exec(ref, inst);
+                Fastum_run(fast, 1);
+                step++;
+
+                const char *why = io.mismatch;
+                if (why == NULL && io.out_ready) {
+                        why = "fast engine did not write the same output";
+                } else if (why == NULL && io.in_ready) {
+                        why = "fast engine did not read the same input";
+                } else if (why == NULL && Fastum_halted(fast) !=
+                                          !ref->notHalt) {
+                        why = "only one engine halted";
+                } else if (why == NULL && (step % interval == 0 ||
+                                           !ref->notHalt) &&
+                           !sameState(ref, fast)) {
+                        why = "registers or program counter differ";
+                }
+                if (why != NULL) {
+                        report(step, last_good, pc, inst, ref, fast, why);
+                        status = EXIT_FAILURE;
+                        break;
+                }
+                if (step % interval == 0) {
+                        last_good = step;
+                }
+        }
+
+        fflush(stdout);
+        UmIO_use(UmIO_stdinGet, UmIO_stdoutPut, NULL);
+        Refum_free(&ref);
+        Fastum_free(&fast);
+        return status;
+}
+
+/********** recordGet ********
+ *
+ * Input source of the reference engine: read the real source and keep
+ * the byte for the fast engine.
+ *
+ * Parameters:
+ *      void *cl: the struct Shared
+ *
+ * Return:
+ *      int: the byte, or EOF
+ *
+ * Expects:
+ *      cl must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+static int recordGet(void *cl)
+{
+        struct Shared *io = cl;
+        io->in_byte = io->src_get(io->src_cl);
+        io->in_ready = true;
+        return io->in_byte;
+}
+
+/********** recordPut ********
+ *
+ * Output sink of the reference engine: write stdout and keep the byte
+ * to check the fast engine against.
+ *
+ * Parameters:
+ *      int c:    the byte
+ *      void *cl: the struct Shared
+ *
+ * Return: void
+ *
+ * Expects:
+ *      cl must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+static void recordPut(int c, void *cl)
+{
+        struct Shared *io = cl;
+        putc(c, stdout);
+        io->out_byte = c;
+        io->out_ready = true;
+}
+
+/********** replayGet ********
+ *
+ * Input source of the fast engine: hand over the byte the reference
+ * engine read in the same step.
+ *
+ * Parameters:
+ *      void *cl: the struct Shared
+ *
+ * Return:
+ *      int: the byte, or EOF if the reference engine read nothing
+ *
+ * Expects:
+ *      cl must not be NULL.
+ * Notes:
+ *      Reading when the reference engine did not is a divergence.
+ ************************/
+static int replayGet(void *cl)
+{
+        struct Shared *io = cl;
+        if (!io->in_ready) {
+                if (io->mismatch == NULL) {
+                        io->mismatch = "fast engine read input the "
+                                       "reference engine did not";
+                }
+                return EOF;
+        }
+        io->in_ready = false;
+        return io->in_byte;
+}
+
+/********** checkPut ********
+ *
+ * Output sink of the fast engine: compare with the byte the reference
+ * engine wrote in the same step.
+ *
+ * Parameters:
+ *      int c:    the byte
+ *      void *cl: the struct Shared
+ *
+ * Return: void
+ *
+ * Expects:
+ *      cl must not be NULL.
+ * Notes:
+ *      Only the low 8 bits are compared, as only they reach stdout.
+ ************************/
+static void checkPut(int c, void *cl)
+{
+        struct Shared *io = cl;
+        if (io->mismatch != NULL) {
+                return;
+        }
+        if (!io->out_ready) {
+                io->mismatch = "fast engine wrote output the reference "
+                               "engine did not";
+        } else if ((c & 0xFF) != (io->out_byte & 0xFF)) {
+                io->mismatch = "output bytes differ";
+        }
+        io->out_ready = false;
+}
+
+/********** sameState ********
+ *
+ * Compare registers and program counters of the two engines.
+ *
+ * Parameters:
+ *      Refum_T ref:    the reference engine
+ *      Fastum_T fast:  the fast engine
+ *
+ * Return:
+ *      bool: true if they agree
+ *
+ * Expects:
+ *      ref and fast must not be NULL.
+ * Notes:
+ *      The program counter is not compared after Halt, where the
+ *      reference engine stops advancing it.
+ ************************/
+static bool sameState(Refum_T ref, Fastum_T fast)
+{
+        if (memcmp(ref->regs, Fastum_regs(fast), sizeof(ref->regs)) != 0) {
+                return false;
+        }
+        return !ref->notHalt || ref->prg_counter == Fastum_pc(fast);
+}
+
+/********** report ********
+ *
+ * Describe a divergence on stderr.
+ *
+ * Parameters:
+ *      uint64_t step:          number of instructions executed
+ *      uint64_t last_good:     last step at which the state agreed
+ *      uint32_t pc:            reference program counter before the step
+ *      Um_instruction inst:    instruction executed in the step
+ *      Refum_T ref:            the reference engine
+ *      Fastum_T fast:          the fast engine
+ *      const char *why:        what disagreed
+ *
+ * Return: void
+ *
+ * Expects:
+ *      ref, fast and why must not be NULL.
+ * Notes:
+ *      None
+ ************************/
+static void report(uint64_t step, uint64_t last_good, uint32_t pc,
+                   Um_instruction inst, Refum_T ref, Fastum_T fast,
+                   const char *why)
+{
+        const uint32_t *fregs = Fastum_regs(fast);
+        Um_opcode op = readOP(inst);
+
+        fprintf(stderr, "verify: divergence at step %llu: %s\n",
+                (unsigned long long)step, why);
+        fprintf(stderr, "  state last agreed after step %llu\n",
+                (unsigned long long)last_good);
+        if (op == LV) {
+                struct RegVal_T rv = read_RegVal(inst);
+                fprintf(stderr, "  instruction m[0][%u] = 0x%08x  %s "
+                        "r%u, %u\n", pc, inst, opnames[op], rv.ra,
+                        rv.value);
+        } else {
+                struct Register3_T r3 = read_3Register(inst);
+                fprintf(stderr, "  instruction m[0][%u] = 0x%08x  %s "
+                        "r%u, r%u, r%u\n", pc, inst, opnames[op],
+                        r3.ra, r3.rb, r3.rc);
+        }
+        fprintf(stderr, "  pc    ref %-10u fast %u\n",
+                ref->prg_counter, Fastum_pc(fast));
+        for (int i = 0; i < 8; i++) {
+                fprintf(stderr, "  r%d    ref 0x%08x fast 0x%08x%s\n", i,
+                        ref->regs[i], fregs[i],
+                        ref->regs[i] != fregs[i] ? "  <--" : "");
+        }
+        if (ref->notHalt) {
+                reportSegments(ref, fast);
+        }
+}
+
+/********** reportSegments ********
+ *
+ * List the segments whose mapping, length or contents differ.
+ *
+ * Parameters:
+ *      Refum_T ref:    the reference engine, not halted
+ *      Fastum_T fast:  the fast engine
+ *
+ * Return: void
+ *
+ * Expects:
+ *      ref and fast must not be NULL.
+ * Notes:
+ *      Both engines hand out identifiers below the reference engine's
+ *      id counter, so only those are examined. For each differing
+ *      segment the first differing word is shown.
+ ************************/
+static void reportSegments(Refum_T ref, Fastum_T fast)
+{
+        for (uint64_t id = 0; id < ref->id_counter; id++) {
+                Seq_T rseg = Refum_segment(ref, id);
+                uint32_t flen = 0;
+                const uint32_t *fseg = Fastum_segment(fast, id, &flen);
+                if (rseg == NULL && fseg == NULL) {
+                        continue;
+                }
+                if (rseg == NULL || fseg == NULL) {
+                        fprintf(stderr, "  m[%llu] mapped only in %s\n",
+                                (unsigned long long)id,
+                                rseg == NULL ? "fast" : "ref");
+                        continue;
+                }
+                uint32_t rlen = Seq_length(rseg);
+                if (rlen != flen) {
+                        fprintf(stderr, "  m[%llu] length ref %u fast %u\n",
+                                (unsigned long long)id, rlen, flen);
+                        continue;
+                }
+                for (uint32_t i = 0; i < rlen; i++) {
+                        uint32_t w = (uint32_t)(uintptr_t)Seq_get(rseg, i);
+                        if (w != fseg[i]) {
+                                fprintf(stderr, "  m[%llu][%u] ref 0x%08x "
+                                        "fast 0x%08x\n",
+                                        (unsigned long long)id, i, w,
+                                        fseg[i]);
+                                break;
+                        }
+                }
+        }
+}
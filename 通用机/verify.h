@@ -0,0 +1,23 @@
+/**************************************************************
+ *
+ *     verify.h
+ *
+ *
+ *     verify.h declares lockstep verification of the fast engine
+ *     against the reference engine. Both run the same program one
+ *     instruction at a time on the same input; the first point at
+ *     which their output, registers or program counter disagree is
+ *     reported together with the state of both machines.
+ *
+ **************************************************************/
+
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdint.h>
+#include "umio.h"
+
+int Verify_run(char *filename, uint32_t interval, UmIO_getfun *get,
+               void *cl);
+
+#endif